@@ -0,0 +1,119 @@
+/**
+ * @file card_health.h
+ * @brief カードごとの健全性記録 (/card_health.bin)
+ * @details
+ * ロガーは正常終了のたびに、そのフライトの書き込み量・書き込み遅延のパーセンタイル・
+ * エラー/リトライ回数を1件追記し、先頭の累計を更新する。カード自身に記録するので、
+ * どの機体で使っても履歴がカードについて回る。testSDcard.cpp の 'H' コマンドで
+ * 履歴と遅延の傾向を表示し、データを取りこぼす前にカードを退役させる判断に使う。
+ *
+ * @section health_format ファイル形式 (リトルエンディアン)
+ * - CardHealthHeader (32 バイト)
+ * - CardHealthFlight × flightCount (各 32 バイト、古い順)
+ */
+#pragma once
+#include <stdint.h>
+
+#define CARD_HEALTH_FILE    "/card_health.bin"
+#define CARD_HEALTH_MAGIC   0x544C4843UL // "CHLT"
+#define CARD_HEALTH_VERSION 1
+
+struct CardHealthHeader {
+  uint32_t magic;             ///< CARD_HEALTH_MAGIC
+  uint16_t version;           ///< CARD_HEALTH_VERSION
+  uint16_t recordSize;        ///< sizeof(CardHealthFlight)
+  uint32_t flightCount;       ///< 記録済みのフライト数
+  uint32_t totalErrors;       ///< 累計エラー回数
+  uint64_t totalBytesWritten; ///< 累計書き込みバイト数
+  uint32_t totalRetries;      ///< 累計リトライ回数
+  uint32_t reserved;
+};
+static_assert(sizeof(CardHealthHeader) == 32, "CardHealthHeader must stay 32 bytes");
+
+struct CardHealthFlight {
+  uint16_t flightNumber; ///< flight_log_XXX の番号
+  uint16_t flags;        ///< 予約
+  uint32_t bytesWritten; ///< このフライトでログに書いたバイト数
+  uint32_t durationS;    ///< 記録時間 (秒)
+  uint32_t p50Us;        ///< 書き込み遅延の p50
+  uint32_t p99Us;        ///< p99
+  uint32_t p999Us;       ///< p99.9
+  uint32_t maxUs;        ///< 最大
+  uint16_t errors;       ///< 書き込み失敗・再オープン失敗の回数
+  uint16_t retries;      ///< リトライで回復した回数
+};
+static_assert(sizeof(CardHealthFlight) == 32, "CardHealthFlight must stay 32 bytes");
+
+#ifdef ARDUINO
+#include "storage_backend.h"
+
+/** @brief ヘッダーがこの版の形式か */
+inline bool cardHealthHeaderValid(const CardHealthHeader& h) {
+  return h.magic == CARD_HEALTH_MAGIC && h.version == CARD_HEALTH_VERSION && h.recordSize == sizeof(CardHealthFlight);
+}
+
+/**
+ * @brief ヘッダーを読む。ファイルが無いか壊れていれば空のヘッダーを返す
+ */
+inline CardHealthHeader cardHealthReadHeader(StorageFile& f) {
+  CardHealthHeader h = {};
+  if (f && f.size() >= sizeof(h)) {
+    f.seek(0);
+    f.read(reinterpret_cast<uint8_t*>(&h), sizeof(h));
+  }
+  if (!cardHealthHeaderValid(h)) {
+    h = {CARD_HEALTH_MAGIC, CARD_HEALTH_VERSION, sizeof(CardHealthFlight), 0, 0, 0, 0, 0};
+  }
+  return h;
+}
+
+/**
+ * @brief 1フライト分の記録を追記し、累計を更新する
+ * @details 追記してからヘッダーを書き換えるので、途中で電源が落ちても既存の記録は壊れない。
+ *          ファイルを開けないときやヘッダーが読めないときは、履歴を消さないよう何も書かずに false を返す。
+ *          作り直すのはファイルが無いときだけである。
+ */
+inline bool cardHealthAppend(const CardHealthFlight& flight) {
+  // 先頭のヘッダーを書き換えるので、追記モードではなく STORAGE_UPDATE ("r+") で開く
+  StorageFile f = storageOpen(CARD_HEALTH_FILE, STORAGE_UPDATE);
+  if (!f) {
+    if (storageExists(CARD_HEALTH_FILE)) {
+      return false; // STORAGE_CREATE は中身を空にするので、あるファイルには使わない
+    }
+    f = storageOpen(CARD_HEALTH_FILE, STORAGE_CREATE);
+  }
+  if (!f) {
+    return false;
+  }
+  CardHealthHeader h = {CARD_HEALTH_MAGIC, CARD_HEALTH_VERSION, sizeof(CardHealthFlight), 0, 0, 0, 0, 0};
+  if (f.size() >= sizeof(h)) {
+    CardHealthHeader onCard = {};
+    f.seek(0);
+    if (f.read(reinterpret_cast<uint8_t*>(&onCard), sizeof(onCard)) != sizeof(onCard) || !cardHealthHeaderValid(onCard)) {
+      f.close();
+      return false; // 読めないヘッダーの上に書くと、後ろの記録ごと切り詰めてしまう
+    }
+    h = onCard;
+  }
+  uint32_t offset = sizeof(CardHealthHeader) + h.flightCount * sizeof(CardHealthFlight);
+  // 前回の追記がヘッダー更新前に途切れていたら、その分は上書きする
+  f.truncate(offset < f.size() ? offset : f.size());
+  if (f.size() < sizeof(CardHealthHeader)) {
+    f.seek(0);
+    f.write(reinterpret_cast<const uint8_t*>(&h), sizeof(h));
+  }
+  f.seek(offset);
+  bool ok = f.write(reinterpret_cast<const uint8_t*>(&flight), sizeof(flight)) == sizeof(flight);
+  if (ok) {
+    h.flightCount++;
+    h.totalBytesWritten += flight.bytesWritten;
+    h.totalErrors += flight.errors;
+    h.totalRetries += flight.retries;
+    f.seek(0);
+    ok = f.write(reinterpret_cast<const uint8_t*>(&h), sizeof(h)) == sizeof(h);
+  }
+  f.close();
+  return ok;
+}
+
+#endif // ARDUINO
@@ -0,0 +1,434 @@
+/**
+ * @file card_verify.h
+ * @brief 全容量書き込み・読み戻しによるmicroSDカードの実容量検証 (偽装カード検出)
+ * @details
+ * 空き領域をすべて検証用ファイル (/verify/NNNN.h2w) で埋め、位置依存のパターンを書き込んでから
+ * 読み戻して照合する。容量を偽装したカードはアドレスが折り返して別の位置のデータが
+ * 読めるため、セクタ先頭に埋め込んだ通し番号のずれとして検出できる。
+ *
+ * - 書き込み・読み出しは 32 KB 単位で行い、ライブラリのマルチブロック転送を使う
+ * - パターンは xorshift32 で生成するため、SPI の転送速度より十分速い
+ * - 進捗は /verify/state.txt に保存し、中断 (任意のキー入力や電源断) 後に再開できる
+ *
+ * @note 32 GB のカードでは書き込みと読み出しに数時間かかる。途中で止めても再開できる。
+ */
+#pragma once
+#include "storage_backend.h"
+
+#define VERIFY_DIR          "/verify"
+#define VERIFY_STATE_FILE   "/verify/state.txt"
+#define VERIFY_FILE_BYTES   (1024UL * 1024UL * 1024UL) // 1ファイル 1 GiB (FAT32の上限より十分小さい)
+#define VERIFY_CHUNK_BYTES  (32 * 1024)                // 1回の転送単位
+#define VERIFY_SECTOR_BYTES 512
+#define VERIFY_MAX_FILES    2048                       // 2 TiB まで
+#define VERIFY_MAX_REGIONS  16                         // 記録する不良領域の数
+
+/** @brief 連続した不良セクタの範囲 */
+struct VerifyRegion {
+  uint64_t startOffset; ///< 検証領域の先頭からのバイト位置
+  uint64_t length;
+  bool aliased;         ///< 別の位置のパターンが読めた (アドレスの折り返し)
+};
+
+/** @brief 読み戻しの集計 */
+struct VerifyResult {
+  uint64_t okBytes;
+  uint64_t badBytes;
+  uint64_t aliasedBytes;
+  uint64_t firstBadOffset; ///< 最初の不良位置。不良が無ければ UINT64_MAX
+  uint32_t missingFiles;   ///< 開けなかった検証ファイルの数 (中身はすべて不良として数える)
+  uint64_t aliasDistance;  ///< 折り返したセクタと、その中身が本来あるべき位置との最小の距離 (バイト)。無ければ 0
+  VerifyRegion regions[VERIFY_MAX_REGIONS]; ///< 再開後は、再開してから見つけた領域だけが入る
+  uint8_t regionCount;
+};
+
+/** @brief 検証の進捗。照合済みファイルの集計と一緒に state.txt に保存される */
+struct VerifyState {
+  uint32_t seed;          ///< パターンの種。再開時も同じ値を使う
+  uint8_t phase;          ///< 0: 書き込み中, 1: 読み戻し中, 2: 完了
+  uint32_t filesWritten;  ///< 書き込みを終えたファイル数
+  uint32_t filesVerified; ///< 照合を終えたファイル数
+  uint64_t lastFileBytes; ///< 最後に書いたファイルの大きさ (それより前のファイルは VERIFY_FILE_BYTES)
+  VerifyResult result;    ///< 照合を終えたファイルまでの集計
+};
+
+/**
+ * @brief 検証領域の先頭から offset バイト目のセクタのパターンを生成する
+ * @details
+ * 先頭8バイトにセクタ番号と種を、残りに xorshift32 の系列を入れる。
+ * セクタ番号を種に混ぜるので、どのセクタの内容も他と一致しない。
+ */
+inline void verifyFillSector(uint8_t* sector, uint32_t seed, uint64_t sectorIndex) {
+  uint32_t* words = reinterpret_cast<uint32_t*>(sector);
+  words[0] = static_cast<uint32_t>(sectorIndex);
+  words[1] = static_cast<uint32_t>(sectorIndex >> 32) ^ seed;
+  uint32_t x = seed ^ static_cast<uint32_t>(sectorIndex * 2654435761u) ^ 0x9E3779B9u;
+  if (x == 0) {
+    x = 1;
+  }
+  for (size_t i = 2; i < VERIFY_SECTOR_BYTES / 4; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    words[i] = x;
+  }
+}
+
+/** @brief 書き込みフェーズで書いたセクタの数 */
+inline uint64_t verifyWrittenSectors(const VerifyState& st) {
+  if (st.filesWritten == 0) {
+    return 0;
+  }
+  return (static_cast<uint64_t>(st.filesWritten - 1) * VERIFY_FILE_BYTES + st.lastFileBytes) / VERIFY_SECTOR_BYTES;
+}
+
+inline void verifyFileName(char* name, uint32_t index) {
+  sprintf(name, VERIFY_DIR "/%04lu.h2w", static_cast<unsigned long>(index));
+}
+
+inline bool verifySaveState(const VerifyState& st) {
+  storageRemove(VERIFY_STATE_FILE);
+  StorageFile f = storageOpen(VERIFY_STATE_FILE, STORAGE_APPEND);
+  if (!f) {
+    return false;
+  }
+  f.print(st.seed);
+  f.print(' ');
+  f.print(st.phase);
+  f.print(' ');
+  f.print(st.filesWritten);
+  f.print(' ');
+  f.print(st.filesVerified);
+  char totals[160];
+  sprintf(totals, " %llu %llu %llu %llu %llu %lu %llu", static_cast<unsigned long long>(st.result.okBytes),
+          static_cast<unsigned long long>(st.result.badBytes), static_cast<unsigned long long>(st.result.aliasedBytes),
+          static_cast<unsigned long long>(st.result.firstBadOffset), static_cast<unsigned long long>(st.lastFileBytes),
+          static_cast<unsigned long>(st.result.missingFiles), static_cast<unsigned long long>(st.result.aliasDistance));
+  f.println(totals);
+  f.close();
+  return true;
+}
+
+inline bool verifyLoadState(VerifyState& st) {
+  StorageFile f = storageOpen(VERIFY_STATE_FILE, STORAGE_READ);
+  if (!f) {
+    return false;
+  }
+  char line[200];
+  size_t n = f.readBytesUntil('\n', line, sizeof(line) - 1);
+  line[n] = '\0';
+  f.close();
+  unsigned long seed, phase, written, verified, missing = 0;
+  unsigned long long ok, bad, aliased, firstBad, lastBytes = VERIFY_FILE_BYTES, aliasDistance = 0;
+  // 後ろの項目が無い古い state.txt は、最後のファイルも満杯で、折り返しも無かったものとして読む
+  if (sscanf(line, "%lu %lu %lu %lu %llu %llu %llu %llu %llu %lu %llu", &seed, &phase, &written, &verified, &ok, &bad,
+             &aliased, &firstBad, &lastBytes, &missing, &aliasDistance) < 8) {
+    return false;
+  }
+  st.seed = seed;
+  st.phase = static_cast<uint8_t>(phase);
+  st.filesWritten = written;
+  st.filesVerified = verified;
+  st.lastFileBytes = lastBytes;
+  st.result = {};
+  st.result.okBytes = ok;
+  st.result.badBytes = bad;
+  st.result.aliasedBytes = aliased;
+  st.result.firstBadOffset = firstBad;
+  st.result.missingFiles = missing;
+  st.result.aliasDistance = aliasDistance;
+  return true;
+}
+
+/** @brief 中断要求 (シリアルへの任意のキー入力) を確認する */
+inline bool verifyAbortRequested() {
+  if (Serial.available()) {
+    while (Serial.available()) {
+      Serial.read();
+    }
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @brief 書き込みフェーズ。空き領域が尽きるまで検証ファイルを書く
+ * @return 中断された場合は false
+ */
+inline bool verifyWritePhase(VerifyState& st, uint8_t* buffer) {
+  unsigned long startMs = millis();
+  uint64_t bytesThisRun = 0;
+  bool cardFull = false;
+
+  while (!cardFull && st.filesWritten < VERIFY_MAX_FILES) {
+    char name[32];
+    verifyFileName(name, st.filesWritten);
+    StorageFile f = storageOpen(name, STORAGE_APPEND);
+    if (!f) {
+      cardFull = true; // ディレクトリエントリすら作れない = 空きが無い
+      break;
+    }
+    // 再開時は、書きかけのファイルをチャンク境界まで切り詰めてから続ける
+    uint64_t pos = f.size() - f.size() % VERIFY_CHUNK_BYTES;
+    f.truncate(pos);
+    f.seek(pos);
+
+    while (pos < VERIFY_FILE_BYTES) {
+      uint64_t base = (static_cast<uint64_t>(st.filesWritten) * VERIFY_FILE_BYTES + pos) / VERIFY_SECTOR_BYTES;
+      for (size_t s = 0; s < VERIFY_CHUNK_BYTES / VERIFY_SECTOR_BYTES; s++) {
+        verifyFillSector(buffer + s * VERIFY_SECTOR_BYTES, st.seed, base + s);
+      }
+      size_t written = f.write(buffer, VERIFY_CHUNK_BYTES);
+      if (written != VERIFY_CHUNK_BYTES) {
+        // 書き切れなかった分は照合の対象外にする
+        f.truncate(pos);
+        cardFull = true;
+        break;
+      }
+      pos += VERIFY_CHUNK_BYTES;
+      bytesThisRun += VERIFY_CHUNK_BYTES;
+
+      if (pos % (16UL * 1024UL * 1024UL) == 0) {
+        unsigned long elapsed = millis() - startMs;
+        Serial.printf("  書き込み %s: %lu MB (%.2f MB/s)\n", name, static_cast<unsigned long>(pos >> 20),
+                      elapsed ? bytesThisRun / 1048.576 / elapsed : 0.0);
+      }
+      if (verifyAbortRequested()) {
+        f.close();
+        verifySaveState(st);
+        Serial.println("中断しました。'R' で再開できます");
+        return false;
+      }
+    }
+    f.close();
+    if (pos == 0) {
+      storageRemove(name); // 1チャンクも書けなかった空ファイルは残さない
+    } else {
+      st.filesWritten++;
+      st.lastFileBytes = pos;
+    }
+    verifySaveState(st);
+  }
+
+  unsigned long elapsed = millis() - startMs;
+  Serial.printf("書き込み完了: %lu ファイル, 今回 %lu MB, 平均 %.2f MB/s\n", static_cast<unsigned long>(st.filesWritten),
+                static_cast<unsigned long>(bytesThisRun >> 20), elapsed ? bytesThisRun / 1048.576 / elapsed : 0.0);
+  st.phase = 1;
+  verifySaveState(st);
+  return true;
+}
+
+/** @brief offset から length バイトの不良を集計し、隣接するものは1つの領域にまとめる */
+inline void verifyRecordBadRange(VerifyResult& r, uint64_t offset, uint64_t length, bool aliased) {
+  if (length == 0) {
+    return;
+  }
+  r.badBytes += length;
+  if (aliased) {
+    r.aliasedBytes += length;
+  }
+  if (offset < r.firstBadOffset) {
+    r.firstBadOffset = offset;
+  }
+  if (r.regionCount > 0) {
+    VerifyRegion& last = r.regions[r.regionCount - 1];
+    if (last.startOffset + last.length == offset && last.aliased == aliased) {
+      last.length += length;
+      return;
+    }
+  }
+  if (r.regionCount < VERIFY_MAX_REGIONS) {
+    r.regions[r.regionCount++] = {offset, length, aliased};
+  }
+}
+
+/** @brief 不良セクタを1つ集計する */
+inline void verifyRecordBad(VerifyResult& r, uint64_t offset, bool aliased) {
+  verifyRecordBadRange(r, offset, VERIFY_SECTOR_BYTES, aliased);
+}
+
+/**
+ * @brief 読み戻しフェーズ。全検証ファイルを読んでパターンと照合する
+ * @return 中断された場合は false
+ */
+inline bool verifyReadPhase(VerifyState& st, uint8_t* buffer) {
+  VerifyResult& result = st.result;
+  uint8_t expected[VERIFY_SECTOR_BYTES];
+  unsigned long startMs = millis();
+  uint64_t bytesThisRun = 0;
+  const uint64_t writtenSectors = verifyWrittenSectors(st);
+
+  // 保存する照合済みの数は、集計に含めたファイルまで。再開時に同じファイルを二重に数えない
+  while (st.filesVerified < st.filesWritten) {
+    char name[32];
+    verifyFileName(name, st.filesVerified);
+    StorageFile f = storageOpen(name, STORAGE_READ);
+    uint64_t fileBase = static_cast<uint64_t>(st.filesVerified) * VERIFY_FILE_BYTES;
+    // 書いたはずの大きさ。最後のファイル以外は満杯まで書いている
+    uint64_t expectedBytes = st.filesVerified + 1 == st.filesWritten ? st.lastFileBytes : VERIFY_FILE_BYTES;
+    if (!f) {
+      // ファイルごと読めないので、書いた分をすべて不良として数える
+      Serial.printf("エラー: 検証ファイルがありません: %s (%llu MB を不良として数える)\n", name,
+                    static_cast<unsigned long long>(expectedBytes >> 20));
+      verifyRecordBadRange(result, fileBase, expectedBytes, false);
+      result.missingFiles++;
+      st.filesVerified++;
+      verifySaveState(st);
+      continue;
+    }
+    uint64_t size = f.size();
+    if (size > expectedBytes) {
+      size = expectedBytes;
+    }
+    // 集計はファイル単位で保存するので、途中で中断したファイルは先頭から照合し直す
+    VerifyResult fileStart = result;
+    for (uint64_t pos = 0; pos < size; pos += VERIFY_CHUNK_BYTES) {
+      size_t want = size - pos < VERIFY_CHUNK_BYTES ? size - pos : VERIFY_CHUNK_BYTES;
+      size_t got = f.read(buffer, want);
+      for (size_t off = 0; off < want; off += VERIFY_SECTOR_BYTES) {
+        uint64_t absolute = fileBase + pos + off;
+        uint64_t sectorIndex = absolute / VERIFY_SECTOR_BYTES;
+        if (off >= got) {
+          verifyRecordBad(result, absolute, false);
+          continue;
+        }
+        verifyFillSector(expected, st.seed, sectorIndex);
+        if (memcmp(expected, buffer + off, VERIFY_SECTOR_BYTES) == 0) {
+          result.okBytes += VERIFY_SECTOR_BYTES;
+        } else {
+          // 書いた範囲の別のセクタの内容がそっくり読めたなら、アドレスが折り返している。
+          // 通し番号だけ見ると、化けたデータをたまたま番号と読んでしまうので全体を照合する
+          const uint32_t* words = reinterpret_cast<const uint32_t*>(buffer + off);
+          uint64_t foundIndex = words[0] | (static_cast<uint64_t>(words[1] ^ st.seed) << 32);
+          bool aliased = false;
+          if (foundIndex != sectorIndex && foundIndex < writtenSectors) {
+            verifyFillSector(expected, st.seed, foundIndex);
+            aliased = memcmp(expected, buffer + off, VERIFY_SECTOR_BYTES) == 0;
+          }
+          if (aliased) {
+            uint64_t distance = foundIndex > sectorIndex ? foundIndex - sectorIndex : sectorIndex - foundIndex;
+            distance *= VERIFY_SECTOR_BYTES;
+            if (result.aliasDistance == 0 || distance < result.aliasDistance) {
+              result.aliasDistance = distance;
+            }
+          }
+          verifyRecordBad(result, absolute, aliased);
+        }
+      }
+      bytesThisRun += want;
+      if ((pos + want) % (16UL * 1024UL * 1024UL) == 0) {
+        unsigned long elapsed = millis() - startMs;
+        Serial.printf("  読み戻し %s: %lu MB (%.2f MB/s)\n", name, static_cast<unsigned long>((pos + want) >> 20),
+                      elapsed ? bytesThisRun / 1048.576 / elapsed : 0.0);
+      }
+      if (verifyAbortRequested()) {
+        f.close();
+        result = fileStart;
+        verifySaveState(st);
+        Serial.println("中断しました。'R' で再開できます");
+        return false;
+      }
+    }
+    f.close();
+    if (size < expectedBytes) {
+      // 書いた分より短くなっていれば、足りない分も不良として数える
+      Serial.printf("エラー: 検証ファイルが短くなっています: %s (%llu / %llu MB)\n", name,
+                    static_cast<unsigned long long>(size >> 20), static_cast<unsigned long long>(expectedBytes >> 20));
+      verifyRecordBadRange(result, fileBase + size, expectedBytes - size, false);
+    }
+    st.filesVerified++;
+    verifySaveState(st);
+  }
+
+  unsigned long elapsed = millis() - startMs;
+  Serial.printf("読み戻し完了: 今回 %lu MB, 平均 %.2f MB/s\n", static_cast<unsigned long>(bytesThisRun >> 20),
+                elapsed ? bytesThisRun / 1048.576 / elapsed : 0.0);
+  st.phase = 2;
+  verifySaveState(st);
+  return true;
+}
+
+/** @brief 検証結果を表示する */
+inline void verifyPrintReport(const VerifyResult& r, uint64_t usedBeforeBytes) {
+  uint64_t claimed = storageCardBytes();
+  Serial.println("===== 容量検証の結果 =====");
+  Serial.printf("公称容量        : %llu MB\n", static_cast<unsigned long long>(claimed >> 20));
+  Serial.printf("検証前の使用量  : %llu MB\n", static_cast<unsigned long long>(usedBeforeBytes >> 20));
+  Serial.printf("正常に読めた領域: %llu MB\n", static_cast<unsigned long long>(r.okBytes >> 20));
+  Serial.printf("不良領域        : %llu MB (うち折り返し %llu MB)\n", static_cast<unsigned long long>(r.badBytes >> 20),
+                static_cast<unsigned long long>(r.aliasedBytes >> 20));
+  if (r.missingFiles > 0) {
+    Serial.printf("開けなかったファイル: %lu 個 (中身はすべて不良領域に含む)\n", static_cast<unsigned long>(r.missingFiles));
+  }
+  if (r.badBytes == 0) {
+    Serial.println("判定: 正常 (書き込んだ全領域を読み戻せました)");
+    return;
+  }
+  // 折り返しがあれば、同じ場所に重なった2つの位置の距離が実際の容量になる。
+  // 折り返していなければ、読み戻せた領域と検証前から使っていた領域の合計で見積もる
+  if (r.aliasDistance > 0) {
+    Serial.printf("実容量の推定    : %llu MB (折り返しの間隔から)\n", static_cast<unsigned long long>(r.aliasDistance >> 20));
+  } else {
+    Serial.printf("実容量の推定    : %llu MB (読み戻せた領域から)\n",
+                  static_cast<unsigned long long>((usedBeforeBytes + r.okBytes) >> 20));
+  }
+  Serial.println(r.aliasedBytes > 0 ? "判定: 容量偽装の疑い (アドレスの折り返しを検出)" : "判定: 不良セクタあり");
+  for (uint8_t i = 0; i < r.regionCount; i++) {
+    Serial.printf("  不良 %2u: %llu MB から %llu KB%s\n", i, static_cast<unsigned long long>(r.regions[i].startOffset >> 20),
+                  static_cast<unsigned long long>(r.regions[i].length >> 10), r.regions[i].aliased ? " (折り返し)" : "");
+  }
+}
+
+/**
+ * @brief 容量検証を実行する
+ * @param resume true なら state.txt から再開し、false なら既存の検証ファイルを消して最初から始める
+ */
+inline void runCapacityVerification(bool resume, uint64_t usedBeforeBytes) {
+  VerifyState st;
+  if (!resume || !verifyLoadState(st)) {
+    if (resume) {
+      Serial.println("再開できる検証がありません。最初から始めます");
+    }
+    // 以前の検証ファイルを消してから始める
+    for (uint32_t i = 0; i < VERIFY_MAX_FILES; i++) {
+      char name[32];
+      verifyFileName(name, i);
+      if (!storageRemove(name)) {
+        break;
+      }
+    }
+    storageMkdir(VERIFY_DIR);
+    st = {};
+    st.seed = static_cast<uint32_t>(micros() ^ 0xA5A5F00Du);
+    st.result.firstBadOffset = UINT64_MAX;
+    verifySaveState(st);
+  }
+
+  // 32 KB の転送バッファ。スタックには置けないので静的に確保する
+  static uint8_t buffer[VERIFY_CHUNK_BYTES] __attribute__((aligned(4)));
+
+  Serial.println("容量検証を開始します。任意のキーで中断できます");
+  if (st.phase == 0 && !verifyWritePhase(st, buffer)) {
+    return;
+  }
+  if (st.phase == 1 && !verifyReadPhase(st, buffer)) {
+    return;
+  }
+  verifyPrintReport(st.result, usedBeforeBytes);
+}
+
+/** @brief 検証ファイルをすべて削除する */
+inline void removeVerificationFiles() {
+  uint32_t removed = 0;
+  for (uint32_t i = 0; i < VERIFY_MAX_FILES; i++) {
+    char name[32];
+    verifyFileName(name, i);
+    if (!storageRemove(name)) {
+      break;
+    }
+    removed++;
+  }
+  storageRemove(VERIFY_STATE_FILE);
+  storageRmdir(VERIFY_DIR);
+  Serial.printf("検証ファイルを %lu 個削除しました\n", static_cast<unsigned long>(removed));
+}
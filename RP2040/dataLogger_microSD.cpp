@@ -17,16 +17,54 @@
  * - SCK: GPIO 18
  * - RX (MISO): GPIO 16
  * - TX (MOSI): GPIO 19
- * - 電源監視ピン: GPIO 2 (任意。INPUT_PULLUPを想定)
+ * - 電源監視ピン: GPIO 2 (任意。INPUT_PULLUPを想定。設定ファイルで変更可能)
+ * - サテライト基板とのUARTリンク: UART0 = GPIO 0 (TX) / 1 (RX)、UART1 = GPIO 4 (TX) / 5 (RX) (任意)
+ * - 2枚目のSDカード (ストライピング時): SPI1 SCK = GPIO 10、TX = GPIO 11、RX = GPIO 12、CS = GPIO 13 (任意)
+ * - SDカードとバスを共有するSPIセンサー: SCK/TX/RX はSDカードと同じ、CS は設定ファイルの sensor_cs (任意)
  *
  * @section functionality 機能概要
  * - 電源ONごとのログファイル自動生成 (例: /flight_log_001.csv)
- * - 20 Hzでのデータサンプリングと記録 (周期は可変)
+ * - 20 Hzでのデータサンプリングと記録 (周期は設定ファイル /logger.cfg で可変)
+ * - RAM上の書き込みバッファによるSDアクセスの集約
  * - 電源OFF時の割り込みによる安全なファイルクローズ処理
- * - 定期的なファイルフラッシュによるデータ保護
+ * - 定期的なファイルフラッシュによるデータ保護 (ハンドルを保持し、ディレクトリ検索なしで確定)
+ * - コンパイル時設定プロファイルによるホットパスの特殊化 (LOGGER_PROFILE)
+ * - 正常終了時のカード健全性記録 (/card_health.bin: 書き込み量・遅延・エラー回数)
+ * - PIOによるデジタル入力のキャプチャ (エッジ時刻または周波数を /flight_log_XXX.evt へ、マイクロ秒精度)
+ * - サテライト基板からのレコードをUART+DMAで受信し、時計のずれを補正して時刻順にログへ統合
+ * - 2枚のカードへのストライピング (stripe=on。偶数ブロックはコア0がカードAへ、奇数ブロックはコア1がカードBへ)
+ * - ホットパス (電源ISR・サンプリング・整形・バッファ・SD書き込みの呼び出し) をSRAMから実行 (LOGGER_HOTPATH_IN_RAM)
+ * - フライト目録 (/flights.cat) の更新 (開始時に「記録中」、正常終了時に統計を埋めて「正常」。途切れたものは次の起動で「電源断」に)
+ * - 共有SPIバスの調停 (カードへの書き込みをセクタ境界で切り分け、切れ目で期限の来たセンサーを先に読む。シリアル 'a' で遅れを測定)
+ * - format=rice でのチャンネルごとの可逆圧縮 (固定次数の整数予測+Rice符号、/flight_log_XXX.bin。tools/rice2csv で CSV に戻せますの)
+ * - 書き込み増幅の集計 (データ・FAT・ディレクトリエントリ・索引のセクタ数。シリアル 'w' とログ末尾のトレーラー行へ)
+ * - ファイルシステムのバックエンドをビルド時に選択 (LOGGER_FS_BACKEND: SD.h・SdFat・FatFs。後の2つは prealloc_mb で連続領域を事前割り当て)
+ * - カードの無い機体向けに、基板のQSPIフラッシュへ littlefs で記録 (LOGGER_FS_FLASH。消去中もSRAMのアラームでサンプリングを続けますの)
+ * - USBシリアルでのフライトのダウンロード (シリアル 'f' で一覧、'g 名前' で取り出し。tools/flash_pull で受け取れますわ)
+ * - サンプルの合間はアラームまで WFI でコアを止める省電力の待機 (idle=sleep。1秒ごとの稼働・休止時間と1サンプルあたりのエネルギーをシリアル 'e' とログ末尾へ)
+ * - ログの時刻の索引 (/flight_log_XXX.idx、1秒ごと) と、それを使ったシリアル 'q 開始ms 終了ms' での時刻の範囲の取り出し (カードを抜かず、ファイルも走査しませんの)
+ * - 両コアのイベントトレース (シリアルコマンド 't' でUSBへ、'T' でSDカードへダンプ)
  */
 #include <SPI.h>
-#include <SD.h>
+#include <hardware/structs/xip_ctrl.h>
+#include "ram_func.h"
+#include "event_trace.h"
+#include "logger_config.h"
+#include "logger_profile.h"
+#include "latency_histogram.h"
+#include "storage_backend.h"
+#include "card_health.h"
+#include "log_storage.h"
+#include "pio_capture.h"
+#include "uart_link.h"
+#include "timeline_merge.h"
+#include "log_stripe.h"
+#include "flight_catalog.h"
+#include "rice_log.h"
+#include "spi_arbiter.h"
+#include "file_download.h"
+#include "low_power.h"
+#include "log_index.h"
 
 //================================================
 //== 設定項目
@@ -37,38 +75,197 @@
 #define PIN_SPI_RX   16
 #define PIN_SPI_TX   19
 
-// 電源監視ピン設定 (例: GPIO 2)
-// このピンの電圧が下がった(FALLING)ことを検知してシャットダウン処理を開始しますわ
-#define PIN_POWER_SENSE 2
+// 実行時設定ファイル
+// サンプリング周波数・フラッシュ周期・バッファサイズ・電源監視ピンはここから読み込みますわ。
+// ファイルが無い項目は logger_config.h の既定値 (20 Hz、1000 ms、GPIO 2 など) になりますの
+#define CONFIG_FILE_NAME "/logger.cfg"
 
-// データロギング設定
-// サンプリング周波数 (Hz)
-const float SAMPLING_FREQUENCY_HZ = 20.0;
-// サンプリング周期 (ミリ秒)
-const unsigned long SAMPLING_INTERVAL_MS = 1000 / SAMPLING_FREQUENCY_HZ;
-// ファイルをフラッシュする周期 (ミリ秒)。不意の電源断によるデータ損失を防ぎますの
-const unsigned long FLUSH_INTERVAL_MS = 1000;
+// 設定プロファイル
+// RuntimeProfile なら上の設定ファイルに従いますの。ProfileDefault20Hz などの StaticProfile を
+// 指定すると設定はコンパイル時に固定され、logData() とエンコーダから実行時の分岐が消えますわ
+#ifndef LOGGER_PROFILE
+#define LOGGER_PROFILE RuntimeProfile
+#endif
+
+// UARTリンクの時刻順統合
+// サテライトのレコードはこの時間だけ遅れて届いても、正しい順序でログに並びますわ
+#define LINK_MERGE_LAG_US 100000
+#define LINK_MERGE_SLOTS  128   // 並べ替えのために保持できる行数
+#define LINK_LINE_MAX     48
+
+// 省電力の待機
+// PIOキャプチャのリング (256 イベント) は割り込みを出しませんので、キャプチャ中はこの間隔で起きて空けますの
+#define IDLE_CAPTURE_MAX_SLEEP_US 1000
+
+// ログの時刻の索引
+// エントリ (8 バイト) はこの数だけ溜めてから .idx へ書きますの (64 件で1セクタですわ)
+#define LOG_INDEX_BUFFER_ENTRIES 64
 
 
 //================================================
 //== グローバル変数
 //================================================
-File logFile;
+LogStorage logFile;   // ログファイル。ハンドルを開いたまま保持しますの
+LogNameCache g_logNames; // ルートにあるログファイル番号のキャッシュ
 char logFileName[30]; // ログファイル名を格納するグローバル変数
 
 // 割り込みサービスルーチン (ISR) で使用するため、volatileを付けますわ
 volatile bool g_powerOffDetected = false;
 
-unsigned long g_lastLogTime = 0;
+LoggerConfig g_config = loggerConfigDefaults(); // 実効設定
+unsigned long g_sampleIntervalUs = 0;           // サンプリング周期 (マイクロ秒)
+uint32_t g_sampleIndex = 0;                     // チャンネルの間引きに使う通し番号
+ChannelSchedule g_channelSchedule;              // チャンネルごとの間引きの残り数 (割り算なしで数えますの)
+
+// 書き込みバッファ。サイズは設定で決まるので、起動時に確保しますの
+char* g_writeBuf = nullptr;
+size_t g_writeLen = 0;
+
+// カード健全性の記録用ですわ。書き込みとフラッシュの遅延、エラー・リトライ回数を数えますの
+int g_flightNumber = 0;
+unsigned long g_logStartMs = 0;
+LatencyHistogram g_writeLatency;
+uint32_t g_bytesWritten = 0;
+uint16_t g_writeErrors = 0;
+uint16_t g_writeRetries = 0;
+
+// PIOキャプチャ。イベントはCSVとは別の .evt ファイルへ、専用のバッファを通して書きますの
+PioCapture g_capture;
+LogStorage g_eventFile;
+char g_eventBuf[1024];
+size_t g_eventLen = 0;
+bool g_captureAny = false;
+
+// サテライト基板とのUARTリンク。リンクが1本でも有効なら、ロガー自身の行も時刻順の統合を通しますの
+uart_inst_t* const kLinkUarts[LOGGER_LINK_COUNT] = {uart0, uart1};
+UartLink g_links[LOGGER_LINK_COUNT];
+TimelineMerger<LINK_MERGE_SLOTS, LINK_LINE_MAX> g_merger;
+bool g_linksActive = false;
+
+// ストライピング。カードBへの書き込みはコア1 (loop1) が受け持ちますの
+static_assert(STRIPE_BUFFERS == LOGGER_STRIPE_BUFFERS, "logger_config.h と log_stripe.h のバッファ数がずれていますわ");
+LogStripe g_stripe;
+
+// 書き込みバッファへ流し込む Print ですわ。ヘッダーや統計のコメント行もデータと同じ経路で書きますの
+class RecordPrint : public Print {
+public:
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+};
+RecordPrint g_recordOut;
+
+// format=rice の圧縮器ですわ。チャンクは書き込みバッファへ直接置きますので、ストライピングともそのまま組めますの
+static_assert(RICE_MAX_CHUNK_BYTES <= LOGGER_RICE_CHUNK_MAX, "logger_config.h の LOGGER_RICE_CHUNK_MAX が足りませんわ");
+struct RiceBufferSink {
+  uint8_t* reserve(size_t maxBytes);
+  void commit(size_t bytes);
+};
+RiceBufferSink g_riceSink;
+RiceLogWriter<RiceBufferSink> g_rice(g_riceSink);
+bool g_riceActive = false;
+
+// 共有SPIバスの調停役ですわ。カードへの書き込みをセクタ境界で切り、その切れ目で期限の来たセンサーを読みますの
+#define SENSOR_SPI_HZ     1000000
+#define SENSOR_DATA_REG   0x3B // 例: 読み出すレジスタ (先頭ビットを立てて読み出しにしますの)
+// 書き込みの途中で読んでおけるサンプル数。フラッシュでは消去 (最悪 400 ms) の間も溜めますので、
+// 250 Hz までなら最悪の消去1回分が収まる深さにしておきますの
+#ifndef PENDING_SAMPLES
+#if LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+#define PENDING_SAMPLES   128
+#else
+#define PENDING_SAMPLES   16
+#endif
+#endif
+static_assert(PENDING_SAMPLES <= 256, "g_pendingHead/g_pendingTail は uint8_t ですの");
+static_assert((PENDING_SAMPLES & (PENDING_SAMPLES - 1)) == 0, "消去中にも使う剰余を割り算にしないよう、2の冪にしてくださいまし");
+struct PendingSample {
+  SampleRecord record;
+  uint64_t us;
+  uint32_t index;
+};
+SpiArbiter g_spiArbiter;
+LatencyHistogram g_sensorLatency; // 予定時刻からセンサーを読み終えるまでの遅れですの
+PendingSample g_pending[PENDING_SAMPLES];
+volatile uint8_t g_pendingHead = 0; // フラッシュの消去中はアラームの割り込みからも積みますの
+volatile uint8_t g_pendingTail = 0;
+uint8_t g_pendingPeak = 0;          // リングに溜まった最大の数ですわ (深さが足りているかの目安ですの)
+uint32_t g_dummySeed = 2463534242u; // ダミーデータの乱数ですわ (random() はフラッシュにありますの)
+
+// フライト目録のエントリ。記録中に要約統計を埋めていき、終了時に書き込みますの
+FlightCatalogEntry g_flight;
+
+unsigned long g_lastSampleUs = 0;
 unsigned long g_lastFlushTime = 0;
 
+// サンプルの合間の待機と、稼働・休止時間の集計ですわ
+IdleSleeper g_idleSleeper;
+IdleAccounting g_idle;
+
+// 時刻の索引ですわ。ログへ流し込んだバイト数を数えておき、区切りの行の位置として書きますの
+LogStorage g_indexFile;
+LogIndexBuilder g_logIndex;
+LogIndexEntry g_indexBuf[LOG_INDEX_BUFFER_ENTRIES];
+uint8_t g_indexLen = 0;
+bool g_indexDirty = false;    // 前回の確定の後に書いたエントリがありますの
+uint32_t g_logStreamBytes = 0; // ログファイルの先頭からのバイト数 (バッファに溜めた分も含みますわ)
+
 
 //================================================
 //== 関数プロトタイプ
 //================================================
+void loadConfig();
 void findNextLogFileName();
 void powerOffISR();
-void logData();
+void logData(uint32_t dueUs);
+bool takeSampleSlot(uint32_t* dueUs);
+bool sampleDuringWrite();
+bool takePendingSample();
+uint32_t flashOpTick();
+void drainPendingSamples();
+void printFlashStats(Print& out, const char* prefix);
+void handleDownloadCommand(int command);
+void beginIdle();
+void idleUntilNextEvent();
+void printIdleStats(Print& out, const char* prefix);
+void beginLogIndex();
+void noteLogIndex(uint32_t timeMs);
+void appendTimedLine(const char* data, size_t len);
+void writeLogIndex();
+void handleQueryCommand();
+int32_t readSpiSensor();
+void benchmarkSpiArbiter();
+void printSpiStats(Print& out, const char* prefix);
+void benchmarkEncoders();
+void benchmarkRice();
+void benchmarkHotPathJitter();
+int printHotPathReport(bool verbose);
+void handleSerialCommand();
+void dumpTraceToCard();
+void appendRecord(const char* data, size_t len);
+void appendText(const char* data, size_t len);
+void LOGGER_RAM_FUNC(appendTimed)(uint64_t timeUs, const char* data, size_t len);
+void beginLinks();
+void pollLinks();
+void printLinkStats(Print& out, const char* prefix);
+void flushWriteBuffer();
+void writeLogBlock(const uint8_t* data, size_t len);
+bool beginStripe();
+void printStripeStats(Print& out);
+void reopenLogFile();
+void recordCardHealth();
+void beginCapture();
+void drainCapture();
+void sampleCaptureFrequency();
+void appendEvent(const char* line, size_t len);
+void flushEventBuffer();
+void writeTrailer();
+void beginFlightCatalog();
+void finishFlightCatalog(uint32_t logSizeBytes);
+void printWriteAmp(Print& out, const char* prefix);
+const char* logFileExtension();
+void beginRice();
+void flushRice();
+void printRiceStats(Print& out, const char* prefix);
 
 
 //================================================
@@ -86,33 +283,123 @@ void setup() {
   SPI.setRX(PIN_SPI_RX);
   SPI.setTX(PIN_SPI_TX);
   SPI.setSCK(PIN_SPI_SCK);
-  if (!SD.begin(PIN_SPI_CS)) {
+  if (!storageBegin(PIN_SPI_CS)) {
     Serial.println("SDカードの初期化に失敗しましたわ。残念ですが、ここで処理を停止します。");
     while (1); // 永久ループ
   }
-  Serial.println("SDカードの初期化に成功しましたわ。");
+  Serial.print("SDカードの初期化に成功しましたわ (");
+  Serial.print(storageBackendName());
+  Serial.println(")。");
+  // 書き込み増幅の見積もりに使うクラスタの大きさとFATの種類ですの
+  writeAmpSetGeometry(storageBlocksPerCluster(), storageFatType());
+
+  // 前回が電源断で途切れていたら、目録のエントリを直しておきますの
+  int recovered = flightCatalogRecover();
+  if (recovered > 0) {
+    Serial.print("途切れていたフライト ");
+    Serial.print(recovered);
+    Serial.println(" 件を目録で「電源断」に直しましたわ。");
+  }
+
+  // 設定ファイルを読み込み、書き込みバッファを確保します
+  if constexpr (LOGGER_PROFILE::kIsStatic) {
+    g_config = LOGGER_PROFILE::config();
+    Serial.println("静的プロファイルでビルドされていますので、設定ファイルは読みませんわ。");
+    loggerConfigPrint(g_config, Serial);
+  } else {
+    loadConfig();
+  }
+  g_sampleIntervalUs = 1000000UL / g_config.sampleHz;
+  channelScheduleBegin<LOGGER_PROFILE>(g_channelSchedule, g_sampleIndex); // 間引き数の割り算はここで一度だけですわ
+
+  // センサーがSDカードとバスを共有するなら、カードの書き込みを切り分けてその切れ目で読みますの
+  if (g_config.sensorCsPin != LOGGER_PIN_NONE) {
+    pinMode(g_config.sensorCsPin, OUTPUT);
+    digitalWrite(g_config.sensorCsPin, HIGH);
+  } else if (storageUseDedicatedBus(PIN_SPI_CS)) {
+    // バスがカード専用と分かったので、カードを選んだままにしておきますの (SdFat のときだけですわ)
+    Serial.println("SPIバスをカード専用にしてマウントし直しましたわ。");
+  }
+  g_spiArbiter.begin([]() { return static_cast<uint32_t>(micros()); }, g_config.spiSliceBytes);
+  latencyReset(g_sensorLatency);
 
-  // 次のログファイル名を決定します
+  // 次のログファイル名を決定します。ディレクトリの走査はここで1回だけですわ
+  g_logNames.scan();
   findNextLogFileName();
+
+  // ストライピングでは書き込みバッファもブロック用の持ち回りになりますの
+  if (g_config.stripe && !beginStripe()) {
+    Serial.println("2枚目のカードを使えませんので、1枚だけで記録しますわ。");
+    g_config.stripe = false;
+    sprintf(logFileName, "/flight_log_%03d.%s", g_flightNumber, logFileExtension());
+  }
+  if (!g_config.stripe) {
+    g_writeBuf = profileAllocBuffer<LOGGER_PROFILE>();
+  }
+  if (g_writeBuf == nullptr) {
+    Serial.println("書き込みバッファを確保できませんでしたわ…。処理を停止します。");
+    while (1);
+  }
   Serial.print("今回のログは '");
   Serial.print(logFileName);
   Serial.println("' に記録しますわ。");
 
+  beginLinks();
+  beginRice();
+
   // ファイルを開き、ヘッダーを書き込みます
-  logFile = SD.open(logFileName, FILE_WRITE);
-  if (logFile) {
+  if (logFile.open(logFileName)) {
+    g_logNames.add(g_flightNumber);
+    // 空のうちに連続したクラスタを確保しておけば、追記のたびのFATの更新が要りませんの
+    if (g_config.preallocMb > 0) {
+      const bool ok = logFile.preAllocate(g_config.preallocMb * 1024UL * 1024UL);
+      Serial.printf("%lu MB の事前割り当て: %s\r\n", static_cast<unsigned long>(g_config.preallocMb),
+                    ok ? (logFile.file().isContiguous() ? "連続した領域を確保しましたわ" : "確保しましたわ")
+                       : "このバックエンドかカードではできませんでしたの");
+    }
+    // 実効設定をコメント行として残しておきますの。後から条件を再現できますわ
+    // データと同じ書き込みバッファを通すので、ストライピングでもブロックに収まりますの
+    loggerConfigPrint(g_config, g_recordOut);
+    g_recordOut.print("# fs_backend=");
+    g_recordOut.println(storageBackendName());
     // CSVヘッダー。記録するデータに合わせて変更してくださいませ
-    logFile.println("timestamp_ms,dummy_sensor1,dummy_sensor2");
-    logFile.flush(); // ヘッダーをすぐに書き込んでおきますの
+    if (g_linksActive) {
+      // サテライトのレコードは source (リンク番号), channel, value の列に入りますの
+      g_recordOut.println("timestamp_ms,dummy_sensor1,dummy_sensor2,source,channel,value");
+    } else {
+      g_recordOut.println("timestamp_ms,dummy_sensor1,dummy_sensor2");
+    }
+    flushRice();
+    flushWriteBuffer();
+    logFile.sync(); // ヘッダーをすぐに書き込んでおきますの
     Serial.println("ヘッダーの書き込みに成功しましたわ。記録を開始します。");
+    beginLogIndex();
+    latencyReset(g_writeLatency);
+    g_logStartMs = millis();
   } else {
     Serial.println("ファイルを開けませんでしたわ…。処理を停止します。");
     while (1);
   }
 
+  beginCapture();
+  beginFlightCatalog();
+
+  // SRAMへ置いたはずの関数や、そこから呼ぶ libgcc のヘルパーがフラッシュに残っていれば、ここでお知らせしますわ
+  if (printHotPathReport(false) > 0) {
+    Serial.println("上の関数やヘルパーはSRAMに載っていませんわ。XIPキャッシュの外れやフラッシュの消去で遅れることがありますの。");
+  }
+
+  // ここから先のカードへの書き込みは、切れ目ごとにサンプリングの期限を確かめますの
+  g_spiArbiter.setUrgent(sampleDuringWrite);
+#if LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+  // フラッシュの書き込みと消去の間は、アラームで予定時刻ごとにサンプルを取りますの
+  g_storageFlash.setTick(flashOpTick);
+#endif
+
   // 電圧がHIGHからLOWに変化した(FALLING)ら、powerOffISR関数を呼び出しますの
-  attachInterrupt(digitalPinToInterrupt(PIN_POWER_SENSE), powerOffISR, FALLING);
+  attachInterrupt(digitalPinToInterrupt(g_config.powerSensePin), powerOffISR, FALLING);
   Serial.println("電源監視を開始しましたわ。いつでも電源をお切りになってよろしくてよ。");
+  beginIdle();
 }
 
 
@@ -122,46 +409,132 @@ void setup() {
 void loop() {
   // --- シャットダウン処理 ---
   if (g_powerOffDetected) {
+#if LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+    g_storageFlash.setTick(nullptr); // 閉じる間に読んだサンプルは記録できませんので、止めておきますの
+#endif
     if (logFile) {
+      if (g_linksActive) {
+        pollLinks();
+        g_merger.releaseAll(appendTimedLine); // 並べ替え待ちの行も時刻順に書き出しますの
+        printLinkStats(g_recordOut, "# "); // リンクの統計をコメント行として残しますわ
+      }
+      drainPendingSamples();
+      printSpiStats(g_recordOut, "# "); // センサーの遅れとバスの保持時間を残しておきますの
+      printFlashStats(g_recordOut, "# "); // フラッシュでは消去で止まった時間も残しますわ
+      printIdleStats(g_recordOut, "# "); // 稼働・休止の時間から、この設定の1サンプルあたりのエネルギーが分かりますの
+      if (g_riceActive) {
+        flushRice(); // 溜まりかけのブロックも書き出してから
+        printRiceStats(g_recordOut, "# "); // 圧縮率と符号化のサイクル数を残しておきますの
+      }
+      writeTrailer(); // 正常に閉じた印として、最後の行にトレーラーを残しますの
+      flushRice();
+      flushWriteBuffer(); // バッファに残ったデータも忘れずに
+      const uint32_t logSizeBytes = logFile.size();
       logFile.close(); // これが一番大事ですわ！
+      if (g_indexFile) {
+        writeLogIndex(); // 溜めていたエントリも書いて、索引を閉じますの
+        g_indexFile.close();
+      }
+      if (g_stripe.active()) {
+        // カードBはコア1が閉じますの。書き終えるまで待ちますわ
+        if (!g_stripe.close(2000)) {
+          Serial.println("2枚目のカードを時間内に閉じられませんでしたわ…。");
+        }
+        printStripeStats(Serial);
+      }
+      if (g_eventFile) {
+        drainCapture();
+        // リングがあふれて失ったイベント数を末尾に残しておきますの
+        for (int ch = 0; ch < LOGGER_CAPTURE_COUNT; ch++) {
+          if (g_capture.active(ch)) {
+            char line[32];
+            int n = snprintf(line, sizeof(line), "# lost ch%d=%lu\r\n", ch + 1, static_cast<unsigned long>(g_capture.lost(ch)));
+            appendEvent(line, static_cast<size_t>(n));
+          }
+        }
+        flushEventBuffer();
+        g_eventFile.close();
+      }
       Serial.println("電源OFFを検知！ ファイルを安全に閉じましたわ。お疲れ様でした。");
+      // ログを守ってから、余力で目録とカードの健全性を記録しますの
+      finishFlightCatalog(logSizeBytes);
+      recordCardHealth();
+      printWriteAmp(Serial, ""); // 最後の close と健全性記録の分まで含めた集計ですわ
     }
     // 割り込みを無効にして、意図しない動作を防ぎます
-    detachInterrupt(digitalPinToInterrupt(PIN_POWER_SENSE));
-    // 全ての処理を停止
+    detachInterrupt(digitalPinToInterrupt(g_config.powerSensePin));
+    // 記録は止めて、USBからのダウンロードだけを受け付けますの
     while (1) {
-      delay(100);
+      if (Serial.available()) {
+        const int command = Serial.read();
+        if (command == 'f' || command == 'g') {
+          handleDownloadCommand(command);
+        } else if (command == 'q') {
+          handleQueryCommand();
+        }
+      }
+      delay(10);
     }
   }
 
-  unsigned long currentTime = millis();
-
   // --- データロギング処理 ---
-  if (currentTime - g_lastLogTime >= SAMPLING_INTERVAL_MS) {
-    g_lastLogTime = currentTime;
-    logData();
+  // カードへの書き込みの途中で読んでおいたサンプルを、先に記録しますの
+  drainPendingSamples();
+  uint32_t dueUs;
+  if (takeSampleSlot(&dueUs)) {
+    logData(dueUs);
+    sampleCaptureFrequency();
   }
 
-  // --- 定期的なフラッシュ処理 ---
-  if (currentTime - g_lastFlushTime >= FLUSH_INTERVAL_MS) {
-    // loop()関数内のフラッシュ処理部分を差し替え
+  // --- UARTリンクの受信 ---
+  pollLinks();
 
-  // --- 定期的なクローズ・再オープン処理 ---
-  if (currentTime - g_lastFlushTime >= FLUSH_INTERVAL_MS) {
+  // --- キャプチャの読み出し ---
+  // リングは1チャンネル256イベントですので、毎周回こまめに空けておきますわ
+  drainCapture();
+
+  unsigned long currentTime = millis();
+
+  // --- 定期的なフラッシュ処理 ---
+  if (currentTime - g_lastFlushTime >= g_config.flushIntervalMs) {
     g_lastFlushTime = currentTime;
-    if (logFile) {
-      // 一度ファイルを閉じて、メタデータを確実に書き込みます
-      logFile.close();
-      // すぐに追記モードで同じファイルを開き直します
-      logFile = SD.open(logFileName, FILE_WRITE);
-      if (!logFile) {
-        // 再オープンに失敗した場合の処理
-        Serial.println("ファイルの再オープンに失敗しましたわ！");
-        // ここでエラー処理（例：LEDを点滅させるなど）をすることも考えられます
+    TRACE_SCOPE(TRACE_EV_FLUSH);
+    if (logFile && g_config.flushPolicy != FLUSH_NONE) {
+      flushRice(); // 圧縮中のブロックも区切って、この周期の分までを確定させますの
+      flushWriteBuffer();
+    }
+    if (logFile && g_config.flushPolicy == FLUSH_SYNC) {
+      // ファイルは開いたまま、ディレクトリエントリとFATだけを更新しますの
+      TRACE_SCOPE(TRACE_EV_SD_FLUSH);
+      unsigned long t0 = micros();
+      g_spiArbiter.acquire(SPI_CLIENT_CARD); // FATとディレクトリエントリの確定は切り分けられませんの
+      if (!logFile.sync()) {
+        g_writeErrors++;
       }
+      g_spiArbiter.release(SPI_CLIENT_CARD);
+      latencyRecord(g_writeLatency, micros() - t0);
+    } else if (logFile && g_config.flushPolicy == FLUSH_CLOSE_REOPEN) {
+      reopenLogFile();
+    }
+    if (g_stripe.active() && g_config.flushPolicy != FLUSH_NONE) {
+      g_stripe.requestSync(); // カードBの確定はコア1に任せて、待たずに進みますの
+    }
+    if (g_eventFile && g_config.flushPolicy != FLUSH_NONE) {
+      flushEventBuffer();
+      g_eventFile.reopen();
+    }
+    if (g_indexDirty && g_config.flushPolicy != FLUSH_NONE) {
+      // 索引はセクタ1つ分ずつ書きますので、書いた周期だけ確定しますの (毎周期の確定は増やしませんわ)
+      g_indexFile.reopen();
+      g_indexDirty = false;
     }
   }
-  }
+
+  // --- シリアルコマンド処理 ---
+  handleSerialCommand();
+
+  // --- 次にすることまで休みますの ---
+  idleUntilNextEvent();
 }
 
 
@@ -169,28 +542,61 @@ void loop() {
 //== 各種処理関数
 //================================================
 
+/**
+ * @brief 設定ファイルを読み込み、検証しますわ
+ * @details
+ * ファイルが無ければ既定値のまま進みますの。解釈できない行は行番号を添えて
+ * お知らせし、その行だけ無視しますわ。RAM予算を超える設定は切り詰めますのよ。
+ */
+void loadConfig() {
+  StorageFile cfgFile = storageOpen(CONFIG_FILE_NAME, STORAGE_READ);
+  if (cfgFile) {
+    char line[96];
+    int lineNumber = 0;
+    while (cfgFile.available()) {
+      size_t n = cfgFile.readBytesUntil('\n', line, sizeof(line) - 1);
+      line[n] = '\0';
+      lineNumber++;
+      if (!loggerConfigParseLine(g_config, line)) {
+        Serial.print(CONFIG_FILE_NAME);
+        Serial.print(" の ");
+        Serial.print(lineNumber);
+        Serial.println(" 行目が解釈できませんでしたわ。無視しますの。");
+      }
+    }
+    cfgFile.close();
+    Serial.println("設定ファイルを読み込みましたわ。");
+  } else {
+    Serial.println("設定ファイルが無いので、既定値で動きますわ。");
+  }
+
+  char message[64];
+  uint32_t fixedRamBytes = traceRamBytes();
+  fixedRamBytes += sizeof(g_links) + sizeof(g_merger) + sizeof(g_stripe) + sizeof(g_rice);
+  if (!loggerConfigValidate(g_config, fixedRamBytes, message, sizeof(message))) {
+    Serial.print("設定に問題がありましたので、値を補正しましたわ: ");
+    Serial.println(message);
+  }
+  loggerConfigPrint(g_config, Serial);
+}
+
 /**
  * @brief 次に使用するログファイル名を検索・生成しますわ
  * @details
- * SDカードルートにある "flight_log_XXX.csv" という形式のファイルを検索し、
- * 存在しない最も若い番号で新しいファイル名を生成しますの。
+ * SDカードルートにある "flight_log_XXX.*" という形式のファイルを起動時の走査結果から探し、
+ * 存在しない最も若い番号で新しいファイル名を生成しますの。カードへの問い合わせはしませんわ。
  */
 void findNextLogFileName() {
-  int fileNumber = 1;
-  while (true) {
-    // ファイル名を生成 (例: /flight_log_001.csv)
-    sprintf(logFileName, "/flight_log_%03d.csv", fileNumber);
-    if (!SD.exists(logFileName)) {
-      break; // このファイル名はまだ使われていないので、これで決定ですわ
-    }
-    fileNumber++;
-    if (fileNumber > 999) { // 念のため、ファイル数の上限を設けておきますわ
-      Serial.println("ログファイルが999を超えましたわ！");
-      // 本来はエラー処理をすべきですが、今回は最初のファイル名を使います
-      sprintf(logFileName, "/flight_log_001.csv");
-      break;
-    }
+  int fileNumber = g_logNames.firstFree();
+  if (fileNumber == 0) { // 念のため、ファイル数の上限を設けておきますわ
+    Serial.println("ログファイルが999を超えましたわ！");
+    // 本来はエラー処理をすべきですが、今回は最初のファイル名を使います
+    fileNumber = 1;
   }
+  // ファイル名を生成 (例: /flight_log_001.csv)
+  // ストライピングではカードAが .s0、カードBが .s1、format=rice では .bin になりますの
+  sprintf(logFileName, "/flight_log_%03d.%s", fileNumber, logFileExtension());
+  g_flightNumber = fileNumber;
 }
 
 /**
@@ -199,29 +605,1328 @@ void findNextLogFileName() {
  * ISR内では重い処理は禁物ですわ。フラグを立てるだけにして、
  * 実際の処理はloop()に任せるのがエレガントな作法ですのよ。
  */
-void powerOffISR() {
+void LOGGER_RAM_FUNC(powerOffISR)() {
+  TRACE_INSTANT(TRACE_EV_ISR_POWER, 0);
   g_powerOffDetected = true;
 }
 
 /**
- * @brief データを生成し、ファイルに記録しますわ
+ * @brief サンプリングの予定時刻が来ていれば、次の予定へ進めますわ
+ * @param dueUs 今回の予定時刻 (マイクロ秒) を返しますの
+ * @details 100 Hz を超えるレートも扱えるよう、周期はマイクロ秒で管理しますの。
+ */
+bool LOGGER_RAM_FUNC(takeSampleSlot)(uint32_t* dueUs) {
+  const unsigned long currentUs = ramTimeUs32(); // micros() と同じ値ですが、フラッシュを通りませんの
+  if (currentUs - g_lastSampleUs < g_sampleIntervalUs) {
+    return false;
+  }
+  g_lastSampleUs += g_sampleIntervalUs;
+  *dueUs = g_lastSampleUs;
+  // 大きく遅れたときは追いつこうとせず、今の時刻から数え直しますわ
+  if (currentUs - g_lastSampleUs >= g_sampleIntervalUs) {
+    g_lastSampleUs = currentUs;
+  }
+  return true;
+}
+
+/**
+ * @brief SDカードとバスを共有するSPIセンサーから、レジスタの2バイトを読みますわ
+ * @details カードの書き込みの切れ目からも呼ばれますので、バスは調停役から受け取りますの。
+ */
+int32_t LOGGER_RAM_FUNC(readSpiSensor)() {
+  if (!g_spiArbiter.acquire(SPI_CLIENT_SENSOR)) {
+    return 0;
+  }
+  SPI.beginTransaction(SPISettings(SENSOR_SPI_HZ, MSBFIRST, SPI_MODE0));
+  digitalWrite(g_config.sensorCsPin, LOW);
+  SPI.transfer(SENSOR_DATA_REG | 0x80);
+  const uint8_t hi = SPI.transfer(0);
+  const uint8_t lo = SPI.transfer(0);
+  digitalWrite(g_config.sensorCsPin, HIGH);
+  SPI.endTransaction();
+  g_spiArbiter.release(SPI_CLIENT_SENSOR);
+  return static_cast<int16_t>((hi << 8) | lo);
+}
+
+/** @brief ダミーデータ用の xorshift32 ですわ。フラッシュの消去中にも呼べますの */
+LOGGER_RAM_INLINE uint32_t dummyRandom() {
+  g_dummySeed ^= g_dummySeed << 13;
+  g_dummySeed ^= g_dummySeed >> 17;
+  g_dummySeed ^= g_dummySeed << 5;
+  return g_dummySeed;
+}
+
+/**
+ * @brief センサーを読んで1サンプルを作りますわ (プロファイルごとに特殊化されますの)
+ * @param dueUs このサンプルの予定時刻。読み終えるまでの遅れを数えますの
  * @details
- * 将来的には、ここで各種センサーからの値を読み取って記録しますのよ。
- * 今はダミーデータを書き込んでいますわ。
+ * 将来的には、ここで各種センサーからの値を読み取りますのよ。今はダミーデータですわ。
+ * カードへの書き込みの切れ目からも、フラッシュの消去中のアラームからも呼ばれますので、
+ * 書き込みバッファには触れず、フラッシュにある関数 (micros()・random()・割り算・__builtin_clz) も呼びませんの。
+ * M0+ には割り算と CLZ の命令がありませんので、% や __builtin_clz は libgcc の呼び出しになってしまいますわ。
  */
-void logData() {
+template <class P>
+LOGGER_RAM_INLINE void acquireSampleT(PendingSample& s, uint32_t dueUs) {
+  // チャンネルごとのレートに合わせて、今回記録するチャンネルを決めますの
+  SampleRecord& record = s.record;
+  s.index = g_sampleIndex;
+  record.present = channelScheduleNext(g_channelSchedule);
+  g_sampleIndex++;
+
+  // --- ↓↓↓ ここにセンサー読み取り処理を実装しますの ↓↓↓ ---
+  s.us = ramTimeUs64(); // millis() と同じ時間軸ですの
+  if (g_config.sensorCsPin != LOGGER_PIN_NONE) {
+    record.value[0] = (record.present & 0x01) ? readSpiSensor() : 0;   // 例: SPI接続のセンサーの16bit値
+  } else {
+    record.value[0] = (record.present & 0x01) ? static_cast<int32_t>(dummyRandom() & 1023) : 0; // 例: 10bit ADCの値
+  }
+  // 例: 温度センサーの値 (0.01単位)。0.0〜99.9 を、割り算の代わりに掛けてずらして作りますの
+  record.value[1] = (record.present & 0x02) ? static_cast<int32_t>(((dummyRandom() & 0xFFFF) * 1000) >> 16) * 10 : 0;
+  // --- ↑↑↑ ここまで ---
+  latencyRecord(g_sensorLatency, ramTimeUs32() - dueUs);
+}
+
+/**
+ * @brief 1サンプルを整形して、書き込みバッファに溜めますわ
+ */
+template <class P>
+LOGGER_RAM_INLINE void recordSampleT(const PendingSample& s) {
+  SampleRecord record = s.record;
+  record.timestampMs = static_cast<uint32_t>(s.us / 1000); // 64ビットの割り算は、消去中にも走る読み取り側ではなくここでしますの
+  // 目録の要約統計 (チャンネルごとの最小・最大) を更新しますの
+  for (int ch = 0; ch < 2; ch++) {
+    if (record.present & (1u << ch)) {
+      flightCatalogNoteValue(g_flight, ch, record.value[ch]);
+    }
+  }
+
+  if (g_riceActive) {
+    // 圧縮では時刻もチャンネル 0 として、各チャンネルと同じく予測して符号化しますの
+    TRACE_SCOPE(TRACE_EV_ENCODE);
+    noteLogIndex(record.timestampMs);
+    g_rice.addSample(0, s.index, static_cast<int32_t>(record.timestampMs));
+    for (int ch = 0; ch < LOGGER_CHANNEL_COUNT; ch++) {
+      if (record.present & (1u << ch)) {
+        g_rice.addSample(static_cast<uint8_t>(ch + 1), s.index, record.value[ch]);
+      }
+    }
+    return;
+  }
+
+  // データをCSV形式に整形してから、書き込みバッファに溜めます
+  char line[48];
+  size_t len;
+  {
+    TRACE_SCOPE(TRACE_EV_ENCODE);
+    len = encodeCsvRecord<P>(line, record);
+  }
+  appendTimed(s.us, line, len);
+}
+
+/**
+ * @brief データを生成し、ファイルに記録しますわ (プロファイルごとに特殊化されますの)
+ */
+template <class P>
+void LOGGER_RAM_FUNC(logDataT)(uint32_t dueUs) {
+  TRACE_SCOPE(TRACE_EV_SAMPLE);
   if (logFile) {
-    // --- ↓↓↓ ここにセンサー読み取り処理を実装しますの ↓↓↓ ---
-    unsigned long timestamp = millis();
-    int dummyValue1 = random(0, 1024); // 例: 10bit ADCの値
-    float dummyValue2 = random(0, 1000) / 10.0; // 例: 温度センサーの値
-    // --- ↑↑↑ ここまで ---
-
-    // データをCSV形式で書き込みます
-    logFile.print(timestamp);
-    logFile.print(",");
-    logFile.print(dummyValue1);
-    logFile.print(",");
-    logFile.println(dummyValue2);
+    PendingSample s;
+    acquireSampleT<P>(s, dueUs);
+    recordSampleT<P>(s);
+  }
+}
+
+void LOGGER_RAM_FUNC(logData)(uint32_t dueUs) {
+  logDataT<LOGGER_PROFILE>(dueUs);
+}
+
+/**
+ * @brief カードへの書き込みの切れ目で呼ばれますの。期限が来ていればセンサーを読んでおきますわ
+ * @details 記録は書き込みが終わってから drainPendingSamples() で行いますの。
+ *          置き場所が埋まっていれば、予定はそのままにして後で読みますわ。
+ * @return センサーを読んだら true
+ */
+bool LOGGER_RAM_FUNC(sampleDuringWrite)() {
+  return logFile && takePendingSample();
+}
+
+/**
+ * @brief 期限が来ていれば1サンプルを読んで、記録待ちのリングに積みますの
+ * @return 読んだら true
+ */
+bool LOGGER_RAM_FUNC(takePendingSample)() {
+  const uint8_t next = static_cast<uint8_t>((g_pendingHead + 1) % PENDING_SAMPLES);
+  uint32_t dueUs;
+  if (next == g_pendingTail || !takeSampleSlot(&dueUs)) {
+    return false;
+  }
+  TRACE_SCOPE(TRACE_EV_SAMPLE);
+  acquireSampleT<LOGGER_PROFILE>(g_pending[g_pendingHead], dueUs);
+  g_pendingHead = next;
+  const uint8_t depth = static_cast<uint8_t>((next + PENDING_SAMPLES - g_pendingTail) % PENDING_SAMPLES);
+  if (depth > g_pendingPeak) {
+    g_pendingPeak = depth;
+  }
+  return true;
+}
+
+/**
+ * @brief フラッシュの書き込み・消去の間に、アラームから呼ばれますわ
+ * @details XIPが止まっていますので、SPIのセンサー (SPIライブラリはフラッシュにありますの) は読まず、
+ *          予定を遅らせて操作の後で読みますわ。
+ * @return 次に呼んでほしい時刻 (次のサンプルの予定時刻)
+ */
+uint32_t LOGGER_RAM_FUNC(flashOpTick)() {
+  if (g_config.sensorCsPin == LOGGER_PIN_NONE) {
+    takePendingSample();
+  }
+  return static_cast<uint32_t>(g_lastSampleUs + g_sampleIntervalUs);
+}
+
+/** @brief 書き込みの途中で読んでおいたサンプルを、読んだ順に記録しますの */
+void LOGGER_RAM_FUNC(drainPendingSamples)() {
+  // 記録の途中の書き込みで、さらにサンプルが積まれることもありますわ
+  while (g_pendingTail != g_pendingHead) {
+    const PendingSample s = g_pending[g_pendingTail];
+    g_pendingTail = static_cast<uint8_t>((g_pendingTail + 1) % PENDING_SAMPLES);
+    recordSampleT<LOGGER_PROFILE>(s);
+  }
+}
+
+/**
+ * @brief SRAMに置いたホットパスの関数と、その実際の配置を表示しますわ
+ * @param verbose false なら、SRAMに無いものだけを表示しますの
+ * @return SRAMに無かった関数と、ホットパスから呼ばれているのにSRAMに無い libgcc のヘルパーの数
+ * @details SDライブラリ本体はコアの一部としてフラッシュに残りますので、ここには含めませんわ。
+ */
+int printHotPathReport(bool verbose) {
+  static const RamFuncEntry kHotPath[] = {
+    RAM_FUNC_ENTRY(powerOffISR),
+    RAM_FUNC_ENTRY(logData),
+    {"logDataT", reinterpret_cast<const void*>(&logDataT<LOGGER_PROFILE>)},
+    RAM_FUNC_ENTRY(takeSampleSlot),
+    RAM_FUNC_ENTRY(readSpiSensor),
+    RAM_FUNC_ENTRY(sampleDuringWrite),
+    RAM_FUNC_ENTRY(takePendingSample),
+    RAM_FUNC_ENTRY(flashOpTick),
+    RAM_FUNC_ENTRY(drainPendingSamples),
+    RAM_FUNC_ENTRY(appendTimed),
+    RAM_FUNC_ENTRY(appendTimedLine),
+    RAM_FUNC_ENTRY(noteLogIndex),
+    RAM_FUNC_ENTRY(appendRecord),
+    RAM_FUNC_ENTRY(appendText),
+    RAM_FUNC_ENTRY(flushWriteBuffer),
+    RAM_FUNC_ENTRY(writeLogBlock),
+    RAM_FUNC_ENTRY(drainCapture),
+  };
+  if (verbose) {
+    Serial.printf("ホットパスの配置 (LOGGER_HOTPATH_IN_RAM=%d):\r\n", LOGGER_HOTPATH_IN_RAM);
+  }
+  const size_t count = sizeof(kHotPath) / sizeof(kHotPath[0]);
+  const int misplaced = ramFuncReport(Serial, kHotPath, count, verbose);
+  return misplaced + ramFuncReportHelpers(Serial, kHotPath, count, verbose);
+}
+
+/**
+ * @brief エンコード速度を比べるベンチマークですわ
+ * @details
+ * 同じダミーレコード列を、汎用の snprintf 版・実行時プロファイル版・
+ * 静的プロファイル版で整形し、1レコードあたりのCPUサイクル数を表示しますの。
+ * ビルドごとに LOGGER_PROFILE を替えて、logData() 全体の差もトレースで確かめられますわ。
+ */
+template <class P>
+uint32_t benchEncodeCycles(uint32_t iterations) {
+  char line[48];
+  SampleRecord record = {0, {0, 0}, 0};
+  volatile size_t sink = 0; // 最適化で消されないようにしますの
+  uint32_t start = rp2040.getCycleCount();
+  for (uint32_t i = 0; i < iterations; i++) {
+    record.present = profileChannelMask<P>(i);
+    record.timestampMs = 123456 + i * 50;
+    record.value[0] = static_cast<int32_t>(i & 1023);
+    record.value[1] = static_cast<int32_t>((i * 7) % 10000);
+    sink = sink + encodeCsvRecord<P>(line, record);
+  }
+  return (rp2040.getCycleCount() - start) / iterations;
+}
+
+uint32_t benchSnprintfCycles(uint32_t iterations) {
+  char line[48];
+  volatile size_t sink = 0;
+  uint32_t start = rp2040.getCycleCount();
+  for (uint32_t i = 0; i < iterations; i++) {
+    sink = sink + snprintf(line, sizeof(line), "%lu,%d,%.2f\r\n", 123456UL + i * 50, (int)(i & 1023), ((i * 7) % 10000) / 100.0);
+  }
+  return (rp2040.getCycleCount() - start) / iterations;
+}
+
+void benchmarkEncoders() {
+  const uint32_t iterations = 5000;
+  Serial.print("エンコードのベンチマーク (");
+  Serial.print(iterations);
+  Serial.println(" レコード、サイクル/レコード):");
+  Serial.print("  snprintf: ");
+  Serial.println(benchSnprintfCycles(iterations));
+  Serial.print("  runtime : ");
+  Serial.println(benchEncodeCycles<RuntimeProfile>(iterations));
+  Serial.print("  static  : ");
+  Serial.println(benchEncodeCycles<ProfileDefault20Hz>(iterations));
+  benchmarkRice();
+}
+
+/**
+ * @brief 予測+Rice符号の圧縮を、IMUのような滑らかな信号で測りますわ
+ * @details 正弦波に小さな雑音を重ねた 1 ブロックを繰り返し符号化し、サイクル/サンプルとビット/サンプルを表示しますの。
+ */
+void benchmarkRice() {
+  static int32_t signal[RICE_BLOCK_SAMPLES];
+  static uint8_t block[RICE_MAX_BLOCK_BYTES(RICE_BLOCK_SAMPLES)];
+  for (int i = 0; i < RICE_BLOCK_SAMPLES; i++) {
+    signal[i] = static_cast<int32_t>(2000.0 * sin(i * 0.05)) + random(-4, 5); // 例: 16ビットの加速度
+  }
+  const uint32_t rounds = 20;
+  size_t bytes = 0;
+  uint32_t start = rp2040.getCycleCount();
+  for (uint32_t r = 0; r < rounds; r++) {
+    bytes = riceEncodeBlock(signal, RICE_BLOCK_SAMPLES, block, sizeof(block));
+  }
+  const uint32_t cycles = (rp2040.getCycleCount() - start) / (rounds * RICE_BLOCK_SAMPLES);
+  const uint32_t bitsX100 = static_cast<uint32_t>(bytes * 800 / RICE_BLOCK_SAMPLES);
+  Serial.printf("  rice    : %lu サイクル/サンプル、%lu.%02lu ビット/サンプル (正弦波+雑音)\r\n", static_cast<unsigned long>(cycles),
+                static_cast<unsigned long>(bitsX100 / 100), static_cast<unsigned long>(bitsX100 % 100));
+  if (g_riceActive) {
+    Serial.print("  記録中の圧縮: ");
+    printRiceStats(Serial, "");
+  }
+}
+
+/**
+ * @brief 1サンプル分の処理 (チャンネル選択・整形・バッファへのコピー) ですわ。揺らぎのベンチマーク用ですの
+ */
+template <class P>
+LOGGER_RAM_INLINE size_t jitterBody(uint32_t i, char* out) {
+  SampleRecord record = {0, {0, 0}, 0};
+  record.present = profileChannelMask<P>(i);
+  record.timestampMs = 123456 + i * 50;
+  record.value[0] = static_cast<int32_t>(i & 1023);
+  record.value[1] = static_cast<int32_t>((i * 7) % 10000);
+  char line[48];
+  size_t len = encodeCsvRecord<P>(line, record);
+  memcpy(out, line, len);
+  return len;
+}
+
+// 中身が同じで、置き場所だけが違う2つの版ですわ
+__attribute__((noinline)) size_t jitterFromFlash(uint32_t i, char* out) {
+  return jitterBody<LOGGER_PROFILE>(i, out);
+}
+
+__attribute__((noinline)) size_t LOGGER_RAM_FUNC(jitterFromRam)(uint32_t i, char* out) {
+  return jitterBody<LOGGER_PROFILE>(i, out);
+}
+
+/** @brief 1つの版を繰り返し呼び、1回ごとのサイクル数を集計して表示しますの */
+void benchJitterOne(const char* label, size_t (*fn)(uint32_t, char*), bool coldCache) {
+  const uint32_t iterations = 2000;
+  LatencyHistogram cycles; // 単位はマイクロ秒ではなくサイクルですわ
+  latencyReset(cycles);
+  char out[48];
+  for (uint32_t i = 0; i < iterations; i++) {
+    if (coldCache) {
+      // XIPキャッシュを空にして、SDライブラリなどに追い出された直後を再現しますの
+      xip_ctrl_hw->flush = 1;
+      (void)xip_ctrl_hw->flush; // 読み出しはフラッシュの完了まで待ちますわ
+    }
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t start = rp2040.getCycleCount();
+    fn(i, out);
+    uint32_t elapsed = rp2040.getCycleCount() - start;
+    restore_interrupts(irq);
+    latencyRecord(cycles, elapsed);
+  }
+  Serial.printf("  %-12s min=%lu p50=%lu p99=%lu max=%lu jitter=%lu\r\n", label, static_cast<unsigned long>(cycles.minUs),
+                static_cast<unsigned long>(latencyPercentile(cycles, 500)), static_cast<unsigned long>(latencyPercentile(cycles, 990)),
+                static_cast<unsigned long>(cycles.maxUs), static_cast<unsigned long>(cycles.maxUs - cycles.minUs));
+}
+
+/**
+ * @brief ホットパスをSRAMから実行したときと、フラッシュから実行したときの揺らぎを比べますわ
+ * @details
+ * 同じ処理をキャッシュが温まった状態と、毎回XIPキャッシュを空にした状態で呼び、
+ * 1回あたりのサイクル数の分布 (最小・中央・p99・最大、揺らぎ = 最大 - 最小) を表示しますの。
+ */
+void benchmarkHotPathJitter() {
+  Serial.println("ホットパスの揺らぎのベンチマーク (サイクル/サンプル):");
+  Serial.println(" キャッシュが温まった状態:");
+  benchJitterOne("flash", jitterFromFlash, false);
+  benchJitterOne("sram", jitterFromRam, false);
+  Serial.println(" 毎回XIPキャッシュを空にした状態:");
+  benchJitterOne("flash", jitterFromFlash, true);
+  benchJitterOne("sram", jitterFromRam, true);
+  printHotPathReport(true);
+}
+
+/**
+ * @brief 1レコードを書き込みバッファに追加しますわ
+ * @details 入りきらないときは、先にバッファの中身をSDカードへ書き出しますの。
+ */
+void LOGGER_RAM_FUNC(appendRecord)(const char* data, size_t len) {
+  if (g_writeLen + len > g_config.bufferBytes) {
+    flushWriteBuffer();
+  }
+  memcpy(g_writeBuf + g_writeLen, data, len);
+  g_writeLen += len;
+  g_logStreamBytes += static_cast<uint32_t>(len);
+}
+
+/**
+ * @brief 時刻付きの1行を、リンクが有効なら時刻順の統合を通して書き込みバッファへ送りますわ
+ */
+void appendTimed(uint64_t timeUs, const char* data, size_t len) {
+  if (g_linksActive) {
+    g_merger.push(timeUs, data, len, appendTimedLine);
+  } else {
+    appendTimedLine(data, len);
+  }
+}
+
+/**
+ * @brief 時刻順に並んだ行を書きますわ。索引の区切りなら、その行の位置を索引に入れますの
+ * @details 行の時刻は先頭の欄 (ミリ秒) ですわ。format=rice の索引はサンプルの側で付けますので、ここでは付けませんの。
+ */
+void LOGGER_RAM_FUNC(appendTimedLine)(const char* data, size_t len) {
+  if (!g_riceActive) {
+    uint32_t timeMs = 0;
+    for (size_t i = 0; i < len && data[i] >= '0' && data[i] <= '9'; i++) {
+      timeMs = timeMs * 10 + static_cast<uint32_t>(data[i] - '0');
+    }
+    noteLogIndex(timeMs);
+  }
+  appendText(data, len);
+}
+
+/**
+ * @brief テキストの行を書きますわ。format=rice ではテキストチャンクに包みますの
+ */
+void LOGGER_RAM_FUNC(appendText)(const char* data, size_t len) {
+  if (g_riceActive) {
+    g_rice.addText(data, len);
+  } else {
+    appendRecord(data, len);
+  }
+}
+
+size_t RecordPrint::write(uint8_t c) {
+  appendText(reinterpret_cast<const char*>(&c), 1);
+  return 1;
+}
+
+size_t RecordPrint::write(const uint8_t* buffer, size_t size) {
+  appendText(reinterpret_cast<const char*>(buffer), size);
+  return size;
+}
+
+/** @brief チャンクを置く場所を書き込みバッファに用意しますわ。入りきらなければ先に書き出しますの */
+uint8_t* RiceBufferSink::reserve(size_t maxBytes) {
+  if (g_writeLen + maxBytes > g_config.bufferBytes) {
+    flushWriteBuffer();
+  }
+  return reinterpret_cast<uint8_t*>(g_writeBuf + g_writeLen);
+}
+
+void RiceBufferSink::commit(size_t bytes) {
+  g_writeLen += bytes;
+  g_logStreamBytes += static_cast<uint32_t>(bytes);
+}
+
+/**
+ * @brief 書き込みバッファの中身をSDカードへ書き出しますわ
+ * @details ストライピングでは、ブロックとして担当のカードへ送り、次のバッファに持ち替えますの。
+ */
+void LOGGER_RAM_FUNC(flushWriteBuffer)() {
+  if (g_writeLen == 0 || !logFile) {
+    return;
+  }
+  if (g_stripe.active()) {
+    g_stripe.submit(g_writeLen, writeLogBlock);
+    g_writeBuf = g_stripe.payload();
+  } else {
+    writeLogBlock(reinterpret_cast<const uint8_t*>(g_writeBuf), g_writeLen);
+  }
+  g_writeLen = 0;
+}
+
+/**
+ * @brief ログファイル (ストライピングではカードA) へ書き込み、遅延とエラーを数えますわ
+ */
+void LOGGER_RAM_FUNC(writeLogBlock)(const uint8_t* data, size_t len) {
+  TRACE_SCOPE(TRACE_EV_SD_WRITE, (uint16_t)(len > 0xFFFF ? 0xFFFF : len));
+  unsigned long t0 = micros();
+  // セクタ境界で切り分け、切れ目ごとに期限の来たセンサーを先に通しますの
+  auto write = [](const uint8_t* p, size_t n) { return logFile.write(p, n); };
+  size_t written = g_spiArbiter.writeSliced(logFile.size(), data, len, write);
+  if (written != len) {
+    // 書き切れなかった分は1度だけやり直しますの
+    written += g_spiArbiter.writeSliced(logFile.size(), data + written, len - written, write);
+    if (written == len) {
+      g_writeRetries++;
+    } else {
+      g_writeErrors++;
+    }
+  }
+  latencyRecord(g_writeLatency, micros() - t0);
+  g_bytesWritten += written;
+}
+
+/**
+ * @brief SPI1の2枚目のカードを初期化し、ストライピングを始めますわ
+ * @details カードBのファイル名はカードAと同じ番号で拡張子を .s1 にしたものですの。
+ */
+bool beginStripe() {
+  SPI1.setSCK(kLoggerStripePins[0]);
+  SPI1.setTX(kLoggerStripePins[1]);
+  SPI1.setRX(kLoggerStripePins[2]);
+  char secondName[sizeof(logFileName)];
+  strcpy(secondName, logFileName);
+  char* ext = strrchr(secondName, '.');
+  if (ext == nullptr) {
+    return false;
+  }
+  strcpy(ext, ".s1");
+  if (!g_stripe.begin(SPI1, kLoggerStripePins[3], secondName, g_config.bufferBytes)) {
+    return false;
+  }
+  g_writeBuf = g_stripe.payload();
+  Serial.print("ストライピングを開始しましたわ。カードBには '");
+  Serial.print(secondName);
+  Serial.println("' を書きますの。");
+  return true;
+}
+
+/**
+ * @brief 書き込み増幅の集計を表示しますわ
+ * @param prefix 各行の先頭に付ける文字列 (ログに残すときは "# ")
+ */
+void printWriteAmp(Print& out, const char* prefix) {
+  const uint32_t ratio = g_writeAmp.ratioX100();
+  out.printf("%swrite_amp logical=%llu physical=%llu ratio=%lu.%02lu syncs=%lu\r\n", prefix,
+             static_cast<unsigned long long>(g_writeAmp.logicalBytes),
+             static_cast<unsigned long long>(g_writeAmp.totalSectors()) * WA_SECTOR_BYTES, static_cast<unsigned long>(ratio / 100),
+             static_cast<unsigned long>(ratio % 100), static_cast<unsigned long>(g_writeAmp.syncs));
+  out.print(prefix);
+  out.print("write_amp sectors");
+  for (int c = 0; c < WA_CATEGORY_COUNT; c++) {
+    out.printf(" %s=%lu", writeAmpCategoryName(c), static_cast<unsigned long>(g_writeAmp.sectors[c]));
+  }
+  out.print("\r\n");
+}
+
+/**
+ * @brief センサーの読み取りの遅れと、共有SPIバスの調停の統計を表示しますわ
+ * @param prefix 各行の先頭に付ける文字列 (ログに残すときは "# ")
+ */
+void printSpiStats(Print& out, const char* prefix) {
+  const SpiArbiterStats& st = g_spiArbiter.stats();
+  out.printf("%sspi sensor_late_us p50=%lu p99=%lu max=%lu n=%lu slice=%lu\r\n", prefix,
+             static_cast<unsigned long>(latencyPercentile(g_sensorLatency, 500)),
+             static_cast<unsigned long>(latencyPercentile(g_sensorLatency, 990)),
+             static_cast<unsigned long>(g_sensorLatency.count > 0 ? g_sensorLatency.maxUs : 0),
+             static_cast<unsigned long>(g_sensorLatency.count), static_cast<unsigned long>(g_spiArbiter.sliceBytes()));
+  out.print(prefix);
+  out.print("spi");
+  for (int c = 0; c < SPI_CLIENT_COUNT; c++) {
+    out.printf(" %s_grants=%lu %s_hold_max_us=%lu", spiClientName(c), static_cast<unsigned long>(st.grants[c]), spiClientName(c),
+               static_cast<unsigned long>(st.maxHoldUs[c]));
   }
+  out.printf(" slices=%lu preemptions=%lu conflicts=%lu\r\n", static_cast<unsigned long>(st.slices),
+             static_cast<unsigned long>(st.preemptions), static_cast<unsigned long>(st.conflicts));
+}
+
+// ベンチマーク中のセンサーの予定時刻と遅れですの
+uint32_t g_benchNextUs = 0;
+LatencyHistogram g_benchLatency;
+
+/** @brief ベンチマーク用の切れ目の処理ですわ。予定時刻が来ていればセンサーを読み、遅れを数えますの */
+bool benchSensorTick() {
+  const uint32_t now = micros();
+  if (static_cast<int32_t>(now - g_benchNextUs) < 0) {
+    return false;
+  }
+  if (g_config.sensorCsPin != LOGGER_PIN_NONE) {
+    readSpiSensor();
+  }
+  latencyRecord(g_benchLatency, static_cast<uint32_t>(micros()) - g_benchNextUs);
+  g_benchNextUs += g_sampleIntervalUs;
+  if (static_cast<int32_t>(micros() - g_benchNextUs) > 0) {
+    g_benchNextUs = micros() + g_sampleIntervalUs; // 大きく遅れたら数え直しますわ
+  }
+  return true;
+}
+
+/**
+ * @brief カードへ書き続けながらセンサーを読み、読み取りの遅れの最悪値を測りますわ
+ * @details
+ * 一時ファイルへ 8 KB ずつ2秒間書き続け、その間サンプリング周期ごとにセンサーを読みますの。
+ * 切り分けなし (1回の write で 8 KB) と、設定の単位 (spi_slice、0 なら 512) で切り分けた場合の
+ * 遅れの分布 (p50・p99・最大) と、カードが1回にバスを保持した最長時間を比べますわ。
+ * 記録はこの間止まりますので、地上での確認に使ってくださいませ。
+ */
+void benchmarkSpiArbiter() {
+  static uint8_t chunk[8192];
+  memset(chunk, 'x', sizeof(chunk));
+  const char* kBenchFile = "/spi_bench.tmp";
+  const uint32_t slices[2] = {0, g_config.spiSliceBytes != 0 ? g_config.spiSliceBytes : SPI_SECTOR_BYTES};
+  const SpiArbiter::UrgentFn savedUrgent = g_spiArbiter.urgent();
+  const uint32_t savedSlice = g_spiArbiter.sliceBytes();
+  const SpiArbiterStats savedStats = g_spiArbiter.exchangeStats({});
+  Serial.printf("共有SPIバスの負荷試験 (%lu Hz でセンサー、8 KB ずつ2秒間書き込み)%s:\r\n",
+                static_cast<unsigned long>(g_config.sampleHz),
+                g_config.sensorCsPin == LOGGER_PIN_NONE ? " ※sensor_cs が無いので読む機会だけを測りますの" : "");
+  for (uint32_t slice : slices) {
+    StorageFile f = storageOpen(kBenchFile, STORAGE_APPEND);
+    if (!f) {
+      Serial.println("一時ファイルを開けませんでしたわ。");
+      break;
+    }
+    latencyReset(g_benchLatency);
+    g_spiArbiter.resetStats();
+    g_spiArbiter.setSliceBytes(slice);
+    g_spiArbiter.setUrgent(benchSensorTick);
+    g_benchNextUs = micros();
+    const unsigned long start = millis();
+    uint32_t bytes = 0;
+    while (millis() - start < 2000) {
+      bytes += g_spiArbiter.writeSliced(f.size(), chunk, sizeof(chunk), [&](const uint8_t* p, size_t n) { return f.write(p, n); });
+      benchSensorTick();
+    }
+    f.close();
+    storageRemove(kBenchFile);
+    Serial.printf("  slice=%-5lu late_us p50=%lu p99=%lu max=%lu (n=%lu)  card_hold_max_us=%lu  %lu KB/s\r\n",
+                  static_cast<unsigned long>(slice), static_cast<unsigned long>(latencyPercentile(g_benchLatency, 500)),
+                  static_cast<unsigned long>(latencyPercentile(g_benchLatency, 990)), static_cast<unsigned long>(g_benchLatency.maxUs),
+                  static_cast<unsigned long>(g_benchLatency.count),
+                  static_cast<unsigned long>(g_spiArbiter.stats().maxHoldUs[SPI_CLIENT_CARD]),
+                  static_cast<unsigned long>(bytes / 2048));
+  }
+  g_spiArbiter.setSliceBytes(savedSlice);
+  g_spiArbiter.setUrgent(savedUrgent);
+  g_spiArbiter.exchangeStats(savedStats);
+}
+
+/** @brief ログファイルの拡張子ですわ (ストライピングでは .s0、format=rice では .bin、それ以外は .csv) */
+const char* logFileExtension() {
+  if (g_config.stripe) {
+    return "s0";
+  }
+  return g_config.format == FORMAT_RICE ? "bin" : "csv";
+}
+
+uint32_t riceCycleCount() {
+  return rp2040.getCycleCount();
+}
+
+/**
+ * @brief format=rice なら圧縮器を用意しますわ
+ * @details チャンネル 0 は時刻で毎サンプル、データチャンネルはそれぞれの間引き数ごとに1サンプルですの。
+ */
+void beginRice() {
+  g_riceActive = g_config.format == FORMAT_RICE;
+  if (!g_riceActive) {
+    return;
+  }
+  uint16_t steps[1 + LOGGER_CHANNEL_COUNT] = {1};
+  for (int ch = 0; ch < LOGGER_CHANNEL_COUNT; ch++) {
+    steps[ch + 1] = static_cast<uint16_t>(profileDivider<LOGGER_PROFILE>(ch));
+  }
+  g_rice.begin(1 + LOGGER_CHANNEL_COUNT, steps);
+  g_rice.setCycleCounter(riceCycleCount);
+}
+
+/** @brief 溜まりかけのブロックとテキストを書き込みバッファへ出しますの (ブロックはここで区切られますわ) */
+void flushRice() {
+  if (g_riceActive) {
+    g_rice.flush();
+  }
+}
+
+/**
+ * @brief 圧縮の統計 (ビット/サンプルと符号化のサイクル/サンプル) を表示しますわ
+ * @param prefix 各行の先頭に付ける文字列 (ログに残すときは "# ")
+ */
+void printRiceStats(Print& out, const char* prefix) {
+  const RiceLogStats& st = g_rice.stats();
+  const uint32_t samples = st.samples > 0 ? st.samples : 1;
+  const uint32_t bitsX100 = static_cast<uint32_t>(st.encodedBytes * 800 / samples);
+  out.printf("%srice samples=%lu blocks=%lu bytes=%llu bits_per_sample=%lu.%02lu cycles_per_sample=%lu\r\n", prefix,
+             static_cast<unsigned long>(st.samples), static_cast<unsigned long>(st.blocks),
+             static_cast<unsigned long long>(st.encodedBytes), static_cast<unsigned long>(bitsX100 / 100),
+             static_cast<unsigned long>(bitsX100 % 100), static_cast<unsigned long>(st.encodeCycles / samples));
+}
+
+/**
+ * @brief このフライトの目録エントリを「記録中」として書きますわ
+ * @details 電源断で終わったときは、このエントリが次の起動時に「電源断」へ直されますの。
+ */
+void beginFlightCatalog() {
+  const char* ext = strrchr(logFileName, '.');
+  g_flight = flightCatalogNew(static_cast<uint16_t>(g_flightNumber), ext != nullptr ? ext + 1 : "csv");
+  g_flight.startUptimeMs = g_logStartMs;
+  g_flight.sampleHz = static_cast<uint16_t>(g_config.sampleHz);
+  g_flight.flushPolicy = static_cast<uint8_t>(g_config.flushPolicy);
+  g_flight.flags = (g_stripe.active() ? FLIGHT_F_STRIPE : 0) | (g_linksActive ? FLIGHT_F_LINKS : 0) |
+                   (g_eventFile ? FLIGHT_F_CAPTURE : 0);
+  if (flightCatalogWrite(g_flight)) {
+    g_writeAmp.logicalBytes += sizeof(g_flight);
+    g_writeAmp.sectors[WA_INDEX]++;
+  } else {
+    Serial.println("フライト目録に書き込めませんでしたわ…。記録は続けますの。");
+  }
+}
+
+/**
+ * @brief 正常終了したフライトの統計を目録に書きますわ
+ * @param logSizeBytes 閉じる直前のログファイルのサイズ
+ */
+void finishFlightCatalog(uint32_t logSizeBytes) {
+  g_flight.state = FLIGHT_CLEAN;
+  g_flight.durationMs = millis() - g_logStartMs;
+  g_flight.samples = g_sampleIndex;
+  g_flight.sizeBytes = logSizeBytes;
+  g_flight.writeP99Us = latencyPercentile(g_writeLatency, 990);
+  g_flight.writeMaxUs = g_writeLatency.maxUs;
+  g_flight.errors = g_writeErrors;
+  const uint32_t ratio = g_writeAmp.ratioX100();
+  g_flight.waRatioX100 = static_cast<uint16_t>(ratio > 0xFFFF ? 0xFFFF : ratio);
+  if (flightCatalogWrite(g_flight)) {
+    g_writeAmp.logicalBytes += sizeof(g_flight);
+    g_writeAmp.sectors[WA_INDEX]++;
+  } else {
+    Serial.println("フライト目録を更新できませんでしたわ…。");
+  }
+}
+
+/**
+ * @brief ログの最後にトレーラー行を書きますわ
+ * @details
+ * この行があれば、ログは正常に閉じられたということですの (電源断で途切れたログには残りませんわ)。
+ * 書き込み増幅は、この行を書く時点までの集計ですの。最後の close の分は含みませんわ。
+ */
+void writeTrailer() {
+  const uint32_t ratio = g_writeAmp.ratioX100();
+  g_recordOut.printf("# trailer flight=%d samples=%lu duration_ms=%lu bytes=%lu errors=%u retries=%u policy=%s"
+                     " wa_logical=%llu wa_data=%lu wa_fat=%lu wa_dir=%lu wa_index=%lu wa_ratio=%lu.%02lu\r\n",
+                     g_flightNumber, static_cast<unsigned long>(g_sampleIndex), static_cast<unsigned long>(millis() - g_logStartMs),
+                     static_cast<unsigned long>(g_bytesWritten + g_writeLen), static_cast<unsigned>(g_writeErrors), static_cast<unsigned>(g_writeRetries),
+                     flushPolicyName(g_config.flushPolicy), static_cast<unsigned long long>(g_writeAmp.logicalBytes),
+                     static_cast<unsigned long>(g_writeAmp.sectors[WA_DATA]), static_cast<unsigned long>(g_writeAmp.sectors[WA_FAT]),
+                     static_cast<unsigned long>(g_writeAmp.sectors[WA_DIR]), static_cast<unsigned long>(g_writeAmp.sectors[WA_INDEX]),
+                     static_cast<unsigned long>(ratio / 100), static_cast<unsigned long>(ratio % 100));
+}
+
+/**
+ * @brief カードごとのブロック数・バイト数と、カードBの待ち・遅延を表示しますわ
+ */
+void printStripeStats(Print& out) {
+  const StripeStats& st = g_stripe.stats();
+  const LatencyHistogram& lat = g_stripe.secondLatency();
+  out.printf("stripe card0 blocks=%lu bytes=%llu, card1 blocks=%lu bytes=%llu\r\n", static_cast<unsigned long>(st.blocks[0]),
+             static_cast<unsigned long long>(st.bytes[0]), static_cast<unsigned long>(st.blocks[1]),
+             static_cast<unsigned long long>(st.bytes[1]));
+  out.printf("stripe stalls=%lu stall_us=%lu card1_errors=%lu card1_p99_us=%lu card1_max_us=%lu\r\n",
+             static_cast<unsigned long>(st.stalls), static_cast<unsigned long>(st.stallUs),
+             static_cast<unsigned long>(st.secondErrors), static_cast<unsigned long>(latencyPercentile(lat, 990)),
+             static_cast<unsigned long>(lat.maxUs));
+}
+
+/**
+ * @brief ログファイルを閉じて開き直した状態にしますわ
+ * @details
+ * 閉じるのと同じく、ディレクトリエントリとFATを確実にカードへ書き込みますの。
+ * 保存層がハンドルを保持しているので、ディレクトリの検索もクラスタチェーンの
+ * たどり直しも起きませんわ。確定に失敗したときやハンドルを失っていたときは名前で開き直し、
+ * 数回までやり直して、やり直しと失敗の回数は健全性記録に残しますわ。
+ */
+void reopenLogFile() {
+  unsigned long t0 = micros();
+  g_spiArbiter.acquire(SPI_CLIENT_CARD);
+  bool ok = false;
+  for (int attempt = 0; attempt < 3 && !ok; attempt++) {
+    {
+      TRACE_SCOPE(TRACE_EV_SD_OPEN);
+      ok = logFile.reopen();
+    }
+    if (ok && attempt > 0) {
+      g_writeRetries++;
+    }
+  }
+  g_spiArbiter.release(SPI_CLIENT_CARD);
+  latencyRecord(g_writeLatency, micros() - t0);
+  if (!ok) {
+    // 再オープンに失敗した場合の処理
+    g_writeErrors++;
+    Serial.println("ファイルの再オープンに失敗しましたわ！");
+    // ここでエラー処理（例：LEDを点滅させるなど）をすることも考えられます
+  }
+}
+
+/**
+ * @brief このフライトの書き込み統計をカードの健全性記録に追記しますわ
+ */
+void recordCardHealth() {
+  CardHealthFlight flight = {};
+  flight.flightNumber = static_cast<uint16_t>(g_flightNumber);
+  flight.bytesWritten = g_bytesWritten;
+  flight.durationS = (millis() - g_logStartMs) / 1000;
+  flight.p50Us = latencyPercentile(g_writeLatency, 500);
+  flight.p99Us = latencyPercentile(g_writeLatency, 990);
+  flight.p999Us = latencyPercentile(g_writeLatency, 999);
+  flight.maxUs = g_writeLatency.maxUs;
+  flight.errors = g_writeErrors;
+  flight.retries = g_writeRetries;
+  if (cardHealthAppend(flight)) {
+    // 記録1件と先頭の累計を書き換え、サイズが変わるのでエントリも書かれますの
+    g_writeAmp.logicalBytes += sizeof(CardHealthFlight) + sizeof(CardHealthHeader);
+    g_writeAmp.sectors[WA_INDEX] += 2;
+    g_writeAmp.sectors[WA_DIR]++;
+    Serial.print("カードの健全性を記録しましたわ (書き込み遅延 p99 ");
+    Serial.print(flight.p99Us);
+    Serial.print(" us, 最大 ");
+    Serial.print(flight.maxUs);
+    Serial.println(" us)。");
+  } else {
+    g_writeErrors++; // 履歴は消さずに残してありますの
+    Serial.println("カードの健全性を記録できませんでしたわ…。履歴はそのまま残してありますの。");
+  }
+}
+
+/**
+ * @brief 設定されたUARTリンクの受信を始めますわ
+ */
+void beginLinks() {
+  for (int i = 0; i < LOGGER_LINK_COUNT; i++) {
+    if (g_config.linkBaud[i] == 0) {
+      continue;
+    }
+    if (g_links[i].begin(kLinkUarts[i], kLoggerLinkPins[i][0], kLoggerLinkPins[i][1], g_config.linkBaud[i])) {
+      g_linksActive = true;
+      Serial.print("UARTリンク ");
+      Serial.print(i + 1);
+      Serial.println(" の受信を開始しましたわ。");
+    } else {
+      Serial.print("UARTリンク ");
+      Serial.print(i + 1);
+      Serial.println(" を開始できませんでしたわ (DMAが足りませんの)。");
+    }
+  }
+}
+
+/**
+ * @brief 各リンクの受信分を取り込み、並べ替えの窓を過ぎた行を書き出しますわ
+ * @details サテライトの行は "時刻,,,リンク番号,チャンネル,値" の形で、ロガーの行と同じCSVに並びますの。
+ */
+void pollLinks() {
+  if (!g_linksActive) {
+    return;
+  }
+  for (int i = 0; i < LOGGER_LINK_COUNT; i++) {
+    g_links[i].poll([i](uint64_t localUs, const LinkRecord& r) {
+      char line[LINK_LINE_MAX];
+      int len = snprintf(line, sizeof(line), "%lu,,,%d,%u,%ld\r\n", static_cast<unsigned long>(localUs / 1000), i + 1,
+                         r.channel, static_cast<long>(r.value));
+      g_merger.push(localUs, line, len, appendTimedLine);
+    });
+  }
+  g_merger.release(time_us_64() - LINK_MERGE_LAG_US, appendTimedLine);
+}
+
+/**
+ * @brief リンクごとの受信量・欠落・時計の推定値を表示しますわ
+ * @param prefix 各行の先頭に付ける文字列 (ログへのコメント行なら "# ")
+ */
+void printLinkStats(Print& out, const char* prefix) {
+  for (int i = 0; i < LOGGER_LINK_COUNT; i++) {
+    if (!g_links[i].active()) {
+      continue;
+    }
+    const LinkStats& s = g_links[i].stats();
+    const UartLinkCounters& c = g_links[i].counters();
+    const LinkClockEstimator& clk = g_links[i].clock();
+    out.printf("%slink%d bytes=%llu rate=%lu B/s frames=%lu crc_err=%lu lost=%lu skipped=%lu overrun=%lu\r\n", prefix, i + 1,
+               static_cast<unsigned long long>(s.bytes), static_cast<unsigned long>(g_links[i].takeBytesPerSecond()),
+               static_cast<unsigned long>(s.frames), static_cast<unsigned long>(s.crcErrors),
+               static_cast<unsigned long>(s.lostFrames), static_cast<unsigned long>(s.skippedBytes),
+               static_cast<unsigned long>(c.overrunBytes));
+    out.printf("%slink%d records=%lu unsynced=%lu rejected=%lu pings=%lu pongs=%lu", prefix, i + 1,
+               static_cast<unsigned long>(c.records), static_cast<unsigned long>(c.unsyncedRecords),
+               static_cast<unsigned long>(c.rejectedRecords), static_cast<unsigned long>(c.pings),
+               static_cast<unsigned long>(c.pongs));
+    out.printf(" offset_us=%lld drift_ppb=%ld min_rtt_us=%lu\r\n",
+               static_cast<long long>(clk.offsetUs()), static_cast<long>(clk.driftPpb()),
+               static_cast<unsigned long>(clk.minDelayUs()));
+  }
+  out.printf("%smerge pending=%u late=%lu forced=%lu\r\n", prefix, g_merger.pending(),
+             static_cast<unsigned long>(g_merger.late()), static_cast<unsigned long>(g_merger.forced()));
+}
+
+/**
+ * @brief 設定されたキャプチャチャンネルを開始し、.evt ファイルを開きますわ
+ * @details
+ * ファイル名はログファイルの拡張子を .evt に替えたものですの (例: /flight_log_001.evt)。
+ * 列は time_us,channel,kind,value で、kind は R/F (立ち上がり/立ち下がり) か
+ * H (周波数モードの1周期分。value は 0.01 Hz 単位の周波数、最後の列がパルス数) ですわ。
+ */
+void beginCapture() {
+  for (int ch = 0; ch < LOGGER_CAPTURE_COUNT; ch++) {
+    uint8_t pin = g_config.capturePin[ch];
+    if (pin == LOGGER_PIN_NONE) {
+      continue;
+    }
+    CaptureMode mode = g_config.captureFreq[ch] ? CAPTURE_FREQ : CAPTURE_EDGES;
+    if (g_capture.begin(ch, pin, mode)) {
+      g_captureAny = true;
+    } else {
+      Serial.print("キャプチャチャンネル ");
+      Serial.print(ch + 1);
+      Serial.println(" を開始できませんでしたわ (PIOかDMAが足りませんの)。");
+    }
+  }
+  if (!g_captureAny) {
+    return;
+  }
+
+  char eventFileName[sizeof(logFileName)];
+  strcpy(eventFileName, logFileName);
+  char* ext = strrchr(eventFileName, '.');
+  if (ext == nullptr) {
+    return;
+  }
+  strcpy(ext, ".evt");
+  if (!g_eventFile.open(eventFileName)) {
+    Serial.println("イベントファイルを開けませんでしたわ…。キャプチャは記録しませんの。");
+    return;
+  }
+  static const char kEventHeader[] = "time_us,channel,kind,value,pulses\r\n";
+  appendEvent(kEventHeader, sizeof(kEventHeader) - 1);
+  flushEventBuffer();
+  g_eventFile.sync();
+  Serial.print("キャプチャを '");
+  Serial.print(eventFileName);
+  Serial.println("' に記録しますわ。");
+}
+
+/**
+ * @brief エッジモードのチャンネルから溜まったイベントを取り出し、1行ずつ書きますわ
+ */
+void LOGGER_RAM_FUNC(drainCapture)() {
+  if (!g_eventFile) {
+    return;
+  }
+  for (int ch = 0; ch < LOGGER_CAPTURE_COUNT; ch++) {
+    if (!g_capture.active(ch) || g_capture.mode(ch) != CAPTURE_EDGES) {
+      continue;
+    }
+    g_capture.drain(ch, [](const CaptureEvent& ev) {
+      char line[40];
+      int len = snprintf(line, sizeof(line), "%llu,%u,%c,,\r\n", static_cast<unsigned long long>(ev.timeUs),
+                         ev.channel + 1, ev.rising ? 'R' : 'F');
+      appendEvent(line, len);
+    });
+  }
+}
+
+/**
+ * @brief 周波数モードのチャンネルを、サンプリング周期ごとに1行として締めくくりますわ
+ */
+void sampleCaptureFrequency() {
+  if (!g_eventFile) {
+    return;
+  }
+  uint64_t nowUs = time_us_64();
+  for (int ch = 0; ch < LOGGER_CAPTURE_COUNT; ch++) {
+    if (!g_capture.active(ch) || g_capture.mode(ch) != CAPTURE_FREQ) {
+      continue;
+    }
+    CaptureFrequency f = g_capture.takeFrequency(ch);
+    char line[56];
+    int len = snprintf(line, sizeof(line), "%llu,%d,H,%lu.%02lu,%lu\r\n", static_cast<unsigned long long>(nowUs), ch + 1,
+                       static_cast<unsigned long>(f.centiHz / 100), static_cast<unsigned long>(f.centiHz % 100),
+                       static_cast<unsigned long>(f.pulses));
+    appendEvent(line, len);
+  }
+}
+
+/**
+ * @brief イベント1行をイベント用バッファに追加しますわ
+ */
+void appendEvent(const char* line, size_t len) {
+  if (g_eventLen + len > sizeof(g_eventBuf)) {
+    flushEventBuffer();
+  }
+  memcpy(g_eventBuf + g_eventLen, line, len);
+  g_eventLen += len;
+}
+
+/**
+ * @brief イベント用バッファを .evt ファイルへ書き出しますわ
+ */
+void flushEventBuffer() {
+  if (g_eventLen == 0 || !g_eventFile) {
+    return;
+  }
+  size_t written = g_eventFile.write(reinterpret_cast<const uint8_t*>(g_eventBuf), g_eventLen);
+  if (written != g_eventLen) {
+    g_writeErrors++;
+  }
+  g_bytesWritten += written;
+  g_eventLen = 0;
+}
+
+/**
+ * @brief シリアルから1文字コマンドを受け付けますわ
+ * @details
+ * - 't': トレースをUSBシリアルへバイナリでダンプしますの
+ * - 'T': トレースをSDカード (ログと同じ番号の .trc ファイル) へダンプしますの
+ * - 'b': エンコーダのベンチマークを実行しますわ
+ * - 'j': ホットパスをSRAMとフラッシュから実行したときの揺らぎを比べますの
+ * - 'm': ホットパスの関数がSRAMに載っているかを表示しますわ
+ * - 'l': UARTリンクの統計 (受信速度・欠落・時計のオフセットとドリフト) を表示しますの
+ * - 'w': 書き込み増幅 (論理バイトと、分類ごとの物理セクタ書き込み数) を表示しますの
+ * - 'k': ストライピングの統計 (カードごとのブロック数、カードBの待ち) を表示しますわ
+ * - 'f': ファイルの一覧を表示しますの
+ * - 'g 名前': ファイルをUSBシリアルへ送りますわ (file_download.h の形式)
+ * - 'e': 稼働・休止の時間と、1サンプルあたりのエネルギーの見積もりを表示しますの
+ * - 'q 開始ms 終了ms [名前]': 索引を使って、ログのその時刻の範囲だけを送りますわ (名前を省けば記録中のログですの)
+ */
+void handleSerialCommand() {
+  if (!Serial.available()) {
+    return;
+  }
+  const int command = Serial.read();
+  switch (command) {
+    case 't':
+      traceDump(Serial);
+      Serial.flush();
+      break;
+    case 'T':
+      dumpTraceToCard();
+      break;
+    case 'b':
+      benchmarkEncoders();
+      break;
+    case 'j':
+      benchmarkHotPathJitter();
+      break;
+    case 'm':
+      printHotPathReport(true);
+      break;
+    case 'w':
+      printWriteAmp(Serial, "");
+      break;
+    case 'a':
+      printSpiStats(Serial, "");
+      benchmarkSpiArbiter();
+      break;
+    case 'k':
+      if (g_stripe.active()) {
+        printStripeStats(Serial);
+      } else {
+        Serial.println("ストライピングは使っていませんわ。");
+      }
+      break;
+    case 'l':
+      if (g_linksActive) {
+        printLinkStats(Serial, "");
+      } else {
+        Serial.println("UARTリンクは設定されていませんわ。");
+      }
+      break;
+    case 'f':
+    case 'g':
+      handleDownloadCommand(command);
+      break;
+    case 'e':
+      printIdleStats(Serial, "");
+      break;
+    case 'q':
+      handleQueryCommand();
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief 'f' (一覧) と 'g 名前' (取り出し) を処理しますの
+ * @details 記録中のログも取り出せますが、最後に確定 (flush) した所までしか見えませんわ。
+ *          シャットダウン後の待機中もここだけは受け付けますの。
+ */
+void handleDownloadCommand(int command) {
+  if (command == 'f') {
+    StorageFile root = storageOpen("/", STORAGE_READ);
+    fileDownloadList(Serial, root);
+    return;
+  }
+  char name[FILE_DOWNLOAD_NAME_MAX];
+  Serial.setTimeout(1000);
+  const size_t n = Serial.readBytesUntil('\n', name, sizeof(name) - 1);
+  name[n] = '\0';
+  const char* path = fileDownloadTrimName(name);
+  StorageFile file = storageOpen(path, STORAGE_READ);
+  if (!file || file.isDirectory()) {
+    Serial.printf("#ERR %s\n", path);
+    return;
+  }
+  fileDownloadSend(Serial, file, path);
+}
+
+/**
+ * @brief ログと同じ番号の .idx を開き、索引の見出しを書きますわ
+ * @details ストライピングではログが2枚のカードに分かれ、ファイルの位置が1つに決まりませんので、索引は作りませんの。
+ */
+void beginLogIndex() {
+  if (g_stripe.active()) {
+    return;
+  }
+  char indexFileName[sizeof(logFileName)];
+  strcpy(indexFileName, logFileName);
+  char* ext = strrchr(indexFileName, '.');
+  if (ext == nullptr) {
+    return;
+  }
+  strcpy(ext, ".idx");
+  if (!g_indexFile.open(indexFileName, WA_INDEX)) {
+    Serial.println("索引ファイルを開けませんでしたわ…。'q' ではファイル全体を送ることになりますの。");
+    return;
+  }
+  const LogIndexHeader header = logIndexHeader(LOG_INDEX_STRIDE_MS);
+  g_indexFile.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+  g_indexFile.sync();
+  g_logIndex = LogIndexBuilder(LOG_INDEX_STRIDE_MS);
+  g_indexLen = 0;
+}
+
+/**
+ * @brief これから書く時刻 timeMs の行が索引の区切りなら、いまの位置をエントリにしますわ
+ * @details format=rice では先に圧縮器を区切って、この時刻より前のサンプルをすべてこの位置より前に出しておきますの。
+ *          そうすればエントリの位置はチャンクの境目になり、そこから読めばこの時刻以降のサンプルがそろいますわ。
+ */
+void LOGGER_RAM_FUNC(noteLogIndex)(uint32_t timeMs) {
+  if (!g_indexFile || !g_logIndex.due(timeMs)) {
+    return;
+  }
+  flushRice();
+  LogIndexEntry entry;
+  g_logIndex.note(timeMs, g_logStreamBytes, &entry);
+  g_indexBuf[g_indexLen++] = entry;
+  if (g_indexLen == LOG_INDEX_BUFFER_ENTRIES) {
+    writeLogIndex();
+  }
+}
+
+/** @brief 溜めたエントリを .idx へ追記しますの (確定は定期フラッシュで行いますわ) */
+void writeLogIndex() {
+  if (g_indexLen == 0 || !g_indexFile) {
+    return;
+  }
+  const size_t bytes = g_indexLen * sizeof(LogIndexEntry);
+  if (g_indexFile.write(reinterpret_cast<const uint8_t*>(g_indexBuf), bytes) != bytes) {
+    g_writeErrors++;
+  }
+  g_indexLen = 0;
+  g_indexDirty = true;
+}
+
+/**
+ * @brief 'q 開始ms 終了ms [名前]' を処理しますの
+ * @details
+ * 索引 (.idx) を二分探索して範囲の始まりと終わりの位置を決め、ログのその部分だけを "#RANGE" で送りますわ
+ * (file_download.h の形式)。カードから読むのはエントリを log2(エントリ数) 回ほどと、送る範囲だけですの。
+ * 範囲の端は索引の間隔 (1秒) の分だけ広くなりますので、受け手が時刻で切りそろえてくださいませ。
+ * 記録中のログなら、ここまでの分と索引を先に確定してから探しますわ。索引が無いログはファイル全体を送りますの。
+ */
+void handleQueryCommand() {
+  char args[FILE_DOWNLOAD_NAME_MAX + 24];
+  Serial.setTimeout(1000);
+  const size_t n = Serial.readBytesUntil('\n', args, sizeof(args) - 1);
+  args[n] = '\0';
+  unsigned long fromMs = 0;
+  unsigned long toMs = 0;
+  char name[FILE_DOWNLOAD_NAME_MAX] = "";
+  const int fields = sscanf(args, "%lu %lu %63s", &fromMs, &toMs, name);
+  if (fields < 2 || toMs < fromMs) {
+    Serial.printf("#ERR %s\n", args);
+    return;
+  }
+  const char* path = fields == 3 ? fileDownloadTrimName(name) : logFileName;
+
+  if (logFile && strcmp(path, logFileName) == 0) {
+    flushRice();
+    flushWriteBuffer();
+    g_spiArbiter.acquire(SPI_CLIENT_CARD);
+    logFile.sync();
+    g_spiArbiter.release(SPI_CLIENT_CARD);
+    if (g_indexFile) {
+      writeLogIndex();
+      g_indexFile.sync();
+      g_indexDirty = false;
+    }
+  }
+
+  char indexPath[FILE_DOWNLOAD_NAME_MAX];
+  strncpy(indexPath, path, sizeof(indexPath) - 5);
+  indexPath[sizeof(indexPath) - 5] = '\0';
+  char* ext = strrchr(indexPath, '.');
+  strcpy(ext != nullptr ? ext : indexPath + strlen(indexPath), ".idx");
+
+  StorageFile log = storageOpen(path, STORAGE_READ);
+  if (!log || log.isDirectory()) {
+    Serial.printf("#ERR %s\n", path);
+    return;
+  }
+  StorageFile index = storageOpen(indexPath, STORAGE_READ);
+  LogIndexHeader header = {};
+  uint32_t count = 0;
+  if (index && index.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header) &&
+      logIndexHeaderValid(header)) {
+    count = (index.size() - sizeof(header)) / header.entryBytes; // 書きかけの半端なエントリは数えませんの
+  } else {
+    Serial.println("索引がありませんので、ファイル全体を送りますわ。");
+  }
+  auto get = [&](uint32_t i) {
+    LogIndexEntry e = {UINT32_MAX, 0};
+    if (!index.seek(sizeof(header) + i * header.entryBytes) ||
+        index.read(reinterpret_cast<uint8_t*>(&e), sizeof(e)) != sizeof(e)) {
+      e = {UINT32_MAX, 0};
+    }
+    return e;
+  };
+  uint32_t start = 0;
+  uint32_t end = 0;
+  logIndexRange(count, static_cast<uint32_t>(fromMs), static_cast<uint32_t>(toMs), log.size(), get, &start, &end);
+  fileDownloadSendRange(Serial, log, path, static_cast<uint32_t>(fromMs), static_cast<uint32_t>(toMs), start, end - start);
+}
+
+/** @brief フラッシュの書き込み・消去の統計を1行で出しますわ (フラッシュのときだけですの) */
+void printFlashStats(Print& out, const char* prefix) {
+#if LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+  const FlashBdStats& st = g_storageFlash.stats();
+  out.printf("%sflash progs=%lu erases=%lu busy_ms=%lu max_op_us=%lu ticks=%lu pending_peak=%u/%u\r\n", prefix,
+             static_cast<unsigned long>(st.progs), static_cast<unsigned long>(st.erases),
+             static_cast<unsigned long>(st.busyUs / 1000), static_cast<unsigned long>(st.maxOpUs),
+             static_cast<unsigned long>(g_storageFlash.ticks()), g_pendingPeak, PENDING_SAMPLES - 1);
+#else
+  (void)out;
+  (void)prefix;
+#endif
+}
+
+/**
+ * @brief サンプルの合間の待機を準備しますわ
+ * @details 割り込みを出さないDMAのリングがあふれないよう、止める時間の上限を決めますの。
+ *          UARTリンクはリングの半分が埋まる時間、キャプチャは IDLE_CAPTURE_MAX_SLEEP_US ですわ。
+ */
+void beginIdle() {
+  if (g_config.idleMode == IDLE_SLEEP && !g_idleSleeper.begin()) {
+    Serial.println("タイマーのアラームが残っていませんので、サンプルの合間も回り続けますわ。");
+    g_config.idleMode = IDLE_POLL;
+  }
+  uint32_t maxSleepUs = IDLE_WINDOW_US;
+  for (int i = 0; i < LOGGER_LINK_COUNT; i++) {
+    if (g_links[i].active()) {
+      const uint32_t halfRingUs = linkWireUs(LINK_RING_BYTES / 2, g_config.linkBaud[i]);
+      maxSleepUs = halfRingUs < maxSleepUs ? halfRingUs : maxSleepUs;
+    }
+  }
+  if (g_captureAny && IDLE_CAPTURE_MAX_SLEEP_US < maxSleepUs) {
+    maxSleepUs = IDLE_CAPTURE_MAX_SLEEP_US;
+  }
+  g_idleSleeper.setMaxSleepUs(maxSleepUs);
+  g_idle.begin(ramTimeUs64(), g_sampleIndex);
+}
+
+/**
+ * @brief 次のサンプルか定期フラッシュの時刻まで、コアを止めますわ (idle=sleep のとき)
+ * @details 書き込みの途中で読んだサンプルが残っていたり、電源断を検知していたりすれば休みませんの。
+ *          idle=poll でも集計だけは続けますので、休止 0 の場合と比べられますわ。
+ */
+void idleUntilNextEvent() {
+  g_idle.roll(ramTimeUs64(), g_sampleIndex);
+  if (g_config.idleMode != IDLE_SLEEP || g_powerOffDetected || g_pendingTail != g_pendingHead) {
+    return;
+  }
+  uint32_t deadlineUs = static_cast<uint32_t>(g_lastSampleUs + g_sampleIntervalUs);
+  const unsigned long sinceFlushMs = millis() - g_lastFlushTime;
+  if (sinceFlushMs >= g_config.flushIntervalMs) {
+    return;
+  }
+  const uint32_t now = ramTimeUs32();
+  // 1回に眠れる長さより先のフラッシュは気にしなくてよいので、掛ける前に切り詰めて桁あふれを防ぎますの
+  uint32_t flushInMs = g_config.flushIntervalMs - sinceFlushMs;
+  const uint32_t maxSleepMs = g_idleSleeper.maxSleepUs() / 1000 + 1;
+  flushInMs = flushInMs < maxSleepMs ? flushInMs : maxSleepMs;
+  const uint32_t flushInUs = flushInMs * 1000;
+  if (static_cast<int32_t>(deadlineUs - now) > static_cast<int32_t>(flushInUs)) {
+    deadlineUs = now + flushInUs;
+  }
+  g_idle.addSleep(g_idleSleeper.sleepUntil(deadlineUs));
+}
+
+/** @brief 稼働・休止の時間と、1サンプルあたりのエネルギーの見積もりを出しますわ */
+void printIdleStats(Print& out, const char* prefix) {
+  const IdleWindow& total = g_idle.total();
+  const IdleWindow& last = g_idle.last();
+  out.printf("%sidle mode=%s seconds=%lu active_ms=%lu sleep_ms=%lu sleeps=%lu samples=%lu max_sleep_us=%lu\r\n", prefix,
+             idleModeName(g_config.idleMode), static_cast<unsigned long>(g_idle.seconds()),
+             static_cast<unsigned long>(total.activeUs / 1000), static_cast<unsigned long>(total.sleepUs / 1000),
+             static_cast<unsigned long>(total.sleeps), static_cast<unsigned long>(total.samples),
+             static_cast<unsigned long>(g_idleSleeper.maxSleepUs()));
+  // 1秒ごとの稼働率の幅と、直前の1秒の内訳ですの。エネルギーは IDLE_ACTIVE_UA / IDLE_SLEEP_UA からの見積もりですわ
+  out.printf("%sidle duty_permille=%lu min=%lu max=%lu last_active_us=%lu last_sleep_us=%lu last_samples=%lu "
+             "energy_nj_per_sample=%lu last=%lu (active_ua=%u sleep_ua=%u supply_mv=%u)\r\n",
+             prefix, static_cast<unsigned long>(idleDutyPermille(total)), static_cast<unsigned long>(g_idle.minDutyPermille()),
+             static_cast<unsigned long>(g_idle.maxDutyPermille()), static_cast<unsigned long>(last.activeUs),
+             static_cast<unsigned long>(last.sleepUs), static_cast<unsigned long>(last.samples),
+             static_cast<unsigned long>(idleEnergyPerSampleNj(total)), static_cast<unsigned long>(idleEnergyPerSampleNj(last)),
+             IDLE_ACTIVE_UA, IDLE_SLEEP_UA, IDLE_SUPPLY_MV);
+}
+
+/**
+ * @brief トレースをSDカードへダンプしますわ
+ * @details ファイル名はログファイルの拡張子を .trc に替えたものですの (例: /flight_log_001.trc)。
+ */
+void dumpTraceToCard() {
+  char traceFileName[sizeof(logFileName)];
+  strcpy(traceFileName, logFileName);
+  char* ext = strrchr(traceFileName, '.');
+  if (ext == nullptr) {
+    return;
+  }
+  strcpy(ext, ".trc");
+
+  StorageFile traceFile = storageOpen(traceFileName, STORAGE_CREATE); // 前回のダンプは上書きしますの
+  if (!traceFile) {
+    Serial.println("トレースファイルを開けませんでしたわ…。");
+    return;
+  }
+  size_t bytes = traceDump(traceFile);
+  traceFile.close();
+  Serial.print("トレースを '");
+  Serial.print(traceFileName);
+  Serial.print("' に書き出しましたわ (");
+  Serial.print(bytes);
+  Serial.println(" バイト)。");
+}
+
+
+//================================================
+//== コア1
+//================================================
+void setup1() {
+}
+
+/**
+ * @brief コア1のループですわ。ストライピング中はカードBへの書き込みを受け持ちますの
+ */
+void loop1() {
+  g_stripe.serviceSecond();
 }
@@ -0,0 +1,68 @@
+// -------------------------------------------------- //
+// This file is autogenerated by pioasm; do not edit! //
+// -------------------------------------------------- //
+
+#pragma once
+
+#if !PICO_NO_HARDWARE
+#include "hardware/pio.h"
+#endif
+
+// ------------ //
+// edge_capture //
+// ------------ //
+
+#define edge_capture_wrap_target 0
+#define edge_capture_wrap 12
+
+static const uint16_t edge_capture_program_instructions[] = {
+            //     .wrap_target
+    0x00c3, //  0: jmp    pin, 3
+    0x0240, //  1: jmp    x--, 0                 [2]
+    0x0000, //  2: jmp    0
+    0x4001, //  3: in     pins, 1
+    0x403f, //  4: in     x, 31
+    0x0046, //  5: jmp    x--, 6
+    0x00cb, //  6: jmp    pin, 11
+    0x4001, //  7: in     pins, 1
+    0x403f, //  8: in     x, 31
+    0x0040, //  9: jmp    x--, 0
+    0x0000, // 10: jmp    0
+    0x0246, // 11: jmp    x--, 6                 [2]
+    0x0006, // 12: jmp    6
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program edge_capture_program = {
+    .instructions = edge_capture_program_instructions,
+    .length = 13,
+    .origin = -1,
+};
+
+static inline pio_sm_config edge_capture_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + edge_capture_wrap_target, offset + edge_capture_wrap);
+    return c;
+}
+
+#include "hardware/clocks.h"
+
+// 1 カウント = 1 us になるよう、4 MHz で動かしますの
+#define EDGE_CAPTURE_TICK_HZ 4000000
+
+static inline void edge_capture_program_init(PIO pio, uint sm, uint offset, uint pin) {
+    pio_sm_config c = edge_capture_program_get_default_config(offset);
+    sm_config_set_in_pins(&c, pin);
+    sm_config_set_jmp_pin(&c, pin);
+    // 左シフト・32ビットで自動プッシュ。RX FIFO を 8 段にして取りこぼしを防ぎますわ
+    sm_config_set_in_shift(&c, false, true, 32);
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+    sm_config_set_clkdiv(&c, (float)clock_get_hz(clk_sys) / EDGE_CAPTURE_TICK_HZ);
+    pio_sm_set_consecutive_pindirs(pio, sm, pin, 1, false);
+    pio_sm_init(pio, sm, offset, &c);
+    // X = 0xFFFFFFFF から数え始めますの
+    pio_sm_exec(pio, sm, pio_encode_mov_not(pio_x, pio_null));
+}
+
+#endif
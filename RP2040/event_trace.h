@@ -0,0 +1,193 @@
+/**
+ * @file event_trace.h
+ * @brief 両コア対応の軽量イベントトレース (バイナリリングバッファ)
+ * @details
+ * サンプリング・整形・SDコマンド・フラッシュ・ISR の開始/終了を
+ * マイクロ秒タイムスタンプ付きでコアごとのリングに記録しますわ。
+ * リングはUSBシリアルまたはSDカードへバイナリのままダンプでき、
+ * ホスト側の tools/trace2json.cpp で Chrome/Perfetto 形式のJSONに変換しますの。
+ *
+ * 前半のフォーマット定義部はホストツールからもインクルードされますので、
+ * Arduino依存の記録処理は ARDUINO マクロの内側に閉じ込めておりますわ。
+ *
+ * @section trace_format ダンプ形式 (リトルエンディアン)
+ * - TraceDumpHeader (16 バイト)
+ * - TraceCoreHeader × coreCount (各 8 バイト)
+ * - TraceRecord × (各コアの count の合計)。コア0、コア1の順に古いものから並びますの
+ */
+#pragma once
+#include <stdint.h>
+
+//================================================
+//== ダンプ形式 (ホストと共有)
+//================================================
+#define TRACE_DUMP_MAGIC   0x31435254UL // "TRC1"
+#define TRACE_DUMP_VERSION 1
+#define TRACE_CORE_COUNT   2
+
+/** @brief 記録するイベントの種類ですわ。番号はダンプ形式の一部ですので、追加は末尾にお願いしますの */
+enum TraceEventId : uint8_t {
+  TRACE_EV_SAMPLE = 1,   ///< logData() 全体
+  TRACE_EV_ENCODE,       ///< 1レコードの文字列整形
+  TRACE_EV_SD_WRITE,     ///< File::write()
+  TRACE_EV_SD_OPEN,      ///< SD.open()
+  TRACE_EV_SD_CLOSE,     ///< File::close()
+  TRACE_EV_SD_FLUSH,     ///< File::flush()
+  TRACE_EV_FLUSH,        ///< loop() の定期フラッシュ処理全体
+  TRACE_EV_ISR_POWER,    ///< 電源OFF割り込み
+  TRACE_EV_COUNT
+};
+
+/** @brief イベントの位相ですの */
+enum TracePhase : uint8_t {
+  TRACE_PH_BEGIN   = 0,
+  TRACE_PH_END     = 1,
+  TRACE_PH_INSTANT = 2,
+};
+
+/** @brief リングに格納する1イベント (8 バイト) */
+struct TraceRecord {
+  uint32_t timestampUs; ///< time_us_32() の値
+  uint8_t  eventId;     ///< TraceEventId
+  uint8_t  phase;       ///< TracePhase
+  uint16_t arg;         ///< イベント固有の引数 (書き込みバイト数など)
+};
+static_assert(sizeof(TraceRecord) == 8, "TraceRecord must stay 8 bytes");
+
+/** @brief ダンプ先頭のヘッダー */
+struct TraceDumpHeader {
+  uint32_t magic;      ///< TRACE_DUMP_MAGIC
+  uint16_t version;    ///< TRACE_DUMP_VERSION
+  uint16_t recordSize; ///< sizeof(TraceRecord)
+  uint32_t coreCount;  ///< 後続の TraceCoreHeader の数
+  uint32_t reserved;
+};
+
+/** @brief コアごとのヘッダー */
+struct TraceCoreHeader {
+  uint32_t count;   ///< このコアのレコード数
+  uint32_t dropped; ///< リングの上書きやダンプ中で失われたレコード数
+};
+
+/** @brief イベント名を返しますわ (ホスト変換ツール用) */
+inline const char* traceEventName(uint8_t id) {
+  static const char* const names[TRACE_EV_COUNT] = {
+    "?", "sample", "encode", "sd_write", "sd_open", "sd_close", "sd_flush", "flush", "isr_power",
+  };
+  return id < TRACE_EV_COUNT ? names[id] : "?";
+}
+
+//================================================
+//== 記録処理 (RP2040)
+//================================================
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <hardware/sync.h>
+#include <hardware/timer.h>
+#include "ram_func.h"
+
+// 0 にするとトレース処理はすべてコンパイル時に消えますわ
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+// コアあたりのレコード数 (2の冪)。1024件で 8 KB/コアですの
+#ifndef TRACE_RING_RECORDS
+#define TRACE_RING_RECORDS 1024
+#endif
+static_assert((TRACE_RING_RECORDS & (TRACE_RING_RECORDS - 1)) == 0, "TRACE_RING_RECORDS must be a power of two");
+
+#if TRACE_ENABLED
+
+/** @brief コア1つ分のリングですの。書き込むのは自コアだけなので、ISRとの排他だけで足りますわ */
+struct TraceRing {
+  TraceRecord records[TRACE_RING_RECORDS];
+  uint32_t head;    ///< 次に書き込む通し番号
+  uint32_t dropped; ///< ダンプ中に捨てたレコード数
+};
+
+inline TraceRing g_traceRings[TRACE_CORE_COUNT];
+// ダンプ中はリングを凍結して、読み出し中の上書きを防ぎますの
+inline volatile bool g_traceFrozen = false;
+
+/**
+ * @brief イベントを1件記録しますわ
+ * @details ISRからも呼べますの。割り込み禁止区間は数命令だけですわ。
+ */
+LOGGER_RAM_INLINE void traceRecord(TraceEventId id, TracePhase phase, uint16_t arg = 0) {
+  TraceRing& ring = g_traceRings[get_core_num()];
+  uint32_t irq = save_and_disable_interrupts();
+  if (g_traceFrozen) {
+    ring.dropped++;
+  } else {
+    TraceRecord& r = ring.records[ring.head & (TRACE_RING_RECORDS - 1)];
+    r.timestampUs = time_us_32();
+    r.eventId = id;
+    r.phase = phase;
+    r.arg = arg;
+    ring.head++;
+  }
+  restore_interrupts(irq);
+}
+
+/** @brief スコープの開始/終了を記録するためのRAIIヘルパーですの */
+class TraceScope {
+public:
+  // フラッシュの消去中に鳴るアラームからも使いますので、呼び出し側へ必ず展開させますの
+  LOGGER_RAM_INLINE explicit TraceScope(TraceEventId id, uint16_t arg = 0) : _id(id) { traceRecord(id, TRACE_PH_BEGIN, arg); }
+  LOGGER_RAM_INLINE ~TraceScope() { traceRecord(_id, TRACE_PH_END); }
+private:
+  TraceEventId _id;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(id, ...) TraceScope TRACE_CONCAT(_traceScope, __LINE__)(id, ##__VA_ARGS__)
+#define TRACE_INSTANT(id, arg) traceRecord(id, TRACE_PH_INSTANT, arg)
+
+/**
+ * @brief 全コアのリングをダンプ形式で出力しますわ
+ * @param out 出力先 (Serial や SDのFile)
+ * @return 書き出したバイト数
+ * @details ダンプ中はリングを凍結し、その間のイベントは dropped として数えますの。
+ */
+inline size_t traceDump(Print& out) {
+  g_traceFrozen = true;
+
+  TraceDumpHeader header = {TRACE_DUMP_MAGIC, TRACE_DUMP_VERSION, sizeof(TraceRecord), TRACE_CORE_COUNT, 0};
+  size_t written = out.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+
+  uint32_t counts[TRACE_CORE_COUNT];
+  for (int core = 0; core < TRACE_CORE_COUNT; core++) {
+    const TraceRing& ring = g_traceRings[core];
+    counts[core] = ring.head < TRACE_RING_RECORDS ? ring.head : TRACE_RING_RECORDS;
+    TraceCoreHeader ch = {counts[core], ring.dropped + (ring.head - counts[core])};
+    written += out.write(reinterpret_cast<const uint8_t*>(&ch), sizeof(ch));
+  }
+
+  for (int core = 0; core < TRACE_CORE_COUNT; core++) {
+    const TraceRing& ring = g_traceRings[core];
+    uint32_t start = ring.head - counts[core];
+    // リングの折り返しを考慮して、古い順に最大2回の連続書き込みで出力しますの
+    uint32_t first = start & (TRACE_RING_RECORDS - 1);
+    uint32_t n1 = counts[core] < TRACE_RING_RECORDS - first ? counts[core] : TRACE_RING_RECORDS - first;
+    written += out.write(reinterpret_cast<const uint8_t*>(&ring.records[first]), n1 * sizeof(TraceRecord));
+    written += out.write(reinterpret_cast<const uint8_t*>(&ring.records[0]), (counts[core] - n1) * sizeof(TraceRecord));
+  }
+
+  g_traceFrozen = false;
+  return written;
+}
+
+/** @brief リングが静的に確保する RAM のバイト数ですわ (設定の検証で使いますの) */
+inline constexpr uint32_t traceRamBytes() { return sizeof(TraceRing) * TRACE_CORE_COUNT; }
+
+#else // TRACE_ENABLED
+
+#define TRACE_SCOPE(id, ...) do {} while (0)
+#define TRACE_INSTANT(id, arg) do {} while (0)
+inline size_t traceDump(Print&) { return 0; }
+inline constexpr uint32_t traceRamBytes() { return 0; }
+
+#endif // TRACE_ENABLED
+#endif // ARDUINO
@@ -0,0 +1,186 @@
+/**
+ * @file file_download.h
+ * @brief USBシリアルでログを一覧・取り出しするための形式
+ * @details
+ * カードを抜けない機体 (QSPIフラッシュに記録する LOGGER_FS_FLASH など) から、USBケーブルだけで
+ * フライトを取り出すために使う。ロガーのシリアルコマンド 'f'・'g 名前'・'q 開始ms 終了ms' が送り、
+ * ホストでは tools/flash_pull が受け取る。
+ *
+ * @section download_format 形式 (行は '\n' で終わる)
+ * - 一覧: "#LIST\n"、ファイルごとに "<パス> <バイト数>\n"、最後に "#END <件数>\n"
+ * - 取り出し: "#FILE <パス> <バイト数>\n"、続けて生のバイト列、最後に "#END <CRC-32 (16進8桁)>\n"
+ * - 範囲の取り出し ('q 開始ms 終了ms [パス]'): "#RANGE <パス> <開始ms> <終了ms> <オフセット> <バイト数>\n"、
+ *   続けてログのオフセットからの生のバイト列、最後に "#END <CRC-32>\n"。範囲は log_index.h の索引で決まる
+ * - 開けなければ "#ERR <パス>\n"。途中で読めなくなったときは、残りを 0 で埋めてから "#END" の代わりに送る
+ *
+ * CRC-32 は zlib と同じもの (反転多項式 0xEDB88320、初期値と最終値で反転) である。
+ * 前半はArduinoに依存しないので、ホストのツールからもインクルードできる。
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FILE_DOWNLOAD_NAME_MAX 64 ///< パスの最大長 (終端を含む)
+#define FILE_DOWNLOAD_CHUNK    512
+
+/**
+ * @brief CRC-32 を続きから計算する
+ * @param crc 最初は 0。前回の戻り値を渡せば続きを計算する
+ */
+inline uint32_t fileDownloadCrc32(uint32_t crc, const uint8_t* data, size_t len) {
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0u - (crc & 1u)));
+    }
+  }
+  return ~crc;
+}
+
+/**
+ * @brief 受け取ったファイル名の前後の空白を除き、先頭に '/' が無ければ補う
+ * @param name 大きさ FILE_DOWNLOAD_NAME_MAX のバッファ。中身を書き換える
+ * @return 整えたパス
+ */
+inline const char* fileDownloadTrimName(char* name) {
+  char* start = name;
+  while (*start == ' ' || *start == '\t') {
+    start++;
+  }
+  size_t len = strlen(start);
+  while (len > 0 && (start[len - 1] == '\r' || start[len - 1] == ' ' || start[len - 1] == '\t')) {
+    start[--len] = '\0';
+  }
+  if (start[0] != '/') {
+    if (len > FILE_DOWNLOAD_NAME_MAX - 2) {
+      len = FILE_DOWNLOAD_NAME_MAX - 2;
+    }
+    memmove(name + 1, start, len);
+    name[0] = '/';
+    name[len + 1] = '\0';
+    return name;
+  }
+  return start;
+}
+
+/**
+ * @brief "#FILE <パス> <バイト数>" の行を解釈する
+ * @return 解釈できれば true
+ */
+inline bool fileDownloadParseHeader(const char* line, char* path, uint32_t* size) {
+  unsigned long n = 0;
+  char fmt[32];
+  snprintf(fmt, sizeof(fmt), "#FILE %%%ds %%lu", FILE_DOWNLOAD_NAME_MAX - 1);
+  if (sscanf(line, fmt, path, &n) != 2) {
+    return false;
+  }
+  *size = static_cast<uint32_t>(n);
+  return true;
+}
+
+/**
+ * @brief "#RANGE <パス> <開始ms> <終了ms> <オフセット> <バイト数>" の行を解釈する
+ * @return 解釈できれば true
+ */
+inline bool fileDownloadParseRange(const char* line, char* path, uint32_t* fromMs, uint32_t* toMs, uint32_t* offset,
+                                   uint32_t* size) {
+  unsigned long v[4] = {};
+  char fmt[48];
+  snprintf(fmt, sizeof(fmt), "#RANGE %%%ds %%lu %%lu %%lu %%lu", FILE_DOWNLOAD_NAME_MAX - 1);
+  if (sscanf(line, fmt, path, &v[0], &v[1], &v[2], &v[3]) != 5) {
+    return false;
+  }
+  *fromMs = static_cast<uint32_t>(v[0]);
+  *toMs = static_cast<uint32_t>(v[1]);
+  *offset = static_cast<uint32_t>(v[2]);
+  *size = static_cast<uint32_t>(v[3]);
+  return true;
+}
+
+//================================================
+//== 送信 (Arduino専用)
+//================================================
+#ifdef ARDUINO
+#include <Arduino.h>
+#include "storage_backend.h"
+
+/** @brief ディレクトリ直下のファイルを一覧する (サブディレクトリには入らない) */
+inline void fileDownloadList(Print& out, StorageFile& dir) {
+  out.print("#LIST\n");
+  uint32_t count = 0;
+  if (dir && dir.isDirectory()) {
+    for (StorageFile entry = dir.openNextFile(); entry; entry = dir.openNextFile()) {
+      if (!entry.isDirectory()) {
+        out.printf("/%s %lu\n", entry.name(), static_cast<unsigned long>(entry.size()));
+        count++;
+      }
+    }
+  }
+  out.printf("#END %lu\n", static_cast<unsigned long>(count));
+}
+
+/**
+ * @brief ファイルのいまの位置から size バイトを送り、"#END <CRC-32>" で締める
+ * @return 送ったバイト数 (埋めた分を含む)
+ */
+inline uint32_t fileDownloadSendBody(Print& out, StorageFile& file, const char* path, uint32_t size) {
+  uint8_t buf[FILE_DOWNLOAD_CHUNK];
+  uint32_t sent = 0;
+  uint32_t crc = 0;
+  while (sent < size) {
+    const size_t want = size - sent < sizeof(buf) ? size - sent : sizeof(buf);
+    const size_t n = file.read(buf, want);
+    if (n == 0) {
+      break;
+    }
+    out.write(buf, n);
+    crc = fileDownloadCrc32(crc, buf, n);
+    sent += n;
+  }
+  // 読めなくなったら残りを 0 で埋めて受け手が大きさどおりに読めるようにし、末尾を #ERR にする
+  const bool complete = sent == size;
+  memset(buf, 0, sizeof(buf));
+  while (sent < size) {
+    const size_t n = size - sent < sizeof(buf) ? size - sent : sizeof(buf);
+    out.write(buf, n);
+    sent += n;
+  }
+  if (complete) {
+    out.printf("#END %08lx\n", static_cast<unsigned long>(crc));
+  } else {
+    out.printf("#ERR %s\n", path);
+  }
+  out.flush();
+  return sent;
+}
+
+/**
+ * @brief ファイルの中身を、大きさと CRC-32 を添えて送る
+ * @return 送ったバイト数 (埋めた分を含む)
+ * @details 見出しの大きさは開いた時点のもの。送る途中で伸びた分は送らない。
+ */
+inline uint32_t fileDownloadSend(Print& out, StorageFile& file, const char* path) {
+  const uint32_t size = file.size();
+  out.printf("#FILE %s %lu\n", path, static_cast<unsigned long>(size));
+  return fileDownloadSendBody(out, file, path, size);
+}
+
+/**
+ * @brief ファイルの [offset, offset + size) を、時刻の範囲と CRC-32 を添えて送る
+ * @return 送ったバイト数。位置を合わせられなければ 0 ("#ERR" を送る)
+ */
+inline uint32_t fileDownloadSendRange(Print& out, StorageFile& file, const char* path, uint32_t fromMs, uint32_t toMs,
+                                      uint32_t offset, uint32_t size) {
+  if (!file.seek(offset)) {
+    out.printf("#ERR %s\n", path);
+    return 0;
+  }
+  out.printf("#RANGE %s %lu %lu %lu %lu\n", path, static_cast<unsigned long>(fromMs), static_cast<unsigned long>(toMs),
+             static_cast<unsigned long>(offset), static_cast<unsigned long>(size));
+  return fileDownloadSendBody(out, file, path, size);
+}
+
+#endif // ARDUINO
@@ -0,0 +1,332 @@
+/**
+ * @file flash_bd.h
+ * @brief littlefs をNORフラッシュに載せるためのブロックデバイスと、ホスト用のフラッシュエミュレーター
+ * @details
+ * - FlashEmulator: RAM上でNORフラッシュの規則 (書き込みは 1→0 だけ、消去でブロックが 0xFF) を再現する。
+ *   ブロックごとの消去回数と、操作時間の見積もり (ページ書き込み・ブロック消去) を数え、
+ *   指定した回数目の操作の途中で電源を落とせる。ホストでファイルシステムの手順を試すために使う
+ * - flashLfsConfigure(): read/prog/erase/sync を持つ任意のデバイスを lfs_config につなぐ
+ * - FlashQspiDevice (Arduino専用): RP2040 の QSPI フラッシュのうち、arduino-pico の FS 領域
+ *   (ボードメニューの Flash Size で選ぶ "FS" の部分、_FS_start〜_FS_end) を使う
+ *
+ * RP2040 では消去と書き込みの間はXIPが止まり、フラッシュ上のコードを実行できない。
+ * 消去 (4 KB) は典型 45 ms、最悪 400 ms ほどかかるので、その間もサンプリングを止めないように
+ * FlashQspiDevice は次のようにする。
+ * - 書き込み・消去の呼び出しをSRAMに置く (pico-sdk の flash_range_* も SRAM にある)
+ * - 相手のコアはSRAMの中で待たせる (rp2040.idleOtherCore)
+ * - 割り込みは、専用のタイマーアラーム1本だけを残してNVICで止める。アラームは操作の間だけ
+ *   予定時刻に鳴り、登録した tick 関数 (SRAMに置くこと) がサンプルを取ってRAMのリングに溜める。
+ *   リングはロガー側で、最悪の消去時間のあいだのサンプルが入る深さにしておく
+ *
+ * 前半はArduinoに依存しないので、ホストのツール (tools/flashfs_sim.cpp) からもインクルードできる。
+ */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <LittleFS.h> // littlefs 本体 (lfs.h) は arduino-pico の LittleFS ライブラリのものを使う
+#else
+#include "lfs.h"
+#endif
+
+#define FLASH_BD_BLOCK_BYTES 4096 ///< 消去の単位 (QSPIフラッシュのセクタ)
+#define FLASH_BD_PAGE_BYTES  256  ///< 書き込みの単位
+
+// 操作時間の見積もり (W25Q16JV のデータシートの典型値と最大値)
+#define FLASH_BD_PROG_US_TYP   400
+#define FLASH_BD_PROG_US_MAX   3000
+#define FLASH_BD_ERASE_US_TYP  45000
+#define FLASH_BD_ERASE_US_MAX  400000
+
+/** @brief デバイスの操作の統計 */
+struct FlashBdStats {
+  uint32_t reads;
+  uint32_t progs;
+  uint32_t erases;
+  uint64_t busyUs;  ///< 書き込み・消去でXIPが止まっていた時間の合計
+  uint32_t maxOpUs; ///< 1回の書き込み・消去の最長
+};
+
+/**
+ * @brief デバイスを littlefs の設定につなぐ
+ * @tparam Device int read(block, off, void*, size) / prog(block, off, const void*, size) / erase(block) / sync() を持つ型。
+ *         戻り値は 0 (成功) か littlefs のエラーコード
+ */
+template <class Device>
+inline void flashLfsConfigure(lfs_config& cfg, Device& dev, uint32_t blockCount) {
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.context = &dev;
+  cfg.read = [](const lfs_config* c, lfs_block_t block, lfs_off_t off, void* buffer, lfs_size_t size) -> int {
+    return static_cast<Device*>(c->context)->read(block, off, buffer, size);
+  };
+  cfg.prog = [](const lfs_config* c, lfs_block_t block, lfs_off_t off, const void* buffer, lfs_size_t size) -> int {
+    return static_cast<Device*>(c->context)->prog(block, off, buffer, size);
+  };
+  cfg.erase = [](const lfs_config* c, lfs_block_t block) -> int {
+    return static_cast<Device*>(c->context)->erase(block);
+  };
+  cfg.sync = [](const lfs_config* c) -> int {
+    return static_cast<Device*>(c->context)->sync();
+  };
+  cfg.read_size = 1;
+  cfg.prog_size = FLASH_BD_PAGE_BYTES;
+  cfg.block_size = FLASH_BD_BLOCK_BYTES;
+  cfg.block_count = blockCount;
+  cfg.block_cycles = 500;          // この回数ごとにメタデータを別のブロックへ移して、消去を散らす
+  cfg.cache_size = FLASH_BD_PAGE_BYTES;
+  cfg.lookahead_size = 32;         // 256 ブロック分の空き状況を一度に見る
+}
+
+//================================================
+//== ホスト用のフラッシュエミュレーター
+//================================================
+
+/**
+ * @brief NORフラッシュの規則を再現するエミュレーター
+ * @details メモリと消去回数の配列は呼び出し側が用意する (大きさは blockCount ブロック分)。
+ */
+class FlashEmulator {
+public:
+  FlashEmulator(uint8_t* mem, uint32_t* eraseCounts, uint32_t blockCount)
+      : _mem(mem), _eraseCounts(eraseCounts), _blockCount(blockCount) {
+    memset(_mem, 0xFF, static_cast<size_t>(blockCount) * FLASH_BD_BLOCK_BYTES);
+    memset(_eraseCounts, 0, blockCount * sizeof(uint32_t));
+  }
+
+  /** @brief 何回目の書き込み・消去の途中で電源を落とすか (0 で落とさない)。数えるのは今からの回数 */
+  void cutPowerAfter(uint32_t ops) { _cutAt = ops == 0 ? 0 : _ops + ops; }
+  /** @brief 電源を入れ直す。メモリの内容はそのまま残る */
+  void powerOn() {
+    _dead = false;
+    _cutAt = 0;
+  }
+  bool dead() const { return _dead; }
+  /** @brief 最悪の操作時間で見積もるなら true (既定は典型値) */
+  void setWorstCaseTiming(bool worst) { _worst = worst; }
+
+  int read(uint32_t block, uint32_t off, void* buffer, uint32_t size) {
+    if (_dead || !inRange(block, off, size)) {
+      return LFS_ERR_IO;
+    }
+    _stats.reads++;
+    memcpy(buffer, at(block, off), size);
+    return 0;
+  }
+
+  int prog(uint32_t block, uint32_t off, const void* buffer, uint32_t size) {
+    if (_dead || !inRange(block, off, size)) {
+      return LFS_ERR_IO;
+    }
+    const uint8_t* src = static_cast<const uint8_t*>(buffer);
+    uint8_t* dst = at(block, off);
+    // 電源断なら前半だけが書かれる
+    const uint32_t n = tick() ? size : size / 2;
+    for (uint32_t i = 0; i < n; i++) {
+      if ((dst[i] & src[i]) != src[i]) {
+        _violations++; // 消去せずに 0→1 へ戻そうとした (ファイルシステムの誤り)
+      }
+      dst[i] &= src[i];
+    }
+    _stats.progs++;
+    account(((size + FLASH_BD_PAGE_BYTES - 1) / FLASH_BD_PAGE_BYTES) *
+            static_cast<uint32_t>(_worst ? FLASH_BD_PROG_US_MAX : FLASH_BD_PROG_US_TYP));
+    return _dead ? LFS_ERR_IO : 0;
+  }
+
+  int erase(uint32_t block) {
+    if (_dead || block >= _blockCount) {
+      return LFS_ERR_IO;
+    }
+    // 電源断なら前半だけが消える
+    const bool complete = tick();
+    memset(at(block, 0), 0xFF, complete ? FLASH_BD_BLOCK_BYTES : FLASH_BD_BLOCK_BYTES / 2);
+    _eraseCounts[block]++;
+    _stats.erases++;
+    account(_worst ? FLASH_BD_ERASE_US_MAX : FLASH_BD_ERASE_US_TYP);
+    return _dead ? LFS_ERR_IO : 0;
+  }
+
+  int sync() { return _dead ? LFS_ERR_IO : 0; }
+
+  const FlashBdStats& stats() const { return _stats; }
+  /** @brief 消去せずに 1 へ戻そうとした書き込みのバイト数 (0 のはず) */
+  uint32_t violations() const { return _violations; }
+  uint32_t ops() const { return _ops; }
+  uint32_t blockCount() const { return _blockCount; }
+  uint32_t maxBlockErases() const {
+    uint32_t m = 0;
+    for (uint32_t b = 0; b < _blockCount; b++) {
+      m = _eraseCounts[b] > m ? _eraseCounts[b] : m;
+    }
+    return m;
+  }
+
+private:
+  bool inRange(uint32_t block, uint32_t off, uint32_t size) const {
+    return block < _blockCount && off + size <= FLASH_BD_BLOCK_BYTES;
+  }
+  uint8_t* at(uint32_t block, uint32_t off) { return _mem + static_cast<size_t>(block) * FLASH_BD_BLOCK_BYTES + off; }
+  /** @brief 操作を1回数える。ここで電源が落ちるなら false */
+  bool tick() {
+    _ops++;
+    if (_cutAt != 0 && _ops >= _cutAt) {
+      _dead = true;
+      return false;
+    }
+    return true;
+  }
+  void account(uint32_t us) {
+    _stats.busyUs += us;
+    _stats.maxOpUs = us > _stats.maxOpUs ? us : _stats.maxOpUs;
+  }
+
+  uint8_t* _mem;
+  uint32_t* _eraseCounts;
+  uint32_t _blockCount;
+  uint32_t _ops = 0;
+  uint32_t _cutAt = 0;
+  uint32_t _violations = 0;
+  bool _dead = false;
+  bool _worst = false;
+  FlashBdStats _stats = {};
+};
+
+//================================================
+//== RP2040 の QSPI フラッシュ (Arduino専用)
+//================================================
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <hardware/flash.h>
+#include <hardware/irq.h>
+#include <hardware/timer.h>
+#include <hardware/structs/timer.h>
+#include <hardware/regs/addressmap.h>
+#include <hardware/regs/m0plus.h>
+#include "ram_func.h"
+
+// arduino-pico のリンカースクリプトが置く FS 領域の両端
+extern "C" uint8_t _FS_start;
+extern "C" uint8_t _FS_end;
+
+class FlashQspiDevice {
+public:
+  /** @brief 操作の間にアラームで呼ぶ関数。SRAMに置き、次に呼んでほしい時刻 (time_us_32) を返す */
+  using TickFn = uint32_t (*)();
+
+  /**
+   * @brief FS 領域を調べ、操作中に使うタイマーアラームを確保する
+   * @return FS 領域が無い (ボードメニューで FS を 0 にした) か、アラームが取れなければ false
+   */
+  bool begin() {
+    const uintptr_t start = reinterpret_cast<uintptr_t>(&_FS_start);
+    const uintptr_t end = reinterpret_cast<uintptr_t>(&_FS_end);
+    if (end <= start) {
+      return false;
+    }
+    _offset = static_cast<uint32_t>(start - XIP_BASE);
+    _blockCount = static_cast<uint32_t>(end - start) / FLASH_BD_BLOCK_BYTES;
+    if (_alarm < 0) {
+      _alarm = hardware_alarm_claim_unused(false);
+      if (_alarm < 0) {
+        return false;
+      }
+      s_active = this;
+      // pico-sdk の共通のアラーム処理はフラッシュにあるので、IRQ を直接受ける
+      irq_set_exclusive_handler(TIMER_IRQ_0 + _alarm, alarmIsr);
+      hw_set_bits(&timer_hw->inte, 1u << _alarm);
+      irq_set_enabled(TIMER_IRQ_0 + _alarm, true);
+    }
+    return true;
+  }
+
+  /** @brief 操作の間に呼ぶ関数を登録する (nullptr で解除) */
+  void setTick(TickFn fn) { _tick = fn; }
+  uint32_t blockCount() const { return _blockCount; }
+  const FlashBdStats& stats() const { return _stats; }
+  /** @brief 操作の間にアラームで呼んだ回数 */
+  uint32_t ticks() const { return _ticks; }
+
+  int read(uint32_t block, uint32_t off, void* buffer, uint32_t size) {
+    _stats.reads++;
+    memcpy(buffer, reinterpret_cast<const void*>(XIP_BASE + _offset + block * FLASH_BD_BLOCK_BYTES + off), size);
+    return 0;
+  }
+
+  int LOGGER_RAM_FUNC(prog)(uint32_t block, uint32_t off, const void* buffer, uint32_t size) {
+    beginOp();
+    flash_range_program(_offset + block * FLASH_BD_BLOCK_BYTES + off, static_cast<const uint8_t*>(buffer), size);
+    endOp();
+    _stats.progs++;
+    return 0;
+  }
+
+  int LOGGER_RAM_FUNC(erase)(uint32_t block) {
+    beginOp();
+    flash_range_erase(_offset + block * FLASH_BD_BLOCK_BYTES, FLASH_BD_BLOCK_BYTES);
+    endOp();
+    _stats.erases++;
+    return 0;
+  }
+
+  int sync() { return 0; }
+
+private:
+  static volatile uint32_t& nvicIser() { return *reinterpret_cast<volatile uint32_t*>(PPB_BASE + M0PLUS_NVIC_ISER_OFFSET); }
+  static volatile uint32_t& nvicIcer() { return *reinterpret_cast<volatile uint32_t*>(PPB_BASE + M0PLUS_NVIC_ICER_OFFSET); }
+
+  /** @brief XIPを止める前に、相手のコアを待たせ、アラーム以外の割り込みを止める */
+  LOGGER_RAM_INLINE void beginOp() {
+    rp2040.idleOtherCore();
+    const uint32_t keep = _alarm >= 0 ? 1u << (TIMER_IRQ_0 + _alarm) : 0;
+    _savedIrqs = nvicIser();
+    nvicIcer() = _savedIrqs & ~keep;
+    _inOp = true;
+    if (_tick != nullptr && keep != 0) {
+      timer_hw->alarm[_alarm] = _tick();
+    }
+    _opStart = time_us_32();
+  }
+
+  LOGGER_RAM_INLINE void endOp() {
+    const uint32_t us = time_us_32() - _opStart;
+    _inOp = false;
+    if (_alarm >= 0) {
+      timer_hw->armed = 1u << _alarm;
+      timer_hw->intr = 1u << _alarm;
+    }
+    nvicIser() = _savedIrqs;
+    rp2040.resumeOtherCore();
+    _stats.busyUs += us;
+    _stats.maxOpUs = us > _stats.maxOpUs ? us : _stats.maxOpUs;
+  }
+
+  /** @brief 操作の間だけ鳴るアラームですの。tick を呼び、次の予定時刻にかけ直す */
+  static void LOGGER_RAM_FUNC(alarmIsr)() {
+    FlashQspiDevice* self = s_active;
+    timer_hw->intr = 1u << self->_alarm;
+    if (!self->_inOp || self->_tick == nullptr) {
+      return;
+    }
+    self->_ticks++;
+    uint32_t next = self->_tick();
+    // 予定がもう過ぎていれば、少し先にかけ直す (鳴らないまま操作が終わるのを防ぐ)
+    if (static_cast<int32_t>(next - time_us_32()) < 10) {
+      next = time_us_32() + 10;
+    }
+    timer_hw->alarm[self->_alarm] = next;
+  }
+
+  inline static FlashQspiDevice* s_active = nullptr;
+  uint32_t _offset = 0;
+  uint32_t _blockCount = 0;
+  int _alarm = -1;
+  TickFn _tick = nullptr;
+  volatile bool _inOp = false;
+  uint32_t _savedIrqs = 0;
+  uint32_t _opStart = 0;
+  volatile uint32_t _ticks = 0;
+  FlashBdStats _stats = {};
+};
+
+#endif // ARDUINO
@@ -0,0 +1,259 @@
+/**
+ * @file flight_catalog.h
+ * @brief カード上のフライト目録 (/flights.cat)
+ * @details
+ * フライトごとに固定長 (64 バイト) のエントリを1つ持ち、ログファイル名・開始時刻・記録時間・
+ * サンプル数・サイズ・終了の仕方 (正常/電源断) と要約統計を記録する。エントリの位置は
+ * フライト番号で決まる (番号 n は n 番目のスロット) ので、更新は探索なしの1回の書き込みで済み、
+ * 一覧は目録全体 (999 フライトでも 64 KB) を1回読むだけで作れる。
+ *
+ * ロガーは記録を始めるときにエントリを「記録中」で書き、正常終了時に統計を埋めて「正常」にする。
+ * 電源断で「記録中」のまま残ったエントリは、次の起動時にファイルの実サイズを入れて
+ * 「電源断」に直す。testSDcard.cpp の 'C' コマンドで一覧と個別の詳細を表示する。
+ *
+ * @section catalog_format ファイル形式 (リトルエンディアン)
+ * - FlightCatalogHeader (32 バイト)
+ * - FlightCatalogEntry × スロット数 (各 64 バイト。スロット n-1 がフライト番号 n。未使用は state = 0)
+ */
+#pragma once
+#include <stdint.h>
+#include "ram_func.h"
+
+#define FLIGHT_CATALOG_FILE    "/flights.cat"
+#define FLIGHT_CATALOG_MAGIC   0x54414346UL // "FCAT"
+#define FLIGHT_CATALOG_VERSION 1
+
+enum FlightState : uint8_t {
+  FLIGHT_EMPTY = 0, ///< 未使用のスロット
+  FLIGHT_OPEN,      ///< 記録中 (起動時にこのままなら、前回は電源断で途切れた)
+  FLIGHT_CLEAN,     ///< 正常に閉じた (ログの末尾にトレーラー行がある)
+  FLIGHT_DIRTY,     ///< 電源断などで途切れた。サイズは次の起動時に実ファイルから補った
+};
+
+enum FlightFlags : uint8_t {
+  FLIGHT_F_STRIPE = 0x01,  ///< 2枚のカードへストライプした (.s0 / .s1)
+  FLIGHT_F_LINKS = 0x02,   ///< サテライトのレコードを統合した
+  FLIGHT_F_CAPTURE = 0x04, ///< キャプチャの .evt ファイルがある
+};
+
+struct FlightCatalogHeader {
+  uint32_t magic;      ///< FLIGHT_CATALOG_MAGIC
+  uint16_t version;    ///< FLIGHT_CATALOG_VERSION
+  uint16_t recordSize; ///< sizeof(FlightCatalogEntry)
+  uint32_t reserved[6];
+};
+static_assert(sizeof(FlightCatalogHeader) == 32, "FlightCatalogHeader must stay 32 bytes");
+
+struct FlightCatalogEntry {
+  uint16_t flightNumber;  ///< flight_log_XXX の番号
+  uint8_t state;          ///< FlightState
+  uint8_t flags;          ///< FlightFlags
+  char ext[4];            ///< ログファイルの拡張子 ("csv" や "s0")
+  uint32_t startUptimeMs; ///< 記録開始時の起動からの時間 (RTC が無いため)
+  uint32_t durationMs;    ///< 記録時間
+  uint32_t samples;       ///< サンプル数
+  uint32_t sizeBytes;     ///< ログファイルのサイズ
+  uint16_t sampleHz;      ///< サンプリング周波数
+  uint8_t flushPolicy;    ///< FlushPolicy
+  uint8_t reserved0;
+  int32_t valueMin[2];    ///< チャンネルごとの最小値 (記録が無ければ INT32_MAX)
+  int32_t valueMax[2];    ///< チャンネルごとの最大値 (記録が無ければ INT32_MIN)
+  uint32_t writeP99Us;    ///< 書き込み遅延の p99
+  uint32_t writeMaxUs;    ///< 書き込み遅延の最大
+  uint16_t errors;        ///< 書き込み失敗の回数
+  uint16_t waRatioX100;   ///< 書き込み増幅率の100倍
+  uint32_t reserved[2];
+};
+static_assert(sizeof(FlightCatalogEntry) == 64, "FlightCatalogEntry must stay 64 bytes");
+
+inline uint32_t flightCatalogOffset(uint16_t flightNumber) {
+  return sizeof(FlightCatalogHeader) + (flightNumber - 1u) * sizeof(FlightCatalogEntry);
+}
+
+inline const char* flightStateName(uint8_t s) {
+  switch (s) {
+    case FLIGHT_OPEN:  return "open";
+    case FLIGHT_CLEAN: return "clean";
+    case FLIGHT_DIRTY: return "dirty";
+    default:           return "-";
+  }
+}
+
+/** @brief 新しいフライトのエントリを作る (統計は空) */
+inline FlightCatalogEntry flightCatalogNew(uint16_t flightNumber, const char* ext) {
+  FlightCatalogEntry e = {};
+  e.flightNumber = flightNumber;
+  e.state = FLIGHT_OPEN;
+  for (int i = 0; i < 3 && ext[i] != '\0'; i++) {
+    e.ext[i] = ext[i];
+  }
+  for (int ch = 0; ch < 2; ch++) {
+    e.valueMin[ch] = INT32_MAX;
+    e.valueMax[ch] = INT32_MIN;
+  }
+  return e;
+}
+
+/** @brief チャンネルの値を要約統計に加える (サンプリングのホットパスから呼ばれる) */
+LOGGER_RAM_INLINE void flightCatalogNoteValue(FlightCatalogEntry& e, int ch, int32_t v) {
+  if (v < e.valueMin[ch]) e.valueMin[ch] = v;
+  if (v > e.valueMax[ch]) e.valueMax[ch] = v;
+}
+
+#ifdef ARDUINO
+#include "storage_backend.h"
+
+/**
+ * @brief 目録を開く。無ければ作る
+ * @details ヘッダーを書き換えることがあるので "r+" で開く。
+ *          開けないときやヘッダーが壊れているときは、過去のエントリを消さないよう手を付けずに無効なハンドルを返す。
+ *          STORAGE_CREATE は中身を空にするので、ファイルが無いときにしか使わない。
+ */
+inline StorageFile flightCatalogOpen() {
+  StorageFile f = storageOpen(FLIGHT_CATALOG_FILE, STORAGE_UPDATE);
+  if (!f) {
+    if (storageExists(FLIGHT_CATALOG_FILE)) {
+      return StorageFile();
+    }
+    f = storageOpen(FLIGHT_CATALOG_FILE, STORAGE_CREATE);
+  }
+  if (!f) {
+    return f;
+  }
+  FlightCatalogHeader h = {};
+  if (f.size() == 0) {
+    // 作ったばかりか、ヘッダーを書く前に電源が落ちた空のファイル。消えるものは無いので書き直してよい
+    h = {FLIGHT_CATALOG_MAGIC, FLIGHT_CATALOG_VERSION, sizeof(FlightCatalogEntry), {}};
+    if (f.write(reinterpret_cast<const uint8_t*>(&h), sizeof(h)) != sizeof(h)) {
+      return StorageFile();
+    }
+    return f;
+  }
+  if (f.read(reinterpret_cast<uint8_t*>(&h), sizeof(h)) == sizeof(h) && h.magic == FLIGHT_CATALOG_MAGIC &&
+      h.version == FLIGHT_CATALOG_VERSION && h.recordSize == sizeof(FlightCatalogEntry)) {
+    return f;
+  }
+  return StorageFile();
+}
+
+/**
+ * @brief エントリをフライト番号のスロットへ書く
+ * @details 末尾より先のスロットなら、間を空のエントリで埋めてから書く。
+ */
+inline bool flightCatalogWrite(const FlightCatalogEntry& e) {
+  if (e.flightNumber == 0) {
+    return false;
+  }
+  StorageFile f = flightCatalogOpen();
+  if (!f) {
+    return false;
+  }
+  const uint32_t offset = flightCatalogOffset(e.flightNumber);
+  bool ok = true;
+  if (f.size() < offset) {
+    static const FlightCatalogEntry kEmpty = {};
+    f.seek(f.size());
+    for (uint32_t pos = f.size(); ok && pos < offset; pos += sizeof(kEmpty)) {
+      ok = f.write(reinterpret_cast<const uint8_t*>(&kEmpty), sizeof(kEmpty)) == sizeof(kEmpty);
+    }
+  }
+  if (ok) {
+    f.seek(offset);
+    ok = f.write(reinterpret_cast<const uint8_t*>(&e), sizeof(e)) == sizeof(e);
+  }
+  f.close();
+  return ok;
+}
+
+/**
+ * @brief 全スロットを順に読み、使われているエントリごとに fn(const FlightCatalogEntry&) を呼ぶ
+ * @return 使われているエントリの数
+ */
+template <class Fn>
+inline int flightCatalogForEach(Fn&& fn) {
+  StorageFile f = storageOpen(FLIGHT_CATALOG_FILE, STORAGE_READ);
+  if (!f) {
+    return 0;
+  }
+  FlightCatalogHeader h = {};
+  int used = 0;
+  if (f.read(reinterpret_cast<uint8_t*>(&h), sizeof(h)) == sizeof(h) && h.magic == FLIGHT_CATALOG_MAGIC &&
+      h.recordSize == sizeof(FlightCatalogEntry)) {
+    FlightCatalogEntry e;
+    while (f.read(reinterpret_cast<uint8_t*>(&e), sizeof(e)) == sizeof(e)) {
+      if (e.state != FLIGHT_EMPTY) {
+        used++;
+        fn(e);
+      }
+    }
+  }
+  f.close();
+  return used;
+}
+
+/**
+ * @brief フライト番号のエントリを1つだけ読む
+ * @details スロットの位置へ seek して読むので、目録の大きさによらない。
+ * @return 目録が無いか、そのスロットが空なら false
+ */
+inline bool flightCatalogRead(uint16_t flightNumber, FlightCatalogEntry* out) {
+  if (flightNumber == 0) {
+    return false;
+  }
+  StorageFile f = storageOpen(FLIGHT_CATALOG_FILE, STORAGE_READ);
+  if (!f) {
+    return false;
+  }
+  FlightCatalogHeader h = {};
+  bool ok = f.read(reinterpret_cast<uint8_t*>(&h), sizeof(h)) == sizeof(h) && h.magic == FLIGHT_CATALOG_MAGIC &&
+            h.recordSize == sizeof(FlightCatalogEntry) && f.seek(flightCatalogOffset(flightNumber)) &&
+            f.read(reinterpret_cast<uint8_t*>(out), sizeof(*out)) == sizeof(*out) && out->state != FLIGHT_EMPTY &&
+            out->flightNumber == flightNumber;
+  f.close();
+  return ok;
+}
+
+/** @brief エントリのログファイル名 ("/flight_log_012.csv") を作る */
+inline void flightCatalogFileName(const FlightCatalogEntry& e, char* out, size_t size) {
+  char ext[5] = {};
+  for (int i = 0; i < 4 && e.ext[i] != '\0'; i++) {
+    ext[i] = e.ext[i];
+  }
+  snprintf(out, size, "/flight_log_%03u.%s", static_cast<unsigned>(e.flightNumber), ext);
+}
+
+/**
+ * @brief 「記録中」のまま残ったエントリを「電源断」に直し、サイズを実ファイルから補う
+ * @return 直したエントリの数
+ */
+inline int flightCatalogRecover() {
+  FlightCatalogEntry pending[8];
+  int count = 0;
+  int fixed = 0;
+  // 読みながら書くとハンドルが2つ要るので、数件ずつ集めてから直す
+  do {
+    count = 0;
+    flightCatalogForEach([&](const FlightCatalogEntry& e) {
+      if (e.state == FLIGHT_OPEN && count < 8) {
+        pending[count++] = e;
+      }
+    });
+    for (int i = 0; i < count; i++) {
+      char name[32];
+      flightCatalogFileName(pending[i], name, sizeof(name));
+      StorageFile log = storageOpen(name, STORAGE_READ);
+      pending[i].sizeBytes = log ? log.size() : 0;
+      if (log) {
+        log.close();
+      }
+      pending[i].state = FLIGHT_DIRTY;
+      if (!flightCatalogWrite(pending[i])) {
+        return fixed;
+      }
+      fixed++;
+    }
+  } while (count == 8);
+  return fixed;
+}
+
+#endif // ARDUINO
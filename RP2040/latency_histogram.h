@@ -0,0 +1,111 @@
+/**
+ * @file latency_histogram.h
+ * @brief マイクロ秒単位の遅延を集計する固定サイズの対数ヒストグラム
+ * @details
+ * 2の冪ごとの区間を 8 分割したバケットに数えるため、メモリは約 1 KB で一定、
+ * 記録は数命令で済み、パーセンタイルの誤差はバケット幅 (最大 12.5%) に収まる。
+ * 最小値・最大値・合計は正確に保持する。
+ * Arduino に依存しないので、ファームウェアとホストツールの両方で使える。
+ */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "ram_func.h"
+
+#define LATENCY_SUB_BITS    3                                 // 2の冪あたり 2^3 = 8 分割
+#define LATENCY_SUB_BUCKETS (1u << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS     ((32 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+struct LatencyHistogram {
+  uint32_t buckets[LATENCY_BUCKETS];
+  uint32_t count;
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint64_t sumUs;
+};
+
+inline void latencyReset(LatencyHistogram& h) {
+  memset(&h, 0, sizeof(h));
+  h.minUs = UINT32_MAX;
+}
+
+/**
+ * @brief 最上位の1のビット位置 (us は 0 以外)
+ * @details M0+ には CLZ 命令が無く、__builtin_clz は libgcc の __clzsi2 (フラッシュにある) の呼び出しになる。
+ *          フラッシュの消去中にも記録するので、シフトと比較だけの二分探索で求める。
+ */
+LOGGER_RAM_INLINE uint32_t latencyMsbOf(uint32_t us) {
+  uint32_t msb = 0;
+  if (us >= 1u << 16) { us >>= 16; msb += 16; }
+  if (us >= 1u << 8)  { us >>= 8;  msb += 8; }
+  if (us >= 1u << 4)  { us >>= 4;  msb += 4; }
+  if (us >= 1u << 2)  { us >>= 2;  msb += 2; }
+  if (us >= 1u << 1)  { msb += 1; }
+  return msb;
+}
+
+/** @brief 値からバケット番号を求める。8 未満はそのまま、それ以上は指数と上位3ビットで決まる */
+LOGGER_RAM_INLINE uint32_t latencyBucketOf(uint32_t us) {
+  if (us < LATENCY_SUB_BUCKETS) {
+    return us;
+  }
+  uint32_t msb = latencyMsbOf(us);
+  uint32_t sub = (us >> (msb - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1);
+  return (msb - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS + sub;
+}
+
+/** @brief バケットに入る値の上限 (この値以下が入る) */
+inline uint32_t latencyBucketUpper(uint32_t bucket) {
+  if (bucket < LATENCY_SUB_BUCKETS) {
+    return bucket;
+  }
+  uint32_t msb = bucket / LATENCY_SUB_BUCKETS + LATENCY_SUB_BITS - 1;
+  uint32_t sub = bucket % LATENCY_SUB_BUCKETS;
+  uint64_t lower = (static_cast<uint64_t>(LATENCY_SUB_BUCKETS + sub)) << (msb - LATENCY_SUB_BITS);
+  uint64_t upper = lower + (1ull << (msb - LATENCY_SUB_BITS)) - 1;
+  return upper > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(upper);
+}
+
+LOGGER_RAM_INLINE void latencyRecord(LatencyHistogram& h, uint32_t us) {
+  h.buckets[latencyBucketOf(us)]++;
+  h.count++;
+  h.sumUs += us;
+  if (us < h.minUs) h.minUs = us;
+  if (us > h.maxUs) h.maxUs = us;
+}
+
+/**
+ * @brief パーセンタイルを求める
+ * @param permille 千分率 (500 = p50, 999 = p99.9)
+ * @return 該当バケットの上限。ただし最大値を超えることはない
+ */
+inline uint32_t latencyPercentile(const LatencyHistogram& h, uint32_t permille) {
+  if (h.count == 0) {
+    return 0;
+  }
+  // 切り上げで、何件目の値を求めるかを決める
+  uint64_t rank = (static_cast<uint64_t>(h.count) * permille + 999) / 1000;
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (uint32_t b = 0; b < LATENCY_BUCKETS; b++) {
+    seen += h.buckets[b];
+    if (seen >= rank) {
+      uint32_t upper = latencyBucketUpper(b);
+      return upper < h.maxUs ? upper : h.maxUs;
+    }
+  }
+  return h.maxUs;
+}
+
+/** @brief 別のヒストグラムを足し込む */
+inline void latencyMerge(LatencyHistogram& dst, const LatencyHistogram& src) {
+  for (uint32_t b = 0; b < LATENCY_BUCKETS; b++) {
+    dst.buckets[b] += src.buckets[b];
+  }
+  dst.count += src.count;
+  dst.sumUs += src.sumUs;
+  if (src.minUs < dst.minUs) dst.minUs = src.minUs;
+  if (src.maxUs > dst.maxUs) dst.maxUs = src.maxUs;
+}
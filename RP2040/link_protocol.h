@@ -0,0 +1,569 @@
+/**
+ * @file link_protocol.h
+ * @brief サテライト基板からロガーへレコードを送るUARTリンクのフレーム形式と時刻同期
+ * @details
+ * センサー基板 (サテライト) は自分の時計で時刻を付けたレコードをフレームにまとめて送り、
+ * ロガーは定期的な PING/PONG の往復から時計のずれ (オフセット) と進み方の差 (ドリフト) を
+ * 推定して、レコードの時刻をロガーの時間軸へ換算する。
+ * Arduino に依存しないので、ファームウェアとホストの模擬ピア (tools/link_sim.cpp) の両方で使える。
+ *
+ * @section link_frame フレーム形式 (リトルエンディアン)
+ * | バイト | 内容 |
+ * |---|---|
+ * | 0-1 | 同期バイト 0xA5 0x5A |
+ * | 2 | 種別 (LinkFrameType) |
+ * | 3 | ペイロード長 (0～LINK_MAX_PAYLOAD) |
+ * | 4-5 | 送信側の通し番号 (フレームごとに +1。欠落の検出に使う) |
+ * | 6- | ペイロード |
+ * | 末尾2 | CRC-16/CCITT-FALSE (種別からペイロード末尾まで) |
+ *
+ * CRCが合わないときは、同期バイトの次のバイトから同期を探し直すので、
+ * 途中のバイト化けや欠落があっても次のフレームから復帰できる。
+ *
+ * @section link_sync 時刻同期
+ * ロガーが PING (自分の送信時刻 t0) を送り、サテライトは受信時刻 t1 と送信時刻 t2 を付けて
+ * PONG を返す。ロガーの受信時刻を t3 とすると、NTP と同じく
+ * オフセット = ((t1 - t0) + (t2 - t3)) / 2、往復遅延 = (t3 - t0) - (t2 - t1) である。
+ * 遅延の大きい (キューに待たされた) 標本を除いて直線を当てはめ、ドリフトを求める。
+ *
+ * t1 と t3 はフレームを受け終えた時刻なので、そのままでは PONG (20 バイト) と PING (12 バイト) の
+ * 送信時間の差だけ片寄る。受信側は linkWireUs() で各フレームの送信時間を引き、
+ * 両方とも「フレームの先頭が届いた時刻」にそろえてから標本にする。
+ *
+ * @section link_telemetry テレメトリ
+ * 同じフレームで、ロガーから地上へログのチャンク (rice_log.h) をそのまま送れる。チャンクは
+ * ペイロードに収まらないことがあるので、LINK_FRAME_TELEMETRY の断片に分ける。各断片は
+ * u16 チャンク内の位置、u16 チャンクのバイト数、続けてその位置からのバイト列である。
+ * 受信側 (LinkTelemetryAssembler) は位置が続かない断片を見たらそのチャンクを捨てるので、
+ * 欠けた無線でも壊れたチャンクを組み立てることはない。
+ */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+#define LINK_SYNC0         0xA5
+#define LINK_SYNC1         0x5A
+#define LINK_HEADER_BYTES  6
+#define LINK_CRC_BYTES     2
+#define LINK_MAX_PAYLOAD   240
+#define LINK_MAX_FRAME     (LINK_HEADER_BYTES + LINK_MAX_PAYLOAD + LINK_CRC_BYTES)
+#define LINK_RECORD_BYTES  9   // LinkRecord 1件の符号化サイズ
+#define LINK_MAX_RECORDS   (LINK_MAX_PAYLOAD / LINK_RECORD_BYTES)
+#define LINK_PING_FRAME_BYTES (LINK_HEADER_BYTES + 4 + LINK_CRC_BYTES)
+#define LINK_PONG_FRAME_BYTES (LINK_HEADER_BYTES + 12 + LINK_CRC_BYTES)
+#define LINK_TELEMETRY_HEADER_BYTES 4
+#define LINK_TELEMETRY_MAX_DATA  (LINK_MAX_PAYLOAD - LINK_TELEMETRY_HEADER_BYTES)
+#define LINK_TELEMETRY_MAX_CHUNK 4096 // 組み立てられるチャンクの最大バイト数
+
+/** @brief フレームの種別 */
+enum LinkFrameType : uint8_t {
+  LINK_FRAME_RECORDS = 1, ///< サテライト→ロガー: LinkRecord の並び
+  LINK_FRAME_PING    = 2, ///< ロガー→サテライト: u32 t0
+  LINK_FRAME_PONG    = 3, ///< サテライト→ロガー: u32 t0 (そのまま返す), u32 t1, u32 t2
+  LINK_FRAME_TELEMETRY = 4, ///< ロガー→地上: u16 位置, u16 チャンクのバイト数, チャンクの断片
+};
+
+/** @brief サテライトが送る1件のレコード */
+struct LinkRecord {
+  uint32_t remoteUs; ///< サテライトの時計での時刻 (マイクロ秒、32ビットで折り返す)
+  uint8_t channel;   ///< サテライト内のチャンネル番号
+  int32_t value;
+};
+
+//================================================
+//== 符号化の補助
+//================================================
+
+inline void linkPutU16(uint8_t* p, uint16_t v) {
+  p[0] = static_cast<uint8_t>(v);
+  p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+inline void linkPutU32(uint8_t* p, uint32_t v) {
+  for (int i = 0; i < 4; i++) {
+    p[i] = static_cast<uint8_t>(v >> (8 * i));
+  }
+}
+
+inline uint16_t linkGetU16(const uint8_t* p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t linkGetU32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+/** @brief bytes バイトをUART (8N1、1バイト10ビット) で送るのにかかる時間 (マイクロ秒) */
+inline uint32_t linkWireUs(size_t bytes, uint32_t baud) {
+  return static_cast<uint32_t>(static_cast<uint64_t>(bytes) * 10 * 1000000 / baud);
+}
+
+/** @brief CRC-16/CCITT-FALSE (多項式 0x1021、初期値 0xFFFF) */
+inline uint16_t linkCrc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF) {
+  for (size_t i = 0; i < len; i++) {
+    crc ^= static_cast<uint16_t>(data[i]) << 8;
+    for (int b = 0; b < 8; b++) {
+      crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
+/**
+ * @brief 1フレームを組み立てる
+ * @param out LINK_HEADER_BYTES + len + LINK_CRC_BYTES バイト以上のバッファ
+ * @return フレームのバイト数。len が大きすぎれば 0
+ */
+inline size_t linkEncodeFrame(uint8_t* out, LinkFrameType type, uint16_t seq, const uint8_t* payload, size_t len) {
+  if (len > LINK_MAX_PAYLOAD) {
+    return 0;
+  }
+  out[0] = LINK_SYNC0;
+  out[1] = LINK_SYNC1;
+  out[2] = type;
+  out[3] = static_cast<uint8_t>(len);
+  linkPutU16(out + 4, seq);
+  if (len > 0) {
+    memcpy(out + LINK_HEADER_BYTES, payload, len);
+  }
+  linkPutU16(out + LINK_HEADER_BYTES + len, linkCrc16(out + 2, LINK_HEADER_BYTES - 2 + len));
+  return LINK_HEADER_BYTES + len + LINK_CRC_BYTES;
+}
+
+inline void linkEncodeRecord(uint8_t* p, const LinkRecord& r) {
+  linkPutU32(p, r.remoteUs);
+  p[4] = r.channel;
+  linkPutU32(p + 5, static_cast<uint32_t>(r.value));
+}
+
+inline LinkRecord linkDecodeRecord(const uint8_t* p) {
+  return {linkGetU32(p), p[4], static_cast<int32_t>(linkGetU32(p + 5))};
+}
+
+/**
+ * @brief チャンク1つをテレメトリの断片に分け、フレームごとに emit(frame, frameBytes) を呼ぶ
+ * @param seq 最初のフレームの通し番号
+ * @return 次に使う通し番号。チャンクが LINK_TELEMETRY_MAX_CHUNK より大きければ何も送らず seq を返す
+ */
+template <class Emit>
+uint16_t linkSendTelemetry(const uint8_t* chunk, size_t len, uint16_t seq, Emit&& emit) {
+  if (len == 0 || len > LINK_TELEMETRY_MAX_CHUNK) {
+    return seq;
+  }
+  uint8_t payload[LINK_MAX_PAYLOAD];
+  uint8_t frame[LINK_MAX_FRAME];
+  for (size_t pos = 0; pos < len; pos += LINK_TELEMETRY_MAX_DATA) {
+    const size_t n = len - pos < LINK_TELEMETRY_MAX_DATA ? len - pos : LINK_TELEMETRY_MAX_DATA;
+    linkPutU16(payload, static_cast<uint16_t>(pos));
+    linkPutU16(payload + 2, static_cast<uint16_t>(len));
+    memcpy(payload + LINK_TELEMETRY_HEADER_BYTES, chunk + pos, n);
+    emit(static_cast<const uint8_t*>(frame),
+         linkEncodeFrame(frame, LINK_FRAME_TELEMETRY, seq++, payload, LINK_TELEMETRY_HEADER_BYTES + n));
+  }
+  return seq;
+}
+
+//================================================
+//== 受信側のパーサー
+//================================================
+
+/** @brief リンク1本の受信統計 */
+struct LinkStats {
+  uint64_t bytes;       ///< 受信したバイト数
+  uint32_t frames;      ///< CRCが合ったフレーム数
+  uint32_t crcErrors;   ///< CRCが合わなかったフレーム数
+  uint32_t lostFrames;  ///< 通し番号の飛びから数えた欠落フレーム数
+  uint32_t skippedBytes; ///< 同期を探す間に読み捨てたバイト数
+};
+
+/**
+ * @brief バイト列からフレームを切り出す状態機械
+ * @details 受け取ったバイトを1つずつ feed() に渡すと、完成したフレームごとに
+ * fn(type, seq, payload, len) を呼ぶ。
+ */
+class LinkParser {
+public:
+  template <class Fn>
+  void feed(const uint8_t* data, size_t len, Fn&& fn) {
+    _stats.bytes += len;
+    for (size_t i = 0; i < len; i++) {
+      step(data[i], fn);
+      // 壊れたフレームから読み直すバイトがあれば、次の入力より先に処理する
+      while (_replayPos < _replayLen) {
+        step(_replay[_replayPos++], fn);
+      }
+    }
+  }
+
+  const LinkStats& stats() const { return _stats; }
+
+private:
+  template <class Fn>
+  void step(uint8_t b, Fn& fn) {
+    if (_fill == 0) {
+      if (b == LINK_SYNC0) {
+        _buf[_fill++] = b;
+      } else {
+        _stats.skippedBytes++;
+      }
+      return;
+    }
+    if (_fill == 1 && b != LINK_SYNC1) {
+      _stats.skippedBytes++;
+      _fill = 0;
+      step(b, fn); // 0xA5 0xA5 0x5A のように同期が続く場合
+      return;
+    }
+    _buf[_fill++] = b;
+    if (_fill < LINK_HEADER_BYTES) {
+      return;
+    }
+    if (_buf[3] > LINK_MAX_PAYLOAD) {
+      resync();
+      return;
+    }
+    const size_t total = LINK_HEADER_BYTES + _buf[3] + LINK_CRC_BYTES;
+    if (_fill < total) {
+      return;
+    }
+    const size_t crcPos = total - LINK_CRC_BYTES;
+    if (linkGetU16(_buf + crcPos) != linkCrc16(_buf + 2, crcPos - 2)) {
+      _stats.crcErrors++;
+      resync();
+      return;
+    }
+    _stats.frames++;
+    const uint16_t seq = linkGetU16(_buf + 4);
+    if (_haveSeq) {
+      uint16_t gap = static_cast<uint16_t>(seq - _expectedSeq);
+      // 大きく戻った番号は送信側の再起動とみなし、欠落には数えない
+      if (gap < 0x8000) {
+        _stats.lostFrames += gap;
+      }
+    }
+    _haveSeq = true;
+    _expectedSeq = static_cast<uint16_t>(seq + 1);
+    _fill = 0;
+    fn(static_cast<LinkFrameType>(_buf[2]), seq, _buf + LINK_HEADER_BYTES, static_cast<size_t>(_buf[3]));
+  }
+
+  /**
+   * @brief 壊れたフレームの同期バイトの次から読み直す
+   * @details 読み直す分は未処理の読み直しバイトの前に置く。読み直し中に再び壊れても、
+   * 合計はそのときの読み直し分より必ず短くなるので、バッファはフレーム1つ分で足りる。
+   */
+  void resync() {
+    size_t n = _fill - 1;
+    size_t rest = _replayLen - _replayPos;
+    memmove(_replay + n, _replay + _replayPos, rest);
+    memcpy(_replay, _buf + 1, n);
+    _replayPos = 0;
+    _replayLen = n + rest;
+    _fill = 0;
+    _stats.skippedBytes++;
+  }
+
+  uint8_t _buf[LINK_MAX_FRAME];
+  uint8_t _replay[LINK_MAX_FRAME];
+  size_t _replayPos = 0;
+  size_t _replayLen = 0;
+  size_t _fill = 0;
+  uint16_t _expectedSeq = 0;
+  bool _haveSeq = false;
+  LinkStats _stats = {};
+};
+
+/** @brief テレメトリの組み立ての統計 */
+struct LinkTelemetryStats {
+  uint32_t fragments; ///< 受け取った断片の数
+  uint32_t chunks;    ///< 組み立て終えたチャンクの数
+  uint32_t dropped;   ///< 断片が欠けて捨てたチャンクの数
+};
+
+/**
+ * @brief LINK_FRAME_TELEMETRY の断片からチャンクを組み立てる
+ * @details 断片は位置の順に届く前提で、位置が続かなければ組み立て中のチャンクを捨てる。
+ * 位置 0 の断片が来れば、そこから新しいチャンクを始める。
+ */
+class LinkTelemetryAssembler {
+public:
+  /** @brief 断片のペイロードを1つ渡す。チャンクがそろえば onChunk(data, len) を呼ぶ */
+  template <class Fn>
+  void add(const uint8_t* payload, size_t len, Fn&& onChunk) {
+    if (len < LINK_TELEMETRY_HEADER_BYTES) {
+      return;
+    }
+    _stats.fragments++;
+    const uint16_t pos = linkGetU16(payload);
+    const uint16_t total = linkGetU16(payload + 2);
+    const size_t n = len - LINK_TELEMETRY_HEADER_BYTES;
+    if (pos == 0) {
+      if (_fill > 0) {
+        _stats.dropped++;
+      }
+      _fill = 0;
+      _total = total;
+    } else if (_fill == 0 || pos != _fill || total != _total) {
+      // 前の断片が欠けた。組み立て中のものを捨て、次の位置 0 まで待つ
+      if (_fill > 0) {
+        _stats.dropped++;
+      }
+      _fill = 0;
+      return;
+    }
+    if (total == 0 || total > LINK_TELEMETRY_MAX_CHUNK || pos + n > total) {
+      _fill = 0;
+      _stats.dropped++;
+      return;
+    }
+    memcpy(_buf + pos, payload + LINK_TELEMETRY_HEADER_BYTES, n);
+    _fill = pos + n;
+    if (_fill == _total) {
+      _stats.chunks++;
+      _fill = 0;
+      onChunk(static_cast<const uint8_t*>(_buf), static_cast<size_t>(_total));
+    }
+  }
+
+  const LinkTelemetryStats& stats() const { return _stats; }
+
+private:
+  uint8_t _buf[LINK_TELEMETRY_MAX_CHUNK];
+  size_t _fill = 0;
+  size_t _total = 0;
+  LinkTelemetryStats _stats = {};
+};
+
+//================================================
+//== 時刻の展開と時計の推定
+//================================================
+
+/**
+ * @brief 32ビットで折り返す時刻を64ビットに展開する
+ * @details 直前の値から ±35 分以内の変化とみなすので、多少前後して届いても正しく展開できる。
+ * 値を検証してから基準を進めたいときは、peek() で展開して accept() で確定する。
+ */
+class LinkTimeUnwrap {
+public:
+  uint64_t unwrap(uint32_t t) {
+    uint64_t v = peek(t);
+    accept(v);
+    return v;
+  }
+
+  /** @brief 基準を動かさずに展開する */
+  uint64_t peek(uint32_t t) const {
+    if (!_valid) {
+      return t;
+    }
+    int32_t delta = static_cast<int32_t>(t - static_cast<uint32_t>(_last));
+    return _last + delta;
+  }
+
+  /** @brief 展開した値を基準として確定する (前へ進むときだけ) */
+  void accept(uint64_t v) {
+    if (!_valid || v > _last) {
+      _last = v;
+      _valid = true;
+    }
+  }
+
+private:
+  uint64_t _last = 0;
+  bool _valid = false;
+};
+
+#define LINK_CLOCK_WINDOW     16      // 直線の当てはめに使う区間の数
+#define LINK_CLOCK_BUCKET     8       // 1区間の PING/PONG 数。区間ごとに最も遅延の小さい標本を残す
+#define LINK_CLOCK_MIN_SPAN   2000000 // ドリフトを求めるのに必要な標本の時間幅 (マイクロ秒)
+#define LINK_CLOCK_MAX_RTT    1000000 // これより長い往復は壊れたフレームとみなす
+
+/**
+ * @brief PING/PONG の往復からサテライトの時計のオフセットとドリフトを推定する
+ * @details 時刻はすべて64ビットに展開したマイクロ秒。
+ * オフセットは「サテライトの時刻 − ロガーの時刻」である。
+ *
+ * 1回の往復の誤差は受信側の読み出し間隔 (数百マイクロ秒) 程度あるので、数秒の幅では
+ * ppm 単位のドリフトは求まらない。そこで LINK_CLOCK_BUCKET 回ごとに最も往復の速かった標本だけを
+ * 窓に残し、窓全体 (既定で 250 ms × 8 × 16 = 32 秒) に直線を当てはめる。
+ */
+class LinkClockEstimator {
+public:
+  /**
+   * @brief 1回の往復を標本として加える
+   * @param t0 ロガーの PING 送信時刻, t1 サテライトの受信時刻, t2 サテライトの送信時刻, t3 ロガーの受信時刻
+   * @return ありえない往復 (負、または長すぎる) なら捨てて false
+   */
+  bool addSample(uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3) {
+    int64_t roundTrip = static_cast<int64_t>(t3 - t0) - static_cast<int64_t>(t2 - t1);
+    if (roundTrip < 0 || roundTrip > LINK_CLOCK_MAX_RTT) {
+      return false;
+    }
+    Sample s;
+    s.localUs = t0 + static_cast<uint64_t>(roundTrip / 2);
+    s.offsetUs = (static_cast<int64_t>(t1 - t0) + static_cast<int64_t>(t2 - t3)) / 2;
+    s.delayUs = static_cast<uint32_t>(roundTrip);
+
+    // 開いている区間の最良の標本を、窓の最新の位置に置く
+    if (_bucketFill == 0) {
+      if (_count < LINK_CLOCK_WINDOW) {
+        _count++;
+      }
+      _samples[_next] = s;
+    } else if (s.delayUs < _samples[_next].delayUs) {
+      _samples[_next] = s;
+    }
+    if (++_bucketFill == LINK_CLOCK_BUCKET) {
+      _bucketFill = 0;
+      _newest = _next;
+      _next = (_next + 1) % LINK_CLOCK_WINDOW;
+    } else {
+      _newest = _next;
+    }
+    fit();
+    return true;
+  }
+
+  bool synced() const { return _count > 0; }
+  /** @brief 最新の当てはめでの、基準時刻におけるオフセット */
+  int64_t offsetUs() const { return _offsetUs; }
+  /** @brief ドリフト (10億分率)。正ならサテライトの時計が速い */
+  int32_t driftPpb() const { return _driftPpb; }
+  /** @brief 窓の中で最小の往復遅延 */
+  uint32_t minDelayUs() const { return _minDelayUs; }
+
+  /** @brief ロガーの時刻 localUs におけるオフセット */
+  int64_t offsetAt(uint64_t localUs) const {
+    int64_t dt = static_cast<int64_t>(localUs - _refUs);
+    return _offsetUs + dt * _driftPpb / 1000000000LL;
+  }
+
+  /** @brief サテライトの時刻をロガーの時間軸へ換算する */
+  uint64_t toLocal(uint64_t remoteUs) const {
+    // オフセットはゆっくりとしか変わらないので、近似したロガー時刻で1回引き直せば十分
+    uint64_t approx = remoteUs - static_cast<uint64_t>(_offsetUs);
+    return remoteUs - static_cast<uint64_t>(offsetAt(approx));
+  }
+
+private:
+  struct Sample {
+    uint64_t localUs;
+    int64_t offsetUs;
+    uint32_t delayUs;
+  };
+
+  /**
+   * @brief 往復遅延の小さい標本だけで直線を当てはめる
+   * @details 遅延が最小値の1.5倍 (最低でも +100 us) を超える標本は、片道だけ待たされて
+   * オフセットが偏っているので使わない。標本の時間幅が LINK_CLOCK_MIN_SPAN に満たない間は
+   * 傾きが安定しないので、ドリフトは前回の値のままにする。
+   */
+  void fit() {
+    _minDelayUs = UINT32_MAX;
+    for (int i = 0; i < _count; i++) {
+      if (_samples[i].delayUs < _minDelayUs) {
+        _minDelayUs = _samples[i].delayUs;
+      }
+    }
+    uint32_t margin = _minDelayUs / 2 > 100 ? _minDelayUs / 2 : 100;
+    uint32_t limit = _minDelayUs + margin;
+    const Sample& newest = _samples[_newest];
+    const uint64_t ref = newest.localUs;
+    const int64_t yRef = newest.offsetUs;
+    double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    double xMin = 0, xMax = 0;
+    for (int i = 0; i < _count; i++) {
+      const Sample& s = _samples[i];
+      if (s.delayUs > limit) {
+        continue;
+      }
+      double x = static_cast<double>(static_cast<int64_t>(s.localUs - ref));
+      double y = static_cast<double>(s.offsetUs - yRef);
+      xMin = n == 0 || x < xMin ? x : xMin;
+      xMax = n == 0 || x > xMax ? x : xMax;
+      n += 1;
+      sx += x;
+      sy += y;
+      sxx += x * x;
+      sxy += x * y;
+    }
+    double slope = _driftPpb * 1e-9;
+    double denom = n * sxx - sx * sx;
+    if (n >= 2 && denom > 0 && xMax - xMin >= LINK_CLOCK_MIN_SPAN) {
+      slope = (n * sxy - sx * sy) / denom;
+    }
+    double intercept = n > 0 ? (sy - slope * sx) / n : 0;
+    _refUs = ref;
+    _offsetUs = yRef + static_cast<int64_t>(intercept);
+    _driftPpb = static_cast<int32_t>(slope * 1e9);
+  }
+
+  Sample _samples[LINK_CLOCK_WINDOW] = {};
+  int _count = 0;
+  int _next = 0;
+  int _newest = 0;
+  int _bucketFill = 0;
+  uint64_t _refUs = 0;
+  int64_t _offsetUs = 0;
+  int32_t _driftPpb = 0;
+  uint32_t _minDelayUs = 0;
+};
+
+//================================================
+//== 送信側 (サテライト基板用)
+//================================================
+
+/**
+ * @brief サテライト側でレコードをフレームにまとめ、PING に応答する
+ * @details 送信関数 write(const uint8_t*, size_t) はUARTなど実際の出力先に合わせて渡す。
+ */
+class LinkSender {
+public:
+  /** @brief レコードを1件溜める。フレームが一杯になったら送る */
+  template <class Write>
+  void addRecord(const LinkRecord& r, Write&& write) {
+    linkEncodeRecord(_payload + _records * LINK_RECORD_BYTES, r);
+    if (++_records == LINK_MAX_RECORDS) {
+      flush(write);
+    }
+  }
+
+  /** @brief 溜まっているレコードを送る */
+  template <class Write>
+  void flush(Write&& write) {
+    if (_records == 0) {
+      return;
+    }
+    send(LINK_FRAME_RECORDS, _payload, _records * LINK_RECORD_BYTES, write);
+    _records = 0;
+  }
+
+  /**
+   * @brief 受信したフレームを処理する (PING には PONG を返す)
+   * @param rxUs PING の受信時刻, nowUs 返信する時刻 (サテライトの時計)
+   */
+  template <class Write>
+  void handleFrame(LinkFrameType type, const uint8_t* payload, size_t len, uint32_t rxUs, uint32_t nowUs, Write&& write) {
+    if (type != LINK_FRAME_PING || len < 4) {
+      return;
+    }
+    uint8_t pong[12];
+    memcpy(pong, payload, 4);
+    linkPutU32(pong + 4, rxUs);
+    linkPutU32(pong + 8, nowUs);
+    send(LINK_FRAME_PONG, pong, sizeof(pong), write);
+  }
+
+private:
+  template <class Write>
+  void send(LinkFrameType type, const uint8_t* payload, size_t len, Write& write) {
+    uint8_t frame[LINK_MAX_FRAME];
+    size_t n = linkEncodeFrame(frame, type, _seq++, payload, len);
+    write(frame, n);
+  }
+
+  uint8_t _payload[LINK_MAX_PAYLOAD];
+  size_t _records = 0;
+  uint16_t _seq = 0;
+};
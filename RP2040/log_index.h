@@ -0,0 +1,135 @@
+/**
+ * @file log_index.h
+ * @brief ログの時刻からファイル位置を引くための、まばらな索引 (.idx) の形式ですわ
+ * @details
+ * ログの行 (やチャンク) は時刻順に並んでいますので、一定の時間 (strideMs) ごとに
+ * 「その時刻以降の最初の行がファイルのどこから始まるか」だけを覚えておけば、
+ * 二分探索で時刻の範囲の先頭へ直接飛べますの。ファイル全体を読む必要はありませんわ。
+ *
+ * @section log_index_format 形式 (リトルエンディアン)
+ * - LogIndexHeader (16 バイト) の後に、LogIndexEntry (8 バイト) が時刻順に並びますの
+ * - エントリは追記していくだけですので、途中で電源が切れても、書き終えた所までは使えますわ。
+ *   末尾の半端なバイトは読み手が捨てますの
+ *
+ * ロガーは記録しながら flight_log_XXX.idx を書き、シリアルの 'q' で時刻の範囲だけを取り出すのに使いますわ。
+ * Arduinoに依存しませんので、ホストのツール (tools/log_merge.cpp) でも同じ形式を読み書きしますわ。
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_INDEX_MAGIC     0x3158494CUL // "LIX1"
+#define LOG_INDEX_VERSION   1
+#define LOG_INDEX_STRIDE_MS 1000         // 既定の間隔ですの
+
+struct LogIndexHeader {
+  uint32_t magic;      ///< LOG_INDEX_MAGIC
+  uint16_t version;    ///< LOG_INDEX_VERSION
+  uint16_t entryBytes; ///< sizeof(LogIndexEntry)。読み手はこの長さで読み進めますの
+  uint32_t strideMs;   ///< エントリの間隔 (目安) ですわ
+  uint32_t reserved;
+};
+static_assert(sizeof(LogIndexHeader) == 16, "LogIndexHeader must stay 16 bytes");
+
+struct LogIndexEntry {
+  uint32_t timeMs; ///< この位置から始まる最初の行の時刻
+  uint32_t offset; ///< ログファイルの先頭からのバイト位置
+};
+static_assert(sizeof(LogIndexEntry) == 8, "LogIndexEntry must stay 8 bytes");
+
+inline LogIndexHeader logIndexHeader(uint32_t strideMs) {
+  return {LOG_INDEX_MAGIC, LOG_INDEX_VERSION, static_cast<uint16_t>(sizeof(LogIndexEntry)), strideMs, 0};
+}
+
+inline bool logIndexHeaderValid(const LogIndexHeader& h) {
+  return h.magic == LOG_INDEX_MAGIC && h.version == LOG_INDEX_VERSION && h.entryBytes >= sizeof(LogIndexEntry);
+}
+
+/**
+ * @brief 書きながら、エントリを置く時機を決めますの
+ * @details 行の先頭ごとに note() を呼び、true が返ればその位置をエントリとして書きますわ。
+ *          最初の行と、前のエントリから strideMs 以上進んだ行に置きますの。
+ */
+class LogIndexBuilder {
+public:
+  explicit LogIndexBuilder(uint32_t strideMs = LOG_INDEX_STRIDE_MS) : _strideMs(strideMs) {}
+
+  /** @brief この時刻の行にエントリを置く番かどうかですわ (置く前に区切りたいときに使いますの) */
+  bool due(uint32_t timeMs) const { return _count == 0 || timeMs - _lastMs >= _strideMs; }
+
+  bool note(uint32_t timeMs, uint32_t offset, LogIndexEntry* entry) {
+    if (!due(timeMs)) {
+      return false;
+    }
+    _lastMs = timeMs;
+    _count++;
+    *entry = {timeMs, offset};
+    return true;
+  }
+
+  uint32_t strideMs() const { return _strideMs; }
+  uint32_t count() const { return _count; }
+
+private:
+  uint32_t _strideMs;
+  uint32_t _lastMs = 0;
+  uint32_t _count = 0;
+};
+
+/**
+ * @brief timeMs 以前で最後のエントリを探しますわ
+ * @param get i 番目のエントリを返す関数 (ファイルから読むときは1件ずつ読みますの)
+ * @return 添字。timeMs が最初のエントリより前なら 0、エントリが無ければ -1
+ * @details そこから読み進めれば、timeMs 以降の最初の行に必ず出会えますの。
+ */
+template <class Get>
+long logIndexFind(uint32_t count, uint32_t timeMs, Get&& get) {
+  if (count == 0) {
+    return -1;
+  }
+  uint32_t lo = 0;
+  uint32_t hi = count; // [lo, hi) で、lo は常に timeMs 以前 (または 0) ですの
+  while (hi - lo > 1) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    const LogIndexEntry e = get(mid);
+    if (e.timeMs <= timeMs) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return static_cast<long>(lo);
+}
+
+/**
+ * @brief [fromMs, toMs] の行を含むバイトの範囲を、索引から求めますわ
+ * @param fileSize ログファイルの (見えている) 大きさ
+ * @details 始まりは fromMs 以前で最後のエントリ、終わりは toMs より後の最初のエントリの位置ですの。
+ *          索引が途中で途切れていても (電源断で最後の分を書けなかったときなど)、最後のエントリから
+ *          ファイルの終わりまでを返しますので、範囲の行を取りこぼすことはありませんわ。
+ *          端はエントリの間隔 (strideMs) の分だけ広くなりますので、読み手が時刻で切りそろえますの。
+ */
+template <class Get>
+void logIndexRange(uint32_t count, uint32_t fromMs, uint32_t toMs, uint32_t fileSize, Get&& get, uint32_t* start,
+                   uint32_t* end) {
+  *start = 0;
+  *end = fileSize;
+  if (count == 0) {
+    return;
+  }
+  const long first = logIndexFind(count, fromMs, get);
+  const LogIndexEntry e = get(static_cast<uint32_t>(first));
+  if (e.timeMs <= fromMs) {
+    *start = e.offset < fileSize ? e.offset : fileSize;
+  }
+  const long last = logIndexFind(count, toMs, get);
+  if (static_cast<uint32_t>(last) + 1 < count) {
+    const LogIndexEntry next = get(static_cast<uint32_t>(last) + 1);
+    if (next.offset < *end) {
+      *end = next.offset;
+    }
+  }
+  if (*end < *start) {
+    *end = *start;
+  }
+}
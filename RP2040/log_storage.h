@@ -0,0 +1,201 @@
+/**
+ * @file log_storage.h
+ * @brief ログファイル名の存在キャッシュと、開いたままのハンドルを再利用する保存層ですわ
+ * @details
+ * ファイルの存在確認やオープンは、呼ぶたびにディレクトリを先頭から走査し、
+ * 追記位置までFATのクラスタチェーンをたどり直しますの。ロガーではそれが
+ * 起動時の番号探し (最大999回) と、毎秒の close/reopen で繰り返されていましたわ。
+ *
+ * - LogNameCache: 起動時にルートを1回だけ走査し、flight_log_XXX の番号をビットマップに
+ *   覚えますの。以後の存在確認と空き番号探しはカードを読みませんわ
+ * - LogStorage: ログファイルのハンドルを開いたまま保持しますの。ハンドルはディレクトリ
+ *   エントリの位置と現在のクラスタを覚えているので、「閉じて開き直す」の代わりに
+ *   sync() でエントリとFATを確定すれば、close() と同じ耐久性を検索なしで得られますわ。
+ *   追記位置とファイルサイズもハンドルが覚えているので、末尾へのシークも要りませんの
+ *
+ * ハンドルが失われたとき (カードの一時的な異常など) だけ、名前で開き直しますわ。
+ * 追記と確定のたびに、カードへのセクタ書き込みを write_amp.h の分類で見積もって数えますの。
+ */
+#pragma once
+#include "storage_backend.h"
+#include "write_amp.h"
+
+#define LOG_NAME_PREFIX  "flight_log_"
+#define LOG_MAX_FLIGHTS  999
+
+//================================================
+//== ファイル名キャッシュ
+//================================================
+
+/** @brief ルートにある flight_log_XXX.* の番号を1ビットずつ覚えますの */
+class LogNameCache {
+public:
+  /**
+   * @brief ルートディレクトリを1回だけ走査しますわ
+   * @return 見つけたログファイルの数
+   */
+  int scan() {
+    memset(_bits, 0, sizeof(_bits));
+    int found = 0;
+    StorageFile root = storageOpen("/", STORAGE_READ);
+    if (!root) {
+      return 0;
+    }
+    StorageFile entry;
+    while ((entry = root.openNextFile())) {
+      int n = parseFlightNumber(entry.name());
+      if (n > 0 && !entry.isDirectory()) {
+        if (!has(n)) {
+          found++;
+        }
+        add(n);
+      }
+      entry.close();
+    }
+    root.close();
+    return found;
+  }
+
+  bool has(int n) const {
+    return n >= 1 && n <= LOG_MAX_FLIGHTS && (_bits[n >> 3] & (1u << (n & 7))) != 0;
+  }
+
+  void add(int n) {
+    if (n >= 1 && n <= LOG_MAX_FLIGHTS) {
+      _bits[n >> 3] |= 1u << (n & 7);
+    }
+  }
+
+  /** @brief 使われていない最小の番号ですわ。空きが無ければ 0 ですの */
+  int firstFree() const {
+    for (int n = 1; n <= LOG_MAX_FLIGHTS; n++) {
+      if (!has(n)) {
+        return n;
+      }
+    }
+    return 0;
+  }
+
+  /** @brief "flight_log_012.csv" や "/flight_log_012.trc" から番号を取り出しますの。違えば 0 ですわ */
+  static int parseFlightNumber(const char* name) {
+    const char* slash = strrchr(name, '/');
+    if (slash != nullptr) {
+      name = slash + 1;
+    }
+    const size_t prefixLen = sizeof(LOG_NAME_PREFIX) - 1;
+    if (strncmp(name, LOG_NAME_PREFIX, prefixLen) != 0) {
+      return 0;
+    }
+    int n = 0;
+    const char* p = name + prefixLen;
+    for (int i = 0; i < 3; i++, p++) {
+      if (*p < '0' || *p > '9') {
+        return 0;
+      }
+      n = n * 10 + (*p - '0');
+    }
+    return *p == '.' ? n : 0;
+  }
+
+private:
+  uint8_t _bits[(LOG_MAX_FLIGHTS + 1 + 7) / 8];
+};
+
+//================================================
+//== ログファイルの保存層
+//================================================
+
+class LogStorage {
+public:
+  /**
+   * @brief 追記モードでファイルを開き、ハンドルを保持しますわ
+   * @param category データセクタをどの分類で数えるか (ログ本体なら WA_DATA)
+   */
+  bool open(const char* path, WriteAmpCategory category = WA_DATA) {
+    strncpy(_path, path, sizeof(_path) - 1);
+    _path[sizeof(_path) - 1] = '\0';
+    _category = category;
+    _file = storageOpen(_path, STORAGE_APPEND);
+    if (_file) {
+      _writeAmp.begin(_file.size(), _category);
+    }
+    return static_cast<bool>(_file);
+  }
+
+  explicit operator bool() const { return static_cast<bool>(_file); }
+  StorageFile& file() { return _file; }
+  const char* path() const { return _path; }
+  /** @brief ハンドルが覚えているファイルサイズですの。カードには問い合わせませんわ */
+  uint32_t size() const { return _file.size(); }
+  /** @brief ハンドルを失って名前で開き直した回数ですわ */
+  uint32_t lookupReopens() const { return _lookupReopens; }
+
+  size_t write(const uint8_t* data, size_t len) {
+    size_t written = _file.write(data, len);
+    _writeAmp.onWrite(static_cast<uint32_t>(written));
+    return written;
+  }
+
+  /**
+   * @brief 開いたばかりの空のファイルに、連続したクラスタを先に確保しますわ
+   * @details 確保できるのは SdFat と FatFs のバックエンドだけですの (storage_backend.h)。
+   *          追記のたびのクラスタ探しとFATの更新が無くなり、閉じるときに余りを返しますわ。
+   * @return 確保できれば true
+   */
+  bool preAllocate(uint32_t bytes) {
+    if (!_file.preAllocate(bytes)) {
+      return false;
+    }
+    _writeAmp.onPreAllocate(bytes);
+    return true;
+  }
+
+  /**
+   * @brief ディレクトリエントリとFATを確定しますの (close() と同じ耐久性)
+   * @return カードが確定を受け付けなければ false ですわ
+   */
+  bool sync() {
+    const bool ok = _file.sync();
+    _writeAmp.onSync();
+    return ok;
+  }
+
+  /**
+   * @brief close/reopen 方針の確定処理ですわ
+   * @details
+   * 保持しているハンドルで sync() するだけで、閉じて開き直した直後と同じ状態になりますの。
+   * ハンドルが無効になっていたときだけ、名前で開き直しますわ。
+   * 確定に失敗したハンドルは捨てますので、やり直しの呼び出しでは名前から開き直しますの
+   * (閉じて開き直していた頃と同じく、カードの不調をここで見つけられますわ)。
+   * @return 確定できて、ハンドルが使える状態なら true
+   */
+  bool reopen() {
+    if (_file) {
+      if (sync()) {
+        return true;
+      }
+      _file.close();
+      return false;
+    }
+    _lookupReopens++;
+    _file = storageOpen(_path, STORAGE_APPEND);
+    if (_file) {
+      _writeAmp.begin(_file.size(), _category);
+    }
+    return static_cast<bool>(_file);
+  }
+
+  void close() {
+    if (_file) {
+      _file.close();
+      _writeAmp.onSync();
+    }
+  }
+
+private:
+  StorageFile _file;
+  char _path[32] = "";
+  uint32_t _lookupReopens = 0;
+  WriteAmpCategory _category = WA_DATA;
+  WriteAmpFile _writeAmp;
+};
@@ -0,0 +1,296 @@
+/**
+ * @file log_stripe.h
+ * @brief 2枚のSDカードへログのブロックを交互に書き分けるストライピング (RAID0 相当) ですわ
+ * @details
+ * カード1枚の書き込み速度では足りないとき、書き込みバッファ1杯分を「ブロック」として
+ * 通し番号を付け、偶数番はSPI0のカードA、奇数番はSPI1のカードBへ書きますの。
+ * カードBへの書き込みはコア1が受け持ちますので、コア0がカードAへ書いている間に
+ * カードBも同時に書き進みますわ。SPIの転送はそれぞれのコントローラのDMAで行われますの。
+ *
+ * 各カードのファイル (flight_log_XXX.s0 / .s1) はブロックの並びで、
+ * ホストの tools/stripe_merge.cpp が通し番号順に並べ直して元のログ (CSV) に戻しますわ。
+ *
+ * 前半のフォーマット定義部はホストツールからもインクルードされますので、
+ * Arduino依存の処理は ARDUINO マクロの内側に閉じ込めておりますわ。
+ *
+ * @section stripe_format ブロック形式 (リトルエンディアン)
+ * - StripeBlockHeader (32 バイト)
+ * - ペイロード (payloadBytes バイト。ログのバイト列をそのまま)
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+//================================================
+//== ブロック形式 (ホストと共有)
+//================================================
+#define STRIPE_MAGIC   0x31505453UL // "STP1"
+#define STRIPE_CARDS   2
+
+/** @brief 各ブロックの先頭に置くヘッダーですわ */
+struct StripeBlockHeader {
+  uint32_t magic;        ///< STRIPE_MAGIC
+  uint32_t seq;          ///< 全カードを通したブロックの通し番号 (0 から)
+  uint32_t payloadBytes; ///< ヘッダーに続くペイロードのバイト数
+  uint32_t crc32;        ///< ペイロードの CRC-32 (書きかけのブロックを見分けますの)
+  uint8_t card;          ///< 書いたカードの番号 (seq % cardCount)
+  uint8_t cardCount;     ///< ストライプするカードの数
+  uint16_t headerBytes;  ///< sizeof(StripeBlockHeader)
+  uint32_t reserved[3];
+};
+static_assert(sizeof(StripeBlockHeader) == 32, "StripeBlockHeader must stay 32 bytes");
+
+/** @brief CRC-32 (IEEE 802.3) の表ですわ。コンパイル時に作りますの */
+struct StripeCrcTable {
+  uint32_t v[256];
+  constexpr StripeCrcTable() : v() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      v[i] = c;
+    }
+  }
+};
+inline constexpr StripeCrcTable kStripeCrcTable{};
+
+inline uint32_t stripeCrc32(const uint8_t* data, size_t len) {
+  uint32_t c = 0xFFFFFFFFu;
+  for (size_t i = 0; i < len; i++) {
+    c = kStripeCrcTable.v[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+  }
+  return c ^ 0xFFFFFFFFu;
+}
+
+//================================================
+//== 書き込み処理 (Arduino専用)
+//================================================
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <SPI.h>
+#include <SdFat.h>
+#include <pico/util/queue.h>
+#include "event_trace.h"
+#include "latency_histogram.h"
+
+// ブロック用バッファの数。カードBの書き込みが遅れても、この数だけはコア0が待たずに進めますの
+#ifndef STRIPE_BUFFERS
+#define STRIPE_BUFFERS 4
+#endif
+
+/** @brief コア1への依頼ですわ */
+struct StripeRequest {
+  uint8_t* block; ///< ヘッダー付きのブロック (WRITE のとき)
+  uint8_t op;     ///< StripeOp
+};
+
+enum StripeOp : uint8_t {
+  STRIPE_OP_WRITE = 0,
+  STRIPE_OP_SYNC,
+  STRIPE_OP_CLOSE,
+};
+
+/** @brief ストライピングの統計ですの */
+struct StripeStats {
+  uint32_t blocks[STRIPE_CARDS];   ///< カードごとのブロック数
+  uint64_t bytes[STRIPE_CARDS];    ///< カードごとのバイト数 (ヘッダー込み)
+  uint32_t stalls;                 ///< 空きバッファを待った回数 (カードBが追いついていない印)
+  uint32_t stallUs;                ///< 空きバッファを待った合計時間
+  uint32_t secondErrors;           ///< カードBの書き込み・確定の失敗回数
+};
+
+class LogStripe {
+public:
+  /**
+   * @brief カードBを初期化してファイルを作り、バッファを確保しますわ (コア0から呼びますの)
+   * @param payloadBytes 1ブロックのペイロードの最大バイト数 (書き込みバッファのサイズ)
+   */
+  bool begin(SPIClassRP2040& spi, uint8_t csPin, const char* path, size_t payloadBytes) {
+    if (!_sd.begin(sdfat::SdSpiConfig(csPin, DEDICATED_SPI, SD_SCK_MHZ(50), &spi))) {
+      return false;
+    }
+    if (!_file.open(&_sd, path, O_WRONLY | O_CREAT | O_TRUNC)) {
+      releaseSetup(false);
+      return false;
+    }
+    _blockBytes = sizeof(StripeBlockHeader) + payloadBytes;
+    queue_init(&_toSecond, sizeof(StripeRequest), STRIPE_BUFFERS + 2);
+    queue_init(&_free, sizeof(uint8_t*), STRIPE_BUFFERS);
+    for (int i = 0; i < STRIPE_BUFFERS; i++) {
+      _pool[i] = static_cast<uint8_t*>(malloc(_blockBytes));
+      if (_pool[i] == nullptr) {
+        releaseSetup(true);
+        return false;
+      }
+    }
+    // 1つはコア0が埋める分、残りは空きとして預けておきますの
+    _current = _pool[0];
+    for (int i = 1; i < STRIPE_BUFFERS; i++) {
+      queue_add_blocking(&_free, &_pool[i]);
+    }
+    latencyReset(_secondLatency);
+    _active = true;
+    return true;
+  }
+
+  bool active() const { return _active; }
+  /** @brief いまコア0が埋めているブロックのペイロード部分ですわ */
+  char* payload() { return reinterpret_cast<char*>(_current + sizeof(StripeBlockHeader)); }
+  const StripeStats& stats() const { return _stats; }
+  /** @brief カードBの書き込み遅延ですの。コア1が閉じた後に読んでくださいませ */
+  const LatencyHistogram& secondLatency() const { return _secondLatency; }
+
+  /**
+   * @brief 埋め終えたブロックに番号を付けて、担当のカードへ送りますわ
+   * @param writeFirst カードAへの書き込み関数 (const uint8_t*, size_t)。偶数番のときコア0で呼びますの
+   * @details 奇数番はコア1へ渡し、代わりの空きバッファを受け取りますの。
+   * 空きが無ければカードBが追いつくまで待ちますわ (その回数と時間を数えますの)。
+   */
+  template <class WriteFirst>
+  void submit(size_t payloadBytes, WriteFirst&& writeFirst) {
+    StripeBlockHeader* h = reinterpret_cast<StripeBlockHeader*>(_current);
+    h->magic = STRIPE_MAGIC;
+    h->seq = _seq;
+    h->payloadBytes = static_cast<uint32_t>(payloadBytes);
+    h->card = static_cast<uint8_t>(_seq % STRIPE_CARDS);
+    h->cardCount = STRIPE_CARDS;
+    h->headerBytes = sizeof(StripeBlockHeader);
+    h->reserved[0] = h->reserved[1] = h->reserved[2] = 0;
+    const size_t total = sizeof(StripeBlockHeader) + payloadBytes;
+    _stats.blocks[h->card]++;
+    _stats.bytes[h->card] += total;
+    _seq++;
+
+    if (h->card == 0) {
+      seal(_current);
+      writeFirst(_current, total);
+      return;
+    }
+    // CRC の計算もカードBの書き込みと一緒にコア1で行いますの
+    StripeRequest req = {_current, STRIPE_OP_WRITE};
+    queue_add_blocking(&_toSecond, &req);
+    if (!queue_try_remove(&_free, &_current)) {
+      _stats.stalls++;
+      unsigned long t0 = micros();
+      queue_remove_blocking(&_free, &_current);
+      _stats.stallUs += micros() - t0;
+    }
+  }
+
+  /** @brief カードBのディレクトリエントリとFATの確定を依頼しますわ (待ちませんの) */
+  void requestSync() {
+    StripeRequest req = {nullptr, STRIPE_OP_SYNC};
+    queue_try_add(&_toSecond, &req);
+  }
+
+  /**
+   * @brief カードBのファイルを閉じ、コア1が書き終えるのを待ちますわ
+   * @return 時間内に閉じられれば true
+   */
+  bool close(uint32_t timeoutMs) {
+    if (!_active) {
+      return true;
+    }
+    StripeRequest req = {nullptr, STRIPE_OP_CLOSE};
+    queue_add_blocking(&_toSecond, &req);
+    unsigned long start = millis();
+    while (!_closed) {
+      if (millis() - start >= timeoutMs) {
+        return false;
+      }
+      delay(1);
+    }
+    _active = false;
+    return true;
+  }
+
+  /**
+   * @brief コア1の仕事ですわ。loop1() から呼んでくださいませ
+   * @details 依頼が来るまで眠って待ちますの。
+   */
+  void serviceSecond() {
+    if (!_active) {
+      delay(10);
+      return;
+    }
+    StripeRequest req;
+    queue_remove_blocking(&_toSecond, &req);
+    switch (req.op) {
+      case STRIPE_OP_WRITE: {
+        seal(req.block);
+        const StripeBlockHeader* h = reinterpret_cast<const StripeBlockHeader*>(req.block);
+        const size_t total = sizeof(StripeBlockHeader) + h->payloadBytes;
+        unsigned long t0 = micros();
+        size_t written;
+        {
+          TRACE_SCOPE(TRACE_EV_SD_WRITE, (uint16_t)(total > 0xFFFF ? 0xFFFF : total));
+          written = _file.write(req.block, total);
+        }
+        latencyRecord(_secondLatency, micros() - t0);
+        if (written != total) {
+          _stats.secondErrors++;
+        }
+        queue_add_blocking(&_free, &req.block);
+        break;
+      }
+      case STRIPE_OP_SYNC: {
+        TRACE_SCOPE(TRACE_EV_SD_FLUSH);
+        if (!_file.sync()) {
+          _stats.secondErrors++;
+        }
+        break;
+      }
+      case STRIPE_OP_CLOSE: {
+        TRACE_SCOPE(TRACE_EV_SD_CLOSE);
+        if (!_file.close()) {
+          _stats.secondErrors++;
+        }
+        _closed = true;
+        break;
+      }
+    }
+  }
+
+private:
+  /**
+   * @brief begin() が途中で失敗したとき、用意した分を逆の順で片付けますわ
+   * @param queuesReady キューを作った後の失敗なら true
+   * @details やり直しの begin() が、残ったマウントやキューを二重に作らずに済みますの。
+   */
+  void releaseSetup(bool queuesReady) {
+    for (int i = STRIPE_BUFFERS - 1; i >= 0; i--) {
+      free(_pool[i]);
+      _pool[i] = nullptr;
+    }
+    _current = nullptr;
+    if (queuesReady) {
+      queue_free(&_free);
+      queue_free(&_toSecond);
+    }
+    if (_file.isOpen()) {
+      _file.close();
+    }
+    _sd.end();
+  }
+
+  static void seal(uint8_t* block) {
+    StripeBlockHeader* h = reinterpret_cast<StripeBlockHeader*>(block);
+    h->crc32 = stripeCrc32(block + sizeof(StripeBlockHeader), h->payloadBytes);
+  }
+
+  sdfat::SdFs _sd;
+  sdfat::FsFile _file;
+  queue_t _toSecond;
+  queue_t _free;
+  uint8_t* _pool[STRIPE_BUFFERS] = {};
+  uint8_t* _current = nullptr;
+  size_t _blockBytes = 0;
+  uint32_t _seq = 0;
+  volatile bool _active = false; // コア1も読みますの
+  volatile bool _closed = false;
+  StripeStats _stats = {};
+  LatencyHistogram _secondLatency;
+};
+
+#endif // ARDUINO
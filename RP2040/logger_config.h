@@ -0,0 +1,433 @@
+/**
+ * @file logger_config.h
+ * @brief SDカード上の設定ファイル (/logger.cfg) による実行時設定ですわ
+ * @details
+ * 起動時に "key = value" 形式のテキストを読み込み、サンプリング周波数・
+ * チャンネルごとのレート・バッファサイズ・フラッシュ方針・出力形式を決めますの。
+ * 機体やカードごとの調整に、もう再書き込みは要りませんわ。
+ *
+ * @code
+ * # /logger.cfg の例
+ * sample_hz    = 100        # 基本サンプリング周波数 (Hz)
+ * ch1_hz       = 100        # チャンネルごとのレート (sample_hz を割り切る値、0 で無効)
+ * ch2_hz       = 10
+ * buffer_bytes = 8192       # RAM上の書き込みバッファ
+ * flush_ms     = 1000       # フラッシュ周期 (10～600000)
+ * flush_policy = close_reopen  # close_reopen | sync | none
+ * format       = csv        # csv | rice (チャンネルごとの予測+Rice符号で可逆圧縮した .bin。tools/rice2csv で CSV に戻せますの)
+ * power_pin    = 2
+ * cap1_pin     = 6          # PIOキャプチャチャンネル (最大4本、未指定で無効)
+ * cap1_mode    = freq       # edges | freq
+ * link1_baud   = 1000000    # サテライト基板とのUARTリンク (0 で無効。ピンは kLoggerLinkPins)
+ * stripe       = off        # on でSPI1の2枚目のカードとブロックを交互に書き分けます (ピンは kLoggerStripePins)
+ * sensor_cs    = 17         # SDカードとバスを共有するSPIセンサーのCS (none で無し)
+ * spi_slice    = 512        # カードへの書き込みを切り分ける単位 (512 の倍数、0 で切り分けない)
+ * prealloc_mb  = 64         # ログファイルに先に確保する領域 (MB、0 で確保しない。SdFat・FatFs のバックエンドだけ)
+ * idle         = sleep      # sleep | poll (サンプルの合間にコアを止めるか、従来どおり回り続けるか)
+ * @endcode
+ *
+ * SPIピンだけはカードを読むために必要ですので、コンパイル時の設定のままですのよ。
+ * 解析部はArduinoに依存しませんので、ホストでも同じ規則で検証できますわ。
+ */
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//================================================
+//== 設定値の定義
+//================================================
+#define LOGGER_CHANNEL_COUNT 2
+#define LOGGER_CAPTURE_COUNT 4    // PIOキャプチャチャンネルの数 (PIO0 のステートマシン数)
+#define LOGGER_PIN_NONE      0xFF // キャプチャチャンネルを使わないときのピン番号
+#define LOGGER_LINK_COUNT    2    // サテライト基板とのUARTリンクの数 (UART0, UART1)
+
+// UARTリンクのピン {TX, RX}。UART0 は GPIO 0/1、UART1 は GPIO 4/5 に固定ですの
+constexpr uint8_t kLoggerLinkPins[LOGGER_LINK_COUNT][2] = {{0, 1}, {4, 5}};
+
+// ストライピング用の2枚目のカード (SPI1) のピン {SCK, TX, RX, CS} ですの
+constexpr uint8_t kLoggerStripePins[4] = {10, 11, 12, 13};
+// ストライピング時のブロック用バッファの数 (log_stripe.h の STRIPE_BUFFERS と同じ値ですわ)
+#define LOGGER_STRIPE_BUFFERS 4
+// format=rice で1回に書くチャンクの最大バイト数 (rice_log.h の RICE_MAX_CHUNK_BYTES 以上ですわ)
+#define LOGGER_RICE_CHUNK_MAX 2112
+
+// 設定で使ってよいRAMの上限 (バイト)。RP2040の264 KBのうち、スタックやライブラリの分を残しておきますの
+#ifndef LOGGER_RAM_BUDGET
+#define LOGGER_RAM_BUDGET (96 * 1024)
+#endif
+
+/** @brief フラッシュ周期ごとに行う処理ですわ */
+enum FlushPolicy : uint8_t {
+  FLUSH_CLOSE_REOPEN = 0, ///< 閉じて開き直す (従来の動作。log_storage.h がハンドルを再利用して検索を省きますの)
+  FLUSH_SYNC,             ///< File::flush() でディレクトリエントリとFATを更新するだけ
+  FLUSH_NONE,             ///< バッファが一杯のときだけ書き込む
+};
+
+/** @brief サンプルの合間の過ごし方ですわ */
+enum IdleMode : uint8_t {
+  IDLE_SLEEP = 0, ///< 次のアラームか割り込みまで WFI でコアを止めますの (low_power.h)
+  IDLE_POLL,      ///< 従来どおり loop() を回し続けますわ
+};
+
+/** @brief ログの出力形式ですの */
+enum OutputFormat : uint8_t {
+  FORMAT_CSV = 0,
+  FORMAT_RICE,    ///< チャンネルごとに予測+Rice符号で可逆圧縮したチャンク (rice_log.h)
+};
+
+/** @brief ロガーの実行時設定ですわ */
+struct LoggerConfig {
+  uint32_t sampleHz;                               ///< 基本サンプリング周波数 (Hz)
+  uint32_t channelHz[LOGGER_CHANNEL_COUNT];        ///< チャンネルごとのレート (Hz)。0 で無効
+  uint32_t bufferBytes;                            ///< RAM上の書き込みバッファのバイト数
+  uint32_t flushIntervalMs;                        ///< フラッシュ周期 (ミリ秒)
+  FlushPolicy flushPolicy;
+  OutputFormat format;
+  uint8_t powerSensePin;
+  uint8_t capturePin[LOGGER_CAPTURE_COUNT];        ///< キャプチャチャンネルのGPIO。LOGGER_PIN_NONE で無効
+  bool captureFreq[LOGGER_CAPTURE_COUNT];          ///< true: 周波数モード, false: エッジモード
+  uint32_t linkBaud[LOGGER_LINK_COUNT];            ///< UARTリンクのボーレート。0 で無効
+  bool stripe;                                     ///< true: 2枚のカードへブロックを交互に書く
+  uint8_t sensorCsPin;                             ///< SDカードとバスを共有するSPIセンサーのCS。LOGGER_PIN_NONE で無し
+  uint32_t spiSliceBytes;                          ///< カードへの書き込みを切り分ける単位。0 で切り分けない
+  uint32_t preallocMb;                             ///< ログファイルに先に確保する領域 (MB)。0 で確保しない
+  IdleMode idleMode;                               ///< サンプルの合間の過ごし方
+};
+
+/** @brief 既定値ですの。設定ファイルが無ければこの値で動きますわ */
+constexpr LoggerConfig loggerConfigDefaults() {
+  LoggerConfig cfg{};
+  cfg.sampleHz = 20;
+  for (int i = 0; i < LOGGER_CHANNEL_COUNT; i++) {
+    cfg.channelHz[i] = 20;
+  }
+  cfg.bufferBytes = 4096;
+  cfg.flushIntervalMs = 1000;
+  cfg.flushPolicy = FLUSH_CLOSE_REOPEN;
+  cfg.format = FORMAT_CSV;
+  cfg.powerSensePin = 2;
+  for (int i = 0; i < LOGGER_CAPTURE_COUNT; i++) {
+    cfg.capturePin[i] = LOGGER_PIN_NONE;
+    cfg.captureFreq[i] = false;
+  }
+  for (int i = 0; i < LOGGER_LINK_COUNT; i++) {
+    cfg.linkBaud[i] = 0;
+  }
+  cfg.stripe = false;
+  cfg.sensorCsPin = LOGGER_PIN_NONE;
+  cfg.spiSliceBytes = 512;
+  cfg.preallocMb = 0;
+  cfg.idleMode = IDLE_SLEEP;
+  return cfg;
+}
+
+inline const char* flushPolicyName(FlushPolicy p) {
+  switch (p) {
+    case FLUSH_CLOSE_REOPEN: return "close_reopen";
+    case FLUSH_SYNC:         return "sync";
+    case FLUSH_NONE:         return "none";
+  }
+  return "?";
+}
+
+inline const char* idleModeName(IdleMode m) {
+  switch (m) {
+    case IDLE_SLEEP: return "sleep";
+    case IDLE_POLL:  return "poll";
+  }
+  return "?";
+}
+
+inline const char* outputFormatName(OutputFormat f) {
+  switch (f) {
+    case FORMAT_CSV:  return "csv";
+    case FORMAT_RICE: return "rice";
+  }
+  return "?";
+}
+
+/** @brief チャンネル ch を何サンプルに1回記録するか。0 なら無効ですの */
+constexpr uint32_t loggerChannelDivider(const LoggerConfig& cfg, int ch) {
+  return cfg.channelHz[ch] == 0 ? 0 : cfg.sampleHz / cfg.channelHz[ch];
+}
+
+//================================================
+//== 解析と検証
+//================================================
+
+/** @brief 文字列を符号なし整数として解釈しますわ。全体が数字でなければ false ですの */
+inline bool loggerConfigParseUint(const char* s, uint32_t* out) {
+  if (*s == '\0') {
+    return false;
+  }
+  char* end;
+  unsigned long v = strtoul(s, &end, 10);
+  if (*end != '\0') {
+    return false;
+  }
+  *out = static_cast<uint32_t>(v);
+  return true;
+}
+
+/**
+ * @brief 1つのキーと値を設定に反映しますわ
+ * @return 未知のキーや解釈できない値なら false (設定は変更しませんの)
+ */
+inline bool loggerConfigApply(LoggerConfig& cfg, const char* key, const char* value) {
+  uint32_t v;
+  if (strcmp(key, "sample_hz") == 0) {
+    if (!loggerConfigParseUint(value, &v)) return false;
+    cfg.sampleHz = v;
+  } else if (strncmp(key, "ch", 2) == 0 && strlen(key) > 5 && strcmp(key + strlen(key) - 3, "_hz") == 0) {
+    // "ch1_hz" ～ "chN_hz"
+    int ch = atoi(key + 2) - 1;
+    if (ch < 0 || ch >= LOGGER_CHANNEL_COUNT || !loggerConfigParseUint(value, &v)) return false;
+    cfg.channelHz[ch] = v;
+  } else if (strcmp(key, "buffer_bytes") == 0) {
+    if (!loggerConfigParseUint(value, &v)) return false;
+    cfg.bufferBytes = v;
+  } else if (strcmp(key, "flush_ms") == 0) {
+    if (!loggerConfigParseUint(value, &v)) return false;
+    cfg.flushIntervalMs = v;
+  } else if (strcmp(key, "flush_policy") == 0) {
+    if (strcmp(value, "close_reopen") == 0)  cfg.flushPolicy = FLUSH_CLOSE_REOPEN;
+    else if (strcmp(value, "sync") == 0)     cfg.flushPolicy = FLUSH_SYNC;
+    else if (strcmp(value, "none") == 0)     cfg.flushPolicy = FLUSH_NONE;
+    else return false;
+  } else if (strcmp(key, "format") == 0) {
+    if (strcmp(value, "csv") == 0)       cfg.format = FORMAT_CSV;
+    else if (strcmp(value, "rice") == 0) cfg.format = FORMAT_RICE;
+    else return false;
+  } else if (strcmp(key, "power_pin") == 0) {
+    if (!loggerConfigParseUint(value, &v) || v > 29) return false;
+    cfg.powerSensePin = static_cast<uint8_t>(v);
+  } else if (strncmp(key, "cap", 3) == 0 && key[3] >= '1' && key[3] < '1' + LOGGER_CAPTURE_COUNT && key[4] == '_') {
+    // "cap1_pin" ～ "capN_pin"、"cap1_mode" ～ "capN_mode"
+    int ch = key[3] - '1';
+    if (strcmp(key + 5, "pin") == 0) {
+      if (strcmp(value, "none") == 0) {
+        cfg.capturePin[ch] = LOGGER_PIN_NONE;
+      } else if (loggerConfigParseUint(value, &v) && v <= 29) {
+        cfg.capturePin[ch] = static_cast<uint8_t>(v);
+      } else {
+        return false;
+      }
+    } else if (strcmp(key + 5, "mode") == 0) {
+      if (strcmp(value, "edges") == 0)     cfg.captureFreq[ch] = false;
+      else if (strcmp(value, "freq") == 0) cfg.captureFreq[ch] = true;
+      else return false;
+    } else {
+      return false;
+    }
+  } else if (strncmp(key, "link", 4) == 0 && key[4] >= '1' && key[4] < '1' + LOGGER_LINK_COUNT &&
+             strcmp(key + 5, "_baud") == 0) {
+    // "link1_baud" ～ "linkN_baud"
+    if (!loggerConfigParseUint(value, &v) || v > 4000000) return false;
+    cfg.linkBaud[key[4] - '1'] = v;
+  } else if (strcmp(key, "stripe") == 0) {
+    if (strcmp(value, "on") == 0)       cfg.stripe = true;
+    else if (strcmp(value, "off") == 0) cfg.stripe = false;
+    else return false;
+  } else if (strcmp(key, "sensor_cs") == 0) {
+    if (strcmp(value, "none") == 0) {
+      cfg.sensorCsPin = LOGGER_PIN_NONE;
+    } else if (loggerConfigParseUint(value, &v) && v <= 29) {
+      cfg.sensorCsPin = static_cast<uint8_t>(v);
+    } else {
+      return false;
+    }
+  } else if (strcmp(key, "spi_slice") == 0) {
+    if (!loggerConfigParseUint(value, &v)) return false;
+    cfg.spiSliceBytes = v;
+  } else if (strcmp(key, "prealloc_mb") == 0) {
+    // FAT32 のファイルは 4 GB 未満ですの
+    if (!loggerConfigParseUint(value, &v) || v > 4095) return false;
+    cfg.preallocMb = v;
+  } else if (strcmp(key, "idle") == 0) {
+    if (strcmp(value, "sleep") == 0)     cfg.idleMode = IDLE_SLEEP;
+    else if (strcmp(value, "poll") == 0) cfg.idleMode = IDLE_POLL;
+    else return false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief 設定ファイルの1行を解析して反映しますわ
+ * @param line 書き換え可能な1行 (改行を含まない)
+ * @return 空行・コメント行・正しい行なら true
+ */
+inline bool loggerConfigParseLine(LoggerConfig& cfg, char* line) {
+  // コメントを取り除きますの
+  char* hash = strchr(line, '#');
+  if (hash) *hash = '\0';
+
+  char* eq = strchr(line, '=');
+  // 前後の空白を削る小さなヘルパーですわ
+  auto trim = [](char* s) {
+    while (*s == ' ' || *s == '\t') s++;
+    char* e = s + strlen(s);
+    while (e > s && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r')) *--e = '\0';
+    return s;
+  };
+  if (eq == nullptr) {
+    return *trim(line) == '\0';
+  }
+  *eq = '\0';
+  return loggerConfigApply(cfg, trim(line), trim(eq + 1));
+}
+
+/**
+ * @brief 設定の整合性とRAM予算を検証し、はみ出した値は直しますわ
+ * @param cfg 検証する設定 (修正されることがありますの)
+ * @param fixedRamBytes 設定とは別に常に使うRAM (トレースリングなど)
+ * @param message 最初に見つかった問題の説明を書き込むバッファ
+ * @return 修正なしで通れば true
+ */
+inline bool loggerConfigValidate(LoggerConfig& cfg, uint32_t fixedRamBytes, char* message, size_t messageSize) {
+  const LoggerConfig defaults = loggerConfigDefaults();
+  bool ok = true;
+  auto fail = [&](const char* text) {
+    if (ok) {
+      strncpy(message, text, messageSize - 1);
+      message[messageSize - 1] = '\0';
+    }
+    ok = false;
+  };
+
+  if (cfg.sampleHz == 0 || cfg.sampleHz > 10000) {
+    fail("sample_hz は 1～10000 ですわ");
+    cfg.sampleHz = defaults.sampleHz;
+  }
+  for (int i = 0; i < LOGGER_CHANNEL_COUNT; i++) {
+    // 各チャンネルは基本周波数を割り切るレートでないと、等間隔に間引けませんの
+    if (cfg.channelHz[i] > cfg.sampleHz || (cfg.channelHz[i] != 0 && cfg.sampleHz % cfg.channelHz[i] != 0)) {
+      fail("chN_hz は sample_hz を割り切る値ですの");
+      cfg.channelHz[i] = cfg.sampleHz;
+    }
+  }
+  if (cfg.flushIntervalMs < 10 || cfg.flushIntervalMs > 600000) {
+    fail("flush_ms は 10～600000 (10 分) ですわ");
+    cfg.flushIntervalMs = defaults.flushIntervalMs;
+  }
+  if (cfg.bufferBytes < 512) {
+    fail("buffer_bytes は 512 以上ですわ");
+    cfg.bufferBytes = 512;
+  }
+  if (cfg.format == FORMAT_RICE && cfg.bufferBytes < LOGGER_RICE_CHUNK_MAX) {
+    // 圧縮したブロックはチャンク単位でバッファへ置きますので、1チャンク分は要りますの
+    fail("format=rice では buffer_bytes が LOGGER_RICE_CHUNK_MAX 以上ですわ");
+    cfg.bufferBytes = LOGGER_RICE_CHUNK_MAX;
+  }
+  if (cfg.spiSliceBytes % 512 != 0) {
+    // セクタ境界で切らないと、SdFat が埋まりかけのセクタを抱えたままになりますの
+    fail("spi_slice は 512 の倍数か 0 ですわ");
+    cfg.spiSliceBytes = defaults.spiSliceBytes;
+  }
+  const uint8_t cs = cfg.sensorCsPin;
+  if (cs != LOGGER_PIN_NONE && (cs == 16 || cs == 18 || cs == 19 || cs == 22 || cs == cfg.powerSensePin)) {
+    fail("sensor_cs がSPIか電源監視のピンと重なっていますの");
+    cfg.sensorCsPin = LOGGER_PIN_NONE;
+  }
+  for (int k = 0; k < 4; k++) {
+    for (int l = 0; l < LOGGER_LINK_COUNT; l++) {
+      const bool linkPin = k < 2 && cfg.linkBaud[l] != 0 && kLoggerLinkPins[l][k] == cfg.sensorCsPin;
+      if (cfg.sensorCsPin != LOGGER_PIN_NONE && (linkPin || (cfg.stripe && kLoggerStripePins[k] == cfg.sensorCsPin))) {
+        fail("sensor_cs がUARTリンクか2枚目のカードのピンと重なっていますの");
+        cfg.sensorCsPin = LOGGER_PIN_NONE;
+      }
+    }
+  }
+  // 有効なUARTリンクと2枚目のカードのピン、センサーのCSは、電源監視やキャプチャには使えませんの
+  auto reservedPin = [&](uint8_t pin) {
+    if (pin == cfg.sensorCsPin) {
+      return true;
+    }
+    for (int l = 0; l < LOGGER_LINK_COUNT; l++) {
+      if (cfg.linkBaud[l] != 0 && (kLoggerLinkPins[l][0] == pin || kLoggerLinkPins[l][1] == pin)) {
+        return true;
+      }
+    }
+    for (int k = 0; k < 4; k++) {
+      if (cfg.stripe && kLoggerStripePins[k] == pin) {
+        return true;
+      }
+    }
+    return false;
+  };
+  for (int k = 0; k < 4; k++) {
+    if (cfg.stripe && kLoggerStripePins[k] == cfg.powerSensePin) {
+      fail("power_pin が2枚目のカードのピンと重なっていますの");
+      cfg.stripe = false;
+    }
+  }
+  for (int l = 0; l < LOGGER_LINK_COUNT; l++) {
+    if (cfg.linkBaud[l] != 0 && (kLoggerLinkPins[l][0] == cfg.powerSensePin || kLoggerLinkPins[l][1] == cfg.powerSensePin)) {
+      fail("power_pin がUARTリンクのピンと重なっていますの");
+      cfg.linkBaud[l] = 0;
+    }
+  }
+  for (int i = 0; i < LOGGER_CAPTURE_COUNT; i++) {
+    // SPIと電源監視のピン、ほかのキャプチャチャンネルとは共有できませんの
+    uint8_t pin = cfg.capturePin[i];
+    bool clash = pin == 16 || pin == 18 || pin == 19 || pin == 22 || pin == cfg.powerSensePin || reservedPin(pin);
+    for (int j = 0; j < i; j++) {
+      clash = clash || pin == cfg.capturePin[j];
+    }
+    if (pin != LOGGER_PIN_NONE && clash) {
+      fail("capN_pin がほかのピンと重なっていますの");
+      cfg.capturePin[i] = LOGGER_PIN_NONE;
+    }
+  }
+  // ストライピングではブロック用バッファを LOGGER_STRIPE_BUFFERS 個持ちますの
+  const uint32_t buffers = cfg.stripe ? LOGGER_STRIPE_BUFFERS : 1;
+  // 大きな buffer_bytes で桁あふれして予算内に見えないよう、64ビットで足しますの
+  if (static_cast<uint64_t>(fixedRamBytes) + static_cast<uint64_t>(cfg.bufferBytes) * buffers > LOGGER_RAM_BUDGET) {
+    fail("buffer_bytes がRAM予算を超えていますの");
+    cfg.bufferBytes = fixedRamBytes < LOGGER_RAM_BUDGET - 512 * buffers ? (LOGGER_RAM_BUDGET - fixedRamBytes) / buffers : 512;
+  }
+  return ok;
+}
+
+/**
+ * @brief 実効設定を "# key=value" 形式の行として書き出しますわ
+ * @details ログファイルの先頭に記録して、後から条件を再現できるようにしますの。
+ */
+template <class Out>
+inline void loggerConfigPrint(const LoggerConfig& cfg, Out& out) {
+  out.print("# sample_hz=");    out.println(cfg.sampleHz);
+  for (int i = 0; i < LOGGER_CHANNEL_COUNT; i++) {
+    out.print("# ch");          out.print(i + 1);
+    out.print("_hz=");          out.println(cfg.channelHz[i]);
+  }
+  out.print("# buffer_bytes="); out.println(cfg.bufferBytes);
+  out.print("# flush_ms=");     out.println(cfg.flushIntervalMs);
+  out.print("# flush_policy="); out.println(flushPolicyName(cfg.flushPolicy));
+  out.print("# format=");       out.println(outputFormatName(cfg.format));
+  out.print("# power_pin=");    out.println(cfg.powerSensePin);
+  for (int i = 0; i < LOGGER_CAPTURE_COUNT; i++) {
+    if (cfg.capturePin[i] == LOGGER_PIN_NONE) {
+      continue;
+    }
+    out.print("# cap");         out.print(i + 1);
+    out.print("_pin=");         out.println(cfg.capturePin[i]);
+    out.print("# cap");         out.print(i + 1);
+    out.print("_mode=");        out.println(cfg.captureFreq[i] ? "freq" : "edges");
+  }
+  for (int i = 0; i < LOGGER_LINK_COUNT; i++) {
+    if (cfg.linkBaud[i] == 0) {
+      continue;
+    }
+    out.print("# link");        out.print(i + 1);
+    out.print("_baud=");        out.println(cfg.linkBaud[i]);
+  }
+  out.print("# stripe=");       out.println(cfg.stripe ? "on" : "off");
+  if (cfg.sensorCsPin != LOGGER_PIN_NONE) {
+    out.print("# sensor_cs=");  out.println(cfg.sensorCsPin);
+  }
+  out.print("# spi_slice=");    out.println(cfg.spiSliceBytes);
+  out.print("# prealloc_mb=");  out.println(cfg.preallocMb);
+  out.print("# idle=");         out.println(idleModeName(cfg.idleMode));
+}
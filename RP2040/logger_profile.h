@@ -0,0 +1,219 @@
+/**
+ * @file logger_profile.h
+ * @brief コンパイル時設定プロファイルと、プロファイルごとに特殊化されるエンコーダですわ
+ * @details
+ * ロガーの設定 (チャンネル構成・レート・エンコード・バッファサイズ) を型として表し、
+ * logData() とCSVエンコーダをその型でテンプレート化しますの。
+ *
+ * - RuntimeProfile: /logger.cfg から読んだ g_config に従う柔軟な版
+ * - StaticProfile<...>: すべてconstexprの版。間引きの剰余やチャンネルの有無の分岐が
+ *   コンパイル時に畳み込まれ、ホットパスから実行時の判断が消えますわ
+ *
+ * どちらを使うかはビルドごとに LOGGER_PROFILE マクロで選びますの。
+ * シリアルコマンド 'b' で両者のエンコード速度を比べられますわ。
+ */
+#pragma once
+#include <stdint.h>
+#include "logger_config.h"
+#include "ram_func.h"
+
+// 実行時設定の実体はスケッチ側にありますの
+extern LoggerConfig g_config;
+
+//================================================
+//== サンプル
+//================================================
+
+/** @brief 1回のサンプリングで得た値ですわ */
+struct SampleRecord {
+  uint32_t timestampMs;
+  int32_t value[LOGGER_CHANNEL_COUNT]; ///< ch1: 生値、ch2: 0.01単位の固定小数点
+  uint8_t present;                     ///< 今回記録するチャンネルのビットマスク
+};
+
+//================================================
+//== プロファイル
+//================================================
+
+/** @brief 実行時設定 (g_config) をそのまま使うプロファイルですの */
+struct RuntimeProfile {
+  static constexpr bool kIsStatic = false;
+  static constexpr const char* kName = "runtime";
+  static const LoggerConfig& config() { return g_config; }
+};
+
+/**
+ * @brief すべての設定をコンパイル時に固定するプロファイルですわ
+ * @details 不正な組み合わせは static_assert でビルド時に弾きますの。
+ */
+template <uint32_t SampleHz, uint32_t Ch1Hz, uint32_t Ch2Hz, uint32_t BufferBytes, uint32_t FlushMs, FlushPolicy Policy>
+struct StaticProfile {
+  static constexpr bool kIsStatic = true;
+  static constexpr const char* kName = "static";
+  static constexpr LoggerConfig config() {
+    LoggerConfig cfg = loggerConfigDefaults();
+    cfg.sampleHz = SampleHz;
+    cfg.channelHz[0] = Ch1Hz;
+    cfg.channelHz[1] = Ch2Hz;
+    cfg.bufferBytes = BufferBytes;
+    cfg.flushIntervalMs = FlushMs;
+    cfg.flushPolicy = Policy;
+    return cfg;
+  }
+
+  static_assert(SampleHz >= 1 && SampleHz <= 10000, "SampleHz must be 1..10000");
+  static_assert(Ch1Hz == 0 || (Ch1Hz <= SampleHz && SampleHz % Ch1Hz == 0), "Ch1Hz must divide SampleHz");
+  static_assert(Ch2Hz == 0 || (Ch2Hz <= SampleHz && SampleHz % Ch2Hz == 0), "Ch2Hz must divide SampleHz");
+  static_assert(BufferBytes >= 512 && BufferBytes <= LOGGER_RAM_BUDGET, "BufferBytes must fit the RAM budget");
+  static_assert(FlushMs >= 10, "FlushMs must be >= 10");
+};
+
+// よく使う構成ですの。従来の 20 Hz・2ch と、高レート向けの構成ですわ
+using ProfileDefault20Hz = StaticProfile<20, 20, 20, 4096, 1000, FLUSH_CLOSE_REOPEN>;
+using ProfileFast500Hz   = StaticProfile<500, 500, 50, 16384, 1000, FLUSH_SYNC>;
+
+/**
+ * @brief チャンネル ch の間引き数を返しますわ
+ * @details 静的プロファイルではconstexprな値になりますの。ただし M0+ には割り算の命令がありませんので、
+ *          2の冪でない間引き数の剰余は、定数でも libgcc の割り算 (フラッシュにありますの) の呼び出しになりますわ。
+ */
+template <class P>
+LOGGER_RAM_INLINE uint32_t profileDivider(int ch) {
+  if constexpr (P::kIsStatic) {
+    constexpr LoggerConfig cfg = P::config();
+    return loggerChannelDivider(cfg, ch);
+  } else {
+    return loggerChannelDivider(P::config(), ch);
+  }
+}
+
+/**
+ * @brief 通し番号 index のサンプルで記録するチャンネルのビットマスクですわ
+ * @note 剰余を使いますので、フラッシュの消去中にも走る読み取りでは ChannelSchedule を使いますの
+ */
+template <class P>
+inline uint8_t profileChannelMask(uint32_t index) {
+  uint8_t mask = 0;
+  for (int ch = 0; ch < LOGGER_CHANNEL_COUNT; ch++) {
+    uint32_t div = profileDivider<P>(ch);
+    if (div == 1 || (div != 0 && index % div == 0)) {
+      mask |= 1u << ch;
+    }
+  }
+  return mask;
+}
+
+/**
+ * @brief チャンネルごとの間引きを、割り算を使わずに数えますわ
+ * @details 次に記録するまでの残りサンプル数をチャンネルごとに持ち、1サンプルごとに1つ減らしますの。
+ *          間引き数は channelScheduleBegin() で一度だけ求めておきますので、
+ *          channelScheduleNext() は比較と引き算だけで済み、フラッシュの消去中にも呼べますわ。
+ */
+struct ChannelSchedule {
+  uint32_t divider[LOGGER_CHANNEL_COUNT];   ///< 何サンプルに1回記録するか。0 なら無効ですの
+  uint32_t countdown[LOGGER_CHANNEL_COUNT]; ///< 次に記録するまでに飛ばすサンプル数ですわ
+};
+
+/** @brief 通し番号 index のサンプルから数え始めますわ。以後は profileChannelMask<P>() と同じ並びになりますの */
+template <class P>
+inline void channelScheduleBegin(ChannelSchedule& s, uint32_t index) {
+  for (int ch = 0; ch < LOGGER_CHANNEL_COUNT; ch++) {
+    const uint32_t div = profileDivider<P>(ch);
+    s.divider[ch] = div;
+    s.countdown[ch] = div == 0 ? 0 : (div - index % div) % div;
+  }
+}
+
+/** @brief 次のサンプルで記録するチャンネルのビットマスクを返して、1サンプル進めますわ */
+LOGGER_RAM_INLINE uint8_t channelScheduleNext(ChannelSchedule& s) {
+  uint8_t mask = 0;
+  for (int ch = 0; ch < LOGGER_CHANNEL_COUNT; ch++) {
+    if (s.divider[ch] == 0) {
+      continue;
+    }
+    if (s.countdown[ch] == 0) {
+      mask |= 1u << ch;
+      s.countdown[ch] = s.divider[ch] - 1;
+    } else {
+      s.countdown[ch]--;
+    }
+  }
+  return mask;
+}
+
+/**
+ * @brief 書き込みバッファを用意しますわ
+ * @details 静的プロファイルなら静的配列、実行時プロファイルならヒープから確保しますの。
+ */
+template <class P>
+inline char* profileAllocBuffer() {
+  if constexpr (P::kIsStatic) {
+    static char buffer[P::config().bufferBytes];
+    return buffer;
+  } else {
+    return static_cast<char*>(malloc(P::config().bufferBytes));
+  }
+}
+
+//================================================
+//== エンコーダ
+//================================================
+
+/** @brief 符号なし整数を10進で書き込み、末尾を返しますわ */
+LOGGER_RAM_INLINE char* encodeUint(char* p, uint32_t v) {
+  char tmp[10];
+  int n = 0;
+  do {
+    tmp[n++] = static_cast<char>('0' + v % 10);
+    v /= 10;
+  } while (v != 0);
+  while (n > 0) {
+    *p++ = tmp[--n];
+  }
+  return p;
+}
+
+/** @brief 符号付き整数を10進で書き込みますの */
+LOGGER_RAM_INLINE char* encodeInt(char* p, int32_t v) {
+  if (v < 0) {
+    *p++ = '-';
+    return encodeUint(p, 0u - static_cast<uint32_t>(v));
+  }
+  return encodeUint(p, static_cast<uint32_t>(v));
+}
+
+/** @brief 0.01単位の固定小数点を "12.30" の形で書き込みますわ (print(float) と同じ小数2桁) */
+LOGGER_RAM_INLINE char* encodeFixed2(char* p, int32_t centi) {
+  if (centi < 0) {
+    *p++ = '-';
+    centi = -centi;
+  }
+  p = encodeUint(p, static_cast<uint32_t>(centi) / 100);
+  uint32_t frac = static_cast<uint32_t>(centi) % 100;
+  *p++ = '.';
+  *p++ = static_cast<char>('0' + frac / 10);
+  *p++ = static_cast<char>('0' + frac % 10);
+  return p;
+}
+
+/**
+ * @brief 1レコードをCSVの1行に整形しますわ
+ * @param out 少なくとも48バイトのバッファ
+ * @return 書き込んだバイト数 (改行 "\r\n" を含みますの)
+ * @details 記録しないチャンネルは空欄にして、列の位置は揃えておきますの。
+ */
+template <class P>
+LOGGER_RAM_INLINE size_t encodeCsvRecord(char* out, const SampleRecord& r) {
+  char* p = encodeUint(out, r.timestampMs);
+  *p++ = ',';
+  if (r.present & 0x01) {
+    p = encodeInt(p, r.value[0]);
+  }
+  *p++ = ',';
+  if (r.present & 0x02) {
+    p = encodeFixed2(p, r.value[1]);
+  }
+  *p++ = '\r';
+  *p++ = '\n';
+  return static_cast<size_t>(p - out);
+}
@@ -0,0 +1,208 @@
+/**
+ * @file low_power.h
+ * @brief サンプルの合間にコアを止める省電力の待機と、1秒ごとの稼働・休止時間の集計ですわ
+ * @details
+ * 20 Hz の記録では loop() はほとんどの時間、時刻を見て回っているだけですので、長い地上設置では
+ * 電池をそのぶん無駄にしますの。idle=sleep では次にすることの時刻 (次のサンプルの予定・
+ * 定期フラッシュ) にタイマーのアラームをかけ、WFI でコアを止めて待ちますわ。
+ * WFI はどの割り込みでも起きますので、USBのコマンド・電源断のピン・コア1からの呼び出しも
+ * 遅れずに受け付けますの。
+ *
+ * - UARTリンクとPIOキャプチャのDMAは割り込みを出さずにリングへ書き続けますので、リングが
+ *   あふれないうちに起きるよう、止める時間の上限 (setMaxSleepUs) を決めておきますわ
+ * - 割り込みを止めてから期限を確かめて WFI に入りますので、確かめた後に届いた割り込みは
+ *   保留のまま WFI をすぐに抜けさせますの (起き損ねはありませんわ)
+ * - IdleAccounting は1秒ごとに、稼働 (active) と休止 (sleep) のマイクロ秒、サンプル数を区切りますの。
+ *   ボードの電流 (IDLE_ACTIVE_UA / IDLE_SLEEP_UA) と電圧から、1サンプルあたりのエネルギーを見積もりますわ
+ *
+ * 電流の既定値は RP2040 (125 MHz、クロックを止めない WFI) の目安ですので、実機で測った値を
+ * ビルド時に渡してくださいませ。ログには時間そのものも残しますので、後から計算し直せますの。
+ * 前半はArduinoに依存しませんので、ホストでも同じ集計を試せますわ。
+ */
+#pragma once
+#include <stdint.h>
+#include "ram_func.h"
+
+#ifndef IDLE_ACTIVE_UA
+#define IDLE_ACTIVE_UA  25000 // 稼働中の電流 (マイクロアンペア)
+#endif
+#ifndef IDLE_SLEEP_UA
+#define IDLE_SLEEP_UA   9000  // WFI で止めている間の電流
+#endif
+#ifndef IDLE_SUPPLY_MV
+#define IDLE_SUPPLY_MV  3300
+#endif
+#define IDLE_MIN_SLEEP_US 50      // これより短い待ちは止めずに回りますの (起きるまでの手間の方が大きいですわ)
+#define IDLE_WINDOW_US    1000000 // 集計の区切り (1秒)
+
+/** @brief 1秒分 (または全体) の集計ですわ */
+struct IdleWindow {
+  uint64_t activeUs;
+  uint64_t sleepUs;
+  uint32_t samples;
+  uint32_t sleeps; ///< WFI に入った回数
+};
+
+/**
+ * @brief 稼働・休止時間からエネルギーを見積もりますの
+ * @return 1サンプルあたりのナノジュール。サンプルが無ければ 0
+ * @details µA × µs × mV = 10^-15 J ですので、10^6 で割ってナノジュールにしますわ
+ */
+inline uint32_t idleEnergyPerSampleNj(const IdleWindow& w, uint32_t activeUa = IDLE_ACTIVE_UA, uint32_t sleepUa = IDLE_SLEEP_UA,
+                                      uint32_t supplyMv = IDLE_SUPPLY_MV) {
+  if (w.samples == 0) {
+    return 0;
+  }
+  const uint64_t charge = w.activeUs * activeUa + w.sleepUs * sleepUa; // µA·µs
+  return static_cast<uint32_t>(charge / w.samples * supplyMv / 1000000);
+}
+
+/** @brief 稼働の割合 (千分率) ですわ */
+inline uint32_t idleDutyPermille(const IdleWindow& w) {
+  const uint64_t total = w.activeUs + w.sleepUs;
+  return total == 0 ? 1000 : static_cast<uint32_t>(w.activeUs * 1000 / total);
+}
+
+/**
+ * @brief 休止した時間を足していき、1秒ごとに稼働時間と合わせて区切りますの
+ * @details 稼働時間は「区切りの長さ - 休止時間」ですので、測るのは WFI の前後だけで済みますわ。
+ */
+class IdleAccounting {
+public:
+  void begin(uint64_t nowUs, uint32_t sampleIndex) {
+    _windowStart = nowUs;
+    _windowIndex = sampleIndex;
+    _current = {};
+    _last = {};
+    _total = {};
+    _seconds = 0;
+    _minDuty = 1000;
+    _maxDuty = 0;
+  }
+
+  void addSleep(uint32_t us) {
+    if (us > 0) {
+      _current.sleepUs += us;
+      _current.sleeps++;
+    }
+  }
+
+  /**
+   * @brief 1秒を過ぎていれば区切りますの
+   * @param sampleIndex いまのサンプルの通し番号 (区切りの間に取ったサンプル数を数えますわ)
+   * @return 区切ったら true
+   */
+  bool roll(uint64_t nowUs, uint32_t sampleIndex) {
+    const uint64_t elapsed = nowUs - _windowStart;
+    if (elapsed < IDLE_WINDOW_US) {
+      return false;
+    }
+    _current.activeUs = elapsed > _current.sleepUs ? elapsed - _current.sleepUs : 0;
+    _current.samples = sampleIndex - _windowIndex;
+    const uint32_t duty = idleDutyPermille(_current);
+    _minDuty = duty < _minDuty ? duty : _minDuty;
+    _maxDuty = duty > _maxDuty ? duty : _maxDuty;
+    _total.activeUs += _current.activeUs;
+    _total.sleepUs += _current.sleepUs;
+    _total.samples += _current.samples;
+    _total.sleeps += _current.sleeps;
+    _last = _current;
+    _current = {};
+    _seconds++;
+    _windowStart = nowUs;
+    _windowIndex = sampleIndex;
+    return true;
+  }
+
+  /** @brief 直前の1秒ですわ */
+  const IdleWindow& last() const { return _last; }
+  /** @brief 区切り終えた全体ですの */
+  const IdleWindow& total() const { return _total; }
+  uint32_t seconds() const { return _seconds; }
+  uint32_t minDutyPermille() const { return _seconds == 0 ? 0 : _minDuty; }
+  uint32_t maxDutyPermille() const { return _maxDuty; }
+
+private:
+  uint64_t _windowStart = 0;
+  uint32_t _windowIndex = 0;
+  IdleWindow _current = {};
+  IdleWindow _last = {};
+  IdleWindow _total = {};
+  uint32_t _seconds = 0;
+  uint32_t _minDuty = 1000;
+  uint32_t _maxDuty = 0;
+};
+
+//================================================
+//== タイマーのアラームで起きる WFI (Arduino専用)
+//================================================
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <hardware/irq.h>
+#include <hardware/structs/timer.h>
+#include <hardware/sync.h>
+#include <hardware/timer.h>
+
+class IdleSleeper {
+public:
+  /**
+   * @brief 起こすためのアラームを確保しますわ
+   * @return アラームが残っていなければ false (そのときは止めずに回りますの)
+   */
+  bool begin() {
+    if (_alarm < 0) {
+      _alarm = hardware_alarm_claim_unused(false);
+      if (_alarm < 0) {
+        return false;
+      }
+      s_alarm = _alarm;
+      // 起こすだけですので、pico-sdk の共通のアラーム処理 (フラッシュにありますの) は通しませんわ
+      irq_set_exclusive_handler(TIMER_IRQ_0 + _alarm, alarmIsr);
+      hw_set_bits(&timer_hw->inte, 1u << _alarm);
+      irq_set_enabled(TIMER_IRQ_0 + _alarm, true);
+    }
+    return true;
+  }
+
+  /** @brief 1回に止める時間の上限ですの (DMAのリングがあふれないように) */
+  void setMaxSleepUs(uint32_t us) { _maxSleepUs = us; }
+  uint32_t maxSleepUs() const { return _maxSleepUs; }
+
+  /**
+   * @brief deadlineUs か、どれかの割り込みまでコアを止めますわ
+   * @return 止めていたマイクロ秒。待つほどでなければ 0
+   */
+  uint32_t LOGGER_RAM_FUNC(sleepUntil)(uint32_t deadlineUs) {
+    if (_alarm < 0) {
+      return 0;
+    }
+    const uint32_t t0 = ramTimeUs32();
+    if (static_cast<int32_t>(deadlineUs - t0) > static_cast<int32_t>(_maxSleepUs)) {
+      deadlineUs = t0 + _maxSleepUs;
+    }
+    if (static_cast<int32_t>(deadlineUs - t0) < IDLE_MIN_SLEEP_US) {
+      return 0;
+    }
+    const uint32_t irq = save_and_disable_interrupts();
+    timer_hw->alarm[_alarm] = deadlineUs;
+    // アラームは一致したときにしか鳴りませんので、かける前に過ぎていたら止めませんの
+    if (static_cast<int32_t>(deadlineUs - ramTimeUs32()) > 0) {
+      __wfi(); // 割り込みを止めていても、保留になれば起きますわ
+    }
+    timer_hw->armed = 1u << _alarm;
+    timer_hw->intr = 1u << _alarm;
+    restore_interrupts(irq);
+    return ramTimeUs32() - t0;
+  }
+
+private:
+  static void LOGGER_RAM_FUNC(alarmIsr)() {
+    timer_hw->intr = 1u << s_alarm; // 起きれば十分ですの
+  }
+
+  inline static int s_alarm = 0;
+  int _alarm = -1;
+  uint32_t _maxSleepUs = IDLE_WINDOW_US;
+};
+
+#endif // ARDUINO
@@ -0,0 +1,210 @@
+/**
+ * @file pio_capture.h
+ * @brief PIOによるデジタルエッジ/周波数キャプチャチャンネルですわ
+ * @details
+ * 20 Hz の logData() でGPIOを読んでも、パルス数や回転数、エッジ時刻は取れませんの。
+ * そこで各チャンネルにPIOのステートマシンを1つ割り当て、edge_capture.pio が
+ * エッジをマイクロ秒精度でハードウェア時刻付けしますわ。結果はDMAでRAM上の
+ * リングバッファへ流れ込むので、CPUは好きなときにまとめて読み出せばよいのですの。
+ *
+ * チャンネルのモード:
+ * - CAPTURE_EDGES: すべてのエッジを (時刻, 立ち上がり/立ち下がり) のイベントとして出力
+ * - CAPTURE_FREQ : サンプリング周期ごとに、立ち上がりエッジの数と周期から求めた周波数を出力
+ *
+ * PIOのカウンタは31ビット (約35分) で折り返しますが、64ビットのシステム時刻を基準に
+ * 展開しますので、35分に1回以上読み出していれば時刻は連続しますわ。
+ */
+#pragma once
+#include <Arduino.h>
+#include <hardware/pio.h>
+#include <hardware/dma.h>
+#include <hardware/timer.h>
+#include "edge_capture.pio.h"
+
+#define CAPTURE_MAX_CHANNELS 4   // PIO0 のステートマシン数
+#define CAPTURE_RING_BITS    10  // リングは 2^10 = 1 KB (256 イベント) /チャンネル
+#define CAPTURE_RING_WORDS   ((1u << CAPTURE_RING_BITS) / 4)
+#define CAPTURE_PIN_NONE     0xFF
+
+/** @brief キャプチャチャンネルのモードですの */
+enum CaptureMode : uint8_t {
+  CAPTURE_EDGES = 0,
+  CAPTURE_FREQ  = 1,
+};
+
+/** @brief 1つのエッジイベントですわ */
+struct CaptureEvent {
+  uint64_t timeUs; ///< time_us_64() と同じ時間軸の時刻
+  uint8_t channel;
+  uint8_t rising;  ///< 1: 立ち上がり, 0: 立ち下がり
+};
+
+/** @brief 周波数モードで1周期ごとに得られる値ですわ */
+struct CaptureFrequency {
+  uint32_t pulses;       ///< この周期の立ち上がりエッジ数
+  uint32_t centiHz;      ///< 周波数 (0.01 Hz 単位)。エッジが無ければ 0
+};
+
+class PioCapture {
+public:
+  /**
+   * @brief チャンネルを開始しますわ
+   * @return PIOのステートマシンかDMAチャンネルが足りなければ false
+   */
+  bool begin(uint8_t ch, uint8_t pin, CaptureMode mode) {
+    if (ch >= CAPTURE_MAX_CHANNELS || pin == CAPTURE_PIN_NONE) {
+      return false;
+    }
+    if (!_programLoaded) {
+      if (!pio_can_add_program(pio0, &edge_capture_program)) {
+        return false;
+      }
+      _offset = pio_add_program(pio0, &edge_capture_program);
+      _programLoaded = true;
+    }
+    Channel& c = _channels[ch];
+    int sm = pio_claim_unused_sm(pio0, false);
+    if (sm < 0) {
+      return false;
+    }
+    int dma = dma_claim_unused_channel(false);
+    if (dma < 0) {
+      pio_sm_unclaim(pio0, sm);
+      return false;
+    }
+    c.sm = static_cast<uint8_t>(sm);
+    c.dma = static_cast<uint8_t>(dma);
+    c.mode = mode;
+    c.readCount = 0;
+    c.ringBase = 0;
+    c.lost = 0;
+    c.pulses = 0;
+    c.lastRiseUs = 0;
+    c.prevPeriodRiseUs = 0;
+
+    edge_capture_program_init(pio0, c.sm, _offset, pin);
+
+    // RX FIFO からリングバッファへ。書き込み側のアドレスを 2^CAPTURE_RING_BITS で折り返しますの
+    dma_channel_config cfg = dma_channel_get_default_config(c.dma);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&cfg, false);
+    channel_config_set_write_increment(&cfg, true);
+    channel_config_set_ring(&cfg, true, CAPTURE_RING_BITS);
+    channel_config_set_dreq(&cfg, pio_get_dreq(pio0, c.sm, false));
+    dma_channel_configure(c.dma, &cfg, _rings[ch], &pio0->rxf[c.sm], kTransferCount, true);
+
+    c.startUs = time_us_64();
+    pio_sm_set_enabled(pio0, c.sm, true);
+    c.active = true;
+    return true;
+  }
+
+  bool active(uint8_t ch) const { return ch < CAPTURE_MAX_CHANNELS && _channels[ch].active; }
+  CaptureMode mode(uint8_t ch) const { return _channels[ch].mode; }
+  /** @brief リングがあふれて失ったイベント数ですわ */
+  uint32_t lost(uint8_t ch) const { return _channels[ch].lost; }
+
+  /**
+   * @brief DMAが書き込んだ新しいイベントを古い順に取り出しますわ
+   * @param fn 各イベントで呼ばれる関数 (const CaptureEvent&)
+   * @details 周波数モードのチャンネルでは、fn は呼ばずにパルス数だけ数えますの。
+   */
+  template <class Fn>
+  void drain(uint8_t ch, Fn&& fn) {
+    Channel& c = _channels[ch];
+    if (!c.active) {
+      return;
+    }
+    uint32_t remaining = dma_channel_hw_addr(c.dma)->transfer_count;
+    uint32_t written = kTransferCount - remaining;
+    if (written - c.readCount > CAPTURE_RING_WORDS) {
+      // 読み出しが間に合わず上書きされた分は捨てて、残っている最古のものから読みますわ
+      c.lost += written - c.readCount - CAPTURE_RING_WORDS;
+      c.readCount = written - CAPTURE_RING_WORDS;
+    }
+    uint64_t nowUs = time_us_64();
+    while (c.readCount != written) {
+      uint32_t word = _rings[ch][(c.ringBase + c.readCount) % CAPTURE_RING_WORDS];
+      c.readCount++;
+      CaptureEvent ev;
+      ev.timeUs = unwrapTime(c, word, nowUs);
+      ev.channel = ch;
+      ev.rising = static_cast<uint8_t>(word >> 31);
+      if (c.mode == CAPTURE_FREQ) {
+        if (ev.rising) {
+          c.pulses++;
+          c.lastRiseUs = ev.timeUs;
+        }
+      } else {
+        fn(ev);
+      }
+    }
+    // 転送回数を使い切る前に、同じリング位置から再開しますの (約40億イベントに1回)
+    if (remaining < (1u << 30)) {
+      rearm(ch);
+    }
+  }
+
+  /**
+   * @brief 周波数モードの1周期分を締めくくりますわ
+   * @details 前の周期の最後の立ち上がりから今回の最後の立ち上がりまでの時間で、パルス数を割りますの。
+   */
+  CaptureFrequency takeFrequency(uint8_t ch) {
+    Channel& c = _channels[ch];
+    drain(ch, [](const CaptureEvent&) {});
+    CaptureFrequency f = {c.pulses, 0};
+    if (c.pulses > 0 && c.prevPeriodRiseUs != 0 && c.lastRiseUs > c.prevPeriodRiseUs) {
+      f.centiHz = static_cast<uint32_t>(static_cast<uint64_t>(c.pulses) * 100000000ULL / (c.lastRiseUs - c.prevPeriodRiseUs));
+    }
+    if (c.pulses > 0) {
+      c.prevPeriodRiseUs = c.lastRiseUs;
+    }
+    c.pulses = 0;
+    return f;
+  }
+
+private:
+  static constexpr uint32_t kTransferCount = 0xFFFFFFFFu;
+
+  struct Channel {
+    uint64_t startUs;
+    uint32_t readCount; ///< 読み出したワード数 (DMAの転送済み数と同じ数え方)
+    uint32_t ringBase;  ///< 転送済み数 0 に対応するリング位置
+    uint32_t lost;
+    uint32_t pulses;
+    uint64_t lastRiseUs;
+    uint64_t prevPeriodRiseUs;
+    uint8_t sm;
+    uint8_t dma;
+    CaptureMode mode;
+    bool active;
+  };
+
+  /**
+   * @brief PIOの31ビット時刻を、64ビットのシステム時刻に展開しますわ
+   * @details イベントは必ず nowUs より過去なので、nowUs を超えない最大の候補を選びますの。
+   */
+  static uint64_t unwrapTime(const Channel& c, uint32_t word, uint64_t nowUs) {
+    uint64_t elapsed = (0x7FFFFFFFu - (word & 0x7FFFFFFFu)) & 0x7FFFFFFFu;
+    uint64_t span = nowUs - c.startUs;
+    uint64_t wraps = span >= elapsed ? (span - elapsed) >> 31 : 0;
+    return c.startUs + elapsed + (wraps << 31);
+  }
+
+  void rearm(uint8_t ch) {
+    Channel& c = _channels[ch];
+    dma_channel_abort(c.dma);
+    // 中止までに書かれた分を基準位置へ繰り込み、未読の分はそのまま読めるようにしますの
+    uint32_t done = kTransferCount - dma_channel_hw_addr(c.dma)->transfer_count;
+    c.ringBase += done;
+    c.readCount -= done;
+    dma_channel_set_write_addr(c.dma, &_rings[ch][c.ringBase % CAPTURE_RING_WORDS], false);
+    dma_channel_set_trans_count(c.dma, kTransferCount, true);
+  }
+
+  // DMAのリング折り返しはバッファがサイズ境界に揃っている必要がありますの
+  alignas(1u << CAPTURE_RING_BITS) uint32_t _rings[CAPTURE_MAX_CHANNELS][CAPTURE_RING_WORDS];
+  Channel _channels[CAPTURE_MAX_CHANNELS] = {};
+  uint _offset = 0;
+  bool _programLoaded = false;
+};
@@ -0,0 +1,240 @@
+/**
+ * @file ram_func.h
+ * @brief ホットパスのコードをSRAMに置くためのマクロと、その配置の確認ですわ
+ * @details
+ * RP2040 のコードは普段QSPIフラッシュからXIPキャッシュ (16 KB) 越しに実行されますので、
+ * キャッシュを外すたびにフラッシュからの読み込み待ちが入り、サンプリングの時刻が揺らぎますの。
+ * SDライブラリのような大きなコードを通ると、ホットパスはキャッシュから追い出されてしまいますわ。
+ *
+ * - LOGGER_RAM_FUNC(name): 関数を .time_critical セクションへ置き、起動時にSRAMへコピーさせますの
+ * - LOGGER_RAM_INLINE: ホットパスから呼ぶ小さな関数を必ず展開させますの。展開しても、中の演算が
+ *   libgcc のヘルパーの呼び出しになることはありますわ (M0+ には割り算も CLZ の命令もありませんので、
+ *   2の冪でない / や %、__builtin_clz は __aeabi_uidivmod や __clzsi2 を呼びますの)。
+ *   ヘルパーはフラッシュにありますので、ホットパスではこうした演算そのものを使わないでくださいまし
+ * - ramTimeUs32() / ramTimeUs64(): タイマーを直接読む時刻ですわ。micros() と time_us_64() は
+ *   フラッシュにありますので、XIPが止まっている間 (フラッシュの消去中) に呼ぶ処理ではこちらを使いますの
+ * - RamFuncEntry / ramFuncReport(): 登録した関数のアドレスがどの領域にあるかを表示しますの
+ * - ramFuncReportHelpers(): 登録した関数から直接呼ばれている libgcc のヘルパーと、その配置を表示しますの
+ *
+ * LOGGER_HOTPATH_IN_RAM を 0 にすると、比較のために全部フラッシュへ戻せますわ。
+ * 前半はArduinoに依存しませんので、ホストでビルドするヘッダーからもインクルードできますの。
+ */
+#pragma once
+#include <stdint.h>
+
+#ifndef LOGGER_HOTPATH_IN_RAM
+#define LOGGER_HOTPATH_IN_RAM 1
+#endif
+
+#if LOGGER_HOTPATH_IN_RAM && defined(ARDUINO_ARCH_RP2040)
+#include <pico/platform.h>
+#define LOGGER_RAM_FUNC(name) __not_in_flash_func(name)
+#else
+#define LOGGER_RAM_FUNC(name) name
+#endif
+
+#if defined(__GNUC__)
+#define LOGGER_RAM_INLINE inline __attribute__((always_inline))
+#else
+#define LOGGER_RAM_INLINE inline
+#endif
+
+// RP2040 のアドレス領域ですわ
+#define RAM_FUNC_XIP_BASE   0x10000000UL
+#define RAM_FUNC_XIP_END    0x11000000UL
+#define RAM_FUNC_SRAM_BASE  0x20000000UL
+#define RAM_FUNC_SRAM_END   0x20042000UL
+
+/** @brief アドレスが指す領域の名前ですわ ("sram" / "flash" / "rom") */
+inline const char* ramFuncRegion(uintptr_t addr) {
+  addr &= ~static_cast<uintptr_t>(1); // Thumb のビットを落としますの
+  if (addr >= RAM_FUNC_SRAM_BASE && addr < RAM_FUNC_SRAM_END) {
+    return "sram";
+  }
+  if (addr >= RAM_FUNC_XIP_BASE && addr < RAM_FUNC_XIP_END) {
+    return "flash";
+  }
+  return "rom";
+}
+
+#if defined(ARDUINO_ARCH_RP2040)
+#include <hardware/structs/timer.h>
+
+/** @brief time_us_32() と同じ値ですわ (micros() と同じ時間軸ですの) */
+LOGGER_RAM_INLINE uint32_t ramTimeUs32() {
+  return timer_hw->timerawl;
+}
+
+/** @brief time_us_64() と同じ値ですわ。上位を読み直して、下位の桁上がりとずれないようにしますの */
+LOGGER_RAM_INLINE uint64_t ramTimeUs64() {
+  uint32_t hi = timer_hw->timerawh;
+  uint32_t lo;
+  for (;;) {
+    lo = timer_hw->timerawl;
+    const uint32_t hi2 = timer_hw->timerawh;
+    if (hi == hi2) {
+      break;
+    }
+    hi = hi2;
+  }
+  return (static_cast<uint64_t>(hi) << 32) | lo;
+}
+#endif
+
+//================================================
+//== 配置の報告 (Arduino専用)
+//================================================
+#ifdef ARDUINO
+#include <Arduino.h>
+
+/** @brief SRAMに置いたつもりの関数ですわ */
+struct RamFuncEntry {
+  const char* name;
+  const void* addr;
+};
+
+#define RAM_FUNC_ENTRY(fn) {#fn, reinterpret_cast<const void*>(&fn)}
+
+/**
+ * @brief 登録した関数の配置を表示しますわ
+ * @param verbose false なら、SRAMに無いものだけを表示しますの
+ * @return SRAMに無かった関数の数
+ */
+inline int ramFuncReport(Print& out, const RamFuncEntry* entries, size_t count, bool verbose) {
+  int misplaced = 0;
+  for (size_t i = 0; i < count; i++) {
+    uintptr_t addr = reinterpret_cast<uintptr_t>(entries[i].addr);
+    const char* region = ramFuncRegion(addr);
+    bool inRam = region[0] == 's';
+    if (!inRam) {
+      misplaced++;
+    }
+    if (verbose || !inRam) {
+      out.printf("  %-20s 0x%08lx %s\r\n", entries[i].name, static_cast<unsigned long>(addr), region);
+    }
+  }
+  return misplaced;
+}
+
+#if defined(ARDUINO_ARCH_RP2040)
+// 割り算とビット演算の libgcc ヘルパーですわ。コアがSDKの実装へ差し替えていても、この名前で届きますの
+extern "C" {
+unsigned __aeabi_uidiv(unsigned, unsigned);
+unsigned long long __aeabi_uidivmod(unsigned, unsigned);
+int __aeabi_idiv(int, int);
+long long __aeabi_idivmod(int, int);
+int __clzsi2(unsigned);
+int __ctzsi2(unsigned);
+int __popcountsi2(unsigned);
+}
+
+// 関数の長さは実行時には分かりませんので、次に分かっている関数の先頭か、ここまでを調べますの
+#define RAM_FUNC_SCAN_BYTES 1024
+
+/** @brief Thumb の BL 命令なら、飛び先のアドレスを求めますわ */
+inline bool ramFuncDecodeBl(const uint16_t* p, uintptr_t* target) {
+  const uint32_t hi = p[0];
+  const uint32_t lo = p[1];
+  if ((hi & 0xF800) != 0xF000 || (lo & 0xD000) != 0xD000) {
+    return false;
+  }
+  const uint32_t s = (hi >> 10) & 1;
+  const uint32_t i1 = ((lo >> 13) & 1) == s;
+  const uint32_t i2 = ((lo >> 11) & 1) == s;
+  uint32_t offset = (s << 24) | (i1 << 23) | (i2 << 22) | ((hi & 0x3FF) << 12) | ((lo & 0x7FF) << 1);
+  if (s) {
+    offset |= 0xFE000000UL; // 25ビットの符号を広げますの
+  }
+  *target = reinterpret_cast<uintptr_t>(p) + 4 + static_cast<intptr_t>(static_cast<int32_t>(offset));
+  return true;
+}
+
+/**
+ * @brief 飛び先 target が helper そのものか、helper へ飛ぶリンカーの veneer かを調べますわ
+ * @details SRAMからフラッシュへは BL が届きませんので、リンカーは近くに veneer を置いて、
+ *          その中の定数 (飛び先のアドレス) から飛びますの。先頭の 16 バイトにその定数がありますわ。
+ */
+inline bool ramFuncBranchesTo(uintptr_t target, uintptr_t helper) {
+  helper &= ~static_cast<uintptr_t>(1);
+  if (target == helper) {
+    return true;
+  }
+  if (ramFuncRegion(target)[0] != 's') {
+    return false; // veneer はSRAMの呼び出し元の近くに置かれますの
+  }
+  for (uintptr_t word = (target + 3) & ~static_cast<uintptr_t>(3); word < target + 16; word += 4) {
+    if ((*reinterpret_cast<const uint32_t*>(word) & ~1UL) == helper) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief 登録した関数から直接呼ばれている libgcc のヘルパーを表示しますわ
+ * @param verbose false なら、SRAMに無いヘルパーを呼んでいるものだけを表示しますの
+ * @return 呼ばれていて、SRAMに無かったヘルパーの数
+ * @details 各関数の先頭から、次に登録した関数の先頭 (最大 RAM_FUNC_SCAN_BYTES) までの BL 命令を調べますの。
+ *          間に登録していない関数があればその呼び出しも数えますし、関数ポインタ経由の呼び出しや
+ *          登録していない関数の中までは追えませんわ。ビルドしたものを正確に調べるには
+ *          tools/ram_report --calls を使ってくださいまし。
+ */
+inline int ramFuncReportHelpers(Print& out, const RamFuncEntry* entries, size_t count, bool verbose) {
+  static const RamFuncEntry kHelpers[] = {
+    RAM_FUNC_ENTRY(__aeabi_uidiv), RAM_FUNC_ENTRY(__aeabi_uidivmod), RAM_FUNC_ENTRY(__aeabi_idiv),
+    RAM_FUNC_ENTRY(__aeabi_idivmod), RAM_FUNC_ENTRY(__clzsi2), RAM_FUNC_ENTRY(__ctzsi2),
+    RAM_FUNC_ENTRY(__popcountsi2),
+  };
+  const size_t helperCount = sizeof(kHelpers) / sizeof(kHelpers[0]);
+  int misplaced = 0;
+  bool any = false;
+  for (size_t i = 0; i < count; i++) {
+    const uintptr_t start = reinterpret_cast<uintptr_t>(entries[i].addr) & ~static_cast<uintptr_t>(1);
+    uintptr_t end = start + RAM_FUNC_SCAN_BYTES;
+    for (size_t j = 0; j < count; j++) {
+      const uintptr_t other = reinterpret_cast<uintptr_t>(entries[j].addr) & ~static_cast<uintptr_t>(1);
+      if (other > start && other < end) {
+        end = other;
+      }
+    }
+    uint32_t calledMask = 0;
+    for (uintptr_t pc = start; pc + 4 <= end; pc += 2) {
+      uintptr_t target;
+      if (!ramFuncDecodeBl(reinterpret_cast<const uint16_t*>(pc), &target)) {
+        continue;
+      }
+      for (size_t h = 0; h < helperCount; h++) {
+        if (ramFuncBranchesTo(target, reinterpret_cast<uintptr_t>(kHelpers[h].addr))) {
+          calledMask |= 1UL << h;
+        }
+      }
+      pc += 2; // BL は 4 バイトですの
+    }
+    for (size_t h = 0; h < helperCount; h++) {
+      if (!(calledMask & (1UL << h))) {
+        continue;
+      }
+      const uintptr_t addr = reinterpret_cast<uintptr_t>(kHelpers[h].addr);
+      const char* region = ramFuncRegion(addr);
+      const bool inRam = region[0] == 's';
+      if (!inRam) {
+        misplaced++;
+      }
+      if (verbose || !inRam) {
+        if (!any) {
+          out.printf("  libgcc ヘルパーの呼び出し:\r\n");
+          any = true;
+        }
+        out.printf("  %-20s 0x%08lx %s <- %s\r\n", kHelpers[h].name, static_cast<unsigned long>(addr), region,
+                   entries[i].name);
+      }
+    }
+  }
+  if (verbose && !any) {
+    out.printf("  libgcc ヘルパーの呼び出しはありませんわ\r\n");
+  }
+  return misplaced;
+}
+#endif // ARDUINO_ARCH_RP2040
+
+#endif // ARDUINO
@@ -0,0 +1,291 @@
+/**
+ * @file rice_codec.h
+ * @brief 固定次数の整数予測とRice符号による、チャンネルごとの可逆圧縮 (FLAC の固定予測と同じ方式)
+ * @details
+ * kHz 級の IMU や気圧のような滑らかな信号は、差分を取っただけでは冗長さが残る。
+ * 1ブロック (既定 256 サンプル) ごとに 0〜4 次の固定予測子
+ * (0: 0, 1: x[-1], 2: 2x[-1]-x[-2], 3: 3x[-1]-3x[-2]+x[-3], 4: 4x[-1]-6x[-2]+4x[-3]-x[-4])
+ * のうち残差の絶対値和が最小のものを選び、残差を32サンプルの区間ごとにパラメータ k を
+ * 選び直すRice符号で書く。
+ *
+ * - 演算はすべて32ビット整数の加減算・小さな定数倍・シフトで、除算命令の無い Cortex-M0+ でも速い
+ *   (残差は 2^32 を法とする差なので、オーバーフローしても可逆である)
+ * - ブロックは先頭の order サンプルをそのまま持ち、前のブロックに依存しない。
+ *   どのブロックからでも復号できる
+ * - 符号長の上限は1サンプル 64 ビット (大きすぎる残差はエスケープして生の32ビットで書く)
+ *
+ * @section rice_format ブロックのビット列 (MSB から順に詰め、末尾はバイト境界まで 0 で埋める)
+ * - order: 3 ビット
+ * - 先頭の order サンプル: 各 32 ビット
+ * - 区間ごと (RICE_PARTITION サンプル、最後は端数): k を 5 ビット、続いて各残差
+ *   - u = zigzag(残差)、q = u >> k。q < RICE_ESCAPE_Q なら q 個の 1、0、u の下位 k ビット
+ *   - そうでなければ RICE_ESCAPE_Q 個の 1 と、u の 32 ビット
+ *
+ * Arduino に依存しないので、ファームウェアとホストツールの両方で使える。
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "ram_func.h"
+
+#define RICE_BLOCK_SAMPLES 256 // 1ブロックの最大サンプル数
+#define RICE_PARTITION     32  // k を選び直す区間のサンプル数
+#define RICE_MAX_ORDER     4
+#define RICE_MAX_K         30
+#define RICE_ESCAPE_Q      32
+// n サンプルのブロックを符号化したときの最大バイト数
+#define RICE_MAX_BLOCK_BYTES(n) (((3 + RICE_MAX_ORDER * 32 + ((n) / RICE_PARTITION + 1) * 5 + (n) * 64) + 7) / 8)
+
+//================================================
+//== ビット入出力
+//================================================
+
+/** @brief MSB から詰めるビット書き込み。32ビットのアキュムレータだけを使う */
+class RiceBitWriter {
+public:
+  RiceBitWriter(uint8_t* out, size_t capacity) : _out(out), _cap(capacity) {}
+
+  /** @brief v の下位 n ビット (n <= 24) を書く */
+  LOGGER_RAM_INLINE void put(uint32_t v, uint32_t n) {
+    _acc = (_acc << n) | (v & ((1u << n) - 1));
+    _bits += n;
+    while (_bits >= 8) {
+      _bits -= 8;
+      if (_pos < _cap) {
+        _out[_pos] = static_cast<uint8_t>(_acc >> _bits);
+      }
+      _pos++;
+    }
+  }
+
+  LOGGER_RAM_INLINE void put32(uint32_t v) {
+    put(v >> 16, 16);
+    put(v & 0xFFFF, 16);
+  }
+
+  /** @brief n 個の 1 を書く */
+  LOGGER_RAM_INLINE void ones(uint32_t n) {
+    while (n >= 16) {
+      put(0xFFFF, 16);
+      n -= 16;
+    }
+    if (n > 0) {
+      put((1u << n) - 1, n);
+    }
+  }
+
+  /** @brief バイト境界まで 0 で埋め、書いたバイト数を返す。容量を超えていれば 0 */
+  size_t finish() {
+    if (_bits > 0) {
+      put(0, 8 - _bits);
+    }
+    return _pos <= _cap ? _pos : 0;
+  }
+
+private:
+  uint8_t* _out;
+  size_t _cap;
+  size_t _pos = 0;
+  uint32_t _acc = 0;
+  uint32_t _bits = 0;
+};
+
+/** @brief MSB から読むビット読み出し。範囲外は 0 として読み、overrun() で知らせる */
+class RiceBitReader {
+public:
+  RiceBitReader(const uint8_t* in, size_t len) : _in(in), _len(len) {}
+
+  /** @brief n ビット (n <= 24) を読む */
+  uint32_t get(uint32_t n) {
+    while (_bits < n) {
+      _acc = (_acc << 8) | (_pos < _len ? _in[_pos] : 0);
+      _pos++;
+      _bits += 8;
+    }
+    _bits -= n;
+    return (_acc >> _bits) & ((1u << n) - 1);
+  }
+
+  uint32_t get32() {
+    uint32_t hi = get(16);
+    return (hi << 16) | get(16);
+  }
+
+  /** @brief 0 が現れるまでの 1 の数を数える (区切りの 0 も読む)。limit 個で打ち切る */
+  uint32_t unary(uint32_t limit) {
+    uint32_t q = 0;
+    while (q < limit && get(1) != 0) {
+      q++;
+    }
+    return q;
+  }
+
+  bool overrun() const { return _pos > _len; }
+
+private:
+  const uint8_t* _in;
+  size_t _len;
+  size_t _pos = 0;
+  uint32_t _acc = 0;
+  uint32_t _bits = 0;
+};
+
+//================================================
+//== 予測と符号化
+//================================================
+
+/** @brief order 次の固定予測の残差 (2^32 を法とする) */
+LOGGER_RAM_INLINE uint32_t riceResidual(const int32_t* x, int i, uint32_t order) {
+  const uint32_t* u = reinterpret_cast<const uint32_t*>(x);
+  switch (order) {
+    case 0:  return u[i];
+    case 1:  return u[i] - u[i - 1];
+    case 2:  return u[i] - 2 * u[i - 1] + u[i - 2];
+    case 3:  return u[i] - 3 * u[i - 1] + 3 * u[i - 2] - u[i - 3];
+    default: return u[i] - 4 * u[i - 1] + 6 * u[i - 2] - 4 * u[i - 3] + u[i - 4];
+  }
+}
+
+LOGGER_RAM_INLINE uint32_t riceZigzag(uint32_t r) {
+  return (r << 1) ^ (0u - (r >> 31));
+}
+
+LOGGER_RAM_INLINE uint32_t riceUnzigzag(uint32_t u) {
+  return (u >> 1) ^ (0u - (u & 1));
+}
+
+/**
+ * @brief 残差の絶対値和が最小の予測次数を選ぶ
+ * @details 5つの次数の残差は、差分を1段ずつ取るだけで同時に求まる。
+ */
+inline uint32_t riceChooseOrder(const int32_t* x, uint32_t n) {
+  if (n <= RICE_MAX_ORDER) {
+    return 0;
+  }
+  uint64_t sum[RICE_MAX_ORDER + 1] = {};
+  const uint32_t* u = reinterpret_cast<const uint32_t*>(x);
+  // d1..d3 は1つ前のサンプルでの1〜3階差分
+  uint32_t d1 = u[3] - u[2];
+  uint32_t d2 = d1 - (u[2] - u[1]);
+  uint32_t d3 = d2 - ((u[2] - u[1]) - (u[1] - u[0]));
+  for (uint32_t i = RICE_MAX_ORDER; i < n; i++) {
+    uint32_t e0 = u[i];
+    uint32_t e1 = e0 - u[i - 1];
+    uint32_t e2 = e1 - d1;
+    uint32_t e3 = e2 - d2;
+    uint32_t e4 = e3 - d3;
+    sum[0] += riceZigzag(e0);
+    sum[1] += riceZigzag(e1);
+    sum[2] += riceZigzag(e2);
+    sum[3] += riceZigzag(e3);
+    sum[4] += riceZigzag(e4);
+    d1 = e1;
+    d2 = e2;
+    d3 = e3;
+  }
+  uint32_t best = 0;
+  for (uint32_t o = 1; o <= RICE_MAX_ORDER; o++) {
+    if (sum[o] < sum[best]) {
+      best = o;
+    }
+  }
+  return best;
+}
+
+/** @brief 区間の zigzag 残差の和から、Rice パラメータ k を見積もる (平均のおおよその log2) */
+LOGGER_RAM_INLINE uint32_t riceChooseK(uint64_t sum, uint32_t count) {
+  uint32_t k = 0;
+  while (k < RICE_MAX_K && (static_cast<uint64_t>(count) << (k + 1)) < sum) {
+    k++;
+  }
+  return k;
+}
+
+/**
+ * @brief n サンプルを1ブロックに符号化する
+ * @param capacity out の大きさ。RICE_MAX_BLOCK_BYTES(n) あれば必ず足りる
+ * @return 書いたバイト数。足りなければ 0
+ */
+inline size_t riceEncodeBlock(const int32_t* x, uint32_t n, uint8_t* out, size_t capacity) {
+  RiceBitWriter w(out, capacity);
+  const uint32_t order = riceChooseOrder(x, n);
+  w.put(order, 3);
+  for (uint32_t i = 0; i < order && i < n; i++) {
+    w.put32(static_cast<uint32_t>(x[i]));
+  }
+  for (uint32_t start = 0; start < n; start += RICE_PARTITION) {
+    const uint32_t end = start + RICE_PARTITION < n ? start + RICE_PARTITION : n;
+    const uint32_t first = start < order ? order : start;
+    uint64_t sum = 0;
+    for (uint32_t i = first; i < end; i++) {
+      sum += riceZigzag(riceResidual(x, i, order));
+    }
+    const uint32_t k = riceChooseK(sum, end > first ? end - first : 1);
+    w.put(k, 5);
+    for (uint32_t i = first; i < end; i++) {
+      const uint32_t u = riceZigzag(riceResidual(x, i, order));
+      const uint32_t q = u >> k;
+      if (q < RICE_ESCAPE_Q) {
+        w.ones(q);
+        w.put(0, 1);
+        if (k > 16) {
+          w.put(u >> 16, k - 16);
+          w.put(u & 0xFFFF, 16);
+        } else if (k > 0) {
+          w.put(u, k);
+        }
+      } else {
+        w.ones(RICE_ESCAPE_Q);
+        w.put32(u);
+      }
+    }
+  }
+  return w.finish();
+}
+
+/**
+ * @brief 1ブロックを復号する
+ * @return ビット列が途中で切れていれば false
+ */
+inline bool riceDecodeBlock(const uint8_t* in, size_t len, uint32_t n, int32_t* x) {
+  RiceBitReader r(in, len);
+  const uint32_t order = r.get(3);
+  if (order > RICE_MAX_ORDER) {
+    return false;
+  }
+  uint32_t* u = reinterpret_cast<uint32_t*>(x);
+  for (uint32_t i = 0; i < order && i < n; i++) {
+    u[i] = r.get32();
+  }
+  for (uint32_t start = 0; start < n; start += RICE_PARTITION) {
+    const uint32_t end = start + RICE_PARTITION < n ? start + RICE_PARTITION : n;
+    const uint32_t first = start < order ? order : start;
+    const uint32_t k = r.get(5);
+    for (uint32_t i = first; i < end; i++) {
+      uint32_t q = r.unary(RICE_ESCAPE_Q);
+      uint32_t z;
+      if (q < RICE_ESCAPE_Q) {
+        uint32_t low = 0;
+        if (k > 16) {
+          low = r.get(k - 16) << 16;
+          low |= r.get(16);
+        } else if (k > 0) {
+          low = r.get(k);
+        }
+        z = (q << k) | low;
+      } else {
+        z = r.get32();
+      }
+      // 予測値を足し戻す (riceResidual と同じ式を残差 0 で評価した値の逆)
+      const uint32_t e = riceUnzigzag(z);
+      switch (order) {
+        case 0:  u[i] = e; break;
+        case 1:  u[i] = e + u[i - 1]; break;
+        case 2:  u[i] = e + 2 * u[i - 1] - u[i - 2]; break;
+        case 3:  u[i] = e + 3 * u[i - 1] - 3 * u[i - 2] + u[i - 3]; break;
+        default: u[i] = e + 4 * u[i - 1] - 6 * u[i - 2] + 4 * u[i - 3] - u[i - 4]; break;
+      }
+    }
+  }
+  return !r.overrun();
+}
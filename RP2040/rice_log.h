@@ -0,0 +1,200 @@
+/**
+ * @file rice_log.h
+ * @brief Rice 圧縮のログ (format = rice) のチャンク形式と、チャンネルごとの書き込み器ですわ
+ * @details
+ * CSV の1行に全チャンネルを並べる代わりに、チャンネルごとに値を RICE_BLOCK_SAMPLES 個ずつ溜めて
+ * rice_codec.h で圧縮し、「ブロック」チャンクとしてログへ書きますの。時刻 (timestamp_ms) も
+ * チャンネル 0 として同じように圧縮しますので、一定周期なら1サンプル数ビットで済みますわ。
+ * 設定のコメント行・CSV ヘッダー・トレーラー・サテライトの行などのテキストは
+ * 「テキスト」チャンクにまとめますの。
+ *
+ * 各チャンクには同期用のマジックとペイロードの CRC がありますので、読み手はファイルの
+ * 途中からでも次のチャンクを探して復号を始められますし、電源断で途切れた末尾も見分けられますわ。
+ * 定期フラッシュのたびに溜まりかけのブロックも書き出しますので、失うのは最後の周期の分だけですの。
+ *
+ * ホストでは tools/logreader.h がこの形式を読み、tools/rice2csv.cpp が元の CSV に戻しますわ。
+ * Arduinoに依存しませんので、ホストでも同じ書き込み器でファイルを作れますの。
+ *
+ * @section rice_log_format ファイル形式 (リトルエンディアン)
+ * - チャンクの並び。各チャンクは RiceChunkHeader (20 バイト) とペイロード (payloadBytes)
+ *   - テキスト: ペイロードはそのままのテキスト (改行込み)
+ *   - ブロック: ペイロードは rice_codec.h のブロック。サンプル k は基本サンプル番号
+ *     firstIndex + k × step のもの (step はチャンネルの間引き数)
+ *   - sequence はブロックを書いた順の通し番号で、全チャンネルで1つの並びですの。テレメトリで
+ *     同じチャンクを送れば、地上でカードの記録と突き合わせられますわ (tools/telem_recorder.cpp)。
+ *     この欄ができる前のログでは 0 ですの
+ */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "rice_codec.h"
+
+#define RICE_CHUNK_MAGIC    0x314B4352UL // "RCK1"
+#define RICE_TEXT_BYTES     256          // テキストチャンクの最大ペイロード
+#define RICE_MAX_CHANNELS   4            // 時刻を含むチャンネル数の上限
+
+enum RiceChunkType : uint8_t {
+  RICE_CHUNK_TEXT = 1,
+  RICE_CHUNK_BLOCK = 2,
+};
+
+struct RiceChunkHeader {
+  uint32_t magic;        ///< RICE_CHUNK_MAGIC
+  uint8_t type;          ///< RiceChunkType
+  uint8_t channel;       ///< 0: 時刻 (ms)、1 以降: データチャンネル
+  uint16_t payloadBytes; ///< ヘッダーに続くペイロードのバイト数
+  uint32_t firstIndex;   ///< 先頭サンプルの基本サンプル番号 (ブロックのみ)
+  uint16_t count;        ///< サンプル数 (ブロックのみ)
+  uint16_t step;         ///< サンプル間の基本サンプル数 (ブロックのみ)
+  uint16_t crc16;        ///< ペイロードの CRC-16/CCITT-FALSE
+  uint16_t sequence;     ///< ファイル内のブロックの通し番号 (下位16ビット。テキストは 0)
+};
+static_assert(sizeof(RiceChunkHeader) == 20, "RiceChunkHeader must stay 20 bytes");
+
+#define RICE_MAX_CHUNK_BYTES (sizeof(RiceChunkHeader) + RICE_MAX_BLOCK_BYTES(RICE_BLOCK_SAMPLES))
+
+/** @brief CRC-16/CCITT-FALSE の表ですわ。コンパイル時に作りますの */
+struct RiceCrcTable {
+  uint16_t v[256];
+  constexpr RiceCrcTable() : v() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint16_t c = static_cast<uint16_t>(i << 8);
+      for (int k = 0; k < 8; k++) {
+        c = (c & 0x8000) ? static_cast<uint16_t>((c << 1) ^ 0x1021) : static_cast<uint16_t>(c << 1);
+      }
+      v[i] = c;
+    }
+  }
+};
+inline constexpr RiceCrcTable kRiceCrcTable{};
+
+inline uint16_t riceCrc16(const uint8_t* data, size_t len) {
+  uint16_t c = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    c = static_cast<uint16_t>((c << 8) ^ kRiceCrcTable.v[((c >> 8) ^ data[i]) & 0xFF]);
+  }
+  return c;
+}
+
+/** @brief 圧縮の統計ですの */
+struct RiceLogStats {
+  uint32_t samples;      ///< 圧縮したサンプル数 (全チャンネル)
+  uint32_t blocks;       ///< 書いたブロック数
+  uint64_t encodedBytes; ///< ブロックチャンクのバイト数 (ヘッダー込み)
+  uint64_t encodeCycles; ///< 符号化にかかったサイクル数 (サイクルカウンタを渡したときだけ)
+};
+
+/**
+ * @brief チャンネルごとにサンプルを溜めて、ブロックとテキストのチャンクを書き出しますわ
+ * @tparam Sink reserve(size_t maxBytes) -> uint8_t* (連続した書き込み先) と commit(size_t bytes) を持つ型
+ */
+template <class Sink>
+class RiceLogWriter {
+public:
+  explicit RiceLogWriter(Sink& sink) : _sink(sink) {}
+
+  /**
+   * @brief チャンネル構成を決めますわ
+   * @param steps チャンネルごとの間引き数 (0 なら使いませんの)。steps[0] は時刻で通常 1
+   */
+  void begin(uint8_t channelCount, const uint16_t* steps) {
+    _channelCount = channelCount > RICE_MAX_CHANNELS ? RICE_MAX_CHANNELS : channelCount;
+    for (uint8_t ch = 0; ch < _channelCount; ch++) {
+      _ch[ch].step = steps[ch];
+      _ch[ch].count = 0;
+    }
+    _textLen = 0;
+    _stats = {};
+  }
+
+  /** @brief 符号化のサイクル数を測る関数を渡しますの (rp2040.getCycleCount など) */
+  void setCycleCounter(uint32_t (*counter)()) { _cycles = counter; }
+
+  /** @brief チャンネル ch の、基本サンプル番号 index の値を加えますわ */
+  LOGGER_RAM_INLINE void addSample(uint8_t ch, uint32_t index, int32_t value) {
+    Channel& c = _ch[ch];
+    if (c.count == 0) {
+      c.firstIndex = index;
+    }
+    c.values[c.count++] = value;
+    if (c.count == RICE_BLOCK_SAMPLES) {
+      emitBlock(ch);
+    }
+  }
+
+  /** @brief テキストを加えますわ。溜まったらテキストチャンクにしますの */
+  void addText(const char* data, size_t len) {
+    while (len > 0) {
+      size_t n = RICE_TEXT_BYTES - _textLen;
+      if (n > len) {
+        n = len;
+      }
+      memcpy(_text + _textLen, data, n);
+      _textLen += n;
+      data += n;
+      len -= n;
+      if (_textLen == RICE_TEXT_BYTES) {
+        emitText();
+      }
+    }
+  }
+
+  /** @brief 溜まりかけのブロックとテキストもすべて書き出しますわ (定期フラッシュと終了時) */
+  void flush() {
+    emitText();
+    for (uint8_t ch = 0; ch < _channelCount; ch++) {
+      if (_ch[ch].count > 0) {
+        emitBlock(ch);
+      }
+    }
+  }
+
+  const RiceLogStats& stats() const { return _stats; }
+
+private:
+  struct Channel {
+    int32_t values[RICE_BLOCK_SAMPLES];
+    uint32_t firstIndex;
+    uint16_t count;
+    uint16_t step;
+  };
+
+  void emitBlock(uint8_t ch) {
+    Channel& c = _ch[ch];
+    uint32_t t0 = _cycles != nullptr ? _cycles() : 0;
+    uint8_t* out = _sink.reserve(RICE_MAX_CHUNK_BYTES);
+    size_t payload = riceEncodeBlock(c.values, c.count, out + sizeof(RiceChunkHeader), RICE_MAX_BLOCK_BYTES(RICE_BLOCK_SAMPLES));
+    RiceChunkHeader h = {RICE_CHUNK_MAGIC, RICE_CHUNK_BLOCK, ch, static_cast<uint16_t>(payload), c.firstIndex, c.count, c.step,
+                         riceCrc16(out + sizeof(RiceChunkHeader), payload), static_cast<uint16_t>(_stats.blocks)};
+    memcpy(out, &h, sizeof(h));
+    _sink.commit(sizeof(h) + payload);
+    if (_cycles != nullptr) {
+      _stats.encodeCycles += _cycles() - t0;
+    }
+    _stats.samples += c.count;
+    _stats.blocks++;
+    _stats.encodedBytes += sizeof(h) + payload;
+    c.count = 0;
+  }
+
+  void emitText() {
+    if (_textLen == 0) {
+      return;
+    }
+    uint8_t* out = _sink.reserve(sizeof(RiceChunkHeader) + _textLen);
+    RiceChunkHeader h = {RICE_CHUNK_MAGIC, RICE_CHUNK_TEXT, 0, static_cast<uint16_t>(_textLen), 0, 0, 0,
+                         riceCrc16(reinterpret_cast<const uint8_t*>(_text), _textLen), 0};
+    memcpy(out, &h, sizeof(h));
+    memcpy(out + sizeof(h), _text, _textLen);
+    _sink.commit(sizeof(h) + _textLen);
+    _textLen = 0;
+  }
+
+  Sink& _sink;
+  Channel _ch[RICE_MAX_CHANNELS];
+  uint8_t _channelCount = 0;
+  char _text[RICE_TEXT_BYTES];
+  size_t _textLen = 0;
+  uint32_t (*_cycles)() = nullptr;
+  RiceLogStats _stats = {};
+};
@@ -0,0 +1,166 @@
+/**
+ * @file spi_arbiter.h
+ * @brief SDカードと同じSPIバス (GPIO 16/18/19) を使うセンサーのための、優先度付きの調停役ですわ
+ * @details
+ * 小さな基板ではセンサーがSDカードとバスを共有しますので、数KBのブロックを1回の write() で
+ * 書くと、その間 (カードが遅ければ数ミリ秒以上) センサーを読めませんの。
+ * そこでカードへの書き込みをセクタ境界 (既定 512 バイト) で切り分け、切れ目ごとにバスを手放して、
+ * 期限の来た優先度の高い処理 (センサーの読み取り) を先に通しますわ。
+ *
+ * - クライアントは番号が小さいほど優先ですの。SPI_CLIENT_SENSOR が最優先ですわ
+ * - 切れ目で呼ぶ処理 (setUrgent) は「期限が来ていれば読み取って true」を返す関数ですの。
+ *   書き込みの途中から呼ばれますので、ここで書き込みバッファに触れてはいけませんわ
+ * - 切り分けの単位はファイル位置のセクタ境界に揃えますの。SdFat は埋まったセクタをその場で
+ *   書き切り、CS を上げてから次へ進みますので、切れ目では必ずバスが空いていますわ
+ * - sync (FAT・ディレクトリエントリの確定) は分けられませんので、保持時間の統計で見えるようにしますの
+ *
+ * Arduinoに依存しませんので、時刻の関数を渡せばホストでも同じ手順を試せますわ。
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPI_SECTOR_BYTES 512
+
+/** @brief バスの利用者ですわ。値が小さいほど優先ですの */
+enum SpiClient : uint8_t {
+  SPI_CLIENT_SENSOR = 0, ///< 周期的なセンサーの読み取り (時間に厳しいもの)
+  SPI_CLIENT_CARD,       ///< SDカードへの書き込みと確定
+  SPI_CLIENT_COUNT
+};
+
+inline const char* spiClientName(uint8_t c) {
+  switch (c) {
+    case SPI_CLIENT_SENSOR: return "sensor";
+    case SPI_CLIENT_CARD:   return "card";
+    default:                return "?";
+  }
+}
+
+/** @brief 調停の統計ですわ */
+struct SpiArbiterStats {
+  uint32_t grants[SPI_CLIENT_COUNT];    ///< バスを渡した回数
+  uint32_t maxHoldUs[SPI_CLIENT_COUNT]; ///< 1回に保持した最長時間
+  uint32_t conflicts;                   ///< 使用中のバスを求められた回数 (0 のはずですの)
+  uint32_t slices;                      ///< 切り分けた書き込みの断片の数
+  uint32_t preemptions;                 ///< 書き込みの切れ目で優先の処理を通した回数
+};
+
+class SpiArbiter {
+public:
+  using UrgentFn = bool (*)();
+  using ClockFn = uint32_t (*)();
+
+  /** @brief 時刻 (マイクロ秒) の関数と、切り分けの単位を決めますの。sliceBytes = 0 なら切り分けませんわ */
+  void begin(ClockFn clock, uint32_t sliceBytes) {
+    _clock = clock;
+    _sliceBytes = sliceBytes;
+    _owner = SPI_CLIENT_COUNT;
+    _stats = {};
+  }
+
+  /** @brief 書き込みの切れ目で呼ぶ処理を登録しますわ (nullptr で解除) */
+  void setUrgent(UrgentFn fn) { _urgent = fn; }
+  UrgentFn urgent() const { return _urgent; }
+  void setSliceBytes(uint32_t bytes) { _sliceBytes = bytes; }
+  uint32_t sliceBytes() const { return _sliceBytes; }
+
+  /** @brief バスを取りますの。ほかが使用中なら数えて false ですわ (協調的に呼ぶ限り起きませんの) */
+  bool acquire(SpiClient c) {
+    if (_owner != SPI_CLIENT_COUNT && _owner != c) {
+      _stats.conflicts++;
+      return false;
+    }
+    _owner = c;
+    _stats.grants[c]++;
+    _since = _clock();
+    return true;
+  }
+
+  void release(SpiClient c) {
+    if (_owner != c) {
+      return;
+    }
+    const uint32_t held = _clock() - _since;
+    if (held > _stats.maxHoldUs[c]) {
+      _stats.maxHoldUs[c] = held;
+    }
+    _owner = SPI_CLIENT_COUNT;
+  }
+
+  /**
+   * @brief 低優先の転送の切れ目で、バスを手放して優先の処理を通しますわ
+   * @details 優先の処理の中から書き込みが起きても、入れ子では呼びませんの。
+   */
+  void yield() {
+    if (_urgent == nullptr || _inYield) {
+      return;
+    }
+    const SpiClient owner = _owner;
+    if (owner != SPI_CLIENT_COUNT) {
+      release(owner);
+    }
+    _inYield = true;
+    if (_urgent()) {
+      _stats.preemptions++;
+    }
+    _inYield = false;
+    if (owner != SPI_CLIENT_COUNT) {
+      acquire(owner);
+    }
+  }
+
+  /**
+   * @brief カードへの書き込みをセクタ境界で切り分け、切れ目ごとに yield() しますわ
+   * @param position 書き始めのファイル位置 (追記ならファイルサイズ)
+   * @param write size_t(const uint8_t*, size_t) の関数。書けたバイト数を返しますの
+   * @return 書けたバイト数の合計
+   */
+  template <class WriteFn>
+  size_t writeSliced(uint32_t position, const uint8_t* data, size_t len, WriteFn&& write) {
+    if (_sliceBytes == 0) {
+      acquire(SPI_CLIENT_CARD);
+      size_t written = write(data, len);
+      release(SPI_CLIENT_CARD);
+      return written;
+    }
+    size_t done = 0;
+    while (done < len) {
+      // 最初の断片は次のセクタ境界まで、あとは sliceBytes ずつですの
+      size_t n = _sliceBytes - (position + done) % _sliceBytes;
+      if (n > len - done) {
+        n = len - done;
+      }
+      acquire(SPI_CLIENT_CARD);
+      const size_t written = write(data + done, n);
+      release(SPI_CLIENT_CARD);
+      _stats.slices++;
+      done += written;
+      if (written != n) {
+        break;
+      }
+      if (done < len) {
+        yield();
+      }
+    }
+    return done;
+  }
+
+  const SpiArbiterStats& stats() const { return _stats; }
+  void resetStats() { _stats = {}; }
+  /** @brief 統計を差し替えて、それまでの統計を返しますの (試験の間だけ別に数えるときに) */
+  SpiArbiterStats exchangeStats(const SpiArbiterStats& next) {
+    const SpiArbiterStats prev = _stats;
+    _stats = next;
+    return prev;
+  }
+
+private:
+  ClockFn _clock = nullptr;
+  UrgentFn _urgent = nullptr;
+  uint32_t _sliceBytes = SPI_SECTOR_BYTES;
+  uint32_t _since = 0;
+  SpiClient _owner = SPI_CLIENT_COUNT;
+  bool _inYield = false;
+  SpiArbiterStats _stats = {};
+};
@@ -0,0 +1,639 @@
+/**
+ * @file storage_backend.h
+ * @brief SDカードのファイルシステムを、ビルド時に選ぶバックエンドで扱うための薄い層
+ * @details
+ * 両スケッチとヘルパー (card_health.h・flight_catalog.h など) は SD.h を直接呼ばず、ここを通す。
+ * バックエンドは LOGGER_FS_BACKEND で選ぶ (例: -DLOGGER_FS_BACKEND=LOGGER_FS_SDFAT)。
+ * - LOGGER_FS_SDH (既定): arduino-pico 付属の SD.h。File が共有ポインタと仮想呼び出しを挟み、
+ *   事前割り当てと連続領域の確認はできない
+ * - LOGGER_FS_SDFAT: SdFat (arduino-pico では namespace sdfat) を直接使う。preAllocate() で連続した
+ *   クラスタを先に確保でき、追記のたびのFATの更新が無くなる。バスを共有しないときは
+ *   storageUseDedicatedBus() でカードを選んだままにできる
+ * - LOGGER_FS_FATFS: ChaN の FatFs (ff.h)。preAllocate() は f_expand() を使う。SPI でカードを読み書きする
+ *   diskio 層 (例: no-OS-FatFS-SD-SPI-RPi-Pico) とそのピン設定 (hw_config) を別に用意し、
+ *   ffconf.h で FF_USE_EXPAND = 1、FF_FS_READONLY = 0 にしておくこと
+ * - LOGGER_FS_FLASH: カードを使わず、基板の QSPI フラッシュの FS 領域に littlefs で書く (flash_bd.h)。
+ *   littlefs はメタデータを2つのブロックに交互に書くので、書いている途中で電源が落ちても
+ *   最後に確定 (flush) した状態でマウントできる。ボードメニューの Flash Size で FS 領域を取っておくこと。
+ *   事前割り当ては無い (littlefs はブロックを書くときに選ぶ)
+ *
+ * StorageFile は Stream なので print() や readBytesUntil() はそのまま使える。
+ * ハンドルはコピーできず、ムーブだけできる (SdFat・FatFs のハンドルを複製すると、
+ * 片方の書き込みがもう片方に見えないため)。破棄するときは閉じる。
+ *
+ * preAllocate() したファイルは、閉じるときに書いた所までで切り詰め、余った領域を返す。
+ * FatFs の f_expand() は確保した大きさをファイルサイズにするため、この層が書いた所までを
+ * size() として覚えておく。閉じる前に電源が落ちると、確保した残り (内容は不定) がファイルに残る。
+ *
+ * 同じカードを2つのドライバでマウントしないよう、このカードに触れる処理はすべてここを通すこと
+ * (log_stripe.h の2枚目のカードは別のバスなので対象外)。
+ */
+#pragma once
+#include <stdint.h>
+
+#define LOGGER_FS_SDH   0
+#define LOGGER_FS_SDFAT 1
+#define LOGGER_FS_FATFS 2
+#define LOGGER_FS_FLASH 3
+
+#ifndef LOGGER_FS_BACKEND
+#define LOGGER_FS_BACKEND LOGGER_FS_SDH
+#endif
+
+// SdFat の SPI クロック (MHz)。SD.h の既定 (SPI_HALF_SPEED) に合わせておく
+#ifndef STORAGE_SPI_MHZ
+#define STORAGE_SPI_MHZ 25
+#endif
+
+/** @brief ファイルを開く方法 */
+enum StorageMode : uint8_t {
+  STORAGE_READ,   ///< 読み出しのみ ("r")。ディレクトリもこれで開く
+  STORAGE_APPEND, ///< 無ければ作り、末尾へ追記する (SD.h の FILE_WRITE)
+  STORAGE_UPDATE, ///< 既存のファイルを任意の位置で読み書きする ("r+")
+  STORAGE_CREATE, ///< 空にして読み書きする ("w+")
+};
+
+inline const char* storageBackendName() {
+#if LOGGER_FS_BACKEND == LOGGER_FS_SDH
+  return "sdh";
+#elif LOGGER_FS_BACKEND == LOGGER_FS_SDFAT
+  return "sdfat";
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FATFS
+  return "fatfs";
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+  return "flash";
+#else
+  return "?";
+#endif
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <SPI.h>
+#if LOGGER_FS_BACKEND == LOGGER_FS_SDH
+#include <SD.h>
+#elif LOGGER_FS_BACKEND == LOGGER_FS_SDFAT
+#include <SdFat.h>
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FATFS
+#include <ff.h>
+#include <diskio.h>
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+#include "flash_bd.h"
+#else
+#error "LOGGER_FS_BACKEND は LOGGER_FS_SDH / LOGGER_FS_SDFAT / LOGGER_FS_FATFS / LOGGER_FS_FLASH のどれか"
+#endif
+
+#if LOGGER_FS_BACKEND == LOGGER_FS_SDFAT
+inline sdfat::SdFs g_storageFs;
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FATFS
+inline FATFS g_storageFs;
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+inline FlashQspiDevice g_storageFlash;
+inline lfs_config g_storageLfsConfig;
+inline lfs_t g_storageFs;
+#endif
+
+class StorageFile;
+inline StorageFile storageOpen(const char* path, StorageMode mode);
+
+/** @brief 開いたファイルかディレクトリ。閉じていれば false に評価される */
+class StorageFile : public Stream {
+public:
+  StorageFile() = default;
+  StorageFile(const StorageFile&) = delete;
+  StorageFile& operator=(const StorageFile&) = delete;
+  StorageFile(StorageFile&& other) { take(other); }
+  StorageFile& operator=(StorageFile&& other) {
+    if (this != &other) {
+      close();
+      take(other);
+    }
+    return *this;
+  }
+  ~StorageFile() { close(); }
+
+  using Print::write;
+
+#if LOGGER_FS_BACKEND == LOGGER_FS_SDH
+  explicit operator bool() const { return static_cast<bool>(_f); }
+  size_t write(uint8_t b) override { return _f.write(b); }
+  size_t write(const uint8_t* data, size_t len) override { return _f.write(data, len); }
+  int available() override { return _f.available(); }
+  int read() override { return _f.read(); }
+  int peek() override { return _f.peek(); }
+  size_t read(uint8_t* buf, size_t len) {
+    const int n = _f.read(buf, len);
+    return n > 0 ? static_cast<size_t>(n) : 0;
+  }
+  void flush() override { sync(); }
+  /** @brief 書いた所までを確定する。SD.h は確定の結果を返さないので、ハンドルが有効かどうかだけを返す */
+  bool sync() {
+    _f.flush();
+    return static_cast<bool>(_f);
+  }
+  bool seek(uint32_t pos) { return _f.seek(pos); }
+  uint32_t position() const { return _f.position(); }
+  uint32_t size() const { return _f.size(); }
+  bool truncate(uint32_t len) { return _f.truncate(len); }
+  const char* name() const { return _f.name(); }
+  bool isDirectory() const { return _f.isDirectory(); }
+  StorageFile openNextFile() {
+    StorageFile e;
+    e._f = _f.openNextFile();
+    return e;
+  }
+  /** @brief SD.h では事前割り当てができない */
+  bool preAllocate(uint32_t) { return false; }
+  bool isContiguous() const { return false; }
+  void close() {
+    if (_f) {
+      _f.close();
+    }
+  }
+
+private:
+  friend StorageFile storageOpen(const char* path, StorageMode mode);
+  void take(StorageFile& other) {
+    _f = other._f;
+    other._f = File();
+  }
+  mutable File _f;
+
+#elif LOGGER_FS_BACKEND == LOGGER_FS_SDFAT
+  explicit operator bool() const { return _f.isOpen(); }
+  size_t write(uint8_t b) override { return _f.write(&b, 1); }
+  size_t write(const uint8_t* data, size_t len) override { return _f.write(data, len); }
+  int available() override { return _f.available(); }
+  int read() override { return _f.read(); }
+  int peek() override { return _f.peek(); }
+  size_t read(uint8_t* buf, size_t len) {
+    const int n = _f.read(buf, len);
+    return n > 0 ? static_cast<size_t>(n) : 0;
+  }
+  void flush() override { sync(); }
+  /** @brief 書いた所までを確定する (ディレクトリエントリと FAT も更新する)。失敗すれば false */
+  bool sync() { return _f.sync(); }
+  bool seek(uint32_t pos) { return _f.seekSet(pos); }
+  uint32_t position() const { return static_cast<uint32_t>(_f.curPosition()); }
+  uint32_t size() const { return static_cast<uint32_t>(_f.fileSize()); }
+  bool truncate(uint32_t len) {
+    _prealloc = false; // 切り詰めで余りのクラスタも返る
+    return _f.truncate(len);
+  }
+  const char* name() const {
+    _f.getName(_name, sizeof(_name));
+    return _name;
+  }
+  bool isDirectory() const { return _f.isDir(); }
+  StorageFile openNextFile() {
+    StorageFile e;
+    e._f.openNext(&_f, O_RDONLY);
+    return e;
+  }
+  /**
+   * @brief 空のファイルに連続したクラスタを確保する (ファイルサイズは変わらない)
+   * @return 確保できれば true
+   */
+  bool preAllocate(uint32_t bytes) {
+    _prealloc = bytes > 0 && _f.fileSize() == 0 && _f.preAllocate(bytes);
+    return _prealloc;
+  }
+  bool isContiguous() const { return _f.isContiguous(); }
+  void close() {
+    if (!_f.isOpen()) {
+      return;
+    }
+    if (_prealloc) {
+      _f.truncate(_f.fileSize());
+      _prealloc = false;
+    }
+    _f.close();
+  }
+
+private:
+  friend StorageFile storageOpen(const char* path, StorageMode mode);
+  void take(StorageFile& other) {
+    // FsFile の代入は中身を複製するだけで閉じないので、元は閉じたハンドルで上書きしておく
+    _f = other._f;
+    other._f = sdfat::FsFile();
+    _prealloc = other._prealloc;
+    other._prealloc = false;
+  }
+  mutable sdfat::FsFile _f;
+  mutable char _name[64] = "";
+  bool _prealloc = false;
+
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FATFS
+  explicit operator bool() const { return _kind != KIND_NONE; }
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* data, size_t len) override {
+    UINT n = 0;
+    if (_kind != KIND_FILE || f_write(&_h.fil, data, len, &n) != FR_OK) {
+      return 0;
+    }
+    if (_prealloc && f_tell(&_h.fil) > _end) {
+      _end = f_tell(&_h.fil);
+    }
+    return n;
+  }
+  int available() override { return static_cast<int>(size() - position()); }
+  int read() override {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+  }
+  int peek() override {
+    const uint32_t pos = position();
+    const int b = read();
+    seek(pos);
+    return b;
+  }
+  size_t read(uint8_t* buf, size_t len) {
+    UINT n = 0;
+    if (_kind != KIND_FILE || f_read(&_h.fil, buf, len, &n) != FR_OK) {
+      return 0;
+    }
+    return n;
+  }
+  void flush() override { sync(); }
+  /** @brief 書いた所までを確定する (ディレクトリエントリと FAT も更新する)。失敗すれば false */
+  bool sync() { return _kind == KIND_FILE && f_sync(&_h.fil) == FR_OK; }
+  bool seek(uint32_t pos) { return _kind == KIND_FILE && f_lseek(&_h.fil, pos) == FR_OK; }
+  uint32_t position() const { return _kind == KIND_FILE ? static_cast<uint32_t>(f_tell(&_h.fil)) : 0; }
+  /** @brief 事前割り当て中は、確保した大きさではなく書いた所までを返す */
+  uint32_t size() const {
+    if (_kind != KIND_FILE) {
+      return 0;
+    }
+    return _prealloc ? _end : static_cast<uint32_t>(f_size(&_h.fil));
+  }
+  bool truncate(uint32_t len) {
+    if (_kind != KIND_FILE || f_lseek(&_h.fil, len) != FR_OK) {
+      return false;
+    }
+    _prealloc = false;
+    return f_truncate(&_h.fil) == FR_OK;
+  }
+  const char* name() const {
+    const char* slash = strrchr(_path, '/');
+    return slash != nullptr ? slash + 1 : _path;
+  }
+  bool isDirectory() const { return _kind == KIND_DIR; }
+  /** @brief 次のエントリを開いて返す (SD.h と同じく、ディレクトリならディレクトリとして開く) */
+  StorageFile openNextFile() {
+    FILINFO info;
+    if (_kind != KIND_DIR || f_readdir(&_h.dir, &info) != FR_OK || info.fname[0] == '\0') {
+      return StorageFile();
+    }
+    char child[sizeof(_path)];
+    const size_t len = strlen(_path);
+    snprintf(child, sizeof(child), "%s%s%s", _path, (len > 0 && _path[len - 1] == '/') ? "" : "/", info.fname);
+    return storageOpen(child, STORAGE_READ);
+  }
+  /**
+   * @brief 空のファイルに連続した領域を確保する (f_expand)
+   * @return 確保できれば true
+   */
+  bool preAllocate(uint32_t bytes) {
+    if (_kind != KIND_FILE || bytes == 0 || f_size(&_h.fil) != 0 || f_expand(&_h.fil, bytes, 1) != FR_OK) {
+      return false;
+    }
+    _prealloc = true;
+    _end = 0;
+    return true;
+  }
+  bool isContiguous() const { return _prealloc; }
+  void close() {
+    if (_kind == KIND_FILE) {
+      if (_prealloc) {
+        f_lseek(&_h.fil, _end);
+        f_truncate(&_h.fil);
+        _prealloc = false;
+      }
+      f_close(&_h.fil);
+    } else if (_kind == KIND_DIR) {
+      f_closedir(&_h.dir);
+    }
+    _kind = KIND_NONE;
+  }
+
+private:
+  friend StorageFile storageOpen(const char* path, StorageMode mode);
+  enum Kind : uint8_t { KIND_NONE, KIND_FILE, KIND_DIR };
+  void take(StorageFile& other) {
+    // FIL と DIR は自分自身を指すポインタを持たないので、そのまま写してよい
+    memcpy(&_h, &other._h, sizeof(_h));
+    memcpy(_path, other._path, sizeof(_path));
+    _kind = other._kind;
+    _prealloc = other._prealloc;
+    _end = other._end;
+    other._kind = KIND_NONE;
+    other._prealloc = false;
+  }
+  union Handle {
+    FIL fil;
+    DIR dir;
+  };
+  Handle _h;
+  char _path[64] = "";
+  Kind _kind = KIND_NONE;
+  bool _prealloc = false;
+  uint32_t _end = 0; ///< 事前割り当て中に書いた所まで
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+  explicit operator bool() const { return _file != nullptr || _dir != nullptr; }
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* data, size_t len) override {
+    if (_file == nullptr) {
+      return 0;
+    }
+    const lfs_ssize_t n = lfs_file_write(&g_storageFs, _file, data, len);
+    return n > 0 ? static_cast<size_t>(n) : 0;
+  }
+  int available() override { return static_cast<int>(size() - position()); }
+  int read() override {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+  }
+  int peek() override {
+    const uint32_t pos = position();
+    const int b = read();
+    seek(pos);
+    return b;
+  }
+  size_t read(uint8_t* buf, size_t len) {
+    if (_file == nullptr) {
+      return 0;
+    }
+    const lfs_ssize_t n = lfs_file_read(&g_storageFs, _file, buf, len);
+    return n > 0 ? static_cast<size_t>(n) : 0;
+  }
+  void flush() override { sync(); }
+  /**
+   * @brief 書いた所までを確定する。失敗すれば false
+   * @details ここで電源が落ちても、前の確定の状態か今回の状態のどちらかが残る。
+   */
+  bool sync() { return _file != nullptr && lfs_file_sync(&g_storageFs, _file) == 0; }
+  bool seek(uint32_t pos) { return _file != nullptr && lfs_file_seek(&g_storageFs, _file, pos, LFS_SEEK_SET) >= 0; }
+  uint32_t position() const {
+    return _file != nullptr ? static_cast<uint32_t>(lfs_file_tell(&g_storageFs, _file)) : 0;
+  }
+  uint32_t size() const { return _file != nullptr ? static_cast<uint32_t>(lfs_file_size(&g_storageFs, _file)) : 0; }
+  bool truncate(uint32_t len) { return _file != nullptr && lfs_file_truncate(&g_storageFs, _file, len) == 0; }
+  const char* name() const {
+    const char* slash = strrchr(_path, '/');
+    return slash != nullptr ? slash + 1 : _path;
+  }
+  bool isDirectory() const { return _dir != nullptr; }
+  /** @brief 次のエントリを開いて返す ("." と ".." は飛ばす) */
+  StorageFile openNextFile() {
+    lfs_info info;
+    if (_dir == nullptr) {
+      return StorageFile();
+    }
+    do {
+      if (lfs_dir_read(&g_storageFs, _dir, &info) <= 0) {
+        return StorageFile();
+      }
+    } while (strcmp(info.name, ".") == 0 || strcmp(info.name, "..") == 0);
+    char child[sizeof(_path)];
+    const size_t len = strlen(_path);
+    snprintf(child, sizeof(child), "%s%s%s", _path, (len > 0 && _path[len - 1] == '/') ? "" : "/", info.name);
+    return storageOpen(child, STORAGE_READ);
+  }
+  /** @brief littlefs には事前割り当てが無い */
+  bool preAllocate(uint32_t) { return false; }
+  bool isContiguous() const { return false; }
+  void close() {
+    if (_file != nullptr) {
+      lfs_file_close(&g_storageFs, _file);
+      delete _file;
+      _file = nullptr;
+    }
+    if (_dir != nullptr) {
+      lfs_dir_close(&g_storageFs, _dir);
+      delete _dir;
+      _dir = nullptr;
+    }
+  }
+
+private:
+  friend StorageFile storageOpen(const char* path, StorageMode mode);
+  void take(StorageFile& other) {
+    // 開いたハンドルは littlefs の一覧に自分の番地でつながれているので、写さずにポインタを渡す
+    _file = other._file;
+    _dir = other._dir;
+    memcpy(_path, other._path, sizeof(_path));
+    other._file = nullptr;
+    other._dir = nullptr;
+  }
+  lfs_file_t* _file = nullptr;
+  lfs_dir_t* _dir = nullptr;
+  char _path[64] = "";
+#endif
+};
+
+/**
+ * @brief カードをマウントする
+ * @details SdFat ではほかの SPI デバイスとバスを共有できる形 (SHARED_SPI) で始める。
+ *          FatFs ではピンとクロックを diskio 層の hw_config で決めるので、csPin は使わない。
+ *          フラッシュでは FS 領域をマウントし、まだ littlefs でなければ初期化してからマウントする。
+ */
+inline bool storageBegin(uint8_t csPin) {
+#if LOGGER_FS_BACKEND == LOGGER_FS_SDH
+  return SD.begin(csPin);
+#elif LOGGER_FS_BACKEND == LOGGER_FS_SDFAT
+  return g_storageFs.begin(sdfat::SdSpiConfig(csPin, SHARED_SPI, SD_SCK_MHZ(STORAGE_SPI_MHZ), &SPI));
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+  (void)csPin;
+  if (!g_storageFlash.begin()) {
+    return false;
+  }
+  flashLfsConfigure(g_storageLfsConfig, g_storageFlash, g_storageFlash.blockCount());
+  if (lfs_mount(&g_storageFs, &g_storageLfsConfig) == 0) {
+    return true;
+  }
+  return lfs_format(&g_storageFs, &g_storageLfsConfig) == 0 && lfs_mount(&g_storageFs, &g_storageLfsConfig) == 0;
+#else
+  (void)csPin;
+  return f_mount(&g_storageFs, "", 1) == FR_OK;
+#endif
+}
+
+/**
+ * @brief バスをほかと共有しないと分かったときに、カードを選んだままにする形でマウントし直す
+ * @details SdFat だけが効く (書き込みのたびのカードの選択と待ちが減る)。開いているファイルが無いときに呼ぶこと。
+ * @return マウントし直したら true
+ */
+inline bool storageUseDedicatedBus(uint8_t csPin) {
+#if LOGGER_FS_BACKEND == LOGGER_FS_SDFAT
+  g_storageFs.end();
+  return g_storageFs.begin(sdfat::SdSpiConfig(csPin, DEDICATED_SPI, SD_SCK_MHZ(STORAGE_SPI_MHZ), &SPI));
+#else
+  (void)csPin;
+  return false;
+#endif
+}
+
+inline StorageFile storageOpen(const char* path, StorageMode mode) {
+  StorageFile f;
+#if LOGGER_FS_BACKEND == LOGGER_FS_SDH
+  switch (mode) {
+    case STORAGE_READ:   f._f = SD.open(path, FILE_READ); break;
+    case STORAGE_APPEND: f._f = SD.open(path, FILE_WRITE); break;
+    case STORAGE_UPDATE: f._f = SDFS.open(path, "r+"); break;
+    case STORAGE_CREATE: f._f = SDFS.open(path, "w+"); break;
+  }
+#elif LOGGER_FS_BACKEND == LOGGER_FS_SDFAT
+  static const int kFlags[] = {O_RDONLY, O_RDWR | O_CREAT | O_APPEND, O_RDWR, O_RDWR | O_CREAT | O_TRUNC};
+  f._f.open(&g_storageFs, path, kFlags[mode]);
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+  strncpy(f._path, path, sizeof(f._path) - 1);
+  f._path[sizeof(f._path) - 1] = '\0';
+  lfs_info info;
+  if (mode == STORAGE_READ && lfs_stat(&g_storageFs, path, &info) == 0 && info.type == LFS_TYPE_DIR) {
+    f._dir = new lfs_dir_t;
+    if (lfs_dir_open(&g_storageFs, f._dir, path) != 0) {
+      delete f._dir;
+      f._dir = nullptr;
+    }
+    return f;
+  }
+  static const int kFlags[] = {LFS_O_RDONLY, LFS_O_RDWR | LFS_O_CREAT | LFS_O_APPEND, LFS_O_RDWR,
+                               LFS_O_RDWR | LFS_O_CREAT | LFS_O_TRUNC};
+  f._file = new lfs_file_t;
+  if (lfs_file_open(&g_storageFs, f._file, path, kFlags[mode]) != 0) {
+    delete f._file;
+    f._file = nullptr;
+  }
+#else
+  strncpy(f._path, path, sizeof(f._path) - 1);
+  f._path[sizeof(f._path) - 1] = '\0';
+  if (mode == STORAGE_READ && f_opendir(&f._h.dir, path) == FR_OK) {
+    f._kind = StorageFile::KIND_DIR;
+    return f;
+  }
+  static const BYTE kFlags[] = {FA_READ, FA_READ | FA_WRITE | FA_OPEN_APPEND, FA_READ | FA_WRITE,
+                                FA_READ | FA_WRITE | FA_CREATE_ALWAYS};
+  if (f_open(&f._h.fil, path, kFlags[mode]) == FR_OK) {
+    f._kind = StorageFile::KIND_FILE;
+  }
+#endif
+  return f;
+}
+
+inline bool storageExists(const char* path) {
+#if LOGGER_FS_BACKEND == LOGGER_FS_SDH
+  return SD.exists(path);
+#elif LOGGER_FS_BACKEND == LOGGER_FS_SDFAT
+  return g_storageFs.exists(path);
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+  lfs_info info;
+  return lfs_stat(&g_storageFs, path, &info) == 0;
+#else
+  FILINFO info;
+  return f_stat(path, &info) == FR_OK;
+#endif
+}
+
+inline bool storageRemove(const char* path) {
+#if LOGGER_FS_BACKEND == LOGGER_FS_SDH
+  return SD.remove(path);
+#elif LOGGER_FS_BACKEND == LOGGER_FS_SDFAT
+  return g_storageFs.remove(path);
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+  return lfs_remove(&g_storageFs, path) == 0;
+#else
+  return f_unlink(path) == FR_OK;
+#endif
+}
+
+inline bool storageMkdir(const char* path) {
+#if LOGGER_FS_BACKEND == LOGGER_FS_SDH
+  return SD.mkdir(path);
+#elif LOGGER_FS_BACKEND == LOGGER_FS_SDFAT
+  return g_storageFs.mkdir(path);
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+  return lfs_mkdir(&g_storageFs, path) == 0;
+#else
+  return f_mkdir(path) == FR_OK;
+#endif
+}
+
+inline bool storageRmdir(const char* path) {
+#if LOGGER_FS_BACKEND == LOGGER_FS_SDH
+  return SD.rmdir(path);
+#elif LOGGER_FS_BACKEND == LOGGER_FS_SDFAT
+  return g_storageFs.rmdir(path);
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+  return lfs_remove(&g_storageFs, path) == 0; // 空のディレクトリは lfs_remove で消せる
+#else
+  return f_unlink(path) == FR_OK; // 空のディレクトリは f_unlink で消せる
+#endif
+}
+
+/** @brief クラスタあたりのセクタ数 (write_amp.h の見積もりに使う) */
+inline uint32_t storageBlocksPerCluster() {
+#if LOGGER_FS_BACKEND == LOGGER_FS_SDH
+  return SD.blocksPerCluster();
+#elif LOGGER_FS_BACKEND == LOGGER_FS_SDFAT
+  return g_storageFs.sectorsPerCluster();
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+  return FLASH_BD_BLOCK_BYTES / 512;
+#else
+  return g_storageFs.csize;
+#endif
+}
+
+/** @brief FATの種類。16・32、exFAT なら 64、FATでなければ 0 */
+inline uint8_t storageFatType() {
+#if LOGGER_FS_BACKEND == LOGGER_FS_SDH
+  return SD.fatType();
+#elif LOGGER_FS_BACKEND == LOGGER_FS_SDFAT
+  return g_storageFs.fatType();
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+  return 0;
+#else
+  switch (g_storageFs.fs_type) {
+    case FS_FAT12: return 12;
+    case FS_FAT16: return 16;
+    case FS_FAT32: return 32;
+    default:       return 64;
+  }
+#endif
+}
+
+/** @brief カードが申告する容量 (バイト) */
+inline uint64_t storageCardBytes() {
+#if LOGGER_FS_BACKEND == LOGGER_FS_SDH
+  return SD.size64();
+#elif LOGGER_FS_BACKEND == LOGGER_FS_SDFAT
+  return static_cast<uint64_t>(g_storageFs.card()->sectorCount()) * 512;
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+  return static_cast<uint64_t>(g_storageFlash.blockCount()) * FLASH_BD_BLOCK_BYTES;
+#else
+  LBA_t sectors = 0;
+  disk_ioctl(g_storageFs.pdrv, GET_SECTOR_COUNT, &sectors);
+  return static_cast<uint64_t>(sectors) * 512;
+#endif
+}
+
+/** @brief カードの種類の表示名 (SD1 / SD2 / SDHC/SDXC / QSPI flash、分からなければ "不明") */
+inline const char* storageCardTypeName() {
+#if LOGGER_FS_BACKEND == LOGGER_FS_SDH
+  static const char* const kNames[] = {"SD1", "SD2", "不明", "SDHC/SDXC"};
+  const uint8_t type = SD.type();
+  return kNames[type < 4 ? type : 2];
+#elif LOGGER_FS_BACKEND == LOGGER_FS_SDFAT
+  switch (g_storageFs.card()->type()) {
+    case SD_CARD_TYPE_SD1:  return "SD1";
+    case SD_CARD_TYPE_SD2:  return "SD2";
+    case SD_CARD_TYPE_SDHC: return "SDHC/SDXC";
+    default:                return "不明";
+  }
+#elif LOGGER_FS_BACKEND == LOGGER_FS_FLASH
+  return "QSPI flash";
+#else
+  return "不明"; // diskio 層によって問い合わせ方が違う
+#endif
+}
+
+#endif // ARDUINO
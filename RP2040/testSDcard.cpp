@@ -9,7 +9,7 @@
  * 
  * @note 対象ボード: Raspberry Pi Pico (RP2040)
  * @note 動作確認環境: earlephilhowerコア
- * @note 必要ライブラリ: SPI.h, SD.h (デフォで入っている)
+ * @note 必要ライブラリ: SPI.h, SD.h (デフォで入っている)。LOGGER_FS_BACKEND で SdFat・FatFs に切り替えられる (storage_backend.h)
  * 
  * @section pin_config ピン設定 SPI0と電源線をSDカードモジュールに接続
  * - VCC: 3.3V
@@ -25,16 +25,42 @@
  * - ディレクトリ構造の再帰的表示
  * - テストファイル(mountdata.txt)への書き込み
  * - 5秒間隔での定期実行
+ * - 全容量の書き込み・読み戻しによる実容量検証 (偽装カード検出、再開可能)
+ * - ロガーのI/Oパターンの再現によるテール遅延の測定と合否判定
+ * - ロガーが記録したカード健全性の履歴と遅延傾向の表示
+ * - フライト目録 (/flights.cat) による全フライトの一覧と個別の詳細表示 (ディレクトリの走査なし)
+ * - ログの先頭・末尾と終わり方 (正常/電源断) の確認 (seek で両端だけ読むので、ファイルの大きさによらない)
+ * - ファイルシステムのバックエンドの比較 (バックエンドごとのビルドで 'W' を流し、/fsbench.csv の結果を並べる)
+ *
+ * @section commands シリアルコマンド
+ * - 'V': 容量検証を最初から実行する (空き領域をすべて使う)
+ * - 'R': 中断した容量検証を再開する
+ * - 'X': 容量検証で作ったファイルを削除する
+ * - 'W [key=value ...]': ロガーのワークロードを再現する (例: "W rate=100 rec=40 buf=8192 dur=600 prealloc=on")。
+ *   結果は /fsbench.csv に追記する
+ * - 'B': /fsbench.csv の結果をカードと条件ごとに並べ、最速のバックエンドを示す
+ * - 'H': カード健全性の履歴を表示する
+ * - 'C [番号]': フライト目録を一覧する。番号を付けるとそのフライトの詳細を表示する
+ * - 'P [N]': ルートのログごとに、ヘッダーと最初・最後の N レコード (既定 3)、トレーラーの有無を表示し、
+ *   目録の終了状態と突き合わせる
  */
 #include <SPI.h>
-#include <SD.h>
+#include "storage_backend.h"
+#include "card_verify.h"
+#include "workload_replay.h"
+#include "card_health.h"
+#include "flight_catalog.h"
+#include "log_index.h"
+#include "log_stripe.h"
+#include "rice_log.h"
+#include "logger_config.h"
 
 #define PIN_SPI_CS 22
 #define PIN_SPI_SCK 18
 #define PIN_SPI_RX 16
 #define PIN_SPI_TX 19
 
-File file;
+StorageFile file;
 
 bool sdInitialized = false;
 
@@ -53,9 +79,9 @@ void initializeMicroSD() {
   SPI.setTX(PIN_SPI_TX);
   SPI.setSCK(PIN_SPI_SCK);
   
-  if (SD.begin(PIN_SPI_CS)) {
+  if (storageBegin(PIN_SPI_CS)) {
     sdInitialized = true;
-    Serial.println("SDカードの初期化に成功しました");
+    Serial.printf("SDカードの初期化に成功しました (%s)\n", storageBackendName());
   } else {
     Serial.println("SDカードの初期化に失敗しました");
   }
@@ -66,8 +92,8 @@ void initializeMicroSD() {
  * @param dir 表示対象のディレクトリファイル
  * @param numTabs インデント用のタブ数（デフォルト: 0）
  */
-void printDirectory(File dir, int numTabs = 0) {
-  File entry;
+void printDirectory(StorageFile& dir, int numTabs = 0) {
+  StorageFile entry;
   while ((entry = dir.openNextFile())) {
     // インデントを表示
     for (uint8_t i = 0; i < numTabs; i++) {
@@ -99,12 +125,10 @@ void viewMicroSDInfo() {
 
   // カードタイプを表示
   Serial.print("カードタイプ: ");
-  uint8_t cardType = SD.type();
-  const char* cardTypes[] = {"SD1", "SD2", "不明", "SDHC/SDXC"};
-  Serial.println(cardTypes[cardType < 4 ? cardType : 2]);
+  Serial.println(storageCardTypeName());
 
   // ディレクトリの内容を一覧表示
-  File root = SD.open("/");
+  StorageFile root = storageOpen("/", STORAGE_READ);
   if (root) {
     printDirectory(root);
     root.close();
@@ -115,12 +139,12 @@ void viewMicroSDInfo() {
 
   // テストファイルの処理
   const char* testFile = "/mountdata.txt";
-  if (SD.exists(testFile)) {
+  if (storageExists(testFile)) {
     Serial.println("mountdata.txt が存在します - データを追記中");
-    file = SD.open(testFile, FILE_WRITE);
+    file = storageOpen(testFile, STORAGE_APPEND);
   } else {
     Serial.println("mountdata.txt が存在しません - 新規作成します");
-    file = SD.open(testFile, FILE_WRITE);
+    file = storageOpen(testFile, STORAGE_APPEND);
   }
 
   if (file) {
@@ -132,6 +156,651 @@ void viewMicroSDInfo() {
   }
 }
 
+/**
+ * @brief ディレクトリ以下のファイルサイズの合計を求める
+ * @param dir 対象ディレクトリ
+ * @param skipName この名前のサブディレクトリは数えない (検証ファイル用)
+ */
+uint64_t sumFileSizes(StorageFile& dir, const char* skipName) {
+  uint64_t total = 0;
+  StorageFile entry;
+  while ((entry = dir.openNextFile())) {
+    if (entry.isDirectory()) {
+      if (strcmp(entry.name(), skipName) != 0) {
+        total += sumFileSizes(entry, skipName);
+      }
+    } else {
+      total += entry.size();
+    }
+    entry.close();
+  }
+  return total;
+}
+
+/**
+ * @brief ロガーのワークロードを再現して、テール遅延を測る
+ * @details コマンドの残りの行を "key=value" として読み、省略した項目はロガーの既定値を使う。
+ */
+void runWorkloadReplay() {
+  char args[96];
+  size_t n = Serial.readBytesUntil('\n', args, sizeof(args) - 1);
+  args[n] = '\0';
+
+  WorkloadParams params = workloadDefaults();
+  if (!workloadParse(params, args)) {
+    Serial.println("エラー: パラメータを解釈できません (rate, rec, buf, flush, policy, dur, prealloc)");
+    return;
+  }
+  uint8_t* buffer = static_cast<uint8_t*>(malloc(params.bufferBytes));
+  if (buffer == nullptr) {
+    Serial.println("エラー: バッファを確保できません");
+    return;
+  }
+  // ヒストグラムは約 3 KB あるので、スタックには置かない
+  static WorkloadResult result;
+  Serial.printf("ワークロードを %lu 秒間再現します。任意のキーで中断できます\n", static_cast<unsigned long>(params.durationS));
+  if (workloadRun(params, result, buffer)) {
+    workloadPrintReport(params, result);
+    if (workloadAppendResult(params, result)) {
+      Serial.println("結果を " WORKLOAD_RESULTS_FILE " に追記しました ('B' でバックエンドを比較できます)");
+    }
+  }
+  free(buffer);
+}
+
+/**
+ * @brief ロガーが記録したカード健全性の履歴を表示する
+ * @details
+ * フライトごとの書き込み遅延とエラー回数を一覧し、最初と最近のフライトの p99 を比べて
+ * 劣化の傾向を示す。最近のフライトの p99 が最初の2倍を超えるか、エラーが出ていれば退役を勧める。
+ */
+void printCardHealth() {
+  StorageFile f = storageOpen(CARD_HEALTH_FILE, STORAGE_READ);
+  if (!f) {
+    Serial.println("健全性の記録がありません (ロガーが正常終了すると作られます)");
+    return;
+  }
+  CardHealthHeader h = cardHealthReadHeader(f);
+  Serial.println("===== カード健全性の履歴 =====");
+  Serial.printf("フライト数: %lu, 累計書き込み: %llu MB, 累計エラー: %lu, 累計リトライ: %lu\n",
+                static_cast<unsigned long>(h.flightCount), static_cast<unsigned long long>(h.totalBytesWritten >> 20),
+                static_cast<unsigned long>(h.totalErrors), static_cast<unsigned long>(h.totalRetries));
+  Serial.println("  番号   時間(s)   書込(KB)   p50(us)   p99(us) p99.9(us)   max(us) エラー リトライ");
+
+  // 傾向を見るため、最初と最近の数フライトの p99 を平均する
+  const uint32_t window = h.flightCount >= 10 ? 5 : h.flightCount / 2;
+  uint64_t earlySum = 0, recentSum = 0;
+  uint32_t recentErrors = 0;
+  f.seek(sizeof(CardHealthHeader));
+  for (uint32_t i = 0; i < h.flightCount; i++) {
+    CardHealthFlight fl;
+    if (f.read(reinterpret_cast<uint8_t*>(&fl), sizeof(fl)) != sizeof(fl)) {
+      Serial.println("エラー: 記録が途中で切れています");
+      break;
+    }
+    Serial.printf("  %4u %9lu %10lu %9lu %9lu %9lu %9lu %6u %8u\n", fl.flightNumber, static_cast<unsigned long>(fl.durationS),
+                  static_cast<unsigned long>(fl.bytesWritten >> 10), static_cast<unsigned long>(fl.p50Us),
+                  static_cast<unsigned long>(fl.p99Us), static_cast<unsigned long>(fl.p999Us),
+                  static_cast<unsigned long>(fl.maxUs), fl.errors, fl.retries);
+    if (i < window) {
+      earlySum += fl.p99Us;
+    }
+    if (i >= h.flightCount - window) {
+      recentSum += fl.p99Us;
+      recentErrors += fl.errors;
+    }
+  }
+  f.close();
+
+  if (window == 0) {
+    return;
+  }
+  uint32_t early = earlySum / window;
+  uint32_t recent = recentSum / window;
+  Serial.printf("p99 の傾向: 最初の %lu フライト平均 %lu us -> 最近 %lu us\n", static_cast<unsigned long>(window),
+                static_cast<unsigned long>(early), static_cast<unsigned long>(recent));
+  if (recentErrors > 0 || recent > early * 2) {
+    Serial.println("判定: 劣化の兆候があります。退役を検討してください");
+  } else {
+    Serial.println("判定: 良好");
+  }
+}
+
+/** @brief チャンネルの値の範囲を "min..max" で表示する。記録が無ければ "-" */
+void printValueRange(const FlightCatalogEntry& e, int ch) {
+  if (e.valueMin[ch] > e.valueMax[ch]) {
+    Serial.print("-");
+  } else {
+    Serial.printf("%ld..%ld", static_cast<long>(e.valueMin[ch]), static_cast<long>(e.valueMax[ch]));
+  }
+}
+
+/**
+ * @brief フライト目録を一覧する。番号を指定すればそのフライトの詳細を表示する
+ * @details 目録を1回読むだけで、ログファイルは開かない。
+ */
+void printFlightCatalog() {
+  char args[16];
+  size_t n = Serial.readBytesUntil('\n', args, sizeof(args) - 1);
+  args[n] = '\0';
+  const int selected = atoi(args);
+
+  if (selected > 0) {
+    bool found = false;
+    flightCatalogForEach([&](const FlightCatalogEntry& e) {
+      if (e.flightNumber != selected) {
+        return;
+      }
+      found = true;
+      char name[32];
+      flightCatalogFileName(e, name, sizeof(name));
+      Serial.printf("===== フライト %u =====\n", e.flightNumber);
+      Serial.printf("ファイル: %s%s\n", name, (e.flags & FLIGHT_F_STRIPE) ? " (+ .s1)" : "");
+      Serial.printf("終了: %s\n", flightStateName(e.state));
+      Serial.printf("開始: 起動後 %lu ms, 記録時間: %lu ms, サンプル: %lu (%u Hz)\n", static_cast<unsigned long>(e.startUptimeMs),
+                    static_cast<unsigned long>(e.durationMs), static_cast<unsigned long>(e.samples), e.sampleHz);
+      Serial.printf("サイズ: %lu バイト, フラッシュ方針: %s\n", static_cast<unsigned long>(e.sizeBytes),
+                    flushPolicyName(static_cast<FlushPolicy>(e.flushPolicy)));
+      Serial.print("ch1: ");
+      printValueRange(e, 0);
+      Serial.print(", ch2: ");
+      printValueRange(e, 1);
+      Serial.println();
+      Serial.printf("書き込み遅延 p99: %lu us, 最大: %lu us, エラー: %u, 書き込み増幅: %u.%02u\n",
+                    static_cast<unsigned long>(e.writeP99Us), static_cast<unsigned long>(e.writeMaxUs), e.errors,
+                    e.waRatioX100 / 100, e.waRatioX100 % 100);
+      Serial.printf("リンク: %s, キャプチャ: %s\n", (e.flags & FLIGHT_F_LINKS) ? "あり" : "なし",
+                    (e.flags & FLIGHT_F_CAPTURE) ? "あり" : "なし");
+    });
+    if (!found) {
+      Serial.printf("フライト %d は目録にありません\n", selected);
+    }
+    return;
+  }
+
+  Serial.println("===== フライト目録 =====");
+  Serial.println("  番号 終了    時間(s)  サンプル   サイズ(KB)  p99(us) ファイル");
+  int used = flightCatalogForEach([](const FlightCatalogEntry& e) {
+    char name[32];
+    flightCatalogFileName(e, name, sizeof(name));
+    Serial.printf("  %4u %-6s %8lu %9lu %12lu %8lu %s\n", e.flightNumber, flightStateName(e.state),
+                  static_cast<unsigned long>(e.durationMs / 1000), static_cast<unsigned long>(e.samples),
+                  static_cast<unsigned long>(e.sizeBytes >> 10), static_cast<unsigned long>(e.writeP99Us), name);
+  });
+  if (used == 0) {
+    Serial.println("目録がありません (ロガーが記録を始めると作られます)");
+  } else {
+    Serial.printf("%d フライト。詳細は 'C 番号' で表示します\n", used);
+  }
+}
+
+#define PREVIEW_WINDOW_BYTES    2048 // 先頭と末尾からそれぞれ読む量。ファイルの大きさによらない
+#define PREVIEW_DEFAULT_RECORDS 3
+#define PREVIEW_MAX_RECORDS     16
+
+static uint8_t previewBuf[PREVIEW_WINDOW_BYTES];
+static int32_t previewValues[RICE_BLOCK_SAMPLES];
+
+/** @brief 1つのログの先頭と末尾を見て分かったこと */
+struct LogPreview {
+  bool trailer;       ///< トレーラー行 ("# trailer ...") がある。正常に閉じた印
+  bool torn;          ///< 末尾が行 (rice ではチャンク) の途中で切れている
+  bool hasFirst;      ///< firstMs が有効
+  bool hasLast;       ///< lastMs が有効
+  uint32_t firstMs;   ///< 最初のレコードの時刻
+  uint32_t lastMs;    ///< 最後のレコードの時刻
+  uint32_t bytesRead; ///< このファイルで読んだバイト数
+};
+
+/** @brief offset から最大 len バイトを previewBuf へ読む */
+size_t previewReadWindow(StorageFile& f, uint32_t offset, size_t len, LogPreview& p) {
+  if (!f.seek(offset)) {
+    return 0;
+  }
+  int n = f.read(previewBuf, len);
+  n = n > 0 ? n : 0;
+  p.bytesRead += static_cast<uint32_t>(n);
+  return static_cast<size_t>(n);
+}
+
+bool previewIsRecord(const char* line) {
+  return line[0] >= '0' && line[0] <= '9';
+}
+
+/** @brief 1行を字下げして表示する (行末の '\r' は落とす) */
+void previewPrintLine(const char* line, size_t len) {
+  while (len > 0 && line[len - 1] == '\r') {
+    len--;
+  }
+  Serial.printf("  %.*s\n", static_cast<int>(len), line);
+}
+
+/** @brief CSV の先頭の窓から、コメント行とヘッダー、最初の records 行を表示する */
+void previewTextHead(const char* text, size_t len, int records, LogPreview& p) {
+  int shown = 0;
+  for (size_t pos = 0; pos < len && shown < records;) {
+    const char* nl = static_cast<const char*>(memchr(text + pos, '\n', len - pos));
+    if (nl == nullptr) {
+      break; // 窓の端で切れた行は表示しない
+    }
+    const size_t lineLen = static_cast<size_t>(nl - (text + pos));
+    if (lineLen > 0 && previewIsRecord(text + pos)) {
+      if (!p.hasFirst) {
+        p.firstMs = strtoul(text + pos, nullptr, 10);
+        p.hasFirst = true;
+      }
+      shown++;
+    }
+    previewPrintLine(text + pos, lineLen);
+    pos += lineLen + 1;
+  }
+}
+
+/**
+ * @brief CSV の末尾の窓から、最後の records 行とトレーラー行を表示する
+ * @param fromMiddle 窓がファイルの途中から始まる (最初の行は切れているので捨てる)
+ * @param continues 窓の終わりがログの終わりではない (ストライプのブロックのように続きが別にある)。
+ *                  最後の行が切れていても途切れとはみなさない
+ */
+void previewTextTail(const char* text, size_t len, bool fromMiddle, bool continues, int records, LogPreview& p) {
+  size_t begin = 0;
+  if (fromMiddle) {
+    const char* nl = static_cast<const char*>(memchr(text, '\n', len));
+    begin = nl != nullptr ? static_cast<size_t>(nl - text) + 1 : len;
+  }
+  size_t end = len;
+  const bool partial = len > begin && text[len - 1] != '\n';
+  p.torn = partial && !continues;
+  if (partial) {
+    while (end > begin && text[end - 1] != '\n') {
+      end--;
+    }
+  }
+
+  // 末尾から行をさかのぼり、最後の records 行とトレーラー行の位置を集める
+  size_t starts[PREVIEW_MAX_RECORDS + 1];
+  int found = 0;
+  size_t trailerAt = len;
+  for (size_t e = end; e > begin && found < records;) {
+    size_t s = e - 1;
+    while (s > begin && text[s - 1] != '\n') {
+      s--;
+    }
+    if (e - 1 - s >= 9 && strncmp(text + s, "# trailer", 9) == 0) {
+      p.trailer = true;
+      trailerAt = s;
+    } else if (e - 1 > s && previewIsRecord(text + s)) {
+      if (!p.hasLast) {
+        p.lastMs = strtoul(text + s, nullptr, 10);
+        p.hasLast = true;
+      }
+      starts[found++] = s;
+    }
+    e = s;
+  }
+  for (int i = found - 1; i >= 0; i--) {
+    const char* nl = static_cast<const char*>(memchr(text + starts[i], '\n', end - starts[i]));
+    previewPrintLine(text + starts[i], static_cast<size_t>(nl - (text + starts[i])));
+  }
+  if (trailerAt < len) {
+    const char* nl = static_cast<const char*>(memchr(text + trailerAt, '\n', end - trailerAt));
+    previewPrintLine(text + trailerAt, static_cast<size_t>(nl - (text + trailerAt)));
+  }
+  if (p.torn) {
+    Serial.printf("  (最後の行が %u バイトで途切れている)\n", static_cast<unsigned>(len - end));
+  }
+}
+
+/**
+ * @brief format=rice の窓からマジックと CRC の合うチャンクを探し、順に onChunk(header, payload) を呼ぶ
+ * @return 最後に見つけたチャンクの終わりの位置 (窓の中)
+ */
+template <class OnChunk>
+size_t previewRiceChunks(const uint8_t* buf, size_t len, OnChunk&& onChunk) {
+  size_t lastEnd = 0;
+  for (size_t pos = 0; pos + sizeof(RiceChunkHeader) <= len;) {
+    RiceChunkHeader h;
+    memcpy(&h, buf + pos, sizeof(h));
+    const size_t total = sizeof(h) + h.payloadBytes;
+    if (h.magic != RICE_CHUNK_MAGIC || pos + total > len || riceCrc16(buf + pos + sizeof(h), h.payloadBytes) != h.crc16) {
+      pos++;
+      continue;
+    }
+    onChunk(h, buf + pos + sizeof(h));
+    pos += total;
+    lastEnd = pos;
+  }
+  return lastEnd;
+}
+
+/** @brief 時刻 (チャンネル 0) のブロックを復号して previewValues に入れる */
+bool previewDecodeTime(const RiceChunkHeader& h, const uint8_t* payload) {
+  return h.type == RICE_CHUNK_BLOCK && h.channel == 0 && h.count > 0 && h.count <= RICE_BLOCK_SAMPLES &&
+         riceDecodeBlock(payload, h.payloadBytes, h.count, previewValues);
+}
+
+void previewPrintTimes(const char* label, uint32_t from, uint32_t to) {
+  Serial.printf("  %s:", label);
+  for (uint32_t i = from; i < to; i++) {
+    Serial.printf(" %lu", static_cast<unsigned long>(static_cast<uint32_t>(previewValues[i])));
+  }
+  Serial.println(" ms");
+}
+
+/** @brief format=rice の先頭の窓から、テキスト (設定とヘッダー) と最初の records 個の時刻を表示する */
+void previewRiceHead(size_t len, int records, LogPreview& p) {
+  bool seenBlock = false;
+  previewRiceChunks(previewBuf, len, [&](const RiceChunkHeader& h, const uint8_t* payload) {
+    if (h.type == RICE_CHUNK_TEXT && !seenBlock) {
+      Serial.write(payload, h.payloadBytes);
+    } else if (!p.hasFirst && previewDecodeTime(h, payload)) {
+      seenBlock = true;
+      p.firstMs = static_cast<uint32_t>(previewValues[0]);
+      p.hasFirst = true;
+      previewPrintTimes("最初の時刻", 0, h.count < static_cast<uint32_t>(records) ? h.count : records);
+    } else if (h.type == RICE_CHUNK_BLOCK) {
+      seenBlock = true;
+    }
+  });
+}
+
+/** @brief format=rice の末尾の窓から、最後の records 個の時刻とトレーラーを表示する */
+void previewRiceTail(size_t len, int records, LogPreview& p) {
+  RiceChunkHeader lastTime = {};
+  const uint8_t* lastTimePayload = nullptr;
+  const size_t lastEnd = previewRiceChunks(previewBuf, len, [&](const RiceChunkHeader& h, const uint8_t* payload) {
+    if (h.type == RICE_CHUNK_BLOCK && h.channel == 0) {
+      lastTime = h;
+      lastTimePayload = payload;
+    } else if (h.type == RICE_CHUNK_TEXT && h.payloadBytes >= 9) {
+      for (size_t i = 0; i + 9 <= h.payloadBytes; i++) {
+        if ((i == 0 || payload[i - 1] == '\n') && memcmp(payload + i, "# trailer", 9) == 0) {
+          p.trailer = true;
+          Serial.print("  ");
+          Serial.write(payload + i, h.payloadBytes - i);
+          break;
+        }
+      }
+    }
+  });
+  if (lastTimePayload != nullptr && previewDecodeTime(lastTime, lastTimePayload)) {
+    const uint32_t count = lastTime.count;
+    p.lastMs = static_cast<uint32_t>(previewValues[count - 1]);
+    p.hasLast = true;
+    previewPrintTimes("最後の時刻", count > static_cast<uint32_t>(records) ? count - records : 0, count);
+  }
+  p.torn = lastEnd < len;
+  if (p.torn) {
+    Serial.printf("  (最後のチャンクが %u バイトで途切れている)\n", static_cast<unsigned>(len - lastEnd));
+  }
+}
+
+/** @brief ストライプのブロックヘッダーらしいか (マジックと、形式の欄の整合) */
+bool previewStripeHeader(const uint8_t* p, StripeBlockHeader& h) {
+  memcpy(&h, p, sizeof(h));
+  return h.magic == STRIPE_MAGIC && h.headerBytes == sizeof(StripeBlockHeader) && h.cardCount == STRIPE_CARDS &&
+         h.card == h.seq % STRIPE_CARDS;
+}
+
+/**
+ * @brief .s0 の先頭の窓から、最初のブロックの番号と、そのペイロード (ログの先頭) の行を表示する
+ * @details ペイロードはログのバイト列をそのまま区切ったものなので、ヘッダーを飛ばせば CSV として読める。
+ */
+void previewStripeHead(size_t len, int records, LogPreview& p, uint32_t* firstSeq) {
+  StripeBlockHeader h;
+  if (len < sizeof(h) || !previewStripeHeader(previewBuf, h)) {
+    Serial.println("  (先頭がストライプのブロックではない)");
+    return;
+  }
+  *firstSeq = h.seq;
+  Serial.printf("  ブロック seq=%lu (%lu バイト)\n", static_cast<unsigned long>(h.seq),
+                static_cast<unsigned long>(h.payloadBytes));
+  const size_t avail = len - sizeof(h) < h.payloadBytes ? len - sizeof(h) : h.payloadBytes;
+  previewTextHead(reinterpret_cast<const char*>(previewBuf + sizeof(h)), avail, records, p);
+}
+
+/**
+ * @brief .s0 の末尾の窓から最後のブロックの番号を探し、窓に入っているペイロードの最後の行を表示する
+ * @param tailStart 窓のファイル上の位置
+ * @details ブロックは書き込みバッファ1杯分で窓より大きいことがあるので、ブロックの先頭が窓に無ければ
+ *          窓をまるごとペイロードとして行だけを表示する。ペイロードの終わりはカードBのブロックへ続くので、行が途中で切れていても
+ *          途切れとはみなさず、最後のブロックが書き終わっているか (ファイルの終わりとの比較) で判断する。
+ */
+void previewStripeTail(size_t len, uint32_t tailStart, uint32_t size, int records, LogPreview& p, uint32_t firstSeq) {
+  StripeBlockHeader h;
+  StripeBlockHeader last = {};
+  size_t lastPos = len;
+  for (size_t pos = 0; pos + sizeof(h) <= len; pos++) {
+    if (previewStripeHeader(previewBuf + pos, h)) {
+      last = h;
+      lastPos = pos;
+    }
+  }
+  LogPreview lines = {};
+  if (lastPos == len) {
+    // 窓はまるごと最後のブロックのペイロードなので、行としては読める
+    previewTextTail(reinterpret_cast<const char*>(previewBuf), len, true, true, records, lines);
+    p.trailer = lines.trailer;
+    p.lastMs = lines.lastMs;
+    p.hasLast = lines.hasLast;
+    Serial.println("  (最後のブロックの先頭が窓の外にあるので、番号と書き終わっているかは分からない)");
+    return;
+  }
+  const uint64_t blockEnd = static_cast<uint64_t>(tailStart) + lastPos + sizeof(h) + last.payloadBytes;
+  Serial.printf("  ブロック seq=%lu (%lu バイト)", static_cast<unsigned long>(last.seq),
+                static_cast<unsigned long>(last.payloadBytes));
+  if (last.seq >= firstSeq && last.seq != UINT32_MAX) {
+    // カードAには偶数番だけが並ぶ
+    Serial.printf(", このカードに %lu ブロック", static_cast<unsigned long>((last.seq - firstSeq) / STRIPE_CARDS + 1));
+  }
+  Serial.println();
+  const size_t payloadStart = lastPos + sizeof(h);
+  const size_t payloadEnd = blockEnd < tailStart + len ? static_cast<size_t>(blockEnd - tailStart) : len;
+  previewTextTail(reinterpret_cast<const char*>(previewBuf + payloadStart), payloadEnd - payloadStart, true, true, records,
+                  lines);
+  p.trailer = lines.trailer;
+  p.lastMs = lines.lastMs;
+  p.hasLast = lines.hasLast;
+  p.torn = blockEnd != size;
+  if (blockEnd > size) {
+    Serial.printf("  (最後のブロックが %lu バイト足りない)\n", static_cast<unsigned long>(blockEnd - size));
+  } else if (blockEnd < size) {
+    Serial.printf("  (最後のブロックの後に %lu バイトの書きかけがある)\n", static_cast<unsigned long>(size - blockEnd));
+  }
+}
+
+/** @brief 索引 (.idx) のヘッダーと最後のエントリだけを読み、エントリ数と最後の時刻を表示する */
+void previewIndex(const char* logPath, LogPreview& p) {
+  char path[40];
+  snprintf(path, sizeof(path), "%s", logPath);
+  char* dot = strrchr(path, '.');
+  if (dot == nullptr || static_cast<size_t>(dot - path) + 5 > sizeof(path)) {
+    return;
+  }
+  strcpy(dot, ".idx");
+  StorageFile f = storageOpen(path, STORAGE_READ);
+  if (!f) {
+    return;
+  }
+  LogIndexHeader h = {};
+  const uint32_t size = f.size();
+  if (f.read(reinterpret_cast<uint8_t*>(&h), sizeof(h)) == sizeof(h) && logIndexHeaderValid(h)) {
+    p.bytesRead += sizeof(h);
+    const uint32_t count = (size - sizeof(h)) / h.entryBytes; // 半端な末尾は数えない
+    LogIndexEntry e = {};
+    if (count > 0 && f.seek(sizeof(h) + (count - 1) * h.entryBytes) &&
+        f.read(reinterpret_cast<uint8_t*>(&e), sizeof(e)) == sizeof(e)) {
+      p.bytesRead += sizeof(e);
+      Serial.printf("索引: %lu エントリ, 最後 %lu ms (位置 %lu)\n", static_cast<unsigned long>(count),
+                    static_cast<unsigned long>(e.timeMs), static_cast<unsigned long>(e.offset));
+    } else {
+      Serial.println("索引: エントリなし");
+    }
+  } else {
+    Serial.println("索引: ヘッダーが壊れている");
+  }
+  f.close();
+}
+
+/**
+ * @brief 1つのログの先頭と末尾だけを seek で読み、中身の見当と終わり方を表示する
+ * @details 読むのは先頭と末尾の PREVIEW_WINDOW_BYTES ずつと索引の数十バイトだけなので、
+ *          ファイルの大きさによらず一定の時間で済む。.s0 はブロックのヘッダーを飛ばしてペイロードの行を表示する。
+ * @return 読んだバイト数
+ */
+uint32_t previewLog(StorageFile& f, const char* path, unsigned flightNumber, const char* ext, int records) {
+  LogPreview p = {};
+  const uint32_t size = f.size();
+  const bool rice = strcmp(ext, "bin") == 0;
+  const bool stripe = strcmp(ext, "s0") == 0;
+  Serial.printf("===== %s (%lu バイト) =====\n", path, static_cast<unsigned long>(size));
+  if (size == 0) {
+    Serial.println("空のファイル");
+    return 0;
+  }
+
+  Serial.println("--- 先頭 ---");
+  size_t n = previewReadWindow(f, 0, size < PREVIEW_WINDOW_BYTES ? size : PREVIEW_WINDOW_BYTES, p);
+  uint32_t firstSeq = UINT32_MAX;
+  if (rice) {
+    previewRiceHead(n, records, p);
+  } else if (stripe) {
+    previewStripeHead(n, records, p, &firstSeq);
+  } else {
+    previewTextHead(reinterpret_cast<const char*>(previewBuf), n, records, p);
+  }
+
+  Serial.println("--- 末尾 ---");
+  const uint32_t tailStart = size > PREVIEW_WINDOW_BYTES ? size - PREVIEW_WINDOW_BYTES : 0;
+  n = previewReadWindow(f, tailStart, size - tailStart, p);
+  if (rice) {
+    previewRiceTail(n, records, p);
+  } else if (stripe) {
+    previewStripeTail(n, tailStart, size, records, p, firstSeq);
+  } else {
+    previewTextTail(reinterpret_cast<const char*>(previewBuf), n, tailStart > 0, false, records, p);
+  }
+
+  if (p.hasFirst && p.hasLast) {
+    Serial.printf("時刻: %lu .. %lu ms (%lu s)\n", static_cast<unsigned long>(p.firstMs),
+                  static_cast<unsigned long>(p.lastMs), static_cast<unsigned long>((p.lastMs - p.firstMs) / 1000));
+  }
+  const char* verdict = p.trailer ? "clean" : "dirty";
+  if (stripe && !p.trailer) {
+    // トレーラーはどちらのカードに入るか決まらないので、ここに無ければ目録に任せる
+    Serial.printf("終了: ストライプの片側 (.s0) にトレーラーが無いため目録で判定する%s\n",
+                  p.torn ? " (最後のブロックは書きかけ)" : "");
+  } else {
+    Serial.printf("終了: %s (%s)\n", verdict,
+                  p.trailer ? "トレーラーあり" : (p.torn ? "トレーラーなし、末尾が途切れている" : "トレーラーなし"));
+  }
+  FlightCatalogEntry e;
+  if (flightCatalogRead(static_cast<uint16_t>(flightNumber), &e)) {
+    const bool catalogClean = e.state == FLIGHT_CLEAN;
+    Serial.printf("目録: %s%s\n", flightStateName(e.state),
+                  ((!stripe || p.trailer) && catalogClean != p.trailer) ? " (ファイルの終わり方と一致しない)" : "");
+  } else {
+    Serial.println("目録: エントリなし");
+  }
+  previewIndex(path, p);
+  Serial.printf("読んだ量: %lu バイト\n", static_cast<unsigned long>(p.bytesRead));
+  return p.bytesRead;
+}
+
+/**
+ * @brief ルートのログ (flight_log_XXX.csv / .bin / .s0) を順に、先頭と末尾だけ表示する
+ * @details コマンドの残りの行を表示するレコード数として読む (省略時は PREVIEW_DEFAULT_RECORDS)。
+ *          ファイル全体は読まないので、長いフライトでも1ファイルあたりの時間は変わらない。
+ */
+void previewLogs() {
+  char args[16];
+  size_t n = Serial.readBytesUntil('\n', args, sizeof(args) - 1);
+  args[n] = '\0';
+  int records = atoi(args);
+  if (records <= 0) {
+    records = PREVIEW_DEFAULT_RECORDS;
+  }
+  records = records < PREVIEW_MAX_RECORDS ? records : PREVIEW_MAX_RECORDS;
+
+  StorageFile root = storageOpen("/", STORAGE_READ);
+  if (!root) {
+    Serial.println("ルートディレクトリを開けませんでした");
+    return;
+  }
+  const unsigned long startMs = millis();
+  int files = 0;
+  uint64_t totalBytes = 0;
+  uint64_t readBytes = 0;
+  StorageFile entry;
+  while ((entry = root.openNextFile())) {
+    const char* name = entry.name();
+    name = name[0] == '/' ? name + 1 : name;
+    unsigned flightNumber = 0;
+    char ext[5] = {};
+    if (!entry.isDirectory() && sscanf(name, "flight_log_%u.%4s", &flightNumber, ext) == 2 &&
+        (strcmp(ext, "csv") == 0 || strcmp(ext, "bin") == 0 || strcmp(ext, "s0") == 0)) {
+      char path[40];
+      snprintf(path, sizeof(path), "/%s", name);
+      totalBytes += entry.size();
+      readBytes += previewLog(entry, path, flightNumber, ext, records);
+      files++;
+    }
+    entry.close();
+  }
+  root.close();
+  if (files == 0) {
+    Serial.println("ログがありません");
+    return;
+  }
+  Serial.printf("%d ファイル, 読んだ量 %lu KB / 全体 %lu KB, %lu ms\n", files, static_cast<unsigned long>(readBytes >> 10),
+                static_cast<unsigned long>(totalBytes >> 10), millis() - startMs);
+}
+
+/**
+ * @brief シリアルから1文字コマンドを受け付ける
+ */
+void handleSerialCommand() {
+  if (!Serial.available()) {
+    return;
+  }
+  char command = Serial.read();
+  if (!sdInitialized) {
+    Serial.println("エラー: SDカードが初期化されていません");
+    return;
+  }
+  switch (command) {
+    case 'V':
+    case 'R': {
+      // 検証ファイル以外の使用量は、実容量の推定に使う
+      StorageFile root = storageOpen("/", STORAGE_READ);
+      uint64_t usedBytes = root ? sumFileSizes(root, VERIFY_DIR + 1) : 0;
+      root.close();
+      runCapacityVerification(command == 'R', usedBytes);
+      break;
+    }
+    case 'X':
+      removeVerificationFiles();
+      break;
+    case 'W':
+      runWorkloadReplay();
+      break;
+    case 'B':
+      workloadPrintComparison();
+      break;
+    case 'H':
+      printCardHealth();
+      break;
+    case 'C':
+      printFlightCatalog();
+      break;
+    case 'P':
+      previewLogs();
+      break;
+    default:
+      break;
+  }
+}
+
 void setup() {
   Serial.begin(115200);
   while (!Serial) {
@@ -143,6 +812,7 @@ void setup() {
 
 void loop() {
   static unsigned long lastViewTime = 0;
+  handleSerialCommand();
   if (sdInitialized) {
     if (millis() - lastViewTime > 5000) {
       viewMicroSDInfo();
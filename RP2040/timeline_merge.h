@@ -0,0 +1,137 @@
+/**
+ * @file timeline_merge.h
+ * @brief 複数の入力から届くレコードを時刻順に並べ替えて1本のログにする
+ * @details
+ * ロガー自身のサンプルはすぐに手に入るが、サテライト基板のレコードはUARTの送信待ちや
+ * フレームへのまとめ込みの分だけ遅れて届く。そこで整形済みの行を時刻付きで一時的に保持し、
+ * 「これより古いレコードはもう届かない」と言える時刻 (ウォーターマーク) を過ぎた分から
+ * 時刻順に書き出す。ウォーターマークより遅れて届いた行は遅着として数え、すぐに書き出す。
+ *
+ * 行の本体はスロットに置いたまま、時刻順の並びは添字の配列だけで管理するので、
+ * 挿入で動くのは 2 バイトの添字だけである。Arduino に依存しない。
+ * push() は呼び出し側へ必ず展開されるので、呼び出し側をSRAMに置けば push() もSRAMで動く。
+ */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "ram_func.h"
+
+/**
+ * @tparam Slots  同時に保持できる行数
+ * @tparam LineMax 1行の最大バイト数
+ */
+template <uint16_t Slots, uint16_t LineMax>
+class TimelineMerger {
+public:
+  TimelineMerger() {
+    for (uint16_t i = 0; i < Slots; i++) {
+      _free[i] = static_cast<uint16_t>(Slots - 1 - i);
+    }
+    _freeCount = Slots;
+  }
+
+  /**
+   * @brief 1行を時刻付きで加える
+   * @param emit 行を書き出す関数 (const char*, size_t)。満杯や遅着のときに呼ばれる
+   */
+  template <class Emit>
+  LOGGER_RAM_INLINE void push(uint64_t timeUs, const char* line, size_t len, Emit&& emit) {
+    if (len > LineMax) {
+      len = LineMax;
+    }
+    if (_released && timeUs < _watermarkUs) {
+      // 並べ替えの窓より遅れて届いた行。順序は崩れるが、捨てずに書き出す
+      _late++;
+      emit(line, len);
+      return;
+    }
+    if (_freeCount == 0) {
+      // 満杯なら最も古い行を先に書き出して場所を空ける
+      _forced++;
+      popOldest(emit);
+    }
+    uint16_t slot = _free[--_freeCount];
+    _slots[slot].timeUs = timeUs;
+    _slots[slot].len = static_cast<uint16_t>(len);
+    memcpy(_slots[slot].line, line, len);
+
+    // 時刻順の位置を後ろから探す (入力はほぼ時刻順なので、たいてい末尾に付く)
+    uint16_t pos = _count;
+    while (pos > 0 && _slots[_order[pos - 1]].timeUs > timeUs) {
+      pos--;
+    }
+    memmove(&_order[pos + 1], &_order[pos], (_count - pos) * sizeof(_order[0]));
+    _order[pos] = slot;
+    _count++;
+  }
+
+  /**
+   * @brief watermarkUs 以前の行を時刻順に書き出す
+   */
+  template <class Emit>
+  void release(uint64_t watermarkUs, Emit&& emit) {
+    if (!_released || watermarkUs > _watermarkUs) {
+      _watermarkUs = watermarkUs;
+      _released = true;
+    }
+    uint16_t n = 0;
+    while (n < _count && _slots[_order[n]].timeUs <= _watermarkUs) {
+      emitSlot(_order[n], emit);
+      n++;
+    }
+    if (n > 0) {
+      memmove(&_order[0], &_order[n], (_count - n) * sizeof(_order[0]));
+      _count -= n;
+    }
+  }
+
+  /** @brief 保持している行をすべて時刻順に書き出す (終了時用) */
+  template <class Emit>
+  void releaseAll(Emit&& emit) {
+    for (uint16_t i = 0; i < _count; i++) {
+      emitSlot(_order[i], emit);
+    }
+    _count = 0;
+  }
+
+  uint16_t pending() const { return _count; }
+  /** @brief 並べ替えの窓より遅れて届き、順序が崩れた行の数 */
+  uint32_t late() const { return _late; }
+  /** @brief 満杯のため窓を待たずに書き出した行の数 */
+  uint32_t forced() const { return _forced; }
+
+private:
+  struct Slot {
+    uint64_t timeUs;
+    uint16_t len;
+    char line[LineMax];
+  };
+
+  template <class Emit>
+  LOGGER_RAM_INLINE void emitSlot(uint16_t slot, Emit& emit) {
+    emit(_slots[slot].line, static_cast<size_t>(_slots[slot].len));
+    _free[_freeCount++] = slot;
+  }
+
+  template <class Emit>
+  LOGGER_RAM_INLINE void popOldest(Emit& emit) {
+    uint16_t slot = _order[0];
+    if (_slots[slot].timeUs > _watermarkUs) {
+      _watermarkUs = _slots[slot].timeUs;
+      _released = true;
+    }
+    emitSlot(slot, emit);
+    memmove(&_order[0], &_order[1], (_count - 1) * sizeof(_order[0]));
+    _count--;
+  }
+
+  Slot _slots[Slots];
+  uint16_t _order[Slots];
+  uint16_t _free[Slots];
+  uint16_t _count = 0;
+  uint16_t _freeCount = 0;
+  uint64_t _watermarkUs = 0;
+  bool _released = false;
+  uint32_t _late = 0;
+  uint32_t _forced = 0;
+};
@@ -0,0 +1,382 @@
+/**
+ * @file decode_simd.h
+ * @brief ホスト側の Rice ブロック復号の高速版 (ビット読み出しの高速化と、SSE4.1/AVX2 による再構成)
+ * @details
+ * rice_codec.h の riceDecodeBlock は1ビットずつ読む素直な実装で、大量のログを CSV に戻すときは
+ * これが律速になる。ここでは復号を2段に分ける。
+ * - 残差の取り出し: 64 ビットのビットバッファを8バイト単位で補充し、unary 部の 1 の並びを
+ *   clz の1命令で数える。ビット列は直列なのでスカラーのまま
+ * - 再構成: zigzag の復号と、予測子の逆演算。order 次の固定予測の残差は order 階差分なので、
+ *   逆演算は order 回の累積和になる。累積和と zigzag 復号は SSE4.1/AVX2 でベクトル化できる
+ *
+ * k = 0 の区間 (時刻のようにほぼ一定の信号) では、残差 0 の並びを clz でまとめて読む。スカラー版は
+ * 累積和を分けずに riceDecodeBlock と同じ1回の走査で再構成し、1サンプル2ビット未満のブロックは
+ * riceDecodeBlock そのものに任せる (x86 以外のホストでも参照実装より遅くならないように)。
+ *
+ * 復号全体を命令セットごとの関数として展開するので、AVX2 版ではビット読み出しも LZCNT と
+ * SHLX/SHRX (BMI2) でコンパイルされる。
+ *
+ * どの命令セットを使うかは起動時に CPU を調べて決める (logDecodeKernels())。環境変数
+ * LOGREADER_SIMD=scalar|sse4|avx2 で上書きでき、ベンチマークや結果の突き合わせに使う。
+ * x86 以外のホストではスカラー版だけになる。結果は riceDecodeBlock とビット単位で一致する。
+ */
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "../rice_codec.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LOGREADER_X86 1
+#include <immintrin.h>
+#else
+#define LOGREADER_X86 0
+#endif
+
+#define LOGREADER_INLINE inline __attribute__((always_inline))
+
+//================================================
+//== 再構成のカーネル
+//================================================
+
+/** @brief 命令セットごとのカーネル。どれも 2^32 を法とする演算で、結果は同じ */
+struct DecodeKernels {
+  const char* name;
+  void (*unzigzag)(uint32_t* v, size_t n);
+  /** @brief v[i] = seed + v[0] + ... + v[i] (その場で書き換える) */
+  void (*prefixSum)(uint32_t* v, size_t n, uint32_t seed);
+  /** @brief 1ブロックの復号全体。ビット読み出しも同じ命令セット (AVX2 版なら BMI2/LZCNT) でコンパイルされる */
+  bool (*decodeBlock)(const uint8_t* in, size_t len, uint32_t n, int32_t* x);
+};
+
+inline void unzigzagScalar(uint32_t* v, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    v[i] = riceUnzigzag(v[i]);
+  }
+}
+
+inline void prefixSumScalar(uint32_t* v, size_t n, uint32_t seed) {
+  uint32_t acc = seed;
+  for (size_t i = 0; i < n; i++) {
+    acc += v[i];
+    v[i] = acc;
+  }
+}
+
+#if LOGREADER_X86
+__attribute__((target("sse4.1"))) inline void unzigzagSse4(uint32_t* v, size_t n) {
+  const __m128i one = _mm_set1_epi32(1);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i));
+    __m128i sign = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(u, one));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(v + i), _mm_xor_si128(_mm_srli_epi32(u, 1), sign));
+  }
+  unzigzagScalar(v + i, n - i);
+}
+
+__attribute__((target("sse4.1"))) inline void prefixSumSse4(uint32_t* v, size_t n, uint32_t seed) {
+  __m128i carry = _mm_set1_epi32(static_cast<int>(seed));
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i));
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+    x = _mm_add_epi32(x, carry);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(v + i), x);
+    carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+  }
+  prefixSumScalar(v + i, n - i, static_cast<uint32_t>(_mm_cvtsi128_si32(carry)));
+}
+
+__attribute__((target("avx2"))) inline void unzigzagAvx2(uint32_t* v, size_t n) {
+  const __m256i one = _mm256_set1_epi32(1);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i u = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i));
+    __m256i sign = _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_and_si256(u, one));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(v + i), _mm256_xor_si256(_mm256_srli_epi32(u, 1), sign));
+  }
+  unzigzagScalar(v + i, n - i);
+}
+
+__attribute__((target("avx2"))) inline void prefixSumAvx2(uint32_t* v, size_t n, uint32_t seed) {
+  __m256i carry = _mm256_set1_epi32(static_cast<int>(seed));
+  const __m256i lastLane = _mm256_set1_epi32(7);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i));
+    // 128 ビットの各レーン内で累積和を取り、下のレーンの合計を上のレーンへ足す
+    x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+    x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+    __m256i low = _mm256_permute2x128_si256(x, x, 0x08); // 下位に 0、上位に下のレーン
+    x = _mm256_add_epi32(x, _mm256_shuffle_epi32(low, _MM_SHUFFLE(3, 3, 3, 3)));
+    x = _mm256_add_epi32(x, carry);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(v + i), x);
+    carry = _mm256_permutevar8x32_epi32(x, lastLane);
+  }
+  prefixSumScalar(v + i, n - i, static_cast<uint32_t>(_mm256_extract_epi32(carry, 0)));
+}
+#endif // LOGREADER_X86
+
+//================================================
+//== ビット列の読み出し
+//================================================
+
+/** @brief 64 ビットのバッファに8バイトずつ補充する MSB 先頭のビット読み出し */
+class FastBitReader {
+public:
+  FastBitReader(const uint8_t* in, size_t len) : _begin(in), _p(in), _end(in + len) { refill(); }
+
+  /** @brief バッファを 56 ビット以上にする */
+  LOGREADER_INLINE void refill() {
+    if (_end - _p >= 8) {
+      uint64_t w;
+      memcpy(&w, _p, 8);
+      _buf |= __builtin_bswap64(w) >> _bits;
+      _p += (63 - _bits) >> 3;
+      _bits |= 56;
+    } else {
+      while (_bits <= 56) {
+        _buf |= static_cast<uint64_t>(_p < _end ? *_p : 0) << (56 - _bits);
+        _p++;
+        _bits += 8;
+      }
+    }
+  }
+
+  /** @brief バッファに n ビット以上なければ補充する */
+  LOGREADER_INLINE void ensure(uint32_t n) {
+    if (_bits < n) {
+      refill();
+    }
+  }
+
+  /** @brief n ビット (1 <= n <= 56、バッファに足りていること) を読む */
+  LOGREADER_INLINE uint32_t take(uint32_t n) {
+    uint32_t v = static_cast<uint32_t>(_buf >> (64 - n));
+    _buf <<= n;
+    _bits -= n;
+    return v;
+  }
+
+  /** @brief 先頭の 1 の並びの長さ (limit で打ち切る。limit <= 32、バッファに limit+1 ビットあること) を数え、区切りの 0 も読む */
+  LOGREADER_INLINE uint32_t unary(uint32_t limit) {
+    uint32_t q = static_cast<uint32_t>(__builtin_clzll(~_buf | (1ull << (63 - limit))));
+    if (q >= limit) {
+      q = limit;
+      _buf <<= limit;
+      _bits -= limit;
+    } else {
+      _buf <<= q + 1;
+      _bits -= q + 1;
+    }
+    return q;
+  }
+
+  /**
+   * @brief 先頭の 0 の並び (k = 0 の区間では、それぞれが残差 0 の1サンプル) を max 個まで読み、その数を返す
+   * @details バッファの有効なビットを越えては数えない。
+   */
+  LOGREADER_INLINE uint32_t zeroRun(uint32_t max) {
+    uint32_t z = _buf == 0 ? 64 : static_cast<uint32_t>(__builtin_clzll(_buf));
+    z = z < _bits ? z : _bits;
+    z = z < max ? z : max;
+    _buf = z < 64 ? _buf << z : 0;
+    _bits -= z;
+    return z;
+  }
+
+  bool overrun() const { return static_cast<size_t>(_p - _begin) * 8 - _bits > static_cast<size_t>(_end - _begin) * 8; }
+
+private:
+  const uint8_t* _begin;
+  const uint8_t* _p;
+  const uint8_t* _end;
+  uint64_t _buf = 0;
+  uint32_t _bits = 0;
+};
+
+/** @brief zigzag の復号と予測子の逆演算を1回の走査で行う (riceDecodeBlock と同じ式) */
+LOGREADER_INLINE void riceReconstructFused(uint32_t* u, uint32_t n, uint32_t order) {
+  switch (order) {
+    case 0:
+      for (uint32_t i = 0; i < n; i++) u[i] = riceUnzigzag(u[i]);
+      break;
+    case 1:
+      for (uint32_t i = 1; i < n; i++) u[i] = riceUnzigzag(u[i]) + u[i - 1];
+      break;
+    case 2:
+      for (uint32_t i = 2; i < n; i++) u[i] = riceUnzigzag(u[i]) + 2 * u[i - 1] - u[i - 2];
+      break;
+    case 3:
+      for (uint32_t i = 3; i < n; i++) u[i] = riceUnzigzag(u[i]) + 3 * u[i - 1] - 3 * u[i - 2] + u[i - 3];
+      break;
+    default:
+      for (uint32_t i = 4; i < n; i++) u[i] = riceUnzigzag(u[i]) + 4 * u[i - 1] - 6 * u[i - 2] + 4 * u[i - 3] - u[i - 4];
+      break;
+  }
+}
+
+/**
+ * @brief 1ブロックを復号する本体。命令セットごとの版へ展開される
+ * @return ビット列が途中で切れていれば false
+ */
+template <void (*Unzigzag)(uint32_t*, size_t), void (*PrefixSum)(uint32_t*, size_t, uint32_t)>
+LOGREADER_INLINE bool riceDecodeBlockWith(const uint8_t* in, size_t len, uint32_t n, int32_t* x) {
+  FastBitReader r(in, len);
+  const uint32_t order = r.take(3);
+  if (order > RICE_MAX_ORDER) {
+    return false;
+  }
+  uint32_t* u = reinterpret_cast<uint32_t*>(x);
+  for (uint32_t i = 0; i < order && i < n; i++) {
+    r.refill();
+    u[i] = r.take(32);
+  }
+  // 残差の zigzag 値をそのまま u[order..n) に並べる
+  for (uint32_t start = 0; start < n; start += RICE_PARTITION) {
+    const uint32_t end = start + RICE_PARTITION < n ? start + RICE_PARTITION : n;
+    r.refill();
+    const uint32_t k = r.take(5);
+    uint32_t i = start < order ? order : start;
+    if (k == 0) {
+      // 時刻のようにほぼ一定の信号では、残差 0 (ビット 0 が1つ) が続く。並びをまとめて読み、
+      // 1サンプルずつの分岐と補充の確認を省く
+      while (i < end) {
+        r.ensure(RICE_ESCAPE_Q + 1);
+        const uint32_t zeros = r.zeroRun(end - i);
+        memset(u + i, 0, zeros * sizeof(uint32_t));
+        i += zeros;
+        if (i == end) {
+          break;
+        }
+        uint32_t q = r.unary(RICE_ESCAPE_Q);
+        if (q == RICE_ESCAPE_Q) {
+          r.ensure(32);
+          q = r.take(32);
+        }
+        u[i++] = q;
+      }
+      continue;
+    }
+    for (; i < end; i++) {
+      // 補充は足りなくなったときだけ (小さな残差なら数サンプルに1回で済む)
+      r.ensure(RICE_ESCAPE_Q + 1);
+      uint32_t q = r.unary(RICE_ESCAPE_Q);
+      if (q == RICE_ESCAPE_Q) {
+        r.ensure(32);
+        q = r.take(32);
+      } else if (k > 0) {
+        r.ensure(k);
+        q = (q << k) | r.take(k);
+      }
+      u[i] = q;
+    }
+  }
+  if (n <= order) {
+    return !r.overrun();
+  }
+  if (PrefixSum == prefixSumScalar) {
+    // ベクトル化できないなら、order 回の累積和より riceDecodeBlock と同じ1回の走査のほうが速い
+    riceReconstructFused(u, n, order);
+    return !r.overrun();
+  }
+  // 先頭サンプルから、各階差分の order-1 番目の値 (累積和の初期値) を求める
+  uint32_t seed[RICE_MAX_ORDER];
+  uint32_t diff[RICE_MAX_ORDER];
+  for (uint32_t i = 0; i < order; i++) {
+    diff[i] = u[i];
+  }
+  for (uint32_t level = 0; level < order; level++) {
+    seed[level] = diff[order - 1]; // level 階差分の order-1 番目
+    for (uint32_t i = order - 1; i > level; i--) {
+      diff[i] -= diff[i - 1];
+    }
+  }
+  Unzigzag(u + order, n - order);
+  for (uint32_t level = order; level-- > 0;) {
+    PrefixSum(u + order, n - order, seed[level]);
+  }
+  return !r.overrun();
+}
+
+/** @brief 1サンプル平均このビット数未満のブロックは、スカラー版では riceDecodeBlock のほうが速い (時刻のチャンネルなど) */
+#define LOGREADER_SCALAR_REFERENCE_BITS 2
+
+inline bool riceDecodeBlockScalar(const uint8_t* in, size_t len, uint32_t n, int32_t* x) {
+  if (len * 8 < static_cast<size_t>(n) * LOGREADER_SCALAR_REFERENCE_BITS) {
+    return riceDecodeBlock(in, len, n, x);
+  }
+  return riceDecodeBlockWith<unzigzagScalar, prefixSumScalar>(in, len, n, x);
+}
+
+#if LOGREADER_X86
+__attribute__((target("sse4.1,popcnt"))) inline bool riceDecodeBlockSse4(const uint8_t* in, size_t len, uint32_t n, int32_t* x) {
+  return riceDecodeBlockWith<unzigzagSse4, prefixSumSse4>(in, len, n, x);
+}
+
+// unary 部の数え上げとシフトが LZCNT と SHLX/SHRX になる
+__attribute__((target("avx2,bmi,bmi2,lzcnt"))) inline bool riceDecodeBlockAvx2(const uint8_t* in, size_t len, uint32_t n, int32_t* x) {
+  return riceDecodeBlockWith<unzigzagAvx2, prefixSumAvx2>(in, len, n, x);
+}
+#endif
+
+//================================================
+//== 実行時の選択
+//================================================
+
+inline const DecodeKernels kDecodeScalar = {"scalar", unzigzagScalar, prefixSumScalar, riceDecodeBlockScalar};
+#if LOGREADER_X86
+inline const DecodeKernels kDecodeSse4 = {"sse4", unzigzagSse4, prefixSumSse4, riceDecodeBlockSse4};
+inline const DecodeKernels kDecodeAvx2 = {"avx2", unzigzagAvx2, prefixSumAvx2, riceDecodeBlockAvx2};
+#endif
+
+/** @brief 名前からカーネルを選ぶ。CPU が対応していなければ nullptr */
+inline const DecodeKernels* logDecodeKernelsByName(const char* name) {
+  if (strcmp(name, "scalar") == 0) {
+    return &kDecodeScalar;
+  }
+#if LOGREADER_X86
+  __builtin_cpu_init();
+  if (strcmp(name, "sse4") == 0 && __builtin_cpu_supports("sse4.1")) {
+    return &kDecodeSse4;
+  }
+  if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2") &&
+      __builtin_cpu_supports("lzcnt")) {
+    return &kDecodeAvx2;
+  }
+#endif
+  return nullptr;
+}
+
+/** @brief この CPU で使う既定のカーネル。最初の呼び出しで決める */
+inline const DecodeKernels& logDecodeKernels() {
+  static const DecodeKernels* chosen = [] {
+    const char* env = getenv("LOGREADER_SIMD");
+    if (env != nullptr) {
+      const DecodeKernels* k = logDecodeKernelsByName(env);
+      if (k != nullptr) {
+        return k;
+      }
+    }
+    for (const char* name : {"avx2", "sse4"}) {
+      const DecodeKernels* k = logDecodeKernelsByName(name);
+      if (k != nullptr) {
+        return k;
+      }
+    }
+    return &kDecodeScalar;
+  }();
+  return *chosen;
+}
+
+/**
+ * @brief 1ブロックを復号する (riceDecodeBlock と同じ結果)
+ * @return ビット列が途中で切れていれば false
+ */
+inline bool riceDecodeBlockFast(const uint8_t* in, size_t len, uint32_t n, int32_t* x,
+                                const DecodeKernels& kernels = logDecodeKernels()) {
+  return kernels.decodeBlock(in, len, n, x);
+}
@@ -0,0 +1,297 @@
+/**
+ * @file fft_simd.h
+ * @brief ホスト側のスペクトル解析のための実数 FFT (基数2、SSE/AVX2 のバタフライ)
+ * @details
+ * 振動の PSD は同じ長さ (nfft) の窓を何万回も変換するので、長さごとに FftPlan を1回作り、
+ * ビット反転の表と回転因子を使い回す。
+ * - 実数 n 点の変換は、偶数番目・奇数番目を実部・虚部にした n/2 点の複素 FFT と、その後の分離で行う
+ * - 複素 FFT は時間間引きの基数2で、実部と虚部を別の配列に持つ (split 形式)。半分の長さ m の段では
+ *   連続する m 個のバタフライが同じ形をしているので、m が 4 以上なら SSE、8 以上なら AVX2 (FMA) で
+ *   まとめて計算する。回転因子が 1 と −i だけの最初の2段は、4点ずつまとめてスカラーで行う
+ *
+ * どのバタフライを使うかは decode_simd.h と同じく起動時に CPU を調べて決める (fftKernels())。
+ * 環境変数 SPECTRUM_SIMD=scalar|sse|avx2 で上書きでき、結果の突き合わせに使う。
+ * FMA の有無で丸めが変わるので、カーネルの間で結果はビット単位では一致しない (誤差は float の丸め程度)。
+ * 同じカーネルなら、スレッドの数や順序によらず同じ結果になる。
+ */
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SPECTRUM_X86 1
+#include <immintrin.h>
+#else
+#define SPECTRUM_X86 0
+#endif
+
+//================================================
+//== バタフライのカーネル
+//================================================
+
+/** @brief 命令セットごとのカーネル */
+struct FftKernels {
+  const char* name;
+  /**
+   * @brief 半分の長さ m の段を、長さ n の全体に対して行う
+   * @param wr, wi この段の回転因子 exp(-2πij/2m) (j < m)
+   */
+  void (*stage)(float* re, float* im, size_t n, size_t m, const float* wr, const float* wi);
+};
+
+inline void fftStageScalar(float* re, float* im, size_t n, size_t m, const float* wr, const float* wi) {
+  for (size_t k = 0; k < n; k += 2 * m) {
+    float* ar = re + k;
+    float* ai = im + k;
+    float* br = ar + m;
+    float* bi = ai + m;
+    for (size_t j = 0; j < m; j++) {
+      const float tr = wr[j] * br[j] - wi[j] * bi[j];
+      const float ti = wr[j] * bi[j] + wi[j] * br[j];
+      br[j] = ar[j] - tr;
+      bi[j] = ai[j] - ti;
+      ar[j] += tr;
+      ai[j] += ti;
+    }
+  }
+}
+
+#if SPECTRUM_X86
+__attribute__((target("sse2"))) inline void fftStageSse(float* re, float* im, size_t n, size_t m, const float* wr,
+                                                       const float* wi) {
+  if (m < 4) {
+    fftStageScalar(re, im, n, m, wr, wi);
+    return;
+  }
+  for (size_t k = 0; k < n; k += 2 * m) {
+    float* ar = re + k;
+    float* ai = im + k;
+    float* br = ar + m;
+    float* bi = ai + m;
+    for (size_t j = 0; j < m; j += 4) {
+      const __m128 c = _mm_loadu_ps(wr + j);
+      const __m128 s = _mm_loadu_ps(wi + j);
+      const __m128 xr = _mm_loadu_ps(br + j);
+      const __m128 xi = _mm_loadu_ps(bi + j);
+      const __m128 tr = _mm_sub_ps(_mm_mul_ps(c, xr), _mm_mul_ps(s, xi));
+      const __m128 ti = _mm_add_ps(_mm_mul_ps(c, xi), _mm_mul_ps(s, xr));
+      const __m128 yr = _mm_loadu_ps(ar + j);
+      const __m128 yi = _mm_loadu_ps(ai + j);
+      _mm_storeu_ps(br + j, _mm_sub_ps(yr, tr));
+      _mm_storeu_ps(bi + j, _mm_sub_ps(yi, ti));
+      _mm_storeu_ps(ar + j, _mm_add_ps(yr, tr));
+      _mm_storeu_ps(ai + j, _mm_add_ps(yi, ti));
+    }
+  }
+}
+
+__attribute__((target("avx2,fma"))) inline void fftStageAvx2(float* re, float* im, size_t n, size_t m, const float* wr,
+                                                            const float* wi) {
+  if (m < 8) {
+    fftStageSse(re, im, n, m, wr, wi);
+    return;
+  }
+  for (size_t k = 0; k < n; k += 2 * m) {
+    float* ar = re + k;
+    float* ai = im + k;
+    float* br = ar + m;
+    float* bi = ai + m;
+    for (size_t j = 0; j < m; j += 8) {
+      const __m256 c = _mm256_loadu_ps(wr + j);
+      const __m256 s = _mm256_loadu_ps(wi + j);
+      const __m256 xr = _mm256_loadu_ps(br + j);
+      const __m256 xi = _mm256_loadu_ps(bi + j);
+      const __m256 tr = _mm256_fmsub_ps(c, xr, _mm256_mul_ps(s, xi));
+      const __m256 ti = _mm256_fmadd_ps(c, xi, _mm256_mul_ps(s, xr));
+      const __m256 yr = _mm256_loadu_ps(ar + j);
+      const __m256 yi = _mm256_loadu_ps(ai + j);
+      _mm256_storeu_ps(br + j, _mm256_sub_ps(yr, tr));
+      _mm256_storeu_ps(bi + j, _mm256_sub_ps(yi, ti));
+      _mm256_storeu_ps(ar + j, _mm256_add_ps(yr, tr));
+      _mm256_storeu_ps(ai + j, _mm256_add_ps(yi, ti));
+    }
+  }
+}
+#endif // SPECTRUM_X86
+
+//================================================
+//== 実行時の選択
+//================================================
+
+inline const FftKernels kFftScalar = {"scalar", fftStageScalar};
+#if SPECTRUM_X86
+inline const FftKernels kFftSse = {"sse", fftStageSse};
+inline const FftKernels kFftAvx2 = {"avx2", fftStageAvx2};
+#endif
+
+/** @brief 名前からカーネルを選ぶ。CPU が対応していなければ nullptr */
+inline const FftKernels* fftKernelsByName(const char* name) {
+  if (strcmp(name, "scalar") == 0) {
+    return &kFftScalar;
+  }
+#if SPECTRUM_X86
+  __builtin_cpu_init();
+  if (strcmp(name, "sse") == 0 && __builtin_cpu_supports("sse2")) {
+    return &kFftSse;
+  }
+  if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return &kFftAvx2;
+  }
+#endif
+  return nullptr;
+}
+
+/** @brief この CPU で使う既定のカーネル。最初の呼び出しで決める */
+inline const FftKernels& fftKernels() {
+  static const FftKernels* chosen = [] {
+    const char* env = getenv("SPECTRUM_SIMD");
+    if (env != nullptr) {
+      const FftKernels* k = fftKernelsByName(env);
+      if (k != nullptr) {
+        return k;
+      }
+    }
+    for (const char* name : {"avx2", "sse"}) {
+      const FftKernels* k = fftKernelsByName(name);
+      if (k != nullptr) {
+        return k;
+      }
+    }
+    return &kFftScalar;
+  }();
+  return *chosen;
+}
+
+//================================================
+//== 実数 FFT
+//================================================
+
+/**
+ * @brief 長さ n (2 の累乗、4 以上) の実数 FFT の計画。作った後は読むだけなので、スレッド間で共有できる
+ * @details 変換の作業領域は Scratch としてスレッドごとに持つ。
+ */
+class FftPlan {
+public:
+  explicit FftPlan(size_t n, const FftKernels& kernels = fftKernels()) : _n(n), _half(n / 2), _kernels(&kernels) {
+    size_t bits = 0;
+    while ((size_t{1} << bits) < _half) {
+      bits++;
+    }
+    _bitrev.resize(_half);
+    for (size_t i = 0; i < _half; i++) {
+      size_t r = 0;
+      for (size_t b = 0; b < bits; b++) {
+        r |= ((i >> b) & 1) << (bits - 1 - b);
+      }
+      _bitrev[i] = static_cast<uint32_t>(r);
+    }
+    // 段ごとの回転因子を、半分の長さ m の順に続けて置く (m の段は m - 1 番目から)
+    _wr.resize(_half);
+    _wi.resize(_half);
+    for (size_t m = 1; m < _half; m *= 2) {
+      for (size_t j = 0; j < m; j++) {
+        const double a = -M_PI * static_cast<double>(j) / static_cast<double>(m);
+        _wr[m - 1 + j] = static_cast<float>(cos(a));
+        _wi[m - 1 + j] = static_cast<float>(sin(a));
+      }
+    }
+    // 分離に使う exp(-2πik/n)
+    _sr.resize(_half + 1);
+    _si.resize(_half + 1);
+    for (size_t k = 0; k <= _half; k++) {
+      const double a = -2.0 * M_PI * static_cast<double>(k) / static_cast<double>(n);
+      _sr[k] = static_cast<float>(cos(a));
+      _si[k] = static_cast<float>(sin(a));
+    }
+  }
+
+  size_t size() const { return _n; }
+  size_t bins() const { return _half + 1; }
+  const FftKernels& kernels() const { return *_kernels; }
+
+  struct Scratch {
+    std::vector<float> re;
+    std::vector<float> im;
+  };
+
+  /**
+   * @brief x[0..n) を変換し、片側のパワー |X[k]|² (k = 0..n/2) を power に書く
+   * @param window 掛ける窓 (n 個)。nullptr なら掛けない
+   * @param mean 窓を掛ける前に引く値 (区間の平均を引いて直流を除くのに使う)
+   */
+  void power(const float* x, const float* window, float mean, float* power, Scratch& s) const {
+    s.re.resize(_half);
+    s.im.resize(_half);
+    float* re = s.re.data();
+    float* im = s.im.data();
+    // 偶数番目を実部、奇数番目を虚部にして、ビット反転の位置に置く
+    for (size_t j = 0; j < _half; j++) {
+      const size_t r = _bitrev[j];
+      const float w0 = window != nullptr ? window[2 * j] : 1.0f;
+      const float w1 = window != nullptr ? window[2 * j + 1] : 1.0f;
+      re[r] = (x[2 * j] - mean) * w0;
+      im[r] = (x[2 * j + 1] - mean) * w1;
+    }
+    size_t m = 1;
+    if (_half >= 4) {
+      firstStages(re, im);
+      m = 4;
+    }
+    for (; m < _half; m *= 2) {
+      _kernels->stage(re, im, _half, m, _wr.data() + m - 1, _wi.data() + m - 1);
+    }
+    // Z[k] から X[k] = E[k] + W^k O[k] を取り出す。E と O は Z[k] と conj(Z[h-k]) の和と差
+    power[0] = (re[0] + im[0]) * (re[0] + im[0]);
+    power[_half] = (re[0] - im[0]) * (re[0] - im[0]);
+    for (size_t k = 1; k < _half; k++) {
+      const float zr = re[k];
+      const float zi = im[k];
+      const float cr = re[_half - k];
+      const float ci = -im[_half - k];
+      const float er = 0.5f * (zr + cr);
+      const float ei = 0.5f * (zi + ci);
+      // O = (Z - conj) / 2i
+      const float or_ = 0.5f * (zi - ci);
+      const float oi = -0.5f * (zr - cr);
+      const float xr = er + _sr[k] * or_ - _si[k] * oi;
+      const float xi = ei + _sr[k] * oi + _si[k] * or_;
+      power[k] = xr * xr + xi * xi;
+    }
+  }
+
+private:
+  /**
+   * @brief m = 1 と m = 2 の段を4点ずつまとめて行う
+   * @details 回転因子は 1 と −i だけなので掛け算が要らない。短い段を SIMD のカーネルに
+   *          1つずつ渡すと、ループの手間の方が大きくなる。
+   */
+  void firstStages(float* re, float* im) const {
+    for (size_t k = 0; k < _half; k += 4) {
+      const float a0r = re[k] + re[k + 1], a0i = im[k] + im[k + 1];
+      const float a1r = re[k] - re[k + 1], a1i = im[k] - im[k + 1];
+      const float a2r = re[k + 2] + re[k + 3], a2i = im[k + 2] + im[k + 3];
+      const float a3r = re[k + 2] - re[k + 3], a3i = im[k + 2] - im[k + 3];
+      re[k] = a0r + a2r;
+      im[k] = a0i + a2i;
+      re[k + 2] = a0r - a2r;
+      im[k + 2] = a0i - a2i;
+      // −i × a3 = (a3i, −a3r)
+      re[k + 1] = a1r + a3i;
+      im[k + 1] = a1i - a3r;
+      re[k + 3] = a1r - a3i;
+      im[k + 3] = a1i + a3r;
+    }
+  }
+
+  size_t _n;
+  size_t _half;
+  const FftKernels* _kernels;
+  std::vector<uint32_t> _bitrev;
+  std::vector<float> _wr;
+  std::vector<float> _wi;
+  std::vector<float> _sr;
+  std::vector<float> _si;
+};
@@ -0,0 +1,326 @@
+/**
+ * @file flash_pull.cpp
+ * @brief ロガーからUSBシリアルでファイルを一覧・取り出すホストツール (file_download.h の形式)
+ * @details
+ * ロガーのシリアルコマンド 'f' (一覧) と 'g 名前' (取り出し) を送り、受け取ったファイルを
+ * CRC-32 で確かめてから保存する。CRC が合わなければ保存せず、終了コード 1 を返す。
+ * 記録中でも使えるが、取り出せるのは最後に確定した所まで (記録を終えてから取るのが確実)。
+ *
+ * range はロガーの 'q' で、ログの .idx を使って時刻の範囲の部分だけを受け取る (カードを抜かずに、
+ * イベントの前後だけを取るため)。ロガーが送る範囲は索引の間隔の分だけ広いので、CSV のログは
+ * 時刻が範囲外の行をここで落とす。format=rice はチャンクの境目から始まるので、そのまま保存して
+ * rice2csv や logtail で読む。名前を省くと記録中 (または最後に記録した) ログになる。
+ *
+ * ビルド: g++ -O2 -std=c++17 -o flash_pull flash_pull.cpp (Linux / macOS)
+ * 使い方:
+ *   flash_pull /dev/ttyACM0 list
+ *   flash_pull /dev/ttyACM0 get /flight_log_003.csv [保存先]
+ *   flash_pull /dev/ttyACM0 all [保存先ディレクトリ=.]
+ *   flash_pull /dev/ttyACM0 range 開始ms 終了ms [/flight_log_003.csv] [保存先]
+ */
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "../file_download.h"
+
+namespace {
+
+const int kTimeoutMs = 5000;
+
+class Port {
+public:
+  explicit Port(const char* path) {
+    _fd = open(path, O_RDWR | O_NOCTTY);
+    if (_fd < 0) {
+      return;
+    }
+    termios tio;
+    tcgetattr(_fd, &tio);
+    cfmakeraw(&tio);
+    cfsetspeed(&tio, B115200); // USB CDC なので速度は関係ないが、設定しておく
+    tio.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(_fd, TCSANOW, &tio);
+    tcflush(_fd, TCIOFLUSH);
+  }
+  ~Port() {
+    if (_fd >= 0) {
+      close(_fd);
+    }
+  }
+  bool ok() const { return _fd >= 0; }
+
+  bool send(const std::string& s) { return write(_fd, s.data(), s.size()) == static_cast<ssize_t>(s.size()); }
+
+  /** @brief 1バイト読む。時間切れなら -1 */
+  int readByte() {
+    if (_pos == _len) {
+      pollfd p = {_fd, POLLIN, 0};
+      if (poll(&p, 1, kTimeoutMs) <= 0) {
+        return -1;
+      }
+      const ssize_t n = read(_fd, _buf, sizeof(_buf));
+      if (n <= 0) {
+        return -1;
+      }
+      _pos = 0;
+      _len = static_cast<size_t>(n);
+    }
+    return _buf[_pos++];
+  }
+
+  /** @brief '\n' までを1行読む ('\n' は含めない) */
+  bool readLine(std::string& line) {
+    line.clear();
+    for (;;) {
+      const int c = readByte();
+      if (c < 0) {
+        return false;
+      }
+      if (c == '\n') {
+        return true;
+      }
+      line += static_cast<char>(c);
+    }
+  }
+
+  /** @brief '#' で始まる行が来るまで読み飛ばす (ロガーの案内の文を除くため) */
+  bool readTagLine(std::string& line) {
+    while (readLine(line)) {
+      if (!line.empty() && line[0] == '#') {
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  int _fd = -1;
+  uint8_t _buf[4096];
+  size_t _pos = 0;
+  size_t _len = 0;
+};
+
+struct Entry {
+  std::string path;
+  unsigned long size;
+};
+
+bool listFiles(Port& port, std::vector<Entry>& out) {
+  std::string line;
+  port.send("f");
+  while (port.readTagLine(line) && line != "#LIST") {
+  }
+  if (line != "#LIST") {
+    return false;
+  }
+  while (port.readLine(line)) {
+    if (line.compare(0, 4, "#END") == 0) {
+      return true;
+    }
+    char path[FILE_DOWNLOAD_NAME_MAX];
+    unsigned long size = 0;
+    if (sscanf(line.c_str(), "%63s %lu", path, &size) == 2) {
+      out.push_back({path, size});
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief 見出しの後の size バイトと "#END <CRC>" を受け取る
+ * @return CRC が合えば true
+ */
+bool receiveBody(Port& port, const std::string& label, uint32_t size, std::vector<uint8_t>& data) {
+  data.resize(size);
+  for (uint32_t i = 0; i < size; i++) {
+    const int c = port.readByte();
+    if (c < 0) {
+      fprintf(stderr, "%s: %u / %u バイトで途切れた\n", label.c_str(), i, size);
+      return false;
+    }
+    data[i] = static_cast<uint8_t>(c);
+  }
+  std::string line;
+  unsigned long expected = 0;
+  if (!port.readLine(line) || sscanf(line.c_str(), "#END %lx", &expected) != 1) {
+    fprintf(stderr, "%s: ロガーが最後まで読めなかった (%s)\n", label.c_str(), line.c_str());
+    return false;
+  }
+  const uint32_t crc = fileDownloadCrc32(0, data.data(), data.size());
+  if (crc != expected) {
+    fprintf(stderr, "%s: CRC が合わない (受信 %08x、ロガー %08lx)\n", label.c_str(), crc, expected);
+    return false;
+  }
+  return true;
+}
+
+bool saveFile(const std::string& dest, const uint8_t* data, size_t len) {
+  FILE* f = fopen(dest.c_str(), "wb");
+  if (f == nullptr || fwrite(data, 1, len, f) != len) {
+    fprintf(stderr, "%s: 書けない (%s)\n", dest.c_str(), strerror(errno));
+    if (f != nullptr) {
+      fclose(f);
+    }
+    return false;
+  }
+  fclose(f);
+  return true;
+}
+
+/** @brief 1つのファイルを取り出して保存する。CRC が合えば true */
+bool getFile(Port& port, const std::string& path, const std::string& dest) {
+  port.send("g " + path + "\n");
+  std::string line;
+  if (!port.readTagLine(line)) {
+    fprintf(stderr, "%s: 応答がない\n", path.c_str());
+    return false;
+  }
+  char name[FILE_DOWNLOAD_NAME_MAX];
+  uint32_t size = 0;
+  if (!fileDownloadParseHeader(line.c_str(), name, &size)) {
+    fprintf(stderr, "%s: %s\n", path.c_str(), line.c_str());
+    return false;
+  }
+  std::vector<uint8_t> data;
+  if (!receiveBody(port, path, size, data) || !saveFile(dest, data.data(), data.size())) {
+    return false;
+  }
+  printf("%s -> %s (%u bytes, crc %08x)\n", name, dest.c_str(), size, fileDownloadCrc32(0, data.data(), data.size()));
+  return true;
+}
+
+/**
+ * @brief CSV のログから、時刻が [fromMs, toMs] の外の行を落とす (コメント行は残す)
+ * @return 残したバイト数
+ */
+size_t trimCsvRange(std::vector<uint8_t>& data, uint32_t fromMs, uint32_t toMs) {
+  size_t out = 0;
+  for (size_t i = 0; i < data.size();) {
+    size_t end = i;
+    while (end < data.size() && data[end] != '\n') {
+      end++;
+    }
+    end = end < data.size() ? end + 1 : end;
+    bool keep = true;
+    if (data[i] >= '0' && data[i] <= '9') {
+      uint32_t ms = 0;
+      for (size_t j = i; j < end && data[j] >= '0' && data[j] <= '9'; j++) {
+        ms = ms * 10 + static_cast<uint32_t>(data[j] - '0');
+      }
+      keep = ms >= fromMs && ms <= toMs;
+    }
+    if (keep) {
+      memmove(data.data() + out, data.data() + i, end - i);
+      out += end - i;
+    }
+    i = end;
+  }
+  data.resize(out);
+  return out;
+}
+
+/** @brief ログの時刻の範囲だけを受け取って保存する。CRC が合えば true */
+bool getRange(Port& port, uint32_t fromMs, uint32_t toMs, const std::string& path, const std::string& dest) {
+  char command[96];
+  snprintf(command, sizeof(command), "q %u %u %s\n", fromMs, toMs, path.c_str());
+  port.send(command);
+  std::string line;
+  if (!port.readTagLine(line)) {
+    fprintf(stderr, "range: 応答がない\n");
+    return false;
+  }
+  char name[FILE_DOWNLOAD_NAME_MAX];
+  uint32_t from = 0;
+  uint32_t to = 0;
+  uint32_t offset = 0;
+  uint32_t size = 0;
+  if (!fileDownloadParseRange(line.c_str(), name, &from, &to, &offset, &size)) {
+    fprintf(stderr, "range: %s\n", line.c_str());
+    return false;
+  }
+  std::vector<uint8_t> data;
+  if (!receiveBody(port, name, size, data)) {
+    return false;
+  }
+  const std::string logName = name;
+  const bool csv = logName.size() > 4 && logName.compare(logName.size() - 4, 4, ".csv") == 0;
+  if (csv) {
+    trimCsvRange(data, from, to);
+  }
+  std::string out = dest;
+  if (out.empty()) {
+    const std::string base = logName.substr(logName.rfind('/') + 1);
+    const size_t dot = base.rfind('.');
+    out = base.substr(0, dot) + "_" + std::to_string(from) + "-" + std::to_string(to) + (dot == std::string::npos ? "" : base.substr(dot));
+  }
+  if (!saveFile(out, data.data(), data.size())) {
+    return false;
+  }
+  printf("%s [%u, %u] ms -> %s (offset %u, %u bytes received, %zu bytes saved)\n", name, from, to, out.c_str(), offset, size,
+         data.size());
+  return true;
+}
+
+std::string baseName(const std::string& path) {
+  const size_t slash = path.rfind('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: flash_pull <port> list | get <path> [dest] | all [dir] | range <from_ms> <to_ms> [path] [dest]\n");
+    return 2;
+  }
+  Port port(argv[1]);
+  if (!port.ok()) {
+    fprintf(stderr, "%s を開けない (%s)\n", argv[1], strerror(errno));
+    return 2;
+  }
+  const std::string command = argv[2];
+  if (command == "list") {
+    std::vector<Entry> entries;
+    if (!listFiles(port, entries)) {
+      fprintf(stderr, "一覧を受け取れなかった\n");
+      return 1;
+    }
+    for (const Entry& e : entries) {
+      printf("%10lu  %s\n", e.size, e.path.c_str());
+    }
+    return 0;
+  }
+  if (command == "get" && argc >= 4) {
+    const std::string path = argv[3];
+    return getFile(port, path, argc >= 5 ? argv[4] : baseName(path)) ? 0 : 1;
+  }
+  if (command == "all") {
+    const std::string dir = argc >= 4 ? argv[3] : ".";
+    std::vector<Entry> entries;
+    if (!listFiles(port, entries)) {
+      fprintf(stderr, "一覧を受け取れなかった\n");
+      return 1;
+    }
+    int fails = 0;
+    for (const Entry& e : entries) {
+      fails += getFile(port, e.path, dir + "/" + baseName(e.path)) ? 0 : 1;
+    }
+    return fails == 0 ? 0 : 1;
+  }
+  if (command == "range" && argc >= 5) {
+    const uint32_t from = static_cast<uint32_t>(strtoul(argv[3], nullptr, 10));
+    const uint32_t to = static_cast<uint32_t>(strtoul(argv[4], nullptr, 10));
+    return getRange(port, from, to, argc >= 6 ? argv[5] : "", argc >= 7 ? argv[6] : "") ? 0 : 1;
+  }
+  fprintf(stderr, "不明なコマンド: %s\n", command.c_str());
+  return 2;
+}
@@ -0,0 +1,283 @@
+/**
+ * @file flashfs_sim.cpp
+ * @brief QSPIフラッシュへの記録 (LOGGER_FS_FLASH) を、flash_bd.h のエミュレーターと littlefs で試すホストツール
+ * @details
+ * ロガーと同じ手順 (書き込みバッファが埋まったら 512 バイトずつ lfs_file_write、確定の周期ごとに
+ * lfs_file_sync) でフライトを書き、次を確かめる。
+ * - 停止時間: 書き込みバッファ1回分と確定1回の、フラッシュが止まっていた時間の最長。
+ *   ロガーはその間のサンプルをRAMのリングに溜めるので、必要な深さ (PENDING_SAMPLES) も表示する。
+ *   典型と最悪 (消去 400 ms) の両方の操作時間で見積もる
+ * - 電源断: フライトの途中の乱数で選んだ操作で電源を落とし、入れ直して次を確かめる。
+ *   マウントできること、途切れたファイルの長さが「最後に確定した長さ」以上「書いた長さ」以下で
+ *   中身が書いたものの先頭と一致すること、それまでのフライトが無傷であること。
+ *   領域が埋まったら古いフライトから消す
+ * - 消耗: ブロックごとの消去回数の最大と平均、NORの規則違反 (消去せずに 0→1) が無いこと
+ *
+ * littlefs のソース (lfs.c・lfs.h・lfs_util.c・lfs_util.h) が要る。arduino-pico では
+ * libraries/LittleFS/lib/littlefs にある。
+ *
+ * ビルド (LFS=littlefs のディレクトリ):
+ *   gcc -O2 -c -I$LFS $LFS/lfs.c $LFS/lfs_util.c
+ *   g++ -O2 -std=c++17 -I$LFS -o flashfs_sim flashfs_sim.cpp lfs.o lfs_util.o
+ * 使い方: flashfs_sim [試行=200] [ブロック数=256] [サンプル/秒=100] [確定間隔ms=1000] [乱数の種=1]
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../flash_bd.h"
+
+namespace {
+
+const uint32_t kBufferBytes = 4096; // logger_config.h の buffer_bytes の既定
+const uint32_t kSliceBytes = 512;   // spi_slice の既定 (カードと同じ切り分けで書く)
+const uint32_t kRecordBytes = 24;   // CSV の1行の目安
+
+/** @brief 1つのフライト。中身は番号から決まる乱数の列 */
+struct Flight {
+  std::string path;
+  std::vector<uint8_t> written; ///< lfs_file_write が受け取った分
+  uint32_t synced = 0;          ///< 最後に lfs_file_sync が成功した長さ
+};
+
+struct StallStats {
+  uint32_t maxBlockUs = 0; ///< 書き込みバッファ1回分の最長
+  uint32_t maxSyncUs = 0;  ///< 確定1回の最長
+};
+
+class Sim {
+public:
+  Sim(uint32_t blocks, uint32_t rateHz, uint32_t syncMs)
+      : _mem(static_cast<size_t>(blocks) * FLASH_BD_BLOCK_BYTES),
+        _erases(blocks),
+        _flash(_mem.data(), _erases.data(), blocks),
+        _rateHz(rateHz),
+        _syncMs(syncMs) {
+    flashLfsConfigure(_cfg, _flash, blocks);
+  }
+
+  FlashEmulator& flash() { return _flash; }
+
+  bool format() { return lfs_format(&_lfs, &_cfg) == 0; }
+  bool mount() { return lfs_mount(&_lfs, &_cfg) == 0; }
+  void unmount() { lfs_unmount(&_lfs); }
+
+  /**
+   * @brief 1フライトを書く。電源が落ちたら、その時点で戻る
+   * @param seconds 記録する秒数
+   * @return 最後まで書いて閉じられたら true (電源断や容量不足なら false)
+   */
+  bool runFlight(Flight& flight, uint32_t seconds, uint32_t seed, StallStats& stall) {
+    lfs_file_t file;
+    if (lfs_file_open(&_lfs, &file, flight.path.c_str(), LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) != 0) {
+      return false;
+    }
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> buf;
+    const uint64_t samples = static_cast<uint64_t>(seconds) * _rateHz;
+    const uint64_t samplesPerSync = static_cast<uint64_t>(_rateHz) * _syncMs / 1000;
+    bool ok = true;
+    for (uint64_t i = 0; i < samples && ok; i++) {
+      for (uint32_t b = 0; b < kRecordBytes; b++) {
+        buf.push_back(static_cast<uint8_t>(rng()));
+      }
+      if (buf.size() >= kBufferBytes) {
+        ok = writeBlock(file, flight, buf, stall);
+      }
+      if (ok && samplesPerSync > 0 && (i + 1) % samplesPerSync == 0) {
+        ok = writeBlock(file, flight, buf, stall) && sync(file, flight, stall);
+      }
+    }
+    ok = ok && writeBlock(file, flight, buf, stall);
+    // 失敗しても閉じる (littlefs は開いたハンドルを一覧につないでいる)。閉じるときに確定もする
+    if (lfs_file_close(&_lfs, &file) == 0) {
+      flight.synced = static_cast<uint32_t>(flight.written.size());
+    } else {
+      ok = false;
+    }
+    return ok;
+  }
+
+  /** @brief 書いたファイルを読み返し、確定した長さ以上・書いた長さ以下の先頭と一致するか */
+  bool verify(const Flight& flight, std::string& why) {
+    lfs_file_t file;
+    if (lfs_file_open(&_lfs, &file, flight.path.c_str(), LFS_O_RDONLY) != 0) {
+      // 一度も確定していなければ、ファイルが無くてもよい
+      why = "開けない";
+      return flight.synced == 0;
+    }
+    const lfs_soff_t size = lfs_file_size(&_lfs, &file);
+    std::vector<uint8_t> data(size > 0 ? static_cast<size_t>(size) : 0);
+    const lfs_ssize_t n = data.empty() ? 0 : lfs_file_read(&_lfs, &file, data.data(), static_cast<lfs_size_t>(data.size()));
+    lfs_file_close(&_lfs, &file);
+    char msg[96];
+    if (n != size) {
+      snprintf(msg, sizeof(msg), "読めたのは %ld / %ld バイト", static_cast<long>(n), static_cast<long>(size));
+      why = msg;
+      return false;
+    }
+    if (static_cast<uint32_t>(size) < flight.synced || static_cast<size_t>(size) > flight.written.size()) {
+      snprintf(msg, sizeof(msg), "長さ %ld が範囲外 (確定 %u、書いた %zu)", static_cast<long>(size), flight.synced,
+               flight.written.size());
+      why = msg;
+      return false;
+    }
+    if (!std::equal(data.begin(), data.end(), flight.written.begin())) {
+      why = "中身が書いたものと違う";
+      return false;
+    }
+    return true;
+  }
+
+  bool remove(const Flight& flight) { return lfs_remove(&_lfs, flight.path.c_str()) == 0; }
+
+private:
+  /** @brief 溜めた分を 512 バイトずつ書く。全体で止まった時間を、リングが溜める時間として数える */
+  bool writeBlock(lfs_file_t& file, Flight& flight, std::vector<uint8_t>& buf, StallStats& stall) {
+    const uint64_t busy0 = _flash.stats().busyUs;
+    size_t done = 0;
+    while (done < buf.size()) {
+      const size_t n = buf.size() - done < kSliceBytes ? buf.size() - done : kSliceBytes;
+      if (lfs_file_write(&_lfs, &file, buf.data() + done, static_cast<lfs_size_t>(n)) != static_cast<lfs_ssize_t>(n)) {
+        return false;
+      }
+      flight.written.insert(flight.written.end(), buf.begin() + done, buf.begin() + done + n);
+      done += n;
+    }
+    buf.clear();
+    const uint32_t us = static_cast<uint32_t>(_flash.stats().busyUs - busy0);
+    stall.maxBlockUs = us > stall.maxBlockUs ? us : stall.maxBlockUs;
+    return true;
+  }
+
+  bool sync(lfs_file_t& file, Flight& flight, StallStats& stall) {
+    const uint64_t busy0 = _flash.stats().busyUs;
+    if (lfs_file_sync(&_lfs, &file) != 0) {
+      return false;
+    }
+    flight.synced = static_cast<uint32_t>(flight.written.size());
+    const uint32_t us = static_cast<uint32_t>(_flash.stats().busyUs - busy0);
+    stall.maxSyncUs = us > stall.maxSyncUs ? us : stall.maxSyncUs;
+    return true;
+  }
+
+  std::vector<uint8_t> _mem;
+  std::vector<uint32_t> _erases;
+  FlashEmulator _flash;
+  lfs_config _cfg;
+  lfs_t _lfs;
+  uint32_t _rateHz;
+  uint32_t _syncMs;
+};
+
+/** @brief 止まっていた時間に溜まるサンプル数 (+1 は止まる直前に読んだ分) */
+uint32_t ringDepth(uint32_t stallUs, uint32_t rateHz) {
+  return static_cast<uint32_t>((static_cast<uint64_t>(stallUs) * rateHz + 999999) / 1000000) + 1;
+}
+
+void printStall(const char* label, const StallStats& s, uint32_t rateHz) {
+  const uint32_t worst = s.maxBlockUs > s.maxSyncUs ? s.maxBlockUs : s.maxSyncUs;
+  printf("  %-8s block max %8.1f ms  sync max %8.1f ms  -> ring depth %u (PENDING_SAMPLES=128 %s)\n", label,
+         s.maxBlockUs / 1000.0, s.maxSyncUs / 1000.0, ringDepth(worst, rateHz),
+         ringDepth(worst, rateHz) <= 127 ? "ok" : "足りない");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const uint32_t trials = argc > 1 ? static_cast<uint32_t>(atoi(argv[1])) : 200;
+  const uint32_t blocks = argc > 2 ? static_cast<uint32_t>(atoi(argv[2])) : 256;
+  const uint32_t rateHz = argc > 3 ? static_cast<uint32_t>(atoi(argv[3])) : 100;
+  const uint32_t syncMs = argc > 4 ? static_cast<uint32_t>(atoi(argv[4])) : 1000;
+  const uint32_t seed = argc > 5 ? static_cast<uint32_t>(atoi(argv[5])) : 1;
+  printf("flash %u blocks (%u KB), %u Hz x %u B, sync every %u ms\n", blocks, blocks * FLASH_BD_BLOCK_BYTES / 1024,
+         rateHz, kRecordBytes, syncMs);
+  int fails = 0;
+
+  // 停止時間: 空のフラッシュに 60 秒のフライトを書く
+  printf("\nstall per call\n");
+  for (bool worst : {false, true}) {
+    Sim sim(blocks, rateHz, syncMs);
+    sim.flash().setWorstCaseTiming(worst);
+    StallStats stall;
+    Flight flight;
+    flight.path = "/flight_log_001.csv";
+    if (!sim.format() || !sim.mount() || !sim.runFlight(flight, 60, seed, stall)) {
+      fprintf(stderr, "電源断なしで書けなかった\n");
+      return 1;
+    }
+    printStall(worst ? "worst" : "typical", stall, rateHz);
+    sim.unmount();
+  }
+
+  // 電源断: 同じフラッシュにフライトを重ねていき、毎回どこかで電源を落とす
+  printf("\npower cuts (%u trials)\n", trials);
+  Sim sim(blocks, rateHz, syncMs);
+  std::mt19937 rng(seed);
+  std::deque<Flight> flights;
+  StallStats stall;
+  uint32_t cuts = 0;
+  uint32_t deleted = 0;
+  if (!sim.format() || !sim.mount()) {
+    fprintf(stderr, "初期化できない\n");
+    return 1;
+  }
+  for (uint32_t t = 0; t < trials; t++) {
+    Flight flight;
+    char path[32];
+    snprintf(path, sizeof(path), "/flight_log_%03u.csv", t % 1000 + 1);
+    flight.path = path;
+    const uint32_t seconds = 5 + rng() % 30;
+    // フライトの操作数はおよそ (書く量 / 256) なので、その範囲から電源を落とす所を選ぶ
+    const uint32_t ops = seconds * rateHz * kRecordBytes / FLASH_BD_PAGE_BYTES + 8;
+    sim.flash().cutPowerAfter(1 + rng() % (ops * 3 / 2));
+    bool completed = sim.runFlight(flight, seconds, seed * 7919 + t, stall);
+    if (!completed && !sim.flash().dead()) {
+      // 容量不足: 古いフライトを消して、同じ番号で書き直す
+      sim.flash().cutPowerAfter(0);
+      while (flights.size() > 1 && !completed) {
+        sim.remove(flights.front());
+        flights.pop_front();
+        deleted++;
+        flight.written.clear();
+        flight.synced = 0;
+        completed = sim.runFlight(flight, seconds, seed * 7919 + t, stall);
+      }
+    }
+    if (sim.flash().dead()) {
+      cuts++;
+    }
+    sim.flash().powerOn();
+    sim.unmount(); // バッファを返すだけ (電源断の後の状態はフラッシュの中身だけ)
+    if (!sim.mount()) {
+      fprintf(stderr, "trial %u: 電源断の後にマウントできない\n", t);
+      fails++;
+      break;
+    }
+    flights.push_back(flight);
+    for (const Flight& f : flights) {
+      std::string why;
+      if (!sim.verify(f, why)) {
+        fprintf(stderr, "trial %u: %s: %s\n", t, f.path.c_str(), why.c_str());
+        fails++;
+      }
+    }
+  }
+  sim.unmount();
+
+  const FlashEmulator& flash = sim.flash();
+  const FlashBdStats& st = flash.stats();
+  printf("  cuts %u, flights deleted for space %u, remaining %zu\n", cuts, deleted, flights.size());
+  printf("  progs %u, erases %u, max erases/block %u (mean %.1f)\n", st.progs, st.erases, flash.maxBlockErases(),
+         static_cast<double>(st.erases) / blocks);
+  if (flash.violations() != 0) {
+    fprintf(stderr, "消去せずに 0->1 へ書いたバイトが %u\n", flash.violations());
+    fails++;
+  }
+  printf("%s\n", fails == 0 ? "PASS" : "FAIL");
+  return fails == 0 ? 0 : 1;
+}
@@ -0,0 +1,241 @@
+/**
+ * @file link_sim.cpp
+ * @brief link_protocol.h と timeline_merge.h を模擬ピアで検証するホストツール
+ * @details
+ * 時計のずれたサテライト基板と、バイトの欠落・化けが起きるUART回線を模擬し、
+ * ロガー側と同じ手順 (パーサー → PING/PONG による時計推定 → 時刻順の統合) を通して次を確かめる。
+ * - 推定したオフセットとドリフトが真の値に近いこと
+ * - 換算したレコード時刻の誤差が小さいこと (サテライトの時計は途中で32ビットを折り返す)
+ * - 受信統計の欠落数が、実際に届かなかったフレーム数と一致すること
+ * - 統合した出力が時刻順に並んでいること
+ *
+ * ビルド: g++ -O2 -std=c++17 -o link_sim link_sim.cpp
+ * 使い方: link_sim [秒数=120] [ドリフトppm=35] [バイト誤り率=1e-5] [乱数の種=1]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "../link_protocol.h"
+#include "../timeline_merge.h"
+
+namespace {
+
+/** @brief 片方向のUART回線。1バイトずつ送信時間を積み、確率で欠落・化けさせる */
+class Wire {
+public:
+  Wire(double baud, double errorRate, std::mt19937& rng) : _byteUs(10.0 * 1e6 / baud), _errorRate(errorRate), _rng(rng) {}
+
+  void send(double nowUs, const uint8_t* data, size_t len) {
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    for (size_t i = 0; i < len; i++) {
+      _busyUntil = (_busyUntil > nowUs ? _busyUntil : nowUs) + _byteUs;
+      double r = u(_rng);
+      if (r < _errorRate) {
+        continue; // 欠落
+      }
+      uint8_t b = data[i];
+      if (r < 2 * _errorRate) {
+        b ^= static_cast<uint8_t>(1u << (_rng() % 8)); // 1ビット化け
+      }
+      _queue.push_back({_busyUntil, b});
+    }
+  }
+
+  /** @brief nowUs までに届いたバイトを取り出す */
+  std::vector<uint8_t> receive(double nowUs) {
+    std::vector<uint8_t> out;
+    while (!_queue.empty() && _queue.front().first <= nowUs) {
+      out.push_back(_queue.front().second);
+      _queue.pop_front();
+    }
+    return out;
+  }
+
+private:
+  double _byteUs;
+  double _errorRate;
+  std::mt19937& _rng;
+  double _busyUntil = 0;
+  std::deque<std::pair<double, uint8_t>> _queue;
+};
+
+/** @brief サテライトの時計。ロガーの時刻から一次式で決まる */
+struct RemoteClock {
+  double offsetUs;
+  double driftPpm;
+  uint64_t at(double localUs) const { return static_cast<uint64_t>(offsetUs + localUs * (1.0 + driftPpm * 1e-6)); }
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const double seconds = argc > 1 ? atof(argv[1]) : 120.0;
+  const double driftPpm = argc > 2 ? atof(argv[2]) : 35.0;
+  const double errorRate = argc > 3 ? atof(argv[3]) : 1e-5;
+  const unsigned seed = argc > 4 ? static_cast<unsigned>(atoi(argv[4])) : 1u;
+
+  std::mt19937 rng(seed);
+  const uint32_t kBaud = 1000000;
+  Wire toLogger(kBaud, errorRate, rng);
+  Wire toSatellite(kBaud, errorRate, rng);
+  // 開始から約10秒でサテライトの32ビット時刻が折り返すようにしておく
+  const RemoteClock remote = {4294967296.0 - 10e6, driftPpm};
+
+  // サテライト側
+  LinkSender sender;
+  LinkParser satParser;
+  uint32_t framesSent = 0;
+  std::vector<double> recordTruth; // value (通し番号) → 生成したロガー時刻
+  double satNowUs = 0;
+  auto satWrite = [&](const uint8_t* data, size_t len) {
+    toLogger.send(satNowUs, data, len);
+    framesSent++;
+  };
+
+  // ロガー側 (uart_link.h の UartLink と同じ手順)
+  LinkParser parser;
+  LinkTimeUnwrap remoteTime;
+  LinkClockEstimator clock;
+  TimelineMerger<128, 48> merger;
+  uint16_t pingSeq = 0;
+  uint32_t records = 0;
+  uint32_t unsynced = 0;
+  uint32_t rejected = 0;
+  double maxErrorUs = 0;
+  double sumErrorUs = 0;
+  uint64_t lastOutUs = 0;
+  uint32_t outOfOrder = 0;
+  uint32_t linesOut = 0;
+  auto emit = [&](const char* line, size_t) {
+    unsigned long long t = strtoull(line, nullptr, 10);
+    if (t < lastOutUs) {
+      outOfOrder++;
+    }
+    lastOutUs = t;
+    linesOut++;
+  };
+
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  const double stepUs = 50;
+  double nextRecordUs = 0;
+  double nextFlushUs = 3700; // サテライトの送信周期は PING と位相をずらしておく
+  double nextPingUs = 0;
+  double nextSampleUs = 0;
+  double nextPollUs = 0;
+  int32_t recordId = 0;
+
+  for (double now = 0; now < seconds * 1e6; now += stepUs) {
+    // --- サテライト: 1 kHz でレコードを作り、10 ms ごとにフレームを送る ---
+    satNowUs = now;
+    while (nextRecordUs <= now) {
+      LinkRecord r = {static_cast<uint32_t>(remote.at(nextRecordUs)), static_cast<uint8_t>(recordId & 1), recordId};
+      recordTruth.push_back(nextRecordUs);
+      recordId++;
+      sender.addRecord(r, satWrite);
+      nextRecordUs += 1000;
+    }
+    if (nextFlushUs <= now) {
+      sender.flush(satWrite);
+      nextFlushUs += 10000;
+    }
+    std::vector<uint8_t> satRx = toSatellite.receive(now);
+    satParser.feed(satRx.data(), satRx.size(), [&](LinkFrameType type, uint16_t, const uint8_t* payload, size_t len) {
+      // 受信から返信までの処理時間に、ときどき大きな待ちを混ぜる
+      double replyDelay = u(rng) < 0.1 ? 2000 + 3000 * u(rng) : 20 * u(rng);
+      satNowUs = now + replyDelay;
+      sender.handleFrame(type, payload, len, static_cast<uint32_t>(remote.at(now)), static_cast<uint32_t>(remote.at(satNowUs)),
+                         satWrite);
+      satNowUs = now;
+    });
+
+    // --- ロガー: 通常は 1 ms ごとに読むが、1秒に1回SD書き込みで 30 ms 止まる ---
+    if (nextPingUs <= now) {
+      uint8_t payload[4];
+      uint8_t frame[LINK_MAX_FRAME];
+      linkPutU32(payload, static_cast<uint32_t>(now));
+      size_t n = linkEncodeFrame(frame, LINK_FRAME_PING, pingSeq++, payload, sizeof(payload));
+      toSatellite.send(now, frame, n);
+      nextPingUs += 250000;
+    }
+    while (nextSampleUs <= now) {
+      char line[48];
+      int len = snprintf(line, sizeof(line), "%llu,local\r\n", static_cast<unsigned long long>(nextSampleUs));
+      merger.push(static_cast<uint64_t>(nextSampleUs), line, len, emit);
+      nextSampleUs += 50000;
+    }
+    if (nextPollUs > now) {
+      continue;
+    }
+    nextPollUs = now + (fmod(now, 1e6) < 1000 ? 30000 : 900 + 200 * u(rng));
+    const uint64_t rxUs = static_cast<uint64_t>(now);
+    std::vector<uint8_t> rx = toLogger.receive(now);
+    parser.feed(rx.data(), rx.size(), [&](LinkFrameType type, uint16_t, const uint8_t* payload, size_t len) {
+      if (type == LINK_FRAME_PONG && len >= 12) {
+        uint32_t t0Low = linkGetU32(payload);
+        uint64_t t0 = rxUs - static_cast<uint32_t>(static_cast<uint32_t>(rxUs) - t0Low);
+        uint64_t t1 = remoteTime.peek(linkGetU32(payload + 4));
+        uint64_t t2 = remoteTime.peek(linkGetU32(payload + 8));
+        uint64_t t3 = rxUs - linkWireUs(LINK_PONG_FRAME_BYTES, kBaud);
+        if (clock.addSample(t0, t1 - linkWireUs(LINK_PING_FRAME_BYTES, kBaud), t2, t3)) {
+          remoteTime.accept(t2);
+        }
+      } else if (type == LINK_FRAME_RECORDS) {
+        for (size_t off = 0; off + LINK_RECORD_BYTES <= len; off += LINK_RECORD_BYTES) {
+          LinkRecord r = linkDecodeRecord(payload + off);
+          uint64_t remoteUs = remoteTime.peek(r.remoteUs);
+          if (!clock.synced()) {
+            unsynced++;
+            continue;
+          }
+          uint64_t localUs = clock.toLocal(remoteUs);
+          if (localUs + 10000000 < rxUs || localUs > rxUs + 1000000) {
+            rejected++;
+            continue;
+          }
+          remoteTime.accept(remoteUs);
+          records++;
+          if (r.value >= 0 && static_cast<size_t>(r.value) < recordTruth.size()) {
+            double err = fabs(static_cast<double>(localUs) - recordTruth[r.value]);
+            // 最初の数秒は標本が少ないので、誤差の集計は10秒以降だけにする
+            if (now > 10e6) {
+              maxErrorUs = err > maxErrorUs ? err : maxErrorUs;
+              sumErrorUs += err;
+            }
+          }
+          char line[48];
+          int n = snprintf(line, sizeof(line), "%llu,remote,%u,%ld\r\n", static_cast<unsigned long long>(localUs), r.channel,
+                           static_cast<long>(r.value));
+          merger.push(localUs, line, n, emit);
+        }
+      }
+    });
+    merger.release(rxUs > 100000 ? rxUs - 100000 : 0, emit);
+  }
+  merger.releaseAll(emit);
+
+  // 真の値: オフセット(ロガー時刻 t) = offset + drift * t
+  const double endUs = seconds * 1e6;
+  const double trueOffset = remote.offsetUs + endUs * driftPpm * 1e-6;
+  const double estOffset = static_cast<double>(clock.offsetAt(static_cast<uint64_t>(endUs)));
+  const LinkStats& s = parser.stats();
+  // 最後のフレームは回線上に残っていることがあるので、欠落の照合では誤差 2 まで許す
+  const long missing = static_cast<long>(framesSent) - static_cast<long>(s.frames);
+  const long lostDiff = labs(missing - static_cast<long>(s.lostFrames));
+
+  printf("frames sent=%u received=%u crc_err=%u lost=%u skipped=%u bytes=%llu\n", framesSent, s.frames, s.crcErrors,
+         s.lostFrames, s.skippedBytes, static_cast<unsigned long long>(s.bytes));
+  printf("records=%u unsynced=%u rejected=%u lines=%u out_of_order=%u late=%u forced=%u\n", records, unsynced, rejected, linesOut, outOfOrder,
+         merger.late(), merger.forced());
+  printf("offset true=%.1f est=%.1f err=%.1f us\n", trueOffset, estOffset, estOffset - trueOffset);
+  printf("drift true=%.0f est=%d ppb, min_rtt=%u us\n", driftPpm * 1000, clock.driftPpb(), clock.minDelayUs());
+  printf("record time error: mean=%.1f max=%.1f us\n", records ? sumErrorUs / records : 0.0, maxErrorUs);
+
+  bool ok = fabs(estOffset - trueOffset) < 50 && fabs(clock.driftPpb() - driftPpm * 1000) < 2000 && maxErrorUs < 100 &&
+            lostDiff <= 2 && outOfOrder == merger.late();
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,620 @@
+/**
+ * @file log_merge.cpp
+ * @brief 複数のロガーのログを時刻順に1本へまとめ、時刻の索引 (.idx) を付けるホストツール
+ * @details
+ * 複数の機体・複数のロガーで取ったフライト (flight_log_XXX.csv / .bin) は時刻の範囲が重なるので、
+ * ロガーごとに時計の補正をかけてから、全体を1回だけ先頭から読んで時刻順に並べる。
+ * - 各ログは logsource.h の LogLineReader で 64 KiB ずつ読む (format=csv と format=rice のどちらでもよい)
+ * - ロガーごとの先頭の行をヒープに入れ、一番早いものを出しては同じロガーの次の行を入れる (k-way マージ)。
+ *   1行あたり O(log k) で、持つのはロガーごとに読みかけの分と並べ替えの窓の分だけなので、
+ *   メモリはファイルの長さによらない
+ * - サテライトの行は統合の遅れの分だけ前後することがあるので、ロガーごとに --lag ミリ秒の窓で並べ直してから出す。
+ *   窓を超えて戻った行はそのまま出し、out_of_order として数える
+ * - 補正後の時刻 = ログの時刻 × (1 − ドリフト × 10⁻⁶) + オフセット。オフセットとドリフトは、
+ *   リンクの時計推定 (printLinkStats の offset / drift) や、共通のイベントの時刻差から求めたものを渡す
+ *
+ * 出力は CSV で、各行は「補正後の時刻 (ミリ秒、小数3桁),ロガー番号,元の行」。
+ * 設定のコメント行などは "# L<番号> " を付けて残す。同じ名前で .idx に log_index.h の索引を書くので、
+ * 時刻の範囲の先頭へ二分探索で飛べる (log_merge --find で試せる)。
+ *
+ * ビルド: g++ -O2 -std=c++17 -o log_merge log_merge.cpp
+ * 使い方: log_merge [-o merged.csv] [--lag ミリ秒=1000] [--stride ミリ秒=1000] ログ[@オフセットms[@ドリフトppm]] ...
+ *         log_merge --find merged.csv 開始ms [終了ms]   (索引を使って範囲の行だけを出す)
+ *         log_merge --selftest
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "logsource.h"
+#include "../log_index.h"
+
+// logger_profile.h の RuntimeProfile が参照する設定 (行の整形には使わない)
+LoggerConfig g_config = loggerConfigDefaults();
+
+namespace {
+
+/** @brief ロガー1台分の入力と補正 */
+struct SourceSpec {
+  std::string path;
+  double offsetMs = 0;
+  double driftPpm = 0;
+};
+
+bool parseSpec(const char* arg, SourceSpec& spec) {
+  std::string s = arg;
+  const size_t at = s.find('@');
+  spec.path = s.substr(0, at);
+  if (at == std::string::npos) {
+    return !spec.path.empty();
+  }
+  char* end = nullptr;
+  spec.offsetMs = strtod(s.c_str() + at + 1, &end);
+  if (*end == '@') {
+    spec.driftPpm = strtod(end + 1, &end);
+  }
+  return *end == '\0' && !spec.path.empty();
+}
+
+/** @brief 並べ替えを待つ1行 */
+struct TimedLine {
+  int64_t timeUs; ///< 補正後の時刻
+  uint64_t order; ///< 同じロガーの中で読んだ順 (同じ時刻なら読んだ順に出す)
+  std::string text;
+};
+
+struct LaterFirst {
+  bool operator()(const TimedLine& a, const TimedLine& b) const {
+    return a.timeUs != b.timeUs ? a.timeUs > b.timeUs : a.order > b.order;
+  }
+};
+
+/**
+ * @brief ロガー1台分の行を、補正後の時刻順に取り出す
+ * @details 読んだ中で一番新しい時刻から lag 以上古い行だけを出すので、窓の中の前後は並べ直せる。
+ */
+class MergeSource {
+public:
+  MergeSource(const SourceSpec& spec, int64_t lagUs) : _spec(spec), _lagUs(lagUs) {}
+
+  bool open() { return _reader.open(_spec.path.c_str()); }
+
+  /**
+   * @brief 次の行を出す。時刻の無い行 (コメントなど) は onText(text) に渡す
+   * @return 行が無くなれば false
+   */
+  template <class OnText>
+  bool next(TimedLine& out, OnText&& onText) {
+    while (!_eof && (_window.empty() || _window.top().timeUs + _lagUs > _newestUs)) {
+      LogLine line;
+      if (!_reader.next(line)) {
+        _eof = true;
+        break;
+      }
+      if (!line.timed) {
+        if (line.text.compare(0, 12, "timestamp_ms") == 0) {
+          _columns = line.text; // CSV ヘッダーはまとめて1行にする
+        } else if (!line.text.empty()) {
+          onText(line.text);
+        }
+        continue;
+      }
+      const int64_t t = correctUs(line.timeMs);
+      _newestUs = _window.empty() && _order == 0 ? t : std::max(_newestUs, t);
+      _window.push({t, _order++, std::move(line.text)});
+      _peakWindow = std::max(_peakWindow, _window.size());
+    }
+    if (_window.empty()) {
+      return false;
+    }
+    // priority_queue の top は const なので、取り出す前に中身を移す
+    out = std::move(const_cast<TimedLine&>(_window.top()));
+    _window.pop();
+    if (_released && out.timeUs < _lastOutUs) {
+      _outOfOrder++;
+    }
+    _released = true;
+    _lastOutUs = std::max(_lastOutUs, out.timeUs);
+    _rows++;
+    return true;
+  }
+
+  int64_t correctUs(uint32_t timeMs) const {
+    return static_cast<int64_t>(llround(timeMs * 1000.0 * (1.0 - _spec.driftPpm * 1e-6) + _spec.offsetMs * 1000.0));
+  }
+
+  const SourceSpec& spec() const { return _spec; }
+  const std::string& columns() const { return _columns; }
+  const LogLineReader& reader() const { return _reader; }
+  uint64_t rows() const { return _rows; }
+  uint64_t outOfOrder() const { return _outOfOrder; }
+  size_t peakWindow() const { return _peakWindow; }
+
+private:
+  SourceSpec _spec;
+  int64_t _lagUs;
+  LogLineReader _reader;
+  std::priority_queue<TimedLine, std::vector<TimedLine>, LaterFirst> _window;
+  int64_t _newestUs = 0;
+  int64_t _lastOutUs = 0;
+  uint64_t _order = 0;
+  uint64_t _rows = 0;
+  uint64_t _outOfOrder = 0;
+  size_t _peakWindow = 0;
+  std::string _columns;
+  bool _eof = false;
+  bool _released = false;
+};
+
+/** @brief 出力と、その索引を書く */
+class MergeWriter {
+public:
+  MergeWriter(FILE* out, FILE* idx, uint32_t strideMs) : _out(out), _idx(idx), _builder(strideMs) {
+    if (_idx != nullptr) {
+      const LogIndexHeader h = logIndexHeader(strideMs);
+      fwrite(&h, sizeof(h), 1, _idx);
+    }
+  }
+
+  void text(const std::string& s) { write(s.data(), s.size()); }
+
+  void row(int64_t timeUs, int logger, const std::string& line) {
+    // 索引の時刻は 0 以上のミリ秒。ファイルが 4 GiB を超えた先は索引に載せない
+    const uint32_t ms = timeUs <= 0 ? 0 : static_cast<uint32_t>(timeUs / 1000);
+    LogIndexEntry e;
+    if (_idx != nullptr && _offset <= UINT32_MAX && _builder.note(ms, static_cast<uint32_t>(_offset), &e)) {
+      fwrite(&e, sizeof(e), 1, _idx);
+    }
+    const int64_t a = timeUs < 0 ? -timeUs : timeUs;
+    char head[48];
+    const int n = snprintf(head, sizeof(head), "%s%lld.%03lld,%d,", timeUs < 0 ? "-" : "", static_cast<long long>(a / 1000),
+                           static_cast<long long>(a % 1000), logger);
+    write(head, static_cast<size_t>(n));
+    write(line.data(), line.size());
+    write("\r\n", 2);
+  }
+
+  uint64_t bytes() const { return _offset; }
+  uint32_t indexEntries() const { return _builder.count(); }
+
+private:
+  void write(const char* data, size_t len) {
+    fwrite(data, 1, len, _out);
+    _offset += len;
+  }
+
+  FILE* _out;
+  FILE* _idx;
+  LogIndexBuilder _builder;
+  uint64_t _offset = 0;
+};
+
+struct MergeResult {
+  uint64_t rows = 0;
+  uint64_t outOfOrder = 0;
+  size_t peakLines = 0; ///< 全ロガーで同時に持った行の最大 (読みかけ + 窓)
+  double seconds = 0;
+};
+
+/** @brief k 本のログを1回ずつ読んで、時刻順にまとめる */
+MergeResult mergeLogs(std::vector<std::unique_ptr<MergeSource>>& sources, MergeWriter& writer, uint32_t lagMs) {
+  const auto t0 = std::chrono::steady_clock::now();
+  MergeResult r;
+  std::string preamble;
+  bool started = false;
+  auto textFor = [&](size_t k) {
+    return [&, k](const std::string& text) {
+      // 元の "# " は付け直す
+      const size_t skip = text[0] != '#' ? 0 : text.compare(0, 2, "# ") == 0 ? 2 : 1;
+      const std::string line = "# L" + std::to_string(k + 1) + " " + text.substr(skip) + "\r\n";
+      if (started) {
+        writer.text(line);
+      } else {
+        preamble += line;
+      }
+    };
+  };
+
+  // 各ロガーの先頭の行をヒープに入れる。ここまでに設定行と CSV ヘッダーがそろう
+  struct Head {
+    int64_t timeUs;
+    size_t source;
+  };
+  auto later = [](const Head& a, const Head& b) { return a.timeUs != b.timeUs ? a.timeUs > b.timeUs : a.source > b.source; };
+  std::priority_queue<Head, std::vector<Head>, decltype(later)> heap(later);
+  std::vector<TimedLine> heads(sources.size());
+  for (size_t k = 0; k < sources.size(); k++) {
+    if (sources[k]->next(heads[k], textFor(k))) {
+      heap.push({heads[k].timeUs, k});
+    }
+  }
+
+  char line[160];
+  snprintf(line, sizeof(line), "# log_merge loggers=%zu lag_ms=%u\r\n", sources.size(), lagMs);
+  writer.text(line);
+  std::string columns;
+  bool sameColumns = true;
+  for (size_t k = 0; k < sources.size(); k++) {
+    const SourceSpec& s = sources[k]->spec();
+    snprintf(line, sizeof(line), "# L%zu file=%s format=%s offset_ms=%.3f drift_ppm=%.3f\r\n", k + 1, s.path.c_str(),
+             sources[k]->reader().rice() ? "rice" : "csv", s.offsetMs, s.driftPpm);
+    writer.text(line);
+    if (k == 0) {
+      columns = sources[k]->columns();
+    }
+    sameColumns = sameColumns && sources[k]->columns() == columns;
+  }
+  writer.text(preamble);
+  started = true;
+  // ロガーごとに列が違えば、元の行の列名はコメントの CSV ヘッダーで見分ける
+  writer.text("time_ms,logger," + (sameColumns && !columns.empty() ? columns : std::string("record")) + "\r\n");
+
+  int64_t lastUs = INT64_MIN;
+  while (!heap.empty()) {
+    const Head h = heap.top();
+    heap.pop();
+    TimedLine& l = heads[h.source];
+    if (l.timeUs < lastUs) {
+      r.outOfOrder++;
+    }
+    lastUs = std::max(lastUs, l.timeUs);
+    writer.row(l.timeUs, static_cast<int>(h.source + 1), l.text);
+    r.rows++;
+    if (sources[h.source]->next(l, textFor(h.source))) {
+      heap.push({l.timeUs, h.source});
+    }
+  }
+  for (auto& s : sources) {
+    r.peakLines += s->reader().peakLines() + s->peakWindow();
+  }
+  r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  return r;
+}
+
+std::string indexPath(const std::string& out) { return out + ".idx"; }
+
+int merge(const std::vector<SourceSpec>& specs, const std::string& outPath, uint32_t lagMs, uint32_t strideMs) {
+  std::vector<std::unique_ptr<MergeSource>> sources;
+  for (const SourceSpec& spec : specs) {
+    sources.emplace_back(new MergeSource(spec, static_cast<int64_t>(lagMs) * 1000));
+    if (!sources.back()->open()) {
+      fprintf(stderr, "%s を開けない\n", spec.path.c_str());
+      return 2;
+    }
+  }
+  FILE* out = fopen(outPath.c_str(), "wb");
+  FILE* idx = fopen(indexPath(outPath).c_str(), "wb");
+  if (out == nullptr || idx == nullptr) {
+    fprintf(stderr, "%s を書けない\n", outPath.c_str());
+    return 2;
+  }
+  MergeWriter writer(out, idx, strideMs);
+  const MergeResult r = mergeLogs(sources, writer, lagMs);
+  fclose(out);
+  fclose(idx);
+  for (size_t k = 0; k < sources.size(); k++) {
+    fprintf(stderr, "L%zu %s: rows=%llu late=%llu bytes=%llu\n", k + 1, sources[k]->spec().path.c_str(),
+            static_cast<unsigned long long>(sources[k]->rows()), static_cast<unsigned long long>(sources[k]->outOfOrder()),
+            static_cast<unsigned long long>(sources[k]->reader().bytesRead()));
+  }
+  fprintf(stderr, "%s: rows=%llu out_of_order=%llu bytes=%llu index_entries=%u peak_lines=%zu %.2f s (%.0f rows/s)\n",
+          outPath.c_str(), static_cast<unsigned long long>(r.rows), static_cast<unsigned long long>(r.outOfOrder),
+          static_cast<unsigned long long>(writer.bytes()), writer.indexEntries(), r.peakLines, r.seconds,
+          r.rows / (r.seconds > 0 ? r.seconds : 1));
+  return r.outOfOrder == 0 ? 0 : 1;
+}
+
+//================================================
+//== 索引を使った範囲の取り出し
+//================================================
+
+/**
+ * @brief 索引で fromMs の手前へ飛び、[fromMs, toMs] の行を onLine(text) に渡す
+ * @return 読んだバイト数 (索引が無ければ -1)
+ */
+template <class OnLine>
+long long findRange(const std::string& path, uint32_t fromMs, uint32_t toMs, OnLine&& onLine) {
+  FILE* idx = fopen(indexPath(path).c_str(), "rb");
+  FILE* f = fopen(path.c_str(), "rb");
+  if (idx == nullptr || f == nullptr) {
+    if (idx != nullptr) fclose(idx);
+    if (f != nullptr) fclose(f);
+    return -1;
+  }
+  LogIndexHeader h;
+  if (fread(&h, sizeof(h), 1, idx) != 1 || !logIndexHeaderValid(h)) {
+    fclose(idx);
+    fclose(f);
+    return -1;
+  }
+  fseek(idx, 0, SEEK_END);
+  const uint32_t count = static_cast<uint32_t>((ftell(idx) - static_cast<long>(sizeof(h))) / h.entryBytes);
+  auto get = [&](uint32_t i) {
+    LogIndexEntry e = {};
+    fseek(idx, static_cast<long>(sizeof(h) + static_cast<uint64_t>(i) * h.entryBytes), SEEK_SET);
+    if (fread(&e, sizeof(e), 1, idx) != 1) {
+      e = {UINT32_MAX, 0};
+    }
+    return e;
+  };
+  const long at = logIndexFind(count, fromMs, get);
+  if (at >= 0) {
+    fseek(f, static_cast<long>(get(static_cast<uint32_t>(at)).offset), SEEK_SET);
+  }
+  fclose(idx);
+  long long bytes = 0;
+  char buf[512];
+  while (fgets(buf, sizeof(buf), f) != nullptr) {
+    bytes += static_cast<long long>(strlen(buf));
+    if (buf[0] == '#' || buf[0] < '0' || buf[0] > '9') {
+      continue;
+    }
+    const double ms = strtod(buf, nullptr);
+    if (ms < fromMs) {
+      continue;
+    }
+    if (ms > toMs) {
+      break;
+    }
+    onLine(buf);
+  }
+  fclose(f);
+  return bytes;
+}
+
+//================================================
+//== 自己試験
+//================================================
+
+struct FileSink {
+  FILE* f = nullptr;
+  uint8_t buf[RICE_MAX_CHUNK_BYTES];
+  uint8_t* reserve(size_t) { return buf; }
+  void commit(size_t bytes) { fwrite(buf, 1, bytes, f); }
+};
+
+/** @brief 合成のロガー1台。真の時刻 truthMs を value[0] に入れておき、補正の結果と比べる */
+struct SyntheticLogger {
+  SourceSpec spec;
+  bool rice;
+  uint32_t hz;
+  uint32_t startMs; ///< 真の時刻で記録を始めた時
+  uint64_t rows = 0;
+};
+
+uint32_t loggerClockMs(const SyntheticLogger& g, double truthMs) {
+  // ロガーの時計は電源を入れた時 (startMs) を 0 とし、driftPpm だけ速く進む
+  return static_cast<uint32_t>(llround((truthMs - g.startMs) * (1.0 + g.spec.driftPpm * 1e-6)));
+}
+
+void writeSynthetic(SyntheticLogger& g, uint32_t seconds) {
+  FILE* f = fopen(g.spec.path.c_str(), "wb");
+  const char* header = "# sample_hz=%u\r\n# ch1_hz=%u\r\n# ch2_hz=%u\r\n";
+  char text[128];
+  const int n = snprintf(text, sizeof(text), header, g.hz, g.hz, g.hz);
+  const char* columns = "timestamp_ms,dummy_sensor1,dummy_sensor2\r\n";
+  const uint32_t samples = seconds * g.hz;
+  if (g.rice) {
+    FileSink sink;
+    sink.f = f;
+    std::unique_ptr<RiceLogWriter<FileSink>> w(new RiceLogWriter<FileSink>(sink));
+    const uint16_t steps[3] = {1, 1, 1};
+    w->begin(3, steps);
+    w->addText(text, static_cast<size_t>(n));
+    w->addText(columns, strlen(columns));
+    w->flush();
+    for (uint32_t i = 0; i < samples; i++) {
+      const double truth = g.startMs + i * 1000.0 / g.hz;
+      w->addSample(0, i, static_cast<int32_t>(loggerClockMs(g, truth)));
+      w->addSample(1, i, static_cast<int32_t>(llround(truth)));
+      w->addSample(2, i, static_cast<int32_t>(i));
+      if (i % g.hz == g.hz - 1) {
+        w->flush();
+      }
+    }
+    w->flush();
+    const char* trailer = "# trailer clean\r\n";
+    w->addText(trailer, strlen(trailer));
+    w->flush();
+  } else {
+    fwrite(text, 1, static_cast<size_t>(n), f);
+    fputs(columns, f);
+    char line[48];
+    // サテライトの行は最大 80 ms 遅れて、時刻順の統合を通った後の順で並ぶ
+    std::vector<std::pair<double, std::string>> pendingSat;
+    for (uint32_t i = 0; i < samples; i++) {
+      const double truth = g.startMs + i * 1000.0 / g.hz;
+      SampleRecord r = {loggerClockMs(g, truth), {static_cast<int32_t>(llround(truth)), static_cast<int32_t>(i)}, 0x03};
+      fwrite(line, 1, encodeCsvRecord<RuntimeProfile>(line, r), f);
+      if (i % 50 == 0) {
+        const double satTruth = truth - 80.0 * ((i / 50) % 3) / 2;
+        char sat[64];
+        snprintf(sat, sizeof(sat), "%u,%ld,,1,0,7\r\n", loggerClockMs(g, satTruth), static_cast<long>(llround(satTruth)));
+        fputs(sat, f);
+      }
+    }
+    fputs("# trailer clean\r\n", f);
+  }
+  g.rows = samples + (g.rice ? 0 : (samples + 49) / 50);
+  fclose(f);
+}
+
+struct SelftestResult {
+  bool pass;
+  size_t peakLines;
+};
+
+SelftestResult selftestRun(uint32_t seconds, bool report) {
+  std::vector<SyntheticLogger> loggers;
+  const uint32_t hzs[] = {1000, 500, 200, 1000, 100, 250};
+  const double drifts[] = {35, -20, 0, 120, -75, 10};
+  std::vector<SourceSpec> specs;
+  char base[] = "/tmp/log_merge_selftestXXXXXX";
+  if (mkdtemp(base) == nullptr) {
+    return {false, 0};
+  }
+  for (int k = 0; k < 6; k++) {
+    SyntheticLogger g;
+    g.rice = k % 2 == 1;
+    g.hz = hzs[k];
+    g.startMs = 5000 + 37000 * k % 60000; // 電源を入れた時刻はばらばらで、範囲は重なる
+    g.spec.path = std::string(base) + "/flight_log_00" + std::to_string(k + 1) + (g.rice ? ".bin" : ".csv");
+    g.spec.offsetMs = g.startMs;
+    g.spec.driftPpm = drifts[k];
+    writeSynthetic(g, seconds);
+    loggers.push_back(g);
+    specs.push_back(g.spec);
+  }
+
+  const std::string out = std::string(base) + "/merged.csv";
+  std::vector<std::unique_ptr<MergeSource>> sources;
+  for (const SourceSpec& s : specs) {
+    sources.emplace_back(new MergeSource(s, 1000 * 1000));
+    sources.back()->open();
+  }
+  FILE* of = fopen(out.c_str(), "wb");
+  FILE* idx = fopen(indexPath(out).c_str(), "wb");
+  MergeWriter writer(of, idx, LOG_INDEX_STRIDE_MS);
+  const MergeResult r = mergeLogs(sources, writer, 1000);
+  fclose(of);
+  fclose(idx);
+
+  // 出力を読み直して、時刻順であること、補正後の時刻が真の時刻 (value[0]) と 1 ms 以内で合うことを確かめる
+  FILE* f = fopen(out.c_str(), "rb");
+  char buf[256];
+  uint64_t rows = 0;
+  uint64_t badTime = 0;
+  uint64_t unordered = 0;
+  double last = -1e300;
+  std::vector<std::pair<double, long>> rowStarts; // 索引の試験用 (時刻と行の位置)
+  long pos = 0;
+  while (fgets(buf, sizeof(buf), f) != nullptr) {
+    const long start = pos;
+    pos += static_cast<long>(strlen(buf));
+    if (buf[0] < '0' || buf[0] > '9') {
+      continue;
+    }
+    char* p = nullptr;
+    const double ms = strtod(buf, &p);
+    strtol(p + 1, &p, 10);          // ロガー番号
+    strtoul(p + 1, &p, 10);         // ロガーの時刻
+    const long truth = strtol(p + 1, nullptr, 10);
+    badTime += fabs(ms - truth) > 1.0;
+    unordered += ms < last;
+    last = std::max(last, ms);
+    rows++;
+    if (rows % 997 == 0) {
+      rowStarts.push_back({ms, start});
+    }
+  }
+  fclose(f);
+  uint64_t expectRows = 0;
+  for (const SyntheticLogger& g : loggers) {
+    expectRows += g.rows;
+  }
+
+  // 索引で飛んだ先から読んだ最初の行が、線形に探した最初の行と同じであること。読む量が少ないこと
+  uint64_t badFind = 0;
+  long long maxBytes = 0;
+  for (const auto& rs : rowStarts) {
+    const uint32_t q = static_cast<uint32_t>(floor(rs.first));
+    std::string first;
+    const long long bytes = findRange(out, q, q + 1, [&](const char* l) {
+      if (first.empty()) {
+        first = l;
+      }
+    });
+    maxBytes = std::max(maxBytes, bytes);
+    const double found = first.empty() ? -1 : strtod(first.c_str(), nullptr);
+    badFind += bytes < 0 || found < q || found > rs.first;
+  }
+
+  const bool pass = rows == expectRows && r.rows == expectRows && badTime == 0 && unordered == 0 && r.outOfOrder == 0 &&
+                    badFind == 0 && maxBytes < static_cast<long long>(writer.bytes() / 20);
+  if (report) {
+    printf("# rows=%llu expected=%llu bad_time=%llu unordered=%llu index_entries=%u finds=%zu bad_find=%llu max_find_bytes=%lld\n",
+           static_cast<unsigned long long>(rows), static_cast<unsigned long long>(expectRows),
+           static_cast<unsigned long long>(badTime), static_cast<unsigned long long>(unordered), writer.indexEntries(),
+           rowStarts.size(), static_cast<unsigned long long>(badFind), maxBytes);
+  }
+  printf("seconds=%u rows=%llu out=%.1f MB merge=%.2f s (%.0f ns/row) peak_lines=%zu %s\n", seconds,
+         static_cast<unsigned long long>(r.rows), writer.bytes() / 1e6, r.seconds, r.seconds * 1e9 / (r.rows ? r.rows : 1),
+         r.peakLines, pass ? "ok" : "NG");
+  for (const SyntheticLogger& g : loggers) {
+    unlink(g.spec.path.c_str());
+  }
+  unlink(out.c_str());
+  unlink(indexPath(out).c_str());
+  rmdir(base);
+  return {pass, r.peakLines};
+}
+
+int selftest() {
+  const SelftestResult a = selftestRun(60, true);
+  const SelftestResult b = selftestRun(240, false);
+  // 4 倍の長さでも、同時に持つ行は増えない (読みかけと窓の分だけ)
+  const bool bounded = b.peakLines <= a.peakLines * 5 / 4;
+  if (!bounded) {
+    printf("peak lines grew with log length (%zu -> %zu)\n", a.peakLines, b.peakLines);
+  }
+  const bool pass = a.pass && b.pass && bounded;
+  printf("%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--selftest") == 0) {
+    return selftest();
+  }
+  if (argc >= 4 && strcmp(argv[1], "--find") == 0) {
+    const uint32_t from = static_cast<uint32_t>(strtoul(argv[3], nullptr, 10));
+    const uint32_t to = argc >= 5 ? static_cast<uint32_t>(strtoul(argv[4], nullptr, 10)) : from + 10000;
+    const long long bytes = findRange(argv[2], from, to, [](const char* line) { fputs(line, stdout); });
+    if (bytes < 0) {
+      fprintf(stderr, "%s の索引を読めない\n", argv[2]);
+      return 2;
+    }
+    fprintf(stderr, "read %lld bytes\n", bytes);
+    return 0;
+  }
+  std::string outPath = "merged.csv";
+  uint32_t lagMs = 1000;
+  uint32_t strideMs = LOG_INDEX_STRIDE_MS;
+  std::vector<SourceSpec> specs;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      outPath = argv[++i];
+    } else if (strcmp(argv[i], "--lag") == 0 && i + 1 < argc) {
+      lagMs = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+    } else if (strcmp(argv[i], "--stride") == 0 && i + 1 < argc) {
+      strideMs = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+    } else {
+      SourceSpec spec;
+      if (!parseSpec(argv[i], spec)) {
+        fprintf(stderr, "解釈できない: %s\n", argv[i]);
+        return 2;
+      }
+      specs.push_back(spec);
+    }
+  }
+  if (specs.empty()) {
+    fprintf(stderr,
+            "usage: log_merge [-o merged.csv] [--lag ms] [--stride ms] log[@offset_ms[@drift_ppm]] ...\n"
+            "       log_merge --find merged.csv from_ms [to_ms]\n"
+            "       log_merge --selftest\n");
+    return 2;
+  }
+  return merge(specs, outPath, lagMs, strideMs);
+}
@@ -0,0 +1,499 @@
+/**
+ * @file logreader.h
+ * @brief format=rice のログ (rice_log.h のチャンク列) をホストで読むための部品
+ * @details
+ * ファイル全体をメモリに読み、チャンクを先頭から順にたどる。マジックが合わない・CRC が合わない
+ * チャンクがあれば1バイトずつ進めて次のマジックを探す (途中の破損から立ち直る)。
+ * 末尾で途切れたチャンク (電源断で書きかけのもの) は torn として数える。
+ * ブロックの復号には decode_simd.h の riceDecodeBlockFast (CPU に合わせて SSE4.1/AVX2 を使う) を使う。
+ *
+ * 書き足されていくファイル (地上試験でUSBの出力を取り込みながら表示するときなど) には、次を使う。
+ * - LogStreamDecoder: 届いた分だけを受け取り、書きかけのチャンクは続きが来るまで持っておく。
+ *   持つのは未処理の分 (多くてもチャンク1つ) だけなので、ファイルが大きくなっても費用は変わらない
+ * - LogRowAssembler: チャンネルごとのブロックを基本サンプル番号で組み直し、全チャンネルがそろった行から出す
+ * - LogTailFile: ファイルの続きを読む。Linux では inotify で書き込みを待つので、書かれてから数ミリ秒で起きる。
+ *   切り詰めや置き換え (取り込みのやり直し) を検出したら先頭から読み直す
+ */
+#pragma once
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "../rice_log.h"
+#include "decode_simd.h"
+
+/** @brief ファイル全体を読む。読めなければ false */
+inline bool logReadFile(const char* path, std::vector<uint8_t>& out) {
+  FILE* f = fopen(path, "rb");
+  if (f == nullptr) {
+    return false;
+  }
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    out.insert(out.end(), buf, buf + n);
+  }
+  fclose(f);
+  return true;
+}
+
+/** @brief 1つのチャンク。payload はファイルの内容を指す */
+struct LogChunk {
+  RiceChunkHeader header;
+  const uint8_t* payload;
+  size_t offset; ///< ファイル先頭からの位置
+};
+
+/** @brief ペイロードの最大 (これより長いと言うヘッダーは壊れている) */
+#define LOG_MAX_PAYLOAD_BYTES \
+  (RICE_MAX_BLOCK_BYTES(RICE_BLOCK_SAMPLES) > RICE_TEXT_BYTES ? RICE_MAX_BLOCK_BYTES(RICE_BLOCK_SAMPLES) : RICE_TEXT_BYTES)
+
+/** @brief チャンク列を順にたどる */
+class LogChunkReader {
+public:
+  /**
+   * @param follow true なら、末尾の書きかけのチャンクを torn とせずに手前で止まる (続きを待つとき)。
+   *        止まった位置は position() で分かる
+   */
+  LogChunkReader(const uint8_t* data, size_t len, bool follow = false) : _data(data), _len(len), _follow(follow) {}
+
+  /** @brief 次の正しいチャンクを返す。無くなれば false */
+  bool next(LogChunk& chunk) {
+    while (_pos + sizeof(RiceChunkHeader) <= _len) {
+      RiceChunkHeader h;
+      memcpy(&h, _data + _pos, sizeof(h));
+      if (h.magic != RICE_CHUNK_MAGIC) {
+        _pos++;
+        _skipped++;
+        continue;
+      }
+      if (h.payloadBytes > LOG_MAX_PAYLOAD_BYTES) {
+        _pos++;
+        _skipped++;
+        continue;
+      }
+      const size_t end = _pos + sizeof(h) + h.payloadBytes;
+      if (end > _len) {
+        // 書きかけのまま途切れたチャンク
+        if (_follow) {
+          return false;
+        }
+        _torn = true;
+        _pos = _len;
+        return false;
+      }
+      const uint8_t* payload = _data + _pos + sizeof(h);
+      if (riceCrc16(payload, h.payloadBytes) != h.crc16) {
+        _pos++;
+        _skipped++;
+        _crcErrors++;
+        continue;
+      }
+      chunk = {h, payload, _pos};
+      _pos = end;
+      return true;
+    }
+    if (_pos < _len && !_follow) {
+      _torn = true;
+      _pos = _len;
+    }
+    return false;
+  }
+
+  /** @brief 処理し終えた所 (follow なら、書きかけのチャンクの先頭) */
+  size_t position() const { return _pos; }
+  size_t skippedBytes() const { return _skipped; }
+  size_t crcErrors() const { return _crcErrors; }
+  bool torn() const { return _torn; }
+
+private:
+  const uint8_t* _data;
+  size_t _len;
+  size_t _pos = 0;
+  size_t _skipped = 0;
+  size_t _crcErrors = 0;
+  bool _torn = false;
+  bool _follow;
+};
+
+/** @brief 復号したブロック */
+struct LogBlock {
+  uint8_t channel;
+  uint32_t firstIndex;
+  uint16_t count;
+  uint16_t step;
+  int32_t values[RICE_BLOCK_SAMPLES];
+};
+
+/** @brief ブロックのチャンクを確かめて復号する。壊れていれば false */
+inline bool logDecodeBlock(const LogChunk& c, LogBlock& out) {
+  const RiceChunkHeader& h = c.header;
+  if (h.type != RICE_CHUNK_BLOCK || h.channel >= RICE_MAX_CHANNELS || h.count == 0 || h.count > RICE_BLOCK_SAMPLES ||
+      h.step == 0 || !riceDecodeBlockFast(c.payload, h.payloadBytes, h.count, out.values)) {
+    return false;
+  }
+  out.channel = h.channel;
+  out.firstIndex = h.firstIndex;
+  out.count = h.count;
+  out.step = h.step;
+  return true;
+}
+
+/**
+ * @brief 少しずつ届くバイト列からチャンクを取り出す (続きから再開できる)
+ * @details 書きかけのチャンクは次の feed() まで持っておく。持つのは未処理の分だけである。
+ */
+class LogStreamDecoder {
+public:
+  /**
+   * @brief 届いたバイトを渡し、そろったチャンクごとに onChunk(const LogChunk&) を呼ぶ
+   * @details LogChunk の payload と offset はこの呼び出しの間だけ有効。offset はストリームの先頭からの位置
+   * @return 取り出したチャンクの数
+   */
+  template <class OnChunk>
+  size_t feed(const uint8_t* data, size_t len, OnChunk&& onChunk) {
+    _buf.insert(_buf.end(), data, data + len);
+    LogChunkReader reader(_buf.data(), _buf.size(), true);
+    LogChunk c;
+    size_t chunks = 0;
+    while (reader.next(c)) {
+      c.offset += _base;
+      onChunk(static_cast<const LogChunk&>(c));
+      chunks++;
+    }
+    const size_t done = reader.position();
+    _skipped += reader.skippedBytes();
+    _crcErrors += reader.crcErrors();
+    _buf.erase(_buf.begin(), _buf.begin() + static_cast<std::ptrdiff_t>(done));
+    _base += done;
+    return chunks;
+  }
+
+  /** @brief ストリームの先頭からやり直す (ファイルが切り詰められたときなど) */
+  void reset() {
+    _buf.clear();
+    _base = 0;
+  }
+
+  /** @brief 続きを待っている (書きかけの) バイト数 */
+  size_t pendingBytes() const { return _buf.size(); }
+  size_t skippedBytes() const { return _skipped; }
+  size_t crcErrors() const { return _crcErrors; }
+
+private:
+  std::vector<uint8_t> _buf;
+  uint64_t _base = 0;
+  size_t _skipped = 0;
+  size_t _crcErrors = 0;
+};
+
+#define LOG_ROW_MAX_AHEAD (1u << 20) ///< 出していない行から、これより先の番号は受け付けない
+
+/** @brief 組み直した1行 (基本サンプル番号1つ分) */
+struct LogRow {
+  uint32_t index;
+  int32_t value[RICE_MAX_CHANNELS]; ///< value[0] は時刻 (ms)
+  uint8_t present;                  ///< 値のあるチャンネルのビット (ビット 0 が時刻)
+};
+
+/**
+ * @brief チャンネルごとのブロックを行に組み直し、そろった行から順に出す
+ * @details
+ * チャンネルごとに「どの番号までのブロックが届いたか」を覚え、見えているすべてのチャンネルが
+ * 届いた番号までを出す。間引いたチャンネル (step > 1) のブロックは長い範囲を覆うので、
+ * ロガーの定期フラッシュでブロックが区切られるまで待つことになる。止まったチャンネルを待ち続けないよう、
+ * 時刻のチャンネルから maxLag 行より遅れたら、そのチャンネルを待たずに出す。
+ *
+ * まだブロックの届いていないチャンネルは待てないので、ログの先頭の設定行 ("# chN_hz=") から
+ * 使うチャンネルが分かるなら expectChannel() で先に知らせておく (noteConfigLine() がそれを行う)。
+ */
+class LogRowAssembler {
+public:
+  explicit LogRowAssembler(uint32_t maxLag = RICE_BLOCK_SAMPLES * 16) : _maxLag(maxLag) {}
+
+  /** @brief ブロックが届く前から、このチャンネルを待つようにする */
+  void expectChannel(uint8_t ch) {
+    if (ch < RICE_MAX_CHANNELS) {
+      _expected |= 1u << ch;
+    }
+  }
+
+  /**
+   * @brief ログの設定行を1行渡す。"# chN_hz=V" (V > 0) ならデータチャンネル N を待つようにする
+   * @return 設定行として使ったら true
+   */
+  bool noteConfigLine(const char* line) {
+    unsigned ch = 0;
+    unsigned long hz = 0;
+    if (sscanf(line, "# ch%u_hz=%lu", &ch, &hz) != 2 || ch == 0 || hz == 0) {
+      return false;
+    }
+    expectChannel(static_cast<uint8_t>(ch));
+    return true;
+  }
+
+  void add(const LogBlock& b) {
+    if (_seen == 0 && _rows.empty()) {
+      _next = b.firstIndex; // 途中から読み始めたときは、最初に届いたブロックから数える
+    }
+    const uint64_t covered = b.firstIndex + static_cast<uint64_t>(b.count) * b.step;
+    if (covered > _covered[b.channel]) {
+      _covered[b.channel] = covered;
+    }
+    _seen |= 1u << b.channel;
+    for (uint32_t k = 0; k < b.count; k++) {
+      const uint64_t index = b.firstIndex + static_cast<uint64_t>(k) * b.step;
+      if (index < _next) {
+        _late++; // もう出した行の値
+        continue;
+      }
+      if (index - _next > LOG_ROW_MAX_AHEAD) {
+        _late++; // 番号が飛びすぎている (壊れたブロック)。待つ行を際限なく増やさない
+        continue;
+      }
+      LogRow& row = rowAt(index);
+      row.value[b.channel] = b.values[k];
+      row.present |= static_cast<uint8_t>(1u << b.channel);
+    }
+  }
+
+  /**
+   * @brief そろった行を番号順に onRow(const LogRow&) へ渡す
+   * @param all true なら待たずに全部出す (ストリームの終わり)
+   * @details 時刻の無い行 (時刻のブロックが失われた分) は出さずに数える。
+   * @return 出した行の数
+   */
+  template <class OnRow>
+  size_t release(OnRow&& onRow, bool all = false) {
+    uint64_t limit = all ? _next + _rows.size() : watermark();
+    size_t n = 0;
+    while (_next < limit && !_rows.empty()) {
+      const LogRow& row = _rows.front();
+      if (row.present & 0x01) {
+        onRow(row);
+        n++;
+      } else if (row.present != 0) {
+        _noTime++;
+      }
+      _rows.pop_front();
+      _next++;
+    }
+    if (_rows.empty() && _next < limit) {
+      _next = limit;
+    }
+    return n;
+  }
+
+  void reset() {
+    _rows.clear();
+    _next = 0;
+    _seen = 0;
+    _expected = 0;
+    memset(_covered, 0, sizeof(_covered));
+  }
+
+  /** @brief 捨てた値の数 (maxLag を超えて遅れたチャンネルか、番号の飛んだブロック) */
+  uint64_t lateValues() const { return _late; }
+  uint64_t rowsWithoutTime() const { return _noTime; }
+  /** @brief 待っている行の数 */
+  size_t pendingRows() const { return _rows.size(); }
+
+private:
+  LogRow& rowAt(uint64_t index) {
+    while (_next + _rows.size() <= index) {
+      LogRow empty = {};
+      empty.index = static_cast<uint32_t>(_next + _rows.size());
+      _rows.push_back(empty);
+    }
+    return _rows[static_cast<size_t>(index - _next)];
+  }
+
+  /** @brief 見えているチャンネルがすべて届いた番号 (時刻から maxLag 以上は遅らせない) */
+  uint64_t watermark() const {
+    if ((_seen & 0x01) == 0) {
+      return _next;
+    }
+    uint64_t mark = _covered[0];
+    const uint32_t waitFor = _seen | _expected;
+    for (int ch = 1; ch < RICE_MAX_CHANNELS; ch++) {
+      if ((waitFor & (1u << ch)) && _covered[ch] < mark) {
+        mark = _covered[ch];
+      }
+    }
+    if (_covered[0] > _maxLag && mark < _covered[0] - _maxLag) {
+      mark = _covered[0] - _maxLag;
+    }
+    return mark;
+  }
+
+  std::deque<LogRow> _rows; ///< _rows[i] が番号 _next + i
+  uint64_t _next = 0;
+  uint64_t _covered[RICE_MAX_CHANNELS] = {};
+  uint32_t _seen = 0;     ///< ブロックの届いたチャンネル
+  uint32_t _expected = 0; ///< 設定行から分かった、使うチャンネル
+  uint32_t _maxLag;
+  uint64_t _late = 0;
+  uint64_t _noTime = 0;
+};
+
+/**
+ * @brief 書き足されていくファイルの続きを読む
+ * @details
+ * Linux では inotify で書き込み (IN_MODIFY) を待つ。ほかの POSIX では 10 ms ごとに大きさを見る。
+ * ファイルが読んだ所より短くなった (切り詰め) か、消されて同じ名前で作り直されたときは、
+ * 先頭から読み直し、restarted() が一度だけ true を返す。
+ */
+class LogTailFile {
+public:
+  LogTailFile() = default;
+  LogTailFile(const LogTailFile&) = delete;
+  LogTailFile& operator=(const LogTailFile&) = delete;
+  ~LogTailFile() { close(); }
+
+  /**
+   * @param fromEnd true なら今の末尾から読み始める (それまでの分は読まない)
+   * @return 開けなければ false
+   */
+  bool open(const char* path, bool fromEnd = false) {
+    close();
+    _path = path;
+    if (!reopen()) {
+      return false;
+    }
+    if (fromEnd) {
+      struct stat st;
+      if (fstat(_fd, &st) == 0) {
+        _offset = static_cast<uint64_t>(st.st_size);
+      }
+    }
+    _restarted = false;
+    return true;
+  }
+
+  void close() {
+#ifdef __linux__
+    if (_inotify >= 0) {
+      ::close(_inotify);
+      _inotify = -1;
+    }
+#endif
+    if (_fd >= 0) {
+      ::close(_fd);
+      _fd = -1;
+    }
+  }
+
+  /**
+   * @brief 続きを読む。無ければ timeoutMs まで書き込みを待つ
+   * @return 読んだバイト数。時間切れなら 0、読めなければ -1
+   */
+  long read(uint8_t* buf, size_t cap, int timeoutMs) {
+    long n = readNow(buf, cap);
+    if (n != 0) {
+      return n;
+    }
+    wait(timeoutMs);
+    return readNow(buf, cap);
+  }
+
+  /** @brief 先頭から読み直したか (呼ぶと戻る)。true ならデコーダーも reset() すること */
+  bool restarted() {
+    const bool r = _restarted;
+    _restarted = false;
+    return r;
+  }
+  uint64_t offset() const { return _offset; }
+  /** @brief 書き込みを待って起きた回数 */
+  uint64_t wakeups() const { return _wakeups; }
+
+private:
+  bool reopen() {
+    close();
+    _fd = ::open(_path.c_str(), O_RDONLY);
+    if (_fd < 0) {
+      return false;
+    }
+#ifdef __linux__
+    _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotify >= 0 &&
+        inotify_add_watch(_inotify, _path.c_str(), IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF) < 0) {
+      ::close(_inotify);
+      _inotify = -1;
+    }
+#endif
+    _offset = 0;
+    _restarted = true;
+    return true;
+  }
+
+  long readNow(uint8_t* buf, size_t cap) {
+    if (_fd < 0 && !reopen()) {
+      return 0; // 作り直されるのを待つ
+    }
+    struct stat st;
+    if (fstat(_fd, &st) != 0) {
+      return -1;
+    }
+    if (st.st_nlink == 0) {
+      // 消された。同じ名前で作り直されていれば開き直す (無ければ残りを読み切る)
+      struct stat byName;
+      if (stat(_path.c_str(), &byName) == 0 && byName.st_ino != st.st_ino) {
+        reopen();
+        return readNow(buf, cap);
+      }
+    }
+    if (static_cast<uint64_t>(st.st_size) < _offset) {
+      _offset = 0; // 切り詰められた
+      _restarted = true;
+    }
+    const ssize_t n = pread(_fd, buf, cap, static_cast<off_t>(_offset));
+    if (n < 0) {
+      return -1;
+    }
+    _offset += static_cast<uint64_t>(n);
+    return n;
+  }
+
+  void wait(int timeoutMs) {
+#ifdef __linux__
+    if (_inotify >= 0) {
+      pollfd p = {_inotify, POLLIN, 0};
+      if (poll(&p, 1, timeoutMs) > 0) {
+        uint8_t events[4096];
+        while (::read(_inotify, events, sizeof(events)) > 0) {
+        }
+        _wakeups++;
+      }
+      return;
+    }
+#endif
+    const int stepMs = timeoutMs < 10 ? timeoutMs : 10;
+    for (int waited = 0; waited < timeoutMs; waited += stepMs) {
+      struct stat st;
+      if (_fd < 0 || fstat(_fd, &st) != 0 || static_cast<uint64_t>(st.st_size) != _offset || st.st_nlink == 0) {
+        _wakeups++;
+        return;
+      }
+      usleep(static_cast<useconds_t>(stepMs) * 1000);
+    }
+  }
+
+  std::string _path;
+  int _fd = -1;
+#ifdef __linux__
+  int _inotify = -1;
+#endif
+  uint64_t _offset = 0;
+  uint64_t _wakeups = 0;
+  bool _restarted = false;
+};
@@ -0,0 +1,228 @@
+/**
+ * @file logsource.h
+ * @brief ロガーのログ (format=csv と format=rice) を、同じ CSV の行として読むための部品
+ * @details
+ * - logRowToCsv: LogRowAssembler が組み直した行を、ロガーの encodeCsvRecord と同じ1行にする
+ * - RiceFollower: 届いた分ずつ format=rice のストリームを行とテキストにする (logtail が使う)
+ * - LogLineReader: ファイルを 64 KiB (rice は 4 KiB) ずつ読み、形式によらず1行ずつ返す。先頭の欄が数字の行
+ *   (サンプルの行とサテライトの行) は時刻 (ミリ秒) 付きとして返す。持つのは1回に読んだ分の行だけなので、
+ *   ファイルの大きさによらずメモリは一定である
+ *
+ * logger_profile.h の RuntimeProfile を使うので、インクルードする側で g_config を定義すること。
+ */
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "logreader.h"
+#include "../logger_profile.h"
+
+/** @brief 組み直した行を、ロガーと同じ CSV の1行にする */
+inline size_t logRowToCsv(const LogRow& row, char* line) {
+  SampleRecord r = {static_cast<uint32_t>(row.value[0]), {0, 0}, 0};
+  for (int ch = 0; ch < LOGGER_CHANNEL_COUNT && ch + 1 < RICE_MAX_CHANNELS; ch++) {
+    if (row.present & (1u << (ch + 1))) {
+      r.value[ch] = row.value[ch + 1];
+      r.present |= static_cast<uint8_t>(1u << ch);
+    }
+  }
+  return encodeCsvRecord<RuntimeProfile>(line, r);
+}
+
+/** @brief 先頭がチャンクのマジックなら format=rice のログ */
+inline bool logLooksLikeRice(const char* path) {
+  FILE* f = fopen(path, "rb");
+  if (f == nullptr) {
+    return false;
+  }
+  uint32_t magic = 0;
+  const bool ok = fread(&magic, 1, sizeof(magic), f) == sizeof(magic) && magic == RICE_CHUNK_MAGIC;
+  fclose(f);
+  return ok;
+}
+
+/** @brief format=rice のストリームを行にして出す。ファイルの読み方とは切り離してある */
+class RiceFollower {
+public:
+  template <class OnRow, class OnText>
+  void feed(const uint8_t* data, size_t len, OnRow&& onRow, OnText&& onText) {
+    _decoder.feed(data, len, [&](const LogChunk& c) {
+      if (c.header.type == RICE_CHUNK_TEXT) {
+        _rows.release(onRow); // それまでにそろった行を先に出して、順序を保つ
+        onText(reinterpret_cast<const char*>(c.payload), c.header.payloadBytes);
+        if (!_seenBlock) {
+          noteHeadText(reinterpret_cast<const char*>(c.payload), c.header.payloadBytes);
+        }
+        return;
+      }
+      if (logDecodeBlock(c, _block)) {
+        _seenBlock = true;
+        _rows.add(_block);
+      } else {
+        _badBlocks++;
+      }
+    });
+    _rows.release(onRow);
+  }
+
+  template <class OnRow>
+  void finish(OnRow&& onRow) {
+    _rows.release(onRow, true);
+  }
+
+  void reset() {
+    _decoder.reset();
+    _rows.reset();
+    _headLine.clear();
+    _seenBlock = false;
+  }
+
+  void printStats(FILE* out) const {
+    fprintf(out, "pending=%zu bytes/%zu rows skipped=%zu crc_errors=%zu bad_blocks=%u late_values=%llu\n",
+            _decoder.pendingBytes(), _rows.pendingRows(), _decoder.skippedBytes(), _decoder.crcErrors(), _badBlocks,
+            static_cast<unsigned long long>(_rows.lateValues()));
+  }
+
+private:
+  /** @brief 最初のブロックより前のテキスト (設定行) から、使うチャンネルを拾う。行はチャンクをまたぐことがある */
+  void noteHeadText(const char* text, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+      if (text[i] == '\n') {
+        _rows.noteConfigLine(_headLine.c_str());
+        _headLine.clear();
+      } else {
+        _headLine += text[i];
+      }
+    }
+  }
+
+  LogStreamDecoder _decoder;
+  LogRowAssembler _rows;
+  LogBlock _block;
+  std::string _headLine;
+  bool _seenBlock = false;
+  uint32_t _badBlocks = 0;
+};
+
+/** @brief ログの1行 (改行は含まない) */
+struct LogLine {
+  std::string text;
+  uint32_t timeMs; ///< timed のときだけ意味がある
+  bool timed;      ///< 先頭の欄が時刻 (ミリ秒) の行
+};
+
+/** @brief format=csv と format=rice のログを、区別せずに1行ずつ読む */
+class LogLineReader {
+public:
+  LogLineReader() = default;
+  LogLineReader(const LogLineReader&) = delete;
+  LogLineReader& operator=(const LogLineReader&) = delete;
+  ~LogLineReader() {
+    if (_f != nullptr) {
+      fclose(_f);
+    }
+  }
+
+  bool open(const char* path) {
+    _rice = logLooksLikeRice(path);
+    _f = fopen(path, "rb");
+    return _f != nullptr;
+  }
+
+  /** @brief 次の行を返す。無くなれば false */
+  bool next(LogLine& out) {
+    while (_pos >= _lines.size()) {
+      if (!refill()) {
+        return false;
+      }
+    }
+    out = std::move(_lines[_pos++]);
+    return true;
+  }
+
+  bool rice() const { return _rice; }
+  const RiceFollower& follower() const { return _follower; }
+  uint64_t bytesRead() const { return _bytes; }
+  /** @brief 1回の読み込みで溜めた行の最大数 (メモリの目安) */
+  size_t peakLines() const { return _peakLines; }
+
+private:
+  static const size_t kReadBytes = 65536;
+  // rice は縮みが大きいので、一度に展開する行が増えすぎないよう小さく読む
+  static const size_t kRiceReadBytes = 4096;
+
+  bool refill() {
+    _lines.clear();
+    _pos = 0;
+    if (_eof) {
+      return false;
+    }
+    _buf.resize(_rice ? kRiceReadBytes : kReadBytes);
+    const size_t n = fread(_buf.data(), 1, _buf.size(), _f);
+    char line[48];
+    auto onRow = [&](const LogRow& row) { pushLine(line, logRowToCsv(row, line)); };
+    auto onText = [&](const char* text, size_t len) { pushText(text, len); };
+    if (n == 0) {
+      _eof = true;
+      if (_rice) {
+        _follower.finish(onRow);
+      }
+      if (!_partial.empty()) {
+        pushLine(_partial.data(), _partial.size());
+        _partial.clear();
+      }
+      return !_lines.empty();
+    }
+    _bytes += n;
+    if (_rice) {
+      _follower.feed(_buf.data(), n, onRow, onText);
+    } else {
+      pushText(reinterpret_cast<const char*>(_buf.data()), n);
+    }
+    _peakLines = _lines.size() > _peakLines ? _lines.size() : _peakLines;
+    return true;
+  }
+
+  /** @brief 行の終わりまで届いた分を行にし、残りは続きを待つ */
+  void pushText(const char* text, size_t len) {
+    for (const char* end = text + len; text < end;) {
+      const char* nl = static_cast<const char*>(memchr(text, '\n', static_cast<size_t>(end - text)));
+      if (nl == nullptr) {
+        _partial.append(text, static_cast<size_t>(end - text));
+        return;
+      }
+      if (_partial.empty()) {
+        pushLine(text, static_cast<size_t>(nl - text));
+      } else {
+        _partial.append(text, static_cast<size_t>(nl - text));
+        pushLine(_partial.data(), _partial.size());
+        _partial.clear();
+      }
+      text = nl + 1;
+    }
+  }
+
+  void pushLine(const char* text, size_t len) {
+    while (len > 0 && (text[len - 1] == '\r' || text[len - 1] == '\n')) {
+      len--;
+    }
+    LogLine l;
+    l.text.assign(text, len);
+    l.timed = len > 0 && text[0] >= '0' && text[0] <= '9';
+    l.timeMs = l.timed ? static_cast<uint32_t>(strtoul(l.text.c_str(), nullptr, 10)) : 0;
+    _lines.push_back(std::move(l));
+  }
+
+  FILE* _f = nullptr;
+  bool _rice = false;
+  bool _eof = false;
+  RiceFollower _follower;
+  std::vector<uint8_t> _buf;
+  std::vector<LogLine> _lines;
+  size_t _pos = 0;
+  std::string _partial;
+  uint64_t _bytes = 0;
+  size_t _peakLines = 0;
+};
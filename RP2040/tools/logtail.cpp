@@ -0,0 +1,327 @@
+/**
+ * @file logtail.cpp
+ * @brief 書き足されていくログを追いかけて、新しい行を数ミリ秒で CSV として出すホストツール
+ * @details
+ * 地上試験でUSBの出力をファイルへ取り込みながらプロットするときに使う (例: logtail capture.bin | plotter)。
+ * logreader.h の LogTailFile で続きだけを読み、LogStreamDecoder と LogRowAssembler で
+ * そろった行から出すので、ファイルがどれだけ大きくなっても1回の更新の費用は変わらない。
+ * - format=rice のログ (先頭がチャンクのマジック): 行を rice2csv と同じ CSV に戻して出す。
+ *   テキストのチャンク (コメント行・サテライトの行) は届いた所で出す
+ * - それ以外 (format=csv など): 行の終わり ('\n') まで届いた分をそのまま出す
+ * ファイルが切り詰められるか作り直されたら、先頭から読み直す。Ctrl-C で統計を標準エラーへ出して終わる。
+ *
+ * ビルド: g++ -O2 -std=c++17 -pthread -o logtail logtail.cpp
+ * 使い方: logtail <ログ> [--from-end]
+ *         logtail --selftest   (別スレッドが書き足すファイルを追いかけ、遅れと1回あたりの費用を測る)
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+
+#include "logsource.h"
+
+// logger_profile.h の RuntimeProfile が参照する設定 (行の整形には使わない)
+LoggerConfig g_config = loggerConfigDefaults();
+
+namespace {
+
+volatile std::sig_atomic_t g_stop = 0;
+
+const size_t kReadBytes = 65536;
+
+int follow(const char* path, bool fromEnd) {
+  const bool rice = logLooksLikeRice(path);
+  LogTailFile tail;
+  if (!tail.open(path, fromEnd)) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return 2;
+  }
+  std::signal(SIGINT, [](int) { g_stop = 1; });
+  RiceFollower follower;
+  std::string partialLine;
+  std::vector<uint8_t> buf(kReadBytes);
+  char line[48];
+  auto onRow = [&](const LogRow& row) { fwrite(line, 1, logRowToCsv(row, line), stdout); };
+  auto onText = [](const char* text, size_t len) { fwrite(text, 1, len, stdout); };
+  uint64_t bytes = 0;
+  while (!g_stop) {
+    const long n = tail.read(buf.data(), buf.size(), 200);
+    if (n < 0) {
+      fprintf(stderr, "read error\n");
+      return 1;
+    }
+    if (tail.restarted()) {
+      fprintf(stderr, "%s was truncated or replaced; reading from the start\n", path);
+      follower.reset();
+      partialLine.clear();
+    }
+    if (n == 0) {
+      continue;
+    }
+    bytes += static_cast<uint64_t>(n);
+    if (rice) {
+      follower.feed(buf.data(), static_cast<size_t>(n), onRow, onText);
+    } else {
+      // 行の終わりまで届いた分だけを出す
+      partialLine.append(reinterpret_cast<const char*>(buf.data()), static_cast<size_t>(n));
+      const size_t end = partialLine.rfind('\n');
+      if (end != std::string::npos) {
+        fwrite(partialLine.data(), 1, end + 1, stdout);
+        partialLine.erase(0, end + 1);
+      }
+    }
+    fflush(stdout);
+  }
+  if (rice) {
+    follower.finish(onRow);
+  }
+  fflush(stdout);
+  fprintf(stderr, "read %llu bytes, %llu wakeups\n", static_cast<unsigned long long>(bytes),
+          static_cast<unsigned long long>(tail.wakeups()));
+  if (rice) {
+    follower.printStats(stderr);
+  }
+  return 0;
+}
+
+//================================================
+//== 自己テスト
+//================================================
+
+int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t threadCpuNs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/** @brief ファイルへ書き足す書き込み先 (RiceLogWriter の Sink)。flush() で取り込みと同じく fflush する */
+struct FileSink {
+  FILE* f = nullptr;
+  uint8_t buf[RICE_MAX_CHUNK_BYTES];
+  uint8_t* reserve(size_t) { return buf; }
+  void commit(size_t bytes) { fwrite(buf, 1, bytes, f); }
+};
+
+/** @brief 合成のサンプル (rice2csv の自己テストと同じ形の信号) */
+SampleRecord syntheticRecord(uint32_t i) {
+  SampleRecord r = {1000 + i + (i % 7 == 0 ? 1 : 0), {0, 0}, 0};
+  r.present = 0x01 | (i % 10 == 0 ? 0x02 : 0);
+  r.value[0] = static_cast<int32_t>(2000 * sin(i * 0.01)) + static_cast<int32_t>((i * 2654435761u) >> 29) - 4;
+  r.value[1] = 101325 + static_cast<int32_t>(i / 50);
+  return r;
+}
+
+void writeSamples(RiceLogWriter<FileSink>& writer, uint32_t from, uint32_t to) {
+  for (uint32_t i = from; i < to; i++) {
+    const SampleRecord r = syntheticRecord(i);
+    writer.addSample(0, i, static_cast<int32_t>(r.timestampMs));
+    writer.addSample(1, i, r.value[0]);
+    if (r.present & 0x02) {
+      writer.addSample(2, i, r.value[1]);
+    }
+  }
+}
+
+struct LiveResult {
+  double p50Ms;
+  double maxMs;
+  double cpuUsPerUpdate;
+  uint64_t updates;
+  bool rowsMatch;
+};
+
+/**
+ * @brief 先に prefillSamples 分を書いたファイルを追いかけ、別スレッドが 20 ms ごとに書き足す分の遅れを測る
+ * @details 遅れは「書き足して fflush した時刻」から「その最後の行を出した時刻」まで。
+ *          1回の更新あたりの CPU 時間は、追いつく前の読み込みを除いた書き足しの間だけで測る。
+ */
+LiveResult runLive(const char* path, uint32_t prefillSamples, uint32_t liveFlushes) {
+  const uint32_t perFlush = 20; // 1 kHz で 20 ms ごとのフラッシュ
+  const uint32_t total = prefillSamples + liveFlushes * perFlush;
+  FileSink sink;
+  sink.f = fopen(path, "wb");
+  std::unique_ptr<RiceLogWriter<FileSink>> w(new RiceLogWriter<FileSink>(sink)); // チャンネルごとのバッファが大きいのでヒープに置く
+  const uint16_t steps[3] = {1, 1, 10};
+  w->begin(3, steps);
+  const char* header = "# sample_hz=1000\r\n# ch1_hz=1000\r\n# ch2_hz=100\r\n# format=rice\r\n"
+                       "timestamp_ms,dummy_sensor1,dummy_sensor2\r\n";
+  w->addText(header, strlen(header));
+  w->flush(); // ロガーも設定行とヘッダーを書いたらすぐに区切る
+  for (uint32_t i = 0; i < prefillSamples; i += 1000) {
+    writeSamples(*w, i, i + 1000 < prefillSamples ? i + 1000 : prefillSamples);
+    w->flush();
+  }
+  fflush(sink.f);
+
+  std::vector<std::atomic<int64_t>> written(total);
+  for (auto& t : written) {
+    t.store(0);
+  }
+  std::atomic<bool> startLive(false);
+  std::thread producer([&] {
+    while (!startLive.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (uint32_t f = 0; f < liveFlushes; f++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      const uint32_t from = prefillSamples + f * perFlush;
+      writeSamples(*w, from, from + perFlush);
+      written[from + perFlush - 1].store(nowNs()); // ファイルへ渡す直前の時刻 (読む側が先に見ることはない)
+      w->flush();
+      fflush(sink.f);
+    }
+  });
+
+  LogTailFile tail;
+  tail.open(path);
+  RiceFollower follower;
+  std::vector<uint8_t> buf(kReadBytes);
+  std::vector<double> latencies;
+  uint32_t expectIndex = 0;
+  bool match = true;
+  char got[48];
+  char want[48];
+  auto onRow = [&](const LogRow& row) {
+    const size_t n = logRowToCsv(row, got);
+    const size_t m = encodeCsvRecord<RuntimeProfile>(want, syntheticRecord(row.index));
+    match &= row.index == expectIndex && n == m && memcmp(got, want, n) == 0;
+    expectIndex = row.index + 1;
+    if (row.index < total) {
+      const int64_t t = written[row.index].load();
+      if (t != 0) {
+        latencies.push_back((nowNs() - t) / 1e6);
+      }
+    }
+  };
+  auto onText = [](const char*, size_t) {};
+
+  // 追いつくまで読む (ここは測らない)
+  for (;;) {
+    const long n = tail.read(buf.data(), buf.size(), 0);
+    if (n <= 0) {
+      break;
+    }
+    follower.feed(buf.data(), static_cast<size_t>(n), onRow, onText);
+  }
+  startLive.store(true);
+  const int64_t cpu0 = threadCpuNs();
+  uint64_t updates = 0;
+  while (expectIndex < total) {
+    const long n = tail.read(buf.data(), buf.size(), 1000);
+    if (n <= 0) {
+      if (n < 0) {
+        break;
+      }
+      continue;
+    }
+    follower.feed(buf.data(), static_cast<size_t>(n), onRow, onText);
+    updates++;
+  }
+  const int64_t cpu = threadCpuNs() - cpu0;
+  producer.join();
+  fclose(sink.f);
+
+  std::sort(latencies.begin(), latencies.end());
+  LiveResult r = {};
+  r.p50Ms = latencies.empty() ? 0 : latencies[latencies.size() / 2];
+  r.maxMs = latencies.empty() ? 0 : latencies.back();
+  r.updates = updates;
+  r.cpuUsPerUpdate = updates > 0 ? cpu / 1e3 / updates : 0;
+  r.rowsMatch = match && expectIndex == total && latencies.size() == liveFlushes;
+  return r;
+}
+
+int selfTest() {
+  char path[] = "/tmp/logtail_selftestXXXXXX";
+  const int fd = mkstemp(path);
+  if (fd < 0) {
+    fprintf(stderr, "cannot create a temporary file\n");
+    return 2;
+  }
+  close(fd);
+  int fails = 0;
+  double cpuSmall = 0;
+  printf("%-10s %9s %8s %8s %14s\n", "prefill", "file_MB", "p50_ms", "max_ms", "cpu_us/update");
+  for (uint32_t prefill : {0u, 10000000u}) {
+    const LiveResult r = runLive(path, prefill, 100);
+    struct stat st;
+    stat(path, &st);
+    printf("%-10u %9.1f %8.2f %8.2f %14.1f\n", prefill, st.st_size / 1e6, r.p50Ms, r.maxMs, r.cpuUsPerUpdate);
+    if (!r.rowsMatch) {
+      fprintf(stderr, "FAIL: rows differ from what was written (prefill %u)\n", prefill);
+      fails++;
+    }
+    if (r.p50Ms > 10.0) {
+      fprintf(stderr, "FAIL: median latency %.2f ms\n", r.p50Ms);
+      fails++;
+    }
+    if (prefill == 0) {
+      cpuSmall = r.cpuUsPerUpdate;
+    } else if (r.cpuUsPerUpdate > cpuSmall * 3 + 20) {
+      fprintf(stderr, "FAIL: update cost grows with file size (%.1f vs %.1f us)\n", r.cpuUsPerUpdate, cpuSmall);
+      fails++;
+    }
+  }
+
+  // 切り詰めて書き直したら、先頭から読み直す
+  {
+    FILE* f = fopen(path, "wb");
+    FileSink sink;
+    sink.f = f;
+    std::unique_ptr<RiceLogWriter<FileSink>> writer(new RiceLogWriter<FileSink>(sink));
+    const uint16_t steps[3] = {1, 1, 10};
+    writer->begin(3, steps);
+    writeSamples(*writer, 0, 100);
+    writer->flush();
+    fflush(f);
+    LogTailFile tail;
+    tail.open(path);
+    std::vector<uint8_t> buf(kReadBytes);
+    while (tail.read(buf.data(), buf.size(), 0) > 0) {
+    }
+    tail.restarted();
+    f = freopen(path, "wb", f); // 取り込みのやり直し
+    sink.f = f;
+    writer->begin(3, steps);
+    writeSamples(*writer, 0, 10);
+    writer->flush();
+    fflush(f);
+    const long n = tail.read(buf.data(), buf.size(), 100);
+    if (n <= 0 || !tail.restarted() || tail.offset() != static_cast<uint64_t>(n)) {
+      fprintf(stderr, "FAIL: truncation not detected\n");
+      fails++;
+    }
+    fclose(f);
+  }
+  unlink(path);
+  printf("%s\n", fails == 0 ? "PASS" : "FAIL");
+  return fails == 0 ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--selftest") == 0) {
+    return selfTest();
+  }
+  if (argc < 2) {
+    fprintf(stderr, "usage: logtail <log> [--from-end]\n       logtail --selftest\n");
+    return 2;
+  }
+  const bool fromEnd = argc > 2 && strcmp(argv[2], "--from-end") == 0;
+  return follow(argv[1], fromEnd);
+}
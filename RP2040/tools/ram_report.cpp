@@ -0,0 +1,236 @@
+/**
+ * @file ram_report.cpp
+ * @brief ビルドしたファームウェアのうち、SRAMから実行される関数を一覧にするホストツール
+ * @details
+ * arm-none-eabi-nm の出力を読み、アドレスがSRAM (0x20000000〜) にあるコードのシンボルを
+ * サイズ付きで表示する。引数に関数名を並べると、それぞれがSRAMに載っているかを確かめ、
+ * フラッシュに残っていれば FAIL とする (ram_func.h の LOGGER_RAM_FUNC の付け忘れ検出用)。
+ *
+ *
+ * --calls を付けると、代わりに arm-none-eabi-objdump の逆アセンブルを読み、引数の関数から
+ * 直接の分岐 (bl / b) でたどれる関数を一覧にする。フラッシュの消去中に走る経路の確認用で、
+ * libgcc のヘルパー (__aeabi_* や __clz* など。M0+ では % や __builtin_clz がこれを呼ぶ) か
+ * フラッシュにある関数に届けば FAIL とする。関数ポインタ経由 (blx rN) の呼び出しはたどれない。
+ *
+ * ビルド: g++ -O2 -std=c++17 -o ram_report ram_report.cpp
+ * 使い方: arm-none-eabi-nm -C -S --defined-only dataLogger_microSD.ino.elf | ram_report [関数名...]
+ * 例:     ... | ram_report powerOffISR logData appendRecord flushWriteBuffer writeLogBlock
+ *         arm-none-eabi-objdump -d -C dataLogger_microSD.ino.elf | ram_report --calls flashOpTick
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../ram_func.h"
+
+namespace {
+
+struct Symbol {
+  unsigned long addr;
+  unsigned long size;
+  std::string name;
+};
+
+/** @brief "-C" で復号した名前から引数リストを落とす ("logDataT<RuntimeProfile>()" → "logDataT<RuntimeProfile>") */
+std::string baseName(const std::string& name) {
+  size_t paren = name.find('(');
+  return paren == std::string::npos ? name : name.substr(0, paren);
+}
+
+/** @brief テンプレート引数と戻り値の型も落とした名前 ("void logDataT<RuntimeProfile>()" → "logDataT") */
+std::string plainName(const std::string& name) {
+  std::string base = baseName(name);
+  size_t angle = base.find('<');
+  if (angle != std::string::npos) {
+    base = base.substr(0, angle);
+  }
+  size_t space = base.find_last_of(' ');
+  return space == std::string::npos ? base : base.substr(space + 1);
+}
+
+/** @brief libgcc の算術ヘルパーか (ラッパーやリンカーの veneer も含む) */
+bool isLibgccHelper(const std::string& name) {
+  static const char* const kPatterns[] = {"__aeabi_", "__clz", "__ctz", "__popcount", "divsi3", "modsi3", "divdi3", "moddi3"};
+  for (const char* p : kPatterns) {
+    if (name.find(p) != std::string::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/** @brief "<foo+0x1c>" の "+0x1c" を落とす */
+std::string stripOffset(const std::string& label) {
+  size_t plus = label.rfind("+0x");
+  if (plus == std::string::npos || label.find_first_not_of("0123456789abcdef", plus + 3) != std::string::npos) {
+    return label;
+  }
+  return label.substr(0, plus);
+}
+
+/**
+ * @brief --calls: 逆アセンブルから呼び出しの関係を作り、roots からたどれる関数を調べる
+ * @return たどれた先に libgcc のヘルパーかフラッシュの関数があれば 1
+ */
+int reportCalls(int rootCount, char** roots) {
+  std::map<std::string, unsigned long> addrOf;            // 関数名 → 先頭アドレス
+  std::map<std::string, std::set<std::string>> callees;   // 関数名 → 直接分岐する先
+  std::string current;
+  char line[1024];
+  while (fgets(line, sizeof(line), stdin) != nullptr) {
+    std::string text(line);
+    while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
+      text.pop_back();
+    }
+    // 関数の見出し: "20000140 <takePendingSample()>:"
+    unsigned long addr;
+    int consumed = 0;
+    if (text.size() > 3 && text.compare(text.size() - 2, 2, ">:") == 0 &&
+        sscanf(text.c_str(), "%lx <%n", &addr, &consumed) == 1 && consumed > 0) {
+      current = text.substr(consumed, text.size() - 2 - consumed);
+      addrOf[current] = addr;
+      continue;
+    }
+    // 命令: "20000142:\tf000 f8a1 \tbl\t20000288 <takePendingSample()>"
+    if (current.empty()) {
+      continue;
+    }
+    size_t tab1 = text.find('\t');
+    size_t tab2 = tab1 == std::string::npos ? tab1 : text.find('\t', tab1 + 1);
+    if (tab2 == std::string::npos) {
+      continue;
+    }
+    size_t tab3 = text.find('\t', tab2 + 1);
+    std::string mnemonic = text.substr(tab2 + 1, tab3 == std::string::npos ? std::string::npos : tab3 - tab2 - 1);
+    if (tab3 == std::string::npos || mnemonic.empty() || mnemonic[0] != 'b' || mnemonic.compare(0, 3, "bic") == 0 ||
+        mnemonic.compare(0, 3, "bkp") == 0) {
+      continue;
+    }
+    size_t open = text.find('<', tab3);
+    size_t close = text.rfind('>');
+    if (open == std::string::npos || close == std::string::npos || close <= open) {
+      continue;
+    }
+    std::string target = stripOffset(text.substr(open + 1, close - open - 1));
+    if (target != current) {
+      callees[current].insert(target);
+    }
+  }
+
+  // 引数の名前は plainName で照合する (テンプレートや引数リストを書かなくてよい)
+  std::vector<std::string> queue;
+  std::map<std::string, std::string> reachedFrom; // 関数名 → 呼び出し元 (根は空)
+  for (int i = 0; i < rootCount; i++) {
+    bool found = false;
+    for (const auto& entry : addrOf) {
+      if (plainName(entry.first) == roots[i] && reachedFrom.find(entry.first) == reachedFrom.end()) {
+        reachedFrom[entry.first] = "";
+        queue.push_back(entry.first);
+        found = true;
+      }
+    }
+    if (!found) {
+      printf("%-24s not found\n", roots[i]);
+      printf("FAIL\n");
+      return 1;
+    }
+  }
+  for (size_t i = 0; i < queue.size(); i++) {
+    if (isLibgccHelper(queue[i])) {
+      continue; // ヘルパーの中身まではたどらない
+    }
+    for (const std::string& next : callees[queue[i]]) {
+      if (reachedFrom.emplace(next, queue[i]).second) {
+        queue.push_back(next);
+      }
+    }
+  }
+
+  int bad = 0;
+  printf("Reachable by direct branches:\n");
+  for (const std::string& name : queue) {
+    auto it = addrOf.find(name);
+    const char* region = it == addrOf.end() ? "?" : ramFuncRegion(it->second);
+    bool helper = isLibgccHelper(name);
+    bool inFlash = strcmp(region, "flash") == 0;
+    const std::string& caller = reachedFrom[name];
+    printf("  %-6s %s%s%s%s\n", region, name.c_str(), caller.empty() ? "" : "  <- ", caller.c_str(),
+           helper ? "  [libgcc helper]" : (inFlash ? "  [flash]" : ""));
+    if (helper || inFlash) {
+      bad++;
+    }
+  }
+  printf("%s\n", bad == 0 ? "PASS" : "FAIL");
+  return bad == 0 ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--calls") == 0) {
+    return reportCalls(argc - 2, argv + 2);
+  }
+  std::vector<Symbol> ramCode;
+  std::map<std::string, std::string> regionOf; // 関数名 → 領域 (同名が複数なら最後に見たもの)
+  char line[1024];
+  while (fgets(line, sizeof(line), stdin) != nullptr) {
+    // 形式: アドレス [サイズ] 種類 名前 (名前には空白が含まれることがある)
+    unsigned long addr;
+    char second[32];
+    char third[32];
+    int consumed = 0;
+    if (sscanf(line, "%lx %31s %31s %n", &addr, second, third, &consumed) < 3) {
+      continue;
+    }
+    unsigned long size = 0;
+    char type;
+    std::string name;
+    if (strlen(second) == 1) {
+      // サイズの無い行。3つ目の語から名前が始まる
+      type = second[0];
+      name = std::string(third) + " " + (line + consumed);
+    } else {
+      size = strtoul(second, nullptr, 16);
+      type = third[0];
+      name = line + consumed;
+    }
+    while (!name.empty() && (name.back() == '\n' || name.back() == '\r' || name.back() == ' ')) {
+      name.pop_back();
+    }
+    if (type != 't' && type != 'T' && type != 'W' && type != 'w') {
+      continue;
+    }
+    const char* region = ramFuncRegion(addr);
+    regionOf[plainName(name)] = region;
+    if (strcmp(region, "sram") == 0) {
+      ramCode.push_back({addr, size, name});
+    }
+  }
+
+  unsigned long total = 0;
+  printf("SRAM-resident code:\n");
+  for (const Symbol& s : ramCode) {
+    printf("  0x%08lx %6lu  %s\n", s.addr, s.size, s.name.c_str());
+    total += s.size;
+  }
+  printf("%zu functions, %lu bytes\n", ramCode.size(), total);
+
+  int missing = 0;
+  for (int i = 1; i < argc; i++) {
+    auto it = regionOf.find(argv[i]);
+    const char* region = it == regionOf.end() ? "not found (inlined?)" : it->second.c_str();
+    bool ok = it != regionOf.end() && it->second == "sram";
+    printf("%-24s %s\n", argv[i], region);
+    if (!ok) {
+      missing++;
+    }
+  }
+  if (argc > 1) {
+    printf("%s\n", missing == 0 ? "PASS" : "FAIL");
+  }
+  return missing == 0 ? 0 : 1;
+}
@@ -0,0 +1,550 @@
+/**
+ * @file spectrum.cpp
+ * @brief ログの振動チャンネルの窓付き FFT (スペクトログラム) と Welch 法の PSD を求めるホストツール
+ * @details
+ * フライト後の解析の中心は、振動のチャンネルを少しずつずらした窓で区切った PSD である。
+ * CSV に書き出してから表計算や Python で計算すると遅いので、ログ (format=csv / format=rice) を
+ * logsource.h の LogLineReader で直接読み、次のように計算する。
+ * - チャンネルごとに値の列を作る。サンプリング周波数はログの設定行 ("# chN_hz=" / "# sample_hz=") から取り、
+ *   無ければ時刻の欄から見積もる (--rate で指定もできる)。欠けたサンプルは詰めて、等間隔とみなす
+ * - nfft 点の窓を hop = nfft × (1 − overlap) ずつずらし、区間の平均を引いて Hann 窓を掛け、
+ *   fft_simd.h の実数 FFT (SSE/AVX2 のバタフライ) で片側の PSD にする。これがスペクトログラムの1行
+ * - Welch の PSD はスペクトログラムの行の平均。パワーの単位は (値の単位)²/Hz で、
+ *   PSD を周波数で積分すると区間の分散になる
+ *
+ * 窓の計算は (チャンネル, 窓 64 本) を1つの仕事にして、--threads 本のスレッドで分け合う。
+ * 窓ごとに書く場所が決まっているので、スレッドの数によらず結果は同じ。
+ *
+ * 出力 (-o の接頭辞、既定は入力の拡張子を除いた名前):
+ * - <接頭辞>_ch<N>_psd.csv: freq_hz,psd。先頭のコメントに条件とスペクトログラムの軸を書く
+ * - <接頭辞>_ch<N>_spectrogram.npy: float32 の [窓の数, nfft/2+1] の行列 (numpy.load でそのまま読める)。
+ *   行 i の窓は t0_ms + i × hop_ms から始まる
+ *
+ * ビルド: g++ -O2 -std=c++17 -pthread -o spectrum spectrum.cpp
+ * 使い方: spectrum [-n nfft=1024] [--overlap 0.5] [--threads N] [--channels 1,2] [--rate hz] [-o 接頭辞] ログ
+ *         spectrum --selftest
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "fft_simd.h"
+#include "logsource.h"
+
+// logger_profile.h の RuntimeProfile が参照する設定 (行の整形には使わない)
+LoggerConfig g_config = loggerConfigDefaults();
+
+namespace {
+
+#define SPECTRUM_TASK_SEGMENTS 64 // 1つの仕事にまとめる窓の数
+
+struct SpectrumOptions {
+  size_t nfft = 1024;
+  double overlap = 0.5;
+  unsigned threads = 0; ///< 0 ならコアの数
+  uint32_t channels = 0; ///< 解析するチャンネルのビット (0 ならすべて)
+  double rateHz = 0;     ///< 0 ならログから
+};
+
+/** @brief ログから取り出した1チャンネル分の値 */
+struct ChannelSeries {
+  int channel = 0; ///< 1 始まり (CSV の2列目が 1)
+  std::vector<float> values;
+  double rateHz = 0;
+  uint32_t firstMs = 0;
+  uint32_t lastMs = 0;
+};
+
+//================================================
+//== ログの読み込み
+//================================================
+
+/**
+ * @brief ログを1回読み、チャンネルごとの値の列にする
+ * @details サテライトの行 (時刻,,,src,ch,value) は振動のチャンネルではないので読み飛ばす。
+ */
+bool loadChannels(const char* path, double rateOverride, std::vector<ChannelSeries>& out) {
+  LogLineReader reader;
+  if (!reader.open(path)) {
+    return false;
+  }
+  double sampleHz = 0;
+  std::vector<double> channelHz;
+  std::vector<ChannelSeries> series;
+  LogLine line;
+  while (reader.next(line)) {
+    const char* s = line.text.c_str();
+    if (!line.timed) {
+      unsigned ch = 0;
+      double hz = 0;
+      if (sscanf(s, "# ch%u_hz=%lf", &ch, &hz) == 2 && ch > 0 && ch < 64) {
+        channelHz.resize(std::max<size_t>(channelHz.size(), ch + 1), 0);
+        channelHz[ch] = hz;
+      } else if (sscanf(s, "# sample_hz=%lf", &hz) == 1) {
+        sampleHz = hz;
+      }
+      continue;
+    }
+    // 欄を区切る。サテライトの行は2・3列目が空で、4列目以降がある
+    const char* fields[16];
+    size_t count = 0;
+    for (const char* p = s; count < 16;) {
+      fields[count++] = p;
+      p = strchr(p, ',');
+      if (p == nullptr) {
+        break;
+      }
+      p++;
+    }
+    if (count >= 6 && fields[1][0] == ',' && fields[2][0] == ',') {
+      continue;
+    }
+    for (size_t i = 1; i < count; i++) {
+      if (fields[i][0] == ',' || fields[i][0] == '\0') {
+        continue; // 間引いたチャンネルの空欄
+      }
+      if (series.size() < i) {
+        series.resize(i);
+      }
+      ChannelSeries& c = series[i - 1];
+      if (c.values.empty()) {
+        c.firstMs = line.timeMs;
+      }
+      c.lastMs = line.timeMs;
+      c.values.push_back(strtof(fields[i], nullptr));
+    }
+  }
+  for (size_t i = 0; i < series.size(); i++) {
+    ChannelSeries& c = series[i];
+    c.channel = static_cast<int>(i + 1);
+    const double configured = i + 1 < channelHz.size() && channelHz[i + 1] > 0 ? channelHz[i + 1] : sampleHz;
+    if (rateOverride > 0) {
+      c.rateHz = rateOverride;
+    } else if (configured > 0) {
+      c.rateHz = configured;
+    } else if (c.values.size() > 1 && c.lastMs > c.firstMs) {
+      c.rateHz = (c.values.size() - 1) * 1000.0 / (c.lastMs - c.firstMs);
+    }
+  }
+  out.swap(series);
+  return true;
+}
+
+//================================================
+//== 解析
+//================================================
+
+/** @brief 1チャンネル分の結果 */
+struct ChannelSpectrum {
+  const ChannelSeries* series = nullptr;
+  size_t segments = 0;
+  size_t hop = 0;
+  std::vector<float> spectrogram; ///< [segments][bins] の PSD
+  std::vector<double> psd;        ///< Welch の平均
+};
+
+struct SpectrumStats {
+  uint64_t ffts = 0;
+  unsigned threads = 0;
+  double seconds = 0;
+};
+
+std::vector<float> hannWindow(size_t n) {
+  std::vector<float> w(n);
+  for (size_t i = 0; i < n; i++) {
+    w[i] = static_cast<float>(0.5 - 0.5 * cos(2.0 * M_PI * static_cast<double>(i) / static_cast<double>(n)));
+  }
+  return w;
+}
+
+/**
+ * @brief 各チャンネルのスペクトログラムと Welch の PSD を求める
+ * @details 窓が nfft 本に満たないチャンネルは segments = 0 のまま残す。
+ */
+SpectrumStats computeSpectra(const std::vector<ChannelSeries>& series, const SpectrumOptions& opt, const FftPlan& plan,
+                             std::vector<ChannelSpectrum>& out) {
+  const auto t0 = std::chrono::steady_clock::now();
+  const size_t n = plan.size();
+  const size_t bins = plan.bins();
+  const size_t hop = std::max<size_t>(1, static_cast<size_t>(llround(n * (1.0 - opt.overlap))));
+  const std::vector<float> window = hannWindow(n);
+  double windowPower = 0;
+  for (float w : window) {
+    windowPower += static_cast<double>(w) * w;
+  }
+
+  struct Task {
+    size_t channel;
+    size_t first;
+    size_t last;
+  };
+  std::vector<Task> tasks;
+  out.clear();
+  for (const ChannelSeries& s : series) {
+    if (opt.channels != 0 && (s.channel >= 32 || !(opt.channels & (1u << s.channel)))) {
+      continue;
+    }
+    ChannelSpectrum c;
+    c.series = &s;
+    c.hop = hop;
+    c.segments = s.values.size() >= n && s.rateHz > 0 ? 1 + (s.values.size() - n) / hop : 0;
+    c.spectrogram.resize(c.segments * bins);
+    for (size_t i = 0; i < c.segments; i += SPECTRUM_TASK_SEGMENTS) {
+      tasks.push_back({out.size(), i, std::min(c.segments, i + SPECTRUM_TASK_SEGMENTS)});
+    }
+    out.push_back(std::move(c));
+  }
+
+  std::atomic<size_t> nextTask{0};
+  auto worker = [&] {
+    FftPlan::Scratch scratch;
+    for (size_t t = nextTask++; t < tasks.size(); t = nextTask++) {
+      const Task& task = tasks[t];
+      ChannelSpectrum& c = out[task.channel];
+      // 片側にまとめるので、直流とナイキスト以外は2倍する
+      const float scale = static_cast<float>(1.0 / (c.series->rateHz * windowPower));
+      for (size_t seg = task.first; seg < task.last; seg++) {
+        const float* x = c.series->values.data() + seg * hop;
+        double sum = 0;
+        for (size_t i = 0; i < n; i++) {
+          sum += x[i];
+        }
+        float* row = c.spectrogram.data() + seg * bins;
+        plan.power(x, window.data(), static_cast<float>(sum / n), row, scratch);
+        row[0] *= scale;
+        row[bins - 1] *= scale;
+        for (size_t k = 1; k + 1 < bins; k++) {
+          row[k] *= 2.0f * scale;
+        }
+      }
+    }
+  };
+  unsigned threads = opt.threads != 0 ? opt.threads : std::max(1u, std::thread::hardware_concurrency());
+  threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, tasks.size())));
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads; i++) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (std::thread& th : pool) {
+    th.join();
+  }
+
+  SpectrumStats stats;
+  stats.threads = threads;
+  for (ChannelSpectrum& c : out) {
+    c.psd.assign(bins, 0.0);
+    for (size_t seg = 0; seg < c.segments; seg++) {
+      const float* row = c.spectrogram.data() + seg * bins;
+      for (size_t k = 0; k < bins; k++) {
+        c.psd[k] += row[k];
+      }
+    }
+    for (double& p : c.psd) {
+      p /= c.segments > 0 ? c.segments : 1;
+    }
+    stats.ffts += c.segments;
+  }
+  stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  return stats;
+}
+
+//================================================
+//== 出力
+//================================================
+
+/** @brief float32 の2次元配列を .npy (形式 1.0) で書く */
+bool writeNpy(const std::string& path, const float* data, size_t rows, size_t cols) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (f == nullptr) {
+    return false;
+  }
+  char dict[128];
+  int len = snprintf(dict, sizeof(dict), "{'descr': '<f4', 'fortran_order': False, 'shape': (%zu, %zu), }", rows, cols);
+  // マジック (6) + 版 (2) + 長さ (2) + 辞書 + 改行を 64 バイトにそろえる
+  const int total = (10 + len + 1 + 63) / 64 * 64;
+  std::string header(dict, static_cast<size_t>(len));
+  header.append(static_cast<size_t>(total - 10 - len - 1), ' ');
+  header += '\n';
+  const uint16_t headerLen = static_cast<uint16_t>(header.size());
+  fwrite("\x93NUMPY\x01\x00", 1, 8, f);
+  fwrite(&headerLen, 2, 1, f);
+  fwrite(header.data(), 1, header.size(), f);
+  fwrite(data, sizeof(float), rows * cols, f);
+  return fclose(f) == 0;
+}
+
+bool writeResults(const std::string& prefix, const char* input, const SpectrumOptions& opt, const FftPlan& plan,
+                  const std::vector<ChannelSpectrum>& spectra) {
+  for (const ChannelSpectrum& c : spectra) {
+    if (c.segments == 0) {
+      continue;
+    }
+    const ChannelSeries& s = *c.series;
+    const std::string base = prefix + "_ch" + std::to_string(s.channel);
+    const std::string npy = base + "_spectrogram.npy";
+    const double df = s.rateHz / plan.size();
+    FILE* f = fopen((base + "_psd.csv").c_str(), "wb");
+    if (f == nullptr || !writeNpy(npy, c.spectrogram.data(), c.segments, plan.bins())) {
+      if (f != nullptr) {
+        fclose(f);
+      }
+      return false;
+    }
+    fprintf(f, "# file=%s channel=%d rate_hz=%.6g samples=%zu\n", input, s.channel, s.rateHz, s.values.size());
+    fprintf(f, "# nfft=%zu overlap=%.3f window=hann detrend=mean segments=%zu df_hz=%.6g fft=%s\n", plan.size(),
+            opt.overlap, c.segments, df, plan.kernels().name);
+    fprintf(f, "# spectrogram=%s rows=%zu cols=%zu t0_ms=%u hop_ms=%.6g\n", npy.c_str(), c.segments, plan.bins(), s.firstMs,
+            c.hop * 1000.0 / s.rateHz);
+    fprintf(f, "freq_hz,psd\n");
+    for (size_t k = 0; k < plan.bins(); k++) {
+      fprintf(f, "%.6g,%.6g\n", k * df, c.psd[k]);
+    }
+    if (fclose(f) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//================================================
+//== 自己試験
+//================================================
+
+/** @brief 倍精度の素直な DFT で |X[k]|² を求める (試験の基準) */
+std::vector<double> naivePower(const std::vector<float>& x) {
+  const size_t n = x.size();
+  std::vector<double> p(n / 2 + 1);
+  for (size_t k = 0; k <= n / 2; k++) {
+    double re = 0;
+    double im = 0;
+    for (size_t i = 0; i < n; i++) {
+      const double a = -2.0 * M_PI * static_cast<double>(k * i % n) / static_cast<double>(n);
+      re += x[i] * cos(a);
+      im += x[i] * sin(a);
+    }
+    p[k] = re * re + im * im;
+  }
+  return p;
+}
+
+std::vector<const FftKernels*> availableKernels() {
+  std::vector<const FftKernels*> list;
+  for (const char* name : {"scalar", "sse", "avx2"}) {
+    const FftKernels* k = fftKernelsByName(name);
+    if (k != nullptr) {
+      list.push_back(k);
+    }
+  }
+  return list;
+}
+
+int selftest() {
+  bool pass = true;
+  std::mt19937 rng(98);
+  std::normal_distribution<float> gauss(0.0f, 1.0f);
+
+  // 1. どのカーネルでも、倍精度の DFT と float の丸め程度で一致する
+  for (const FftKernels* k : availableKernels()) {
+    double worst = 0;
+    for (size_t n = 4; n <= 2048; n *= 2) {
+      std::vector<float> x(n);
+      for (float& v : x) {
+        v = gauss(rng);
+      }
+      const FftPlan plan(n, *k);
+      FftPlan::Scratch s;
+      std::vector<float> p(plan.bins());
+      plan.power(x.data(), nullptr, 0.0f, p.data(), s);
+      const std::vector<double> ref = naivePower(x);
+      const double peak = *std::max_element(ref.begin(), ref.end());
+      for (size_t i = 0; i < ref.size(); i++) {
+        worst = std::max(worst, fabs(p[i] - ref[i]) / peak);
+      }
+    }
+    const bool ok = worst < 1e-4;
+    printf("fft %-6s n=4..2048 max_rel_error=%.2e %s\n", k->name, worst, ok ? "ok" : "NG");
+    pass = pass && ok;
+  }
+
+  // 2. 正弦波 + 白色雑音: ピークの周波数と、PSD の積分 = 分散
+  const double fs = 1000.0;
+  const double f0 = 123.0;
+  const double amp = 2.0;
+  const double sigma = 0.5;
+  std::vector<ChannelSeries> series(2);
+  for (int c = 0; c < 2; c++) {
+    series[c].channel = c + 1;
+    series[c].rateHz = fs;
+    series[c].values.resize(600000);
+    for (size_t i = 0; i < series[c].values.size(); i++) {
+      series[c].values[i] = static_cast<float>(amp * sin(2 * M_PI * f0 * i / fs) + sigma * gauss(rng) + 100.0 * c);
+    }
+  }
+  SpectrumOptions opt;
+  opt.threads = 1;
+  const FftPlan plan(1024);
+  std::vector<ChannelSpectrum> one;
+  const SpectrumStats s1 = computeSpectra(series, opt, plan, one);
+  const double df = fs / plan.size();
+  for (const ChannelSpectrum& c : one) {
+    const size_t peak = static_cast<size_t>(std::max_element(c.psd.begin(), c.psd.end()) - c.psd.begin());
+    double integral = 0;
+    for (double p : c.psd) {
+      integral += p * df;
+    }
+    const double variance = amp * amp / 2 + sigma * sigma;
+    const bool ok = fabs(peak * df - f0) <= df && fabs(integral / variance - 1.0) < 0.02;
+    printf("ch%d peak=%.1f Hz (expect %.1f) integral=%.4f variance=%.4f segments=%zu %s\n", c.series->channel, peak * df, f0,
+           integral, variance, c.segments, ok ? "ok" : "NG");
+    pass = pass && ok;
+  }
+
+  // 3. スレッドの数によらず、スペクトログラムはビット単位で同じ
+  opt.threads = 8;
+  std::vector<ChannelSpectrum> many;
+  const SpectrumStats s8 = computeSpectra(series, opt, plan, many);
+  bool same = true;
+  for (size_t c = 0; c < one.size(); c++) {
+    same = same && one[c].spectrogram == many[c].spectrogram;
+  }
+  printf("threads=1: %.0f fft/s  threads=%u: %.0f fft/s (x%.1f) identical=%s\n", s1.ffts / s1.seconds, s8.threads,
+         s8.ffts / s8.seconds, s1.seconds / s8.seconds, same ? "yes" : "NO");
+  pass = pass && same;
+
+  // 4. カーネルごとの速さ (1 スレッド、nfft=1024)
+  for (const FftKernels* k : availableKernels()) {
+    const FftPlan p(1024, *k);
+    FftPlan::Scratch s;
+    std::vector<float> out(p.bins());
+    const size_t reps = 20000;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reps; i++) {
+      p.power(series[0].values.data() + (i % 500) * 512, nullptr, 0.0f, out.data(), s);
+    }
+    const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    printf("fft %-6s nfft=1024 %.0f fft/s (%.2f us/fft)\n", k->name, reps / sec, sec * 1e6 / reps);
+  }
+
+  // 5. ログのファイルから読む (設定行の周波数、サテライトの行と間引いた空欄を読み飛ばす)
+  char path[] = "/tmp/spectrum_selftestXXXXXX";
+  const int fd = mkstemp(path);
+  FILE* f = fdopen(fd, "wb");
+  fprintf(f, "# sample_hz=1000\r\n# ch1_hz=1000\r\n# ch2_hz=500\r\ntimestamp_ms,dummy_sensor1,dummy_sensor2\r\n");
+  for (uint32_t i = 0; i < 8192; i++) {
+    fprintf(f, "%u,%d,", i, static_cast<int>(lround(1000 * sin(2 * M_PI * 250.0 * i / 1000.0))));
+    if (i % 2 == 0) {
+      fprintf(f, "%d", static_cast<int>(i));
+    }
+    fprintf(f, "\r\n");
+    if (i % 100 == 0) {
+      fprintf(f, "%u,,,1,0,42\r\n", i);
+    }
+  }
+  fclose(f);
+  std::vector<ChannelSeries> loaded;
+  const bool read = loadChannels(path, 0, loaded);
+  unlink(path);
+  std::vector<ChannelSpectrum> fromLog;
+  computeSpectra(loaded, opt, plan, fromLog);
+  const bool okLoad = read && loaded.size() == 2 && loaded[0].values.size() == 8192 && loaded[1].values.size() == 4096 &&
+                      loaded[0].rateHz == 1000 && loaded[1].rateHz == 500 && fromLog.size() == 2 &&
+                      std::max_element(fromLog[0].psd.begin(), fromLog[0].psd.end()) - fromLog[0].psd.begin() == 256;
+  printf("log: channels=%zu samples=%zu/%zu rate=%.0f/%.0f %s\n", loaded.size(), loaded.empty() ? 0 : loaded[0].values.size(),
+         loaded.size() < 2 ? 0 : loaded[1].values.size(), loaded.empty() ? 0 : loaded[0].rateHz,
+         loaded.size() < 2 ? 0 : loaded[1].rateHz, okLoad ? "ok" : "NG");
+  pass = pass && okLoad;
+
+  printf("%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
+
+uint32_t parseChannels(const char* s) {
+  uint32_t mask = 0;
+  for (char* p = const_cast<char*>(s); *p != '\0';) {
+    const unsigned long ch = strtoul(p, &p, 10);
+    if (ch > 0 && ch < 32) {
+      mask |= 1u << ch;
+    }
+    if (*p == ',') {
+      p++;
+    } else if (*p != '\0') {
+      return 0;
+    }
+  }
+  return mask;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--selftest") == 0) {
+    return selftest();
+  }
+  SpectrumOptions opt;
+  std::string prefix;
+  const char* input = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      opt.nfft = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--overlap") == 0 && i + 1 < argc) {
+      opt.overlap = strtod(argv[++i], nullptr);
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      opt.threads = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+    } else if (strcmp(argv[i], "--channels") == 0 && i + 1 < argc) {
+      opt.channels = parseChannels(argv[++i]);
+    } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+      opt.rateHz = strtod(argv[++i], nullptr);
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      prefix = argv[++i];
+    } else {
+      input = argv[i];
+    }
+  }
+  if (input == nullptr || opt.nfft < 4 || (opt.nfft & (opt.nfft - 1)) != 0 || opt.overlap < 0 || opt.overlap >= 1) {
+    fprintf(stderr,
+            "usage: spectrum [-n nfft(2^k)] [--overlap 0..1) [--threads N] [--channels 1,2] [--rate hz] [-o prefix] log\n"
+            "       spectrum --selftest\n");
+    return 2;
+  }
+  if (prefix.empty()) {
+    prefix = input;
+    const size_t dot = prefix.find_last_of('.');
+    if (dot != std::string::npos && prefix.find('/', dot) == std::string::npos) {
+      prefix.resize(dot);
+    }
+  }
+
+  const auto t0 = std::chrono::steady_clock::now();
+  std::vector<ChannelSeries> series;
+  if (!loadChannels(input, opt.rateHz, series)) {
+    fprintf(stderr, "%s を開けない\n", input);
+    return 2;
+  }
+  const double loadSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  const FftPlan plan(opt.nfft);
+  std::vector<ChannelSpectrum> spectra;
+  const SpectrumStats stats = computeSpectra(series, opt, plan, spectra);
+  if (!writeResults(prefix, input, opt, plan, spectra)) {
+    fprintf(stderr, "%s の結果を書けない\n", prefix.c_str());
+    return 2;
+  }
+  for (const ChannelSpectrum& c : spectra) {
+    fprintf(stderr, "ch%d: samples=%zu rate_hz=%.6g segments=%zu%s\n", c.series->channel, c.series->values.size(),
+            c.series->rateHz, c.segments, c.segments == 0 ? " (too short or no rate; skipped)" : "");
+  }
+  fprintf(stderr, "load %.2f s, %llu fft (nfft=%zu, %s, %u threads) %.2f s = %.0f fft/s\n", loadSec,
+          static_cast<unsigned long long>(stats.ffts), opt.nfft, plan.kernels().name, stats.threads, stats.seconds,
+          stats.ffts / (stats.seconds > 0 ? stats.seconds : 1));
+  return 0;
+}
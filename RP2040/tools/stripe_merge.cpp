@@ -0,0 +1,145 @@
+/**
+ * @file stripe_merge.cpp
+ * @brief 2枚のカードにストライプしたログ (.s0 / .s1) を元の1本のログに戻すホストツール
+ * @details
+ * 各ファイルを log_stripe.h のブロック形式として読み、マジックと CRC-32 を確かめてから
+ * 通し番号順に並べ、ペイロードをつなげて出力する。次のものは標準エラーへ報告する。
+ * - 通し番号の欠け (片方のカードが途中で書けなくなった等)
+ * - 同じ通し番号の重複 (後から読んだ方を捨てる)
+ * - CRC の合わないブロック、途中で切れた末尾のブロック (電源断で書きかけのもの)
+ *
+ * 欠けがあっても、読めたブロックはそのまま出力する。終了コードは欠け・破損が無ければ 0。
+ *
+ * ビルド: g++ -O2 -std=c++17 -o stripe_merge stripe_merge.cpp
+ * 使い方: stripe_merge flight_log_001.s0 flight_log_001.s1 [出力=flight_log_001.csv]
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../log_stripe.h"
+
+namespace {
+
+struct Block {
+  uint32_t seq;
+  std::vector<uint8_t> payload;
+};
+
+struct ReadResult {
+  uint32_t blocks = 0;
+  uint32_t badCrc = 0;
+  uint32_t badHeader = 0;
+  bool torn = false;
+};
+
+/** @brief 1枚分のファイルからブロックを読み出す。ヘッダーが壊れていたらそこで止める */
+ReadResult readBlocks(const char* path, std::vector<Block>& out) {
+  ReadResult r;
+  FILE* f = fopen(path, "rb");
+  if (f == nullptr) {
+    fprintf(stderr, "%s: 開けません\n", path);
+    r.badHeader++;
+    return r;
+  }
+  for (;;) {
+    StripeBlockHeader h;
+    size_t n = fread(&h, 1, sizeof(h), f);
+    if (n == 0) {
+      break;
+    }
+    if (n != sizeof(h)) {
+      r.torn = true;
+      break;
+    }
+    if (h.magic != STRIPE_MAGIC || h.headerBytes < sizeof(h) || h.cardCount != STRIPE_CARDS) {
+      // 以降のブロック境界が分からないので、ここで読むのをやめる
+      fprintf(stderr, "%s: オフセット %ld のヘッダーが不正です\n", path, ftell(f) - static_cast<long>(n));
+      r.badHeader++;
+      break;
+    }
+    if (h.headerBytes > sizeof(h)) {
+      fseek(f, h.headerBytes - sizeof(h), SEEK_CUR);
+    }
+    Block b;
+    b.seq = h.seq;
+    b.payload.resize(h.payloadBytes);
+    if (fread(b.payload.data(), 1, h.payloadBytes, f) != h.payloadBytes) {
+      r.torn = true;
+      break;
+    }
+    if (stripeCrc32(b.payload.data(), b.payload.size()) != h.crc32) {
+      fprintf(stderr, "%s: ブロック %u の CRC が合いません\n", path, h.seq);
+      r.badCrc++;
+      continue;
+    }
+    out.push_back(std::move(b));
+    r.blocks++;
+  }
+  fclose(f);
+  if (r.torn) {
+    fprintf(stderr, "%s: 末尾のブロックが途中で切れています (書きかけ)\n", path);
+  }
+  return r;
+}
+
+/** @brief "xxx.s0" から "xxx.csv" を作る */
+std::string defaultOutput(const std::string& first) {
+  size_t dot = first.find_last_of('.');
+  return (dot == std::string::npos ? first : first.substr(0, dot)) + ".csv";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s card0.s0 card1.s1 [out.csv]\n", argv[0]);
+    return 2;
+  }
+  std::vector<Block> blocks;
+  uint32_t badCrc = 0;
+  uint32_t badHeader = 0;
+  uint32_t torn = 0;
+  for (int i = 1; i <= 2; i++) {
+    ReadResult r = readBlocks(argv[i], blocks);
+    printf("%s: blocks=%u bad_crc=%u%s\n", argv[i], r.blocks, r.badCrc, r.torn ? " torn_tail" : "");
+    badCrc += r.badCrc;
+    badHeader += r.badHeader;
+    torn += r.torn ? 1 : 0;
+  }
+
+  std::stable_sort(blocks.begin(), blocks.end(), [](const Block& a, const Block& b) { return a.seq < b.seq; });
+
+  const std::string outPath = argc > 3 ? argv[3] : defaultOutput(argv[1]);
+  FILE* out = fopen(outPath.c_str(), "wb");
+  if (out == nullptr) {
+    fprintf(stderr, "%s: 書き込めません\n", outPath.c_str());
+    return 2;
+  }
+  uint32_t expected = 0;
+  uint32_t missing = 0;
+  uint32_t duplicates = 0;
+  uint64_t bytes = 0;
+  bool first = true;
+  for (const Block& b : blocks) {
+    if (!first && b.seq < expected) {
+      duplicates++;
+      continue;
+    }
+    if (b.seq > expected) {
+      fprintf(stderr, "ブロック %u..%u が欠けています\n", expected, b.seq - 1);
+      missing += b.seq - expected;
+    }
+    fwrite(b.payload.data(), 1, b.payload.size(), out);
+    bytes += b.payload.size();
+    expected = b.seq + 1;
+    first = false;
+  }
+  fclose(out);
+
+  printf("%s: blocks=%u bytes=%llu missing=%u duplicates=%u bad_crc=%u\n", outPath.c_str(), expected - missing, static_cast<unsigned long long>(bytes),
+         missing, duplicates, badCrc);
+  return (missing == 0 && badCrc == 0 && badHeader == 0 && torn == 0) ? 0 : 1;
+}
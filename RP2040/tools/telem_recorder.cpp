@@ -0,0 +1,646 @@
+/**
+ * @file telem_recorder.cpp
+ * @brief 地上でテレメトリを記録し、回収したカードのログと突き合わせるホストツール
+ * @details
+ * テレメトリはリアルタイムに届くが欠ける。カードのログは欠けないが、機体を回収するまで読めず、
+ * 墜落の直前や壊れた所は残らないことがある。ロガーは各ブロックチャンクに通し番号
+ * (RiceChunkHeader::sequence) を付け、同じチャンクをテレメトリ (link_protocol.h の
+ * LINK_FRAME_TELEMETRY) でも送るので、両方を通し番号で突き合わせられる。
+ * - record: シリアルポート (または標準入力) のフレームからチャンクを組み立て、CRC を確かめてファイルへ足していく。
+ *   書いたファイルは format=rice のログと同じ形式なので、logtail や rice2csv でそのまま読める
+ * - merge: カードのログとテレメトリの記録を通し番号の順に1回ずつたどって1本のログにまとめ、
+ *   通し番号の範囲ごとにどちらから取ったか (both / card / telemetry) と、どちらにも無い範囲 (missing) を出す。
+ *   どちらのファイルも 64 KiB ずつ読むだけなので、費用はブロック数に比例し、メモリはファイルの大きさによらない
+ *
+ * 両方にあるブロックはカードの方を使う (中身が食い違えば mismatch として数える)。
+ * テキストのチャンク (設定行など) はカードのものだけを、カードでの位置のまま出す。
+ * 通し番号が戻ったブロック (テレメトリの順序の入れ替わりや重複) は使わずに数えるだけにする。
+ * 通し番号はファイルごとに 0 から始まるので、カードのファイルと、そのファイルを書いていた間の記録を渡すこと。
+ *
+ * ビルド: g++ -O2 -std=c++17 -o telem_recorder telem_recorder.cpp
+ * 使い方:
+ *   telem_recorder record <ポート|-> <記録ファイル> [ボーレート=115200]
+ *   telem_recorder merge <カードのログ> <記録ファイル> [出力=merged.bin] [-v]
+ *   telem_recorder --selftest
+ */
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "logreader.h"
+#include "../link_protocol.h"
+
+namespace {
+
+volatile std::sig_atomic_t g_stop = 0;
+
+void onSignal(int) { g_stop = 1; }
+
+//================================================
+//== 記録
+//================================================
+
+speed_t baudToSpeed(unsigned long baud) {
+  switch (baud) {
+  case 9600: return B9600;
+  case 19200: return B19200;
+  case 38400: return B38400;
+  case 57600: return B57600;
+  case 230400: return B230400;
+#ifdef B460800
+  case 460800: return B460800;
+#endif
+#ifdef B921600
+  case 921600: return B921600;
+#endif
+  default: return B115200;
+  }
+}
+
+/** @brief 組み立てたチャンクがログのチャンクとして正しいか (マジック、長さ、CRC) */
+bool chunkValid(const uint8_t* data, size_t len) {
+  if (len < sizeof(RiceChunkHeader)) {
+    return false;
+  }
+  RiceChunkHeader h;
+  memcpy(&h, data, sizeof(h));
+  return h.magic == RICE_CHUNK_MAGIC && sizeof(h) + h.payloadBytes == len &&
+         h.crc16 == riceCrc16(data + sizeof(h), h.payloadBytes);
+}
+
+/** @brief フレームを受けてチャンクを組み立てる。record と自己試験で共用する */
+class TelemetryReceiver {
+public:
+  /** @brief 受けたバイトを渡す。正しいチャンクごとに onChunk(data, len) を呼ぶ */
+  template <class Fn>
+  void feed(const uint8_t* data, size_t len, Fn&& onChunk) {
+    _parser.feed(data, len, [&](LinkFrameType type, uint16_t, const uint8_t* payload, size_t n) {
+      if (type != LINK_FRAME_TELEMETRY) {
+        return;
+      }
+      _assembler.add(payload, n, [&](const uint8_t* chunk, size_t chunkLen) {
+        if (chunkValid(chunk, chunkLen)) {
+          _chunks++;
+          onChunk(chunk, chunkLen);
+        } else {
+          _invalid++;
+        }
+      });
+    });
+  }
+
+  void print(FILE* out) const {
+    const LinkStats& s = _parser.stats();
+    const LinkTelemetryStats& t = _assembler.stats();
+    fprintf(out, "bytes=%llu frames=%u lost_frames=%u crc_errors=%u chunks=%u dropped_chunks=%u invalid_chunks=%u\n",
+            static_cast<unsigned long long>(s.bytes), s.frames, s.lostFrames, s.crcErrors, _chunks, t.dropped, _invalid);
+  }
+
+  uint32_t chunks() const { return _chunks; }
+
+private:
+  LinkParser _parser;
+  LinkTelemetryAssembler _assembler;
+  uint32_t _chunks = 0;
+  uint32_t _invalid = 0;
+};
+
+int record(const char* port, const char* path, unsigned long baud) {
+  int fd = 0;
+  if (strcmp(port, "-") != 0) {
+    fd = open(port, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+      fprintf(stderr, "%s を開けない (%s)\n", port, strerror(errno));
+      return 2;
+    }
+    termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    cfsetspeed(&tio, baudToSpeed(baud));
+    tio.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(fd, TCSANOW, &tio);
+    tcflush(fd, TCIFLUSH);
+  }
+  // 途中で止まっても前回までの分を失わないよう、追記で開く
+  FILE* out = fopen(path, "ab");
+  if (out == nullptr) {
+    fprintf(stderr, "%s を開けない (%s)\n", path, strerror(errno));
+    return 2;
+  }
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  TelemetryReceiver rx;
+  uint8_t buf[4096];
+  auto lastReport = std::chrono::steady_clock::now();
+  while (!g_stop) {
+    pollfd p = {fd, POLLIN, 0};
+    if (poll(&p, 1, 200) < 0) {
+      break;
+    }
+    if (p.revents != 0) {
+      const ssize_t n = read(fd, buf, sizeof(buf));
+      if (n <= 0) {
+        break; // 標準入力の終わり、またはポートが外れた
+      }
+      rx.feed(buf, static_cast<size_t>(n), [&](const uint8_t* chunk, size_t len) { fwrite(chunk, 1, len, out); });
+      fflush(out); // 地上局が落ちても、受けた分はファイルに残す
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (now - lastReport >= std::chrono::seconds(1)) {
+      lastReport = now;
+      rx.print(stderr);
+    }
+  }
+  fclose(out);
+  if (fd > 0) {
+    close(fd);
+  }
+  rx.print(stderr);
+  return 0;
+}
+
+//================================================
+//== 突き合わせ
+//================================================
+
+/** @brief 16ビットの通し番号を64ビットに展開する (直前から ±32767 以内の変化とみなす) */
+class SeqUnwrap {
+public:
+  uint64_t unwrap(uint16_t s) {
+    if (!_have) {
+      _have = true;
+      _last = s;
+      return s;
+    }
+    const int16_t d = static_cast<int16_t>(static_cast<uint16_t>(s - static_cast<uint16_t>(_last)));
+    if (d < 0 && static_cast<uint64_t>(-d) > _last) {
+      return 0; // 最初より前には戻れない
+    }
+    const uint64_t v = _last + d;
+    if (v > _last) {
+      _last = v;
+    }
+    return v;
+  }
+
+private:
+  uint64_t _last = 0;
+  bool _have = false;
+};
+
+/** @brief ファイルからブロックチャンクを1つずつ取り出す。読むのは 64 KiB ずつ */
+class BlockSource {
+public:
+  struct Block {
+    RiceChunkHeader header;
+    uint64_t seq;
+    std::vector<uint8_t> bytes; ///< ヘッダーを含むチャンク全体
+  };
+
+  explicit BlockSource(FILE* f) : _f(f) {}
+
+  /**
+   * @brief 次のブロックを返す。途中のテキストのチャンクは onText(data, len) に渡す
+   * @return ブロックが無くなれば false
+   */
+  template <class OnText>
+  bool next(Block& out, OnText&& onText) {
+    for (;;) {
+      while (_pos < _queue.size()) {
+        Item& item = _queue[_pos++];
+        RiceChunkHeader h;
+        memcpy(&h, item.bytes.data(), sizeof(h));
+        if (h.type != RICE_CHUNK_BLOCK) {
+          _texts++;
+          onText(item.bytes.data(), item.bytes.size());
+          continue;
+        }
+        out.header = h;
+        out.seq = _unwrap.unwrap(h.sequence);
+        out.bytes.swap(item.bytes);
+        return true;
+      }
+      if (!refill()) {
+        return false;
+      }
+    }
+  }
+
+  size_t skippedBytes() const { return _decoder.skippedBytes(); }
+  size_t crcErrors() const { return _decoder.crcErrors(); }
+  /** @brief 末尾で途切れたチャンクのバイト数 (読み終えてから) */
+  size_t tornBytes() const { return _eof ? _decoder.pendingBytes() : 0; }
+  uint64_t texts() const { return _texts; }
+
+private:
+  struct Item {
+    std::vector<uint8_t> bytes;
+  };
+
+  bool refill() {
+    _queue.clear();
+    _pos = 0;
+    uint8_t buf[65536];
+    while (_queue.empty() && !_eof) {
+      const size_t n = fread(buf, 1, sizeof(buf), _f);
+      if (n == 0) {
+        _eof = true;
+        break;
+      }
+      _decoder.feed(buf, n, [&](const LogChunk& c) {
+        Item item;
+        item.bytes.resize(sizeof(RiceChunkHeader) + c.header.payloadBytes);
+        memcpy(item.bytes.data(), &c.header, sizeof(RiceChunkHeader));
+        memcpy(item.bytes.data() + sizeof(RiceChunkHeader), c.payload, c.header.payloadBytes);
+        _queue.push_back(std::move(item));
+      });
+    }
+    return !_queue.empty();
+  }
+
+  FILE* _f;
+  LogStreamDecoder _decoder;
+  SeqUnwrap _unwrap;
+  std::vector<Item> _queue;
+  size_t _pos = 0;
+  bool _eof = false;
+  uint64_t _texts = 0;
+};
+
+enum BlockOrigin { ORIGIN_BOTH, ORIGIN_CARD, ORIGIN_TELEMETRY, ORIGIN_MISSING };
+const char* const kOriginNames[] = {"both", "card", "telemetry", "missing"};
+
+struct MergeResult {
+  uint64_t blocks[4];   ///< 由来ごとのブロック数 (BlockOrigin の順)
+  uint64_t mismatches;  ///< 両方にあって中身が食い違ったブロック
+  uint64_t stale[2];    ///< 通し番号が戻って使わなかったブロック (カード、テレメトリ)
+  uint64_t lastSeq;     ///< 最後の通し番号 + 1
+  double seconds;
+};
+
+/**
+ * @brief 2つのブロック列を通し番号の順に1回ずつたどってまとめる
+ * @param onRange 由来の同じ範囲ごとに onRange(origin, first, last)
+ * @param onBlock ブロックごとに onBlock(origin, seq, header)。missing では header は nullptr
+ */
+template <class OnRange, class OnBlock>
+MergeResult mergeLogs(BlockSource& card, BlockSource& telem, FILE* out, OnRange&& onRange, OnBlock&& onBlock) {
+  const auto t0 = std::chrono::steady_clock::now();
+  MergeResult r = {};
+  auto writeText = [&](const uint8_t* data, size_t len) {
+    if (out != nullptr) {
+      fwrite(data, 1, len, out);
+    }
+  };
+  auto dropText = [](const uint8_t*, size_t) {};
+
+  BlockSource::Block a, b;
+  bool haveA = card.next(a, writeText);
+  bool haveB = telem.next(b, dropText);
+  uint64_t expected = 0;
+  int runOrigin = -1;
+  uint64_t runFirst = 0;
+  auto note = [&](BlockOrigin origin, uint64_t seq) {
+    if (runOrigin != static_cast<int>(origin)) {
+      if (runOrigin >= 0) {
+        onRange(static_cast<BlockOrigin>(runOrigin), runFirst, seq - 1);
+      }
+      runOrigin = origin;
+      runFirst = seq;
+    }
+  };
+
+  while (haveA || haveB) {
+    // 通し番号が戻ったものは使わない
+    if (haveA && a.seq < expected) {
+      r.stale[0]++;
+      haveA = card.next(a, writeText);
+      continue;
+    }
+    if (haveB && b.seq < expected) {
+      r.stale[1]++;
+      haveB = telem.next(b, dropText);
+      continue;
+    }
+    BlockOrigin origin;
+    const BlockSource::Block* use;
+    if (haveA && haveB && a.seq == b.seq) {
+      origin = ORIGIN_BOTH;
+      use = &a;
+      if (a.bytes != b.bytes) {
+        r.mismatches++;
+      }
+    } else if (haveA && (!haveB || a.seq < b.seq)) {
+      origin = ORIGIN_CARD;
+      use = &a;
+    } else {
+      origin = ORIGIN_TELEMETRY;
+      use = &b;
+    }
+    if (use->seq > expected) {
+      note(ORIGIN_MISSING, expected);
+      r.blocks[ORIGIN_MISSING] += use->seq - expected;
+      for (uint64_t s = expected; s < use->seq; s++) {
+        onBlock(ORIGIN_MISSING, s, static_cast<const RiceChunkHeader*>(nullptr));
+      }
+    }
+    note(origin, use->seq);
+    r.blocks[origin]++;
+    onBlock(origin, use->seq, &use->header);
+    if (out != nullptr) {
+      fwrite(use->bytes.data(), 1, use->bytes.size(), out);
+    }
+    expected = use->seq + 1;
+    if (origin != ORIGIN_TELEMETRY) {
+      haveA = card.next(a, writeText);
+    }
+    if (origin != ORIGIN_CARD) {
+      haveB = telem.next(b, dropText);
+    }
+  }
+  if (runOrigin >= 0) {
+    onRange(static_cast<BlockOrigin>(runOrigin), runFirst, expected - 1);
+  }
+  r.lastSeq = expected;
+  r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  return r;
+}
+
+void printSourceStats(const char* name, const BlockSource& s) {
+  printf("# %s: skipped_bytes=%zu crc_errors=%zu torn_bytes=%zu text_chunks=%llu\n", name, s.skippedBytes(), s.crcErrors(),
+         s.tornBytes(), static_cast<unsigned long long>(s.texts()));
+}
+
+void printSummary(const MergeResult& r) {
+  printf("# blocks=%llu both=%llu card=%llu telemetry=%llu missing=%llu mismatch=%llu stale_card=%llu stale_telemetry=%llu\n",
+         static_cast<unsigned long long>(r.lastSeq), static_cast<unsigned long long>(r.blocks[ORIGIN_BOTH]),
+         static_cast<unsigned long long>(r.blocks[ORIGIN_CARD]), static_cast<unsigned long long>(r.blocks[ORIGIN_TELEMETRY]),
+         static_cast<unsigned long long>(r.blocks[ORIGIN_MISSING]), static_cast<unsigned long long>(r.mismatches),
+         static_cast<unsigned long long>(r.stale[0]), static_cast<unsigned long long>(r.stale[1]));
+}
+
+int merge(const char* cardPath, const char* telemPath, const char* outPath, bool verbose) {
+  FILE* cf = fopen(cardPath, "rb");
+  FILE* tf = fopen(telemPath, "rb");
+  if (cf == nullptr || tf == nullptr) {
+    fprintf(stderr, "%s を開けない\n", cf == nullptr ? cardPath : telemPath);
+    return 2;
+  }
+  FILE* out = fopen(outPath, "wb");
+  if (out == nullptr) {
+    fprintf(stderr, "%s を開けない (%s)\n", outPath, strerror(errno));
+    return 2;
+  }
+  BlockSource card(cf), telem(tf);
+  printf("# origin first_seq last_seq blocks\n");
+  const MergeResult r = mergeLogs(
+      card, telem, out,
+      [](BlockOrigin origin, uint64_t first, uint64_t last) {
+        printf("%s %llu %llu %llu\n", kOriginNames[origin], static_cast<unsigned long long>(first),
+               static_cast<unsigned long long>(last), static_cast<unsigned long long>(last - first + 1));
+      },
+      [verbose](BlockOrigin origin, uint64_t seq, const RiceChunkHeader* h) {
+        if (!verbose) {
+          return;
+        }
+        if (h == nullptr) {
+          printf("  %llu %s\n", static_cast<unsigned long long>(seq), kOriginNames[origin]);
+        } else {
+          printf("  %llu %s ch=%u first_index=%lu count=%u\n", static_cast<unsigned long long>(seq), kOriginNames[origin],
+                 h->channel, static_cast<unsigned long>(h->firstIndex), h->count);
+        }
+      });
+  fclose(out);
+  fclose(cf);
+  fclose(tf);
+  printSourceStats("card", card);
+  printSourceStats("telemetry", telem);
+  printSummary(r);
+  return r.blocks[ORIGIN_MISSING] == 0 ? 0 : 1;
+}
+
+//================================================
+//== 自己試験
+//================================================
+
+/** @brief 書き込み器の出力をメモリに溜め、チャンクの区切りも覚える */
+struct ChunkSink {
+  std::vector<uint8_t> data;
+  std::vector<size_t> ends;
+  size_t reserved = 0;
+  uint8_t* reserve(size_t maxBytes) {
+    reserved = data.size();
+    data.resize(reserved + maxBytes);
+    return data.data() + reserved;
+  }
+  void commit(size_t bytes) {
+    data.resize(reserved + bytes);
+    ends.push_back(data.size());
+  }
+};
+
+FILE* memoryFile(const std::vector<uint8_t>& bytes) {
+  FILE* f = tmpfile();
+  fwrite(bytes.data(), 1, bytes.size(), f);
+  rewind(f);
+  return f;
+}
+
+/** @brief 1回の試験。カードは途中を壊して末尾を切り、テレメトリは回線で欠けさせる */
+bool selftestRun(uint32_t samples, bool report, std::mt19937& rng) {
+  // ロガーと同じく、時刻と3チャンネルを書き、定期フラッシュで区切る
+  ChunkSink sink;
+  RiceLogWriter<ChunkSink> writer(sink);
+  const uint16_t steps[4] = {1, 1, 1, 4};
+  writer.begin(4, steps);
+  const char head[] = "# ch1_hz=1000\n# ch2_hz=1000\n# ch3_hz=250\ntimestamp_ms,a,b,c\n";
+  writer.addText(head, sizeof(head) - 1);
+  writer.flush();
+  for (uint32_t i = 0; i < samples; i++) {
+    writer.addSample(0, i, static_cast<int32_t>(i));
+    writer.addSample(1, i, static_cast<int32_t>(1000 * sin(i * 0.01)));
+    writer.addSample(2, i, static_cast<int32_t>(rng() % 64));
+    if (i % 4 == 0) {
+      writer.addSample(3, i, static_cast<int32_t>(i / 4));
+    }
+    if (i % 5000 == 4999) {
+      writer.flush();
+    }
+  }
+  writer.flush();
+  const uint64_t totalBlocks = writer.stats().blocks;
+
+  // 元のブロックを通し番号の順に並べる (正解)
+  std::vector<std::vector<uint8_t>> original;
+  std::vector<size_t> chunkStart;
+  for (size_t k = 0, start = 0; k < sink.ends.size(); start = sink.ends[k++]) {
+    chunkStart.push_back(start);
+    RiceChunkHeader h;
+    memcpy(&h, sink.data.data() + start, sizeof(h));
+    if (h.type == RICE_CHUNK_BLOCK) {
+      original.emplace_back(sink.data.begin() + start, sink.data.begin() + sink.ends[k]);
+    }
+  }
+
+  // カード: 途中の 1% を壊し、末尾の 3% を失う (墜落)
+  std::vector<uint8_t> cardBytes = sink.data;
+  const size_t badFrom = cardBytes.size() * 40 / 100;
+  const size_t badLen = cardBytes.size() / 100;
+  for (size_t i = badFrom; i < badFrom + badLen; i++) {
+    cardBytes[i] ^= static_cast<uint8_t>(rng() | 1);
+  }
+  cardBytes.resize(cardBytes.size() * 97 / 100);
+
+  // テレメトリ: チャンクを断片に分け、フレームの 5% を落とし、1e-5 のバイトを化けさせる。
+  // 全体の 60～62% の間は電波が途切れる (カードの壊れた所と重ならない)
+  std::vector<uint8_t> wire;
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  uint16_t frameSeq = 0;
+  const size_t outageFrom = sink.ends.size() * 60 / 100;
+  const size_t outageTo = sink.ends.size() * 62 / 100;
+  for (size_t k = 0; k < sink.ends.size(); k++) {
+    const bool outage = k >= outageFrom && k < outageTo;
+    frameSeq = linkSendTelemetry(sink.data.data() + chunkStart[k], sink.ends[k] - chunkStart[k], frameSeq,
+                                 [&](const uint8_t* frame, size_t len) {
+                                   if (outage || u(rng) < 0.05) {
+                                     return;
+                                   }
+                                   for (size_t i = 0; i < len; i++) {
+                                     wire.push_back(u(rng) < 1e-5 ? static_cast<uint8_t>(frame[i] ^ 0x10) : frame[i]);
+                                   }
+                                 });
+  }
+  TelemetryReceiver rx;
+  std::vector<uint8_t> telemBytes;
+  for (size_t pos = 0; pos < wire.size(); pos += 1000) {
+    const size_t n = std::min<size_t>(1000, wire.size() - pos);
+    rx.feed(wire.data() + pos, n,
+            [&](const uint8_t* chunk, size_t len) { telemBytes.insert(telemBytes.end(), chunk, chunk + len); });
+  }
+
+  // 正解の由来: 各ファイルを丸ごと読んで、残った通し番号を集める
+  auto seqsOf = [](const std::vector<uint8_t>& bytes) {
+    std::set<uint64_t> s;
+    LogChunkReader reader(bytes.data(), bytes.size());
+    LogChunk c;
+    SeqUnwrap unwrap;
+    while (reader.next(c)) {
+      if (c.header.type == RICE_CHUNK_BLOCK) {
+        s.insert(unwrap.unwrap(c.header.sequence));
+      }
+    }
+    return s;
+  };
+  const std::set<uint64_t> inCard = seqsOf(cardBytes);
+  const std::set<uint64_t> inTelem = seqsOf(telemBytes);
+
+  FILE* cf = memoryFile(cardBytes);
+  FILE* tf = memoryFile(telemBytes);
+  FILE* out = tmpfile();
+  BlockSource card(cf), telem(tf);
+  uint64_t wrongOrigin = 0;
+  uint64_t ranges = 0;
+  const MergeResult r = mergeLogs(
+      card, telem, out, [&](BlockOrigin, uint64_t, uint64_t) { ranges++; },
+      [&](BlockOrigin origin, uint64_t seq, const RiceChunkHeader*) {
+        const bool c = inCard.count(seq) != 0;
+        const bool t = inTelem.count(seq) != 0;
+        const BlockOrigin want = c && t ? ORIGIN_BOTH : c ? ORIGIN_CARD : t ? ORIGIN_TELEMETRY : ORIGIN_MISSING;
+        wrongOrigin += origin != want;
+      });
+
+  // まとめたログのブロックは、元のブロックと1バイトも違わないはず
+  std::vector<uint8_t> merged(static_cast<size_t>(ftell(out)));
+  rewind(out);
+  const bool readOk = fread(merged.data(), 1, merged.size(), out) == merged.size();
+  fclose(out);
+  fclose(cf);
+  fclose(tf);
+  uint64_t wrongBytes = 0;
+  uint64_t mergedBlocks = 0;
+  uint64_t mergedTexts = 0;
+  LogChunkReader reader(merged.data(), merged.size());
+  LogChunk c;
+  SeqUnwrap unwrap;
+  while (reader.next(c)) {
+    if (c.header.type != RICE_CHUNK_BLOCK) {
+      mergedTexts++;
+      continue;
+    }
+    const uint64_t seq = unwrap.unwrap(c.header.sequence);
+    const size_t len = sizeof(RiceChunkHeader) + c.header.payloadBytes;
+    mergedBlocks++;
+    if (seq >= original.size() || original[seq].size() != len ||
+        memcmp(original[seq].data(), merged.data() + c.offset, len) != 0) {
+      wrongBytes++;
+    }
+  }
+
+  const bool pass = readOk && wrongOrigin == 0 && wrongBytes == 0 && r.mismatches == 0 && r.stale[0] == 0 &&
+                    r.stale[1] == 0 && mergedBlocks == r.lastSeq - r.blocks[ORIGIN_MISSING] && mergedTexts > 0 &&
+                    r.lastSeq <= totalBlocks && r.blocks[ORIGIN_TELEMETRY] > 0 && r.blocks[ORIGIN_CARD] > 0;
+  if (report) {
+    rx.print(stdout);
+    printSourceStats("card", card);
+    printSourceStats("telemetry", telem);
+    printSummary(r);
+    printf("# written=%llu ranges=%llu wrong_origin=%llu wrong_bytes=%llu\n", static_cast<unsigned long long>(totalBlocks),
+           static_cast<unsigned long long>(ranges), static_cast<unsigned long long>(wrongOrigin),
+           static_cast<unsigned long long>(wrongBytes));
+  }
+  printf("samples=%u blocks=%llu merge=%.1f ms (%.0f ns/block) %s\n", samples, static_cast<unsigned long long>(r.lastSeq),
+         r.seconds * 1e3, r.seconds * 1e9 / static_cast<double>(r.lastSeq ? r.lastSeq : 1), pass ? "ok" : "NG");
+  return pass;
+}
+
+int selftest() {
+  std::mt19937 rng(1);
+  bool pass = selftestRun(1000000, true, rng);
+  // 費用がブロック数に比例することを、大きさを変えて確かめる
+  pass = selftestRun(4000000, false, rng) && pass;
+  pass = selftestRun(16000000, false, rng) && pass;
+  printf("%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--selftest") == 0) {
+    return selftest();
+  }
+  if (argc >= 4 && strcmp(argv[1], "record") == 0) {
+    return record(argv[2], argv[3], argc >= 5 ? strtoul(argv[4], nullptr, 10) : 115200);
+  }
+  if (argc >= 4 && strcmp(argv[1], "merge") == 0) {
+    const char* outPath = "merged.bin";
+    bool verbose = false;
+    for (int i = 4; i < argc; i++) {
+      if (strcmp(argv[i], "-v") == 0) {
+        verbose = true;
+      } else {
+        outPath = argv[i];
+      }
+    }
+    return merge(argv[2], argv[3], outPath, verbose);
+  }
+  fprintf(stderr,
+          "usage: telem_recorder record <port|-> <telemetry.bin> [baud]\n"
+          "       telem_recorder merge <card.bin> <telemetry.bin> [out.bin] [-v]\n"
+          "       telem_recorder --selftest\n");
+  return 2;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file trace2json.cpp
+ * @brief event_trace.h のバイナリダンプを Chrome/Perfetto の Trace Event JSON に変換するホストツール
+ * @details
+ * 入力はSDカード上の .trc ファイル、またはUSBシリアルをそのまま保存したキャプチャ。
+ * キャプチャにはテキストのログが混ざるため、先頭からマジック "TRC1" を探して読み始める。
+ * 出力JSONは chrome://tracing または https://ui.perfetto.dev でそのまま開ける。
+ *
+ * ビルド: g++ -O2 -std=c++17 -o trace2json trace2json.cpp
+ * 使い方: trace2json <input.trc|capture.bin> [output.json]
+ */
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "../event_trace.h"
+
+/**
+ * @brief バッファ中のダンプ先頭位置を探す
+ * @return 見つからなければ -1
+ */
+static long findDump(const std::vector<uint8_t>& data) {
+  const uint32_t magic = TRACE_DUMP_MAGIC;
+  for (size_t i = 0; i + sizeof(TraceDumpHeader) <= data.size(); i++) {
+    if (memcmp(&data[i], &magic, sizeof(magic)) == 0) {
+      return static_cast<long>(i);
+    }
+  }
+  return -1;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <input.trc|capture.bin> [output.json]\n", argv[0]);
+    return 1;
+  }
+
+  FILE* in = fopen(argv[1], "rb");
+  if (!in) {
+    perror(argv[1]);
+    return 1;
+  }
+  std::vector<uint8_t> data;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+    data.insert(data.end(), chunk, chunk + n);
+  }
+  fclose(in);
+
+  long pos = findDump(data);
+  if (pos < 0) {
+    fprintf(stderr, "error: trace dump magic not found\n");
+    return 1;
+  }
+  TraceDumpHeader header;
+  memcpy(&header, &data[pos], sizeof(header));
+  if (header.version != TRACE_DUMP_VERSION || header.recordSize != sizeof(TraceRecord)) {
+    fprintf(stderr, "error: unsupported dump version %u (record size %u)\n", header.version, header.recordSize);
+    return 1;
+  }
+  size_t offset = pos + sizeof(header);
+  // コア数はファイルの値なので、確保する前に上限と残りのバイト数で確かめる
+  if (header.coreCount == 0 || header.coreCount > TRACE_CORE_COUNT) {
+    fprintf(stderr, "error: bad core count %u\n", header.coreCount);
+    return 1;
+  }
+  if (offset + static_cast<size_t>(header.coreCount) * sizeof(TraceCoreHeader) > data.size()) {
+    fprintf(stderr, "error: truncated dump\n");
+    return 1;
+  }
+  std::vector<TraceCoreHeader> cores(header.coreCount);
+  memcpy(cores.data(), &data[offset], cores.size() * sizeof(TraceCoreHeader));
+  offset += cores.size() * sizeof(TraceCoreHeader);
+
+  FILE* out = argc >= 3 ? fopen(argv[2], "w") : stdout;
+  if (!out) {
+    perror(argv[2]);
+    return 1;
+  }
+
+  // 各コアのタイムスタンプは 32bit µs で約71分で折り返すため、古い順に展開して64bitに伸ばす。
+  // 両コアとも同じハードウェアタイマーを読んでいるので、最初のレコードの最小値を共通の原点にする
+  uint32_t origin = 0;
+  bool haveOrigin = false;
+  size_t scan = offset;
+  for (const TraceCoreHeader& ch : cores) {
+    if (ch.count > 0 && scan + sizeof(TraceRecord) <= data.size()) {
+      TraceRecord r;
+      memcpy(&r, &data[scan], sizeof(r));
+      if (!haveOrigin || static_cast<int32_t>(r.timestampUs - origin) < 0) {
+        origin = r.timestampUs;
+        haveOrigin = true;
+      }
+    }
+    scan += static_cast<size_t>(ch.count) * sizeof(TraceRecord);
+  }
+
+  fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  bool first = true;
+  for (size_t core = 0; core < cores.size(); core++) {
+    fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"core%zu\"}}",
+            first ? "" : ",\n", core, core);
+    first = false;
+    if (cores[core].dropped > 0) {
+      fprintf(stderr, "core%zu: %u records dropped\n", core, cores[core].dropped);
+    }
+
+    uint64_t base = 0;
+    uint32_t prev = origin;
+    for (uint32_t i = 0; i < cores[core].count; i++) {
+      if (offset + sizeof(TraceRecord) > data.size()) {
+        fprintf(stderr, "warning: dump truncated at core%zu record %u\n", core, i);
+        break;
+      }
+      TraceRecord r;
+      memcpy(&r, &data[offset], sizeof(r));
+      offset += sizeof(r);
+
+      base += static_cast<uint32_t>(r.timestampUs - prev);
+      prev = r.timestampUs;
+
+      const char* ph = r.phase == TRACE_PH_BEGIN ? "B" : r.phase == TRACE_PH_END ? "E" : "i";
+      fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%llu,\"pid\":1,\"tid\":%zu",
+              traceEventName(r.eventId), ph, static_cast<unsigned long long>(base), core);
+      if (r.phase == TRACE_PH_INSTANT) {
+        fprintf(out, ",\"s\":\"t\"");
+      }
+      if (r.phase != TRACE_PH_END) {
+        fprintf(out, ",\"args\":{\"arg\":%u}", r.arg);
+      }
+      fprintf(out, "}");
+    }
+  }
+  fprintf(out, "\n]}\n");
+
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
@@ -0,0 +1,202 @@
+/**
+ * @file uart_link.h
+ * @brief サテライト基板からのレコードをUARTとDMAで受け取るリンクですわ
+ * @details
+ * 受信はDMAがUARTのデータレジスタからRAM上のリングバッファへ流し込みますので、
+ * 1 Mbaud でもバイトごとの割り込みは起きませんの。loop() から poll() を呼ぶたびに、
+ * 新しく届いたバイトを link_protocol.h のパーサーに渡してフレームを取り出しますわ。
+ *
+ * poll() は一定間隔で PING を送り、PONG から時計のオフセットとドリフトを推定して、
+ * レコードの時刻をロガーの時間軸 (time_us_64) へ換算してから渡しますの。
+ * 最初の PONG が届くまでは換算できないので、そのレコードは数えて読み捨てますわ。
+ */
+#pragma once
+#include <Arduino.h>
+#include <hardware/uart.h>
+#include <hardware/dma.h>
+#include <hardware/gpio.h>
+#include <hardware/timer.h>
+#include "link_protocol.h"
+
+#define LINK_RING_BITS         11   // 受信リングは 2^11 = 2 KB。1 Mbaud で約 20 ms 分ですわ
+#define LINK_RING_BYTES        (1u << LINK_RING_BITS)
+#define LINK_PING_INTERVAL_MS  250
+// 換算した時刻が受信時刻からこの範囲を外れるレコードは、CRCをすり抜けた化けとみなしますの
+#define LINK_RECORD_MAX_AGE_US   10000000
+#define LINK_RECORD_MAX_AHEAD_US 1000000
+
+/** @brief リンク1本の統計ですわ (受信パーサーの統計に加えて) */
+struct UartLinkCounters {
+  uint32_t records;         ///< 受け取ったレコード数
+  uint32_t unsyncedRecords; ///< 時刻同期の前に届いて読み捨てたレコード数
+  uint32_t rejectedRecords; ///< 時刻がありえない範囲にあって捨てたレコード数
+  uint32_t overrunBytes;    ///< リングがあふれて失ったバイト数
+  uint32_t pings;           ///< 送った PING の数
+  uint32_t pongs;           ///< 受け取った PONG の数
+};
+
+class UartLink {
+public:
+  /**
+   * @brief UARTとDMAを設定して受信を始めますわ
+   * @return DMAチャンネルが足りなければ false
+   */
+  bool begin(uart_inst_t* uart, uint txPin, uint rxPin, uint32_t baud) {
+    int dma = dma_claim_unused_channel(false);
+    if (dma < 0) {
+      return false;
+    }
+    _uart = uart;
+    _dma = static_cast<uint>(dma);
+    _baud = uart_init(_uart, baud); // 実際に設定できたボーレートが返りますの
+    gpio_set_function(txPin, GPIO_FUNC_UART);
+    gpio_set_function(rxPin, GPIO_FUNC_UART);
+    uart_set_fifo_enabled(_uart, true);
+
+    // UARTのデータレジスタからリングへ。書き込み側のアドレスを 2^LINK_RING_BITS で折り返しますの
+    dma_channel_config cfg = dma_channel_get_default_config(_dma);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_8);
+    channel_config_set_read_increment(&cfg, false);
+    channel_config_set_write_increment(&cfg, true);
+    channel_config_set_ring(&cfg, true, LINK_RING_BITS);
+    channel_config_set_dreq(&cfg, uart_get_dreq(_uart, false));
+    dma_channel_configure(_dma, &cfg, _ring, &uart_get_hw(_uart)->dr, kTransferCount, true);
+
+    _readCount = 0;
+    _ringBase = 0;
+    _active = true;
+    _lastPingMs = millis() - LINK_PING_INTERVAL_MS; // 最初の poll() ですぐに PING を送りますわ
+    _rateStartMs = millis();
+    _rateStartBytes = 0;
+    return true;
+  }
+
+  bool active() const { return _active; }
+  const LinkStats& stats() const { return _parser.stats(); }
+  const UartLinkCounters& counters() const { return _counters; }
+  const LinkClockEstimator& clock() const { return _clock; }
+
+  /**
+   * @brief 届いたバイトを処理し、必要なら PING を送りますわ
+   * @param onRecord 各レコードで呼ばれる関数 (uint64_t localUs, const LinkRecord&)
+   */
+  template <class Fn>
+  void poll(Fn&& onRecord) {
+    if (!_active) {
+      return;
+    }
+    uint32_t written = kTransferCount - dma_channel_hw_addr(_dma)->transfer_count;
+    if (written - _readCount > LINK_RING_BYTES) {
+      // 読み出しが間に合わず上書きされた分は捨てますの。パーサーは次の同期から復帰しますわ
+      _counters.overrunBytes += written - _readCount - LINK_RING_BYTES;
+      _readCount = written - LINK_RING_BYTES;
+    }
+    // リングの折り返しをまたぐ分は2回に分けて渡しますの
+    while (_readCount != written) {
+      uint32_t pos = (_ringBase + _readCount) % LINK_RING_BYTES;
+      uint32_t n = written - _readCount;
+      if (n > LINK_RING_BYTES - pos) {
+        n = LINK_RING_BYTES - pos;
+      }
+      uint64_t rxUs = time_us_64();
+      _parser.feed(_ring + pos, n, [&](LinkFrameType type, uint16_t, const uint8_t* payload, size_t len) {
+        handleFrame(type, payload, len, rxUs, onRecord);
+      });
+      _readCount += n;
+    }
+    if (kTransferCount - written < (1u << 30)) {
+      rearm();
+    }
+    if (millis() - _lastPingMs >= LINK_PING_INTERVAL_MS) {
+      _lastPingMs = millis();
+      sendPing();
+    }
+  }
+
+  /**
+   * @brief 直近の受信速度 (バイト/秒) ですわ。呼ぶたびに測定区間を新しくしますの
+   */
+  uint32_t takeBytesPerSecond() {
+    unsigned long now = millis();
+    uint64_t bytes = _parser.stats().bytes;
+    unsigned long dt = now - _rateStartMs;
+    uint32_t rate = dt > 0 ? static_cast<uint32_t>((bytes - _rateStartBytes) * 1000 / dt) : 0;
+    _rateStartMs = now;
+    _rateStartBytes = bytes;
+    return rate;
+  }
+
+private:
+  static constexpr uint32_t kTransferCount = 0xFFFFFFFFu;
+
+  template <class Fn>
+  void handleFrame(LinkFrameType type, const uint8_t* payload, size_t len, uint64_t rxUs, Fn& onRecord) {
+    if (type == LINK_FRAME_PONG && len >= 12) {
+      // t0 は自分の時計の下位32ビットですので、受信時刻を基準に展開しますわ
+      uint32_t t0Low = linkGetU32(payload);
+      uint64_t t0 = rxUs - static_cast<uint32_t>(static_cast<uint32_t>(rxUs) - t0Low);
+      uint64_t t1 = _remoteTime.peek(linkGetU32(payload + 4));
+      uint64_t t2 = _remoteTime.peek(linkGetU32(payload + 8));
+      // 受け終えた時刻を、フレームの先頭が届いた時刻にそろえますの
+      uint64_t t3 = rxUs - linkWireUs(LINK_PONG_FRAME_BYTES, _baud);
+      if (_clock.addSample(t0, t1 - linkWireUs(LINK_PING_FRAME_BYTES, _baud), t2, t3)) {
+        _remoteTime.accept(t2);
+      }
+      _counters.pongs++;
+    } else if (type == LINK_FRAME_RECORDS) {
+      for (size_t off = 0; off + LINK_RECORD_BYTES <= len; off += LINK_RECORD_BYTES) {
+        LinkRecord r = linkDecodeRecord(payload + off);
+        uint64_t remoteUs = _remoteTime.peek(r.remoteUs);
+        if (!_clock.synced()) {
+          _counters.unsyncedRecords++;
+          continue;
+        }
+        uint64_t localUs = _clock.toLocal(remoteUs);
+        if (localUs + LINK_RECORD_MAX_AGE_US < rxUs || localUs > rxUs + LINK_RECORD_MAX_AHEAD_US) {
+          _counters.rejectedRecords++;
+          continue;
+        }
+        _remoteTime.accept(remoteUs);
+        _counters.records++;
+        onRecord(localUs, r);
+      }
+    }
+  }
+
+  void sendPing() {
+    uint8_t payload[4];
+    uint8_t frame[LINK_HEADER_BYTES + sizeof(payload) + LINK_CRC_BYTES];
+    linkPutU32(payload, time_us_32());
+    size_t n = linkEncodeFrame(frame, LINK_FRAME_PING, _txSeq++, payload, sizeof(payload));
+    // 12 バイトはUARTの送信FIFO (32段) に収まるので、待たずに戻りますの
+    uart_write_blocking(_uart, frame, n);
+    _counters.pings++;
+  }
+
+  void rearm() {
+    dma_channel_abort(_dma);
+    // 中止までに書かれた分を基準位置へ繰り込み、未読の分はそのまま読めるようにしますの
+    uint32_t done = kTransferCount - dma_channel_hw_addr(_dma)->transfer_count;
+    _ringBase += done;
+    _readCount -= done;
+    dma_channel_set_write_addr(_dma, &_ring[_ringBase % LINK_RING_BYTES], false);
+    dma_channel_set_trans_count(_dma, kTransferCount, true);
+  }
+
+  // DMAのリング折り返しはバッファがサイズ境界に揃っている必要がありますの
+  alignas(LINK_RING_BYTES) uint8_t _ring[LINK_RING_BYTES];
+  uart_inst_t* _uart = nullptr;
+  uint _dma = 0;
+  uint32_t _baud = 1;
+  uint32_t _readCount = 0;
+  uint32_t _ringBase = 0;
+  bool _active = false;
+  uint16_t _txSeq = 0;
+  unsigned long _lastPingMs = 0;
+  unsigned long _rateStartMs = 0;
+  uint64_t _rateStartBytes = 0;
+  LinkParser _parser;
+  LinkTimeUnwrap _remoteTime;
+  LinkClockEstimator _clock;
+  UartLinkCounters _counters = {};
+};
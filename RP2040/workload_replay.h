@@ -0,0 +1,364 @@
+/**
+ * @file workload_replay.h
+ * @brief ロガーのI/Oパターンを再現してカードのテール遅延を測るベンチマーク
+ * @details
+ * dataLogger_microSD.cpp と同じく、一定周期でレコードをRAMバッファに溜め、
+ * バッファが一杯になったら書き込み、フラッシュ周期ごとに close/reopen (または sync) を行う。
+ * これを指定時間だけ実時間で続け、SD操作ごとの遅延を latency_histogram.h で集計する。
+ * 書き込みと確定はロガーと同じ log_storage.h の LogStorage を通すので、close_reopen は
+ * ハンドルを保ったままの確定になり、ビルド時に選んだバックエンド (storage_backend.h) がそのまま測られる。
+ *
+ * 判定は「1回のフラッシュ処理で止まっていた時間 (書き込み + close/open)」を使う。
+ * その間に溜まるデータがロガーのバッファ深さに収まれば合格とする。
+ *
+ * @code
+ * W rate=20 rec=32 buf=4096 flush=1000 policy=close_reopen dur=300 prealloc=on
+ * @endcode
+ *
+ * 結果は1行ずつ /fsbench.csv に追記する。バックエンドを変えて書き込み直したファームウェアで
+ * 同じカードに同じ条件を流せば、workloadPrintComparison() がカードと条件ごとに並べて最速のものを示す。
+ */
+#pragma once
+#include "storage_backend.h"
+#include "log_storage.h"
+#include "latency_histogram.h"
+
+#define WORKLOAD_FILE "/workload.bin"
+#define WORKLOAD_RESULTS_FILE "/fsbench.csv"
+
+/** @brief 再現するI/Oパターン */
+struct WorkloadParams {
+  uint32_t rateHz;      ///< サンプリング周波数 (rate)
+  uint32_t recordBytes; ///< 1レコードのバイト数 (rec)
+  uint32_t bufferBytes; ///< RAMバッファのバイト数 (buf)
+  uint32_t flushMs;     ///< フラッシュ周期 (flush)
+  bool closeReopen;     ///< true: close/reopen, false: flush() (policy)
+  uint32_t durationS;   ///< 実行時間 (dur)
+  bool preAllocate;     ///< 実行時間分の領域を先に確保する (prealloc=on|off)
+};
+
+/** @brief 測定結果 */
+struct WorkloadResult {
+  LatencyHistogram write;  ///< バッファを書き出す write() 1回
+  LatencyHistogram sync;   ///< close+open または flush()
+  LatencyHistogram stall;  ///< 1回のフラッシュ処理全体 (判定に使う)
+  uint32_t missedSamples;  ///< 書き込みで周期に間に合わなかったサンプル数
+  uint32_t errors;         ///< 書き込み失敗・再オープン失敗の回数
+  uint64_t bytesWritten;
+  uint32_t elapsedMs;      ///< 実際にかかった時間
+  bool preallocated;       ///< 事前割り当てができた
+  bool contiguous;         ///< ファイルが連続領域に置かれた
+};
+
+inline WorkloadParams workloadDefaults() {
+  // ロガーの既定値 (20 Hz、4 KB バッファ、1 秒ごとの close/reopen) に合わせる
+  return {20, 32, 4096, 1000, true, 300, false};
+}
+
+/**
+ * @brief "key=value" を空白で区切った文字列からパラメータを読む
+ * @return 解釈できないトークンがあれば false
+ */
+inline bool workloadParse(WorkloadParams& p, char* args) {
+  for (char* tok = strtok(args, " \t\r\n"); tok != nullptr; tok = strtok(nullptr, " \t\r\n")) {
+    char* eq = strchr(tok, '=');
+    if (eq == nullptr) {
+      return false;
+    }
+    *eq = '\0';
+    const char* value = eq + 1;
+    if (strcmp(tok, "policy") == 0) {
+      if (strcmp(value, "close_reopen") == 0) p.closeReopen = true;
+      else if (strcmp(value, "sync") == 0)    p.closeReopen = false;
+      else return false;
+      continue;
+    }
+    if (strcmp(tok, "prealloc") == 0) {
+      if (strcmp(value, "on") == 0)       p.preAllocate = true;
+      else if (strcmp(value, "off") == 0) p.preAllocate = false;
+      else return false;
+      continue;
+    }
+    uint32_t v = strtoul(value, nullptr, 10);
+    if (v == 0) {
+      return false;
+    }
+    if (strcmp(tok, "rate") == 0)       p.rateHz = v;
+    else if (strcmp(tok, "rec") == 0)   p.recordBytes = v;
+    else if (strcmp(tok, "buf") == 0)   p.bufferBytes = v;
+    else if (strcmp(tok, "flush") == 0) p.flushMs = v;
+    else if (strcmp(tok, "dur") == 0)   p.durationS = v;
+    else return false;
+  }
+  return p.recordBytes <= p.bufferBytes;
+}
+
+/**
+ * @brief ロガーのI/Oパターンを実時間で再現する
+ * @param buffer p.bufferBytes 以上のバッファ
+ * @return 中断されなければ true
+ */
+inline bool workloadRun(const WorkloadParams& p, WorkloadResult& r, uint8_t* buffer) {
+  latencyReset(r.write);
+  latencyReset(r.sync);
+  latencyReset(r.stall);
+  r.missedSamples = 0;
+  r.errors = 0;
+  r.bytesWritten = 0;
+  r.elapsedMs = 0;
+  r.preallocated = false;
+  r.contiguous = false;
+
+  storageRemove(WORKLOAD_FILE);
+  static LogStorage f;
+  if (!f.open(WORKLOAD_FILE)) {
+    Serial.println("エラー: ワークロード用ファイルを開けません");
+    return false;
+  }
+  if (p.preAllocate) {
+    uint64_t bytes = static_cast<uint64_t>(p.rateHz) * p.recordBytes * p.durationS + p.bufferBytes;
+    r.preallocated = f.preAllocate(bytes < UINT32_MAX ? static_cast<uint32_t>(bytes) : UINT32_MAX);
+    if (!r.preallocated) {
+      Serial.printf("注意: %s では事前割り当てができません (確保せずに続けます)\n", storageBackendName());
+    }
+  }
+  r.contiguous = f.file().isContiguous();
+  for (uint32_t i = 0; i < p.bufferBytes; i++) {
+    buffer[i] = static_cast<uint8_t>('0' + i % 10);
+  }
+
+  const unsigned long intervalUs = 1000000UL / p.rateHz;
+  const unsigned long startUs = micros();
+  const unsigned long endMs = millis() + p.durationS * 1000UL;
+  unsigned long nextSampleUs = startUs;
+  unsigned long lastFlushMs = millis();
+  unsigned long lastReportMs = millis();
+  size_t pending = 0;
+
+  // バッファを書き出して遅延を記録する。書き出しにかかった時間を返す
+  auto writeOut = [&]() -> uint32_t {
+    if (pending == 0) {
+      return 0;
+    }
+    unsigned long t0 = micros();
+    size_t written = f.write(buffer, pending);
+    uint32_t dt = micros() - t0;
+    latencyRecord(r.write, dt);
+    if (written != pending) {
+      r.errors++;
+    }
+    r.bytesWritten += written;
+    pending = 0;
+    return dt;
+  };
+
+  while (static_cast<long>(millis() - endMs) < 0) {
+    // 次のサンプル時刻まで待つ (ロガーの loop() と同じく、周期はマイクロ秒で管理する)
+    while (static_cast<long>(micros() - nextSampleUs) < 0) {
+    }
+    nextSampleUs += intervalUs;
+    // 書き込みで周期を1つ以上飛ばしたら、飛ばした分を数えて追いつく
+    unsigned long now = micros();
+    if (static_cast<long>(now - nextSampleUs) >= 0) {
+      uint32_t missed = (now - nextSampleUs) / intervalUs + 1;
+      r.missedSamples += missed;
+      nextSampleUs += missed * intervalUs;
+    }
+
+    if (pending + p.recordBytes > p.bufferBytes) {
+      latencyRecord(r.stall, writeOut());
+    }
+    pending += p.recordBytes;
+
+    if (millis() - lastFlushMs >= p.flushMs) {
+      lastFlushMs = millis();
+      uint32_t stall = writeOut();
+      unsigned long t0 = micros();
+      if (p.closeReopen) {
+        if (!f.reopen()) {
+          r.errors++;
+          f.close(); // 静的なハンドルを開いたまま残すと、次の再現が古いハンドルで始まる
+          Serial.println("エラー: 再オープンに失敗しました");
+          return false;
+        }
+      } else if (!f.sync()) {
+        r.errors++;
+      }
+      uint32_t dt = micros() - t0;
+      latencyRecord(r.sync, dt);
+      latencyRecord(r.stall, stall + dt);
+    }
+
+    if (millis() - lastReportMs >= 10000) {
+      lastReportMs = millis();
+      Serial.printf("  %lu 秒経過: 最大停止 %lu us, 取りこぼし %lu\n", (lastReportMs - (endMs - p.durationS * 1000UL)) / 1000,
+                    static_cast<unsigned long>(r.stall.maxUs), static_cast<unsigned long>(r.missedSamples));
+      if (Serial.available()) {
+        while (Serial.available()) {
+          Serial.read();
+        }
+        f.close();
+        Serial.println("中断しました");
+        return false;
+      }
+    }
+  }
+  writeOut();
+  f.close();
+  r.elapsedMs = millis() - (endMs - p.durationS * 1000UL);
+  storageRemove(WORKLOAD_FILE);
+  return true;
+}
+
+inline void workloadPrintRow(const char* label, const LatencyHistogram& h) {
+  Serial.printf("  %-6s %8lu %8lu %8lu %8lu %8lu\n", label, static_cast<unsigned long>(h.count),
+                static_cast<unsigned long>(latencyPercentile(h, 500)), static_cast<unsigned long>(latencyPercentile(h, 990)),
+                static_cast<unsigned long>(latencyPercentile(h, 999)), static_cast<unsigned long>(h.maxUs));
+}
+
+/**
+ * @brief 結果を表示し、バッファ深さに対する合否を判定する
+ * @return 合格なら true
+ */
+inline bool workloadPrintReport(const WorkloadParams& p, const WorkloadResult& r) {
+  // バッファが吸収できる停止時間 = バッファ深さ / データレート
+  uint64_t bytesPerSecond = static_cast<uint64_t>(p.rateHz) * p.recordBytes;
+  uint32_t budgetUs = static_cast<uint32_t>(static_cast<uint64_t>(p.bufferBytes) * 1000000ULL / bytesPerSecond);
+
+  Serial.println("===== ワークロード再現の結果 (us) =====");
+  Serial.printf("条件: rate=%lu Hz, rec=%lu B, buf=%lu B, flush=%lu ms, policy=%s, dur=%lu s\n",
+                static_cast<unsigned long>(p.rateHz), static_cast<unsigned long>(p.recordBytes),
+                static_cast<unsigned long>(p.bufferBytes), static_cast<unsigned long>(p.flushMs),
+                p.closeReopen ? "close_reopen" : "sync", static_cast<unsigned long>(p.durationS));
+  Serial.println("  操作      回数      p50      p99    p99.9      max");
+  workloadPrintRow("write", r.write);
+  workloadPrintRow("sync", r.sync);
+  workloadPrintRow("stall", r.stall);
+  Serial.printf("バックエンド: %s, 事前割り当て: %s, 連続領域: %s\n", storageBackendName(),
+                r.preallocated ? "あり" : "なし", r.contiguous ? "はい" : "いいえ");
+  Serial.printf("書き込み量: %llu KB, エラー: %lu, 取りこぼし: %lu\n", static_cast<unsigned long long>(r.bytesWritten >> 10),
+                static_cast<unsigned long>(r.errors), static_cast<unsigned long>(r.missedSamples));
+  Serial.printf("バッファが吸収できる停止時間: %lu us\n", static_cast<unsigned long>(budgetUs));
+
+  bool pass = r.errors == 0 && r.stall.maxUs < budgetUs;
+  if (pass) {
+    Serial.println("判定: 合格");
+  } else if (r.errors == 0 && latencyPercentile(r.stall, 999) < budgetUs) {
+    Serial.println("判定: 不合格 (p99.9 は収まるが、最大停止がバッファ深さを超える)");
+  } else {
+    Serial.println("判定: 不合格");
+  }
+  return pass;
+}
+
+/**
+ * @brief 結果を1行として /fsbench.csv に追記する
+ * @details カードは種類と公称容量で見分ける。同じカードに別のバックエンドで流した結果と比べるために使う。
+ */
+inline bool workloadAppendResult(const WorkloadParams& p, const WorkloadResult& r) {
+  const bool fresh = !storageExists(WORKLOAD_RESULTS_FILE);
+  StorageFile f = storageOpen(WORKLOAD_RESULTS_FILE, STORAGE_APPEND);
+  if (!f) {
+    return false;
+  }
+  if (fresh) {
+    f.println("backend,card,card_mb,rate,rec,buf,flush,policy,prealloc,contiguous,"
+              "write_p99,sync_p99,stall_p99,stall_max,missed,errors,kb_per_s");
+  }
+  const uint32_t kbPerS = r.elapsedMs > 0 ? static_cast<uint32_t>(r.bytesWritten * 1000 / 1024 / r.elapsedMs) : 0;
+  f.printf("%s,%s,%lu,%lu,%lu,%lu,%lu,%s,%d,%d,%lu,%lu,%lu,%lu,%lu,%lu,%lu\r\n", storageBackendName(), storageCardTypeName(),
+           static_cast<unsigned long>(storageCardBytes() >> 20), static_cast<unsigned long>(p.rateHz),
+           static_cast<unsigned long>(p.recordBytes), static_cast<unsigned long>(p.bufferBytes),
+           static_cast<unsigned long>(p.flushMs), p.closeReopen ? "close_reopen" : "sync", r.preallocated ? 1 : 0,
+           r.contiguous ? 1 : 0, static_cast<unsigned long>(latencyPercentile(r.write, 990)),
+           static_cast<unsigned long>(latencyPercentile(r.sync, 990)),
+           static_cast<unsigned long>(latencyPercentile(r.stall, 990)), static_cast<unsigned long>(r.stall.maxUs),
+           static_cast<unsigned long>(r.missedSamples), static_cast<unsigned long>(r.errors),
+           static_cast<unsigned long>(kbPerS));
+  f.close();
+  return true;
+}
+
+/** @brief /fsbench.csv の1行 */
+struct WorkloadBenchRow {
+  char backend[8];
+  char card[16];
+  char policy[16];
+  unsigned long cardMb, rate, rec, buf, flush, prealloc, contiguous;
+  unsigned long writeP99, syncP99, stallP99, stallMax, missed, errors, kbPerS;
+};
+
+/** @brief 同じカード・同じ条件の行か */
+inline bool workloadSameSetup(const WorkloadBenchRow& a, const WorkloadBenchRow& b) {
+  return strcmp(a.card, b.card) == 0 && a.cardMb == b.cardMb && a.rate == b.rate && a.rec == b.rec &&
+         a.buf == b.buf && a.flush == b.flush && strcmp(a.policy, b.policy) == 0;
+}
+
+/**
+ * @brief /fsbench.csv を読み、カードと条件ごとにバックエンドを並べて最速のものに印を付ける
+ * @details 最速は「エラーが無く、最大停止が最も短いもの」とする (ロガーのバッファ深さを決めるのは最大停止のため)。
+ *          最大停止が同じなら p99 の停止、さらに同じなら書き込み速度で決める。
+ */
+inline void workloadPrintComparison() {
+  StorageFile f = storageOpen(WORKLOAD_RESULTS_FILE, STORAGE_READ);
+  if (!f) {
+    Serial.println("比較できる結果がありません。'W' をバックエンドごとのファームウェアで実行してください");
+    return;
+  }
+  static WorkloadBenchRow rows[32];
+  int count = 0;
+  char line[192];
+  while (count < 32) {
+    size_t n = f.readBytesUntil('\n', line, sizeof(line) - 1);
+    if (n == 0) {
+      break;
+    }
+    line[n] = '\0';
+    WorkloadBenchRow& w = rows[count];
+    if (sscanf(line, "%7[^,],%15[^,],%lu,%lu,%lu,%lu,%lu,%15[^,],%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu", w.backend, w.card,
+               &w.cardMb, &w.rate, &w.rec, &w.buf, &w.flush, w.policy, &w.prealloc, &w.contiguous, &w.writeP99,
+               &w.syncP99, &w.stallP99, &w.stallMax, &w.missed, &w.errors, &w.kbPerS) == 17) {
+      count++; // 見出しの行は数値が読めないので飛ばされる
+    }
+  }
+  f.close();
+
+  bool printed[32] = {};
+  for (int i = 0; i < count; i++) {
+    if (printed[i]) {
+      continue;
+    }
+    const WorkloadBenchRow& key = rows[i];
+    Serial.printf("===== %s %lu MB: rate=%lu rec=%lu buf=%lu flush=%lu policy=%s =====\n", key.card, key.cardMb, key.rate,
+                  key.rec, key.buf, key.flush, key.policy);
+    int best = -1;
+    for (int j = i; j < count; j++) {
+      const WorkloadBenchRow& w = rows[j];
+      if (!workloadSameSetup(key, w) || w.errors != 0) {
+        continue;
+      }
+      if (best < 0 || w.stallMax < rows[best].stallMax ||
+          (w.stallMax == rows[best].stallMax &&
+           (w.stallP99 < rows[best].stallP99 || (w.stallP99 == rows[best].stallP99 && w.kbPerS > rows[best].kbPerS)))) {
+        best = j;
+      }
+    }
+    Serial.println("    backend  prealloc  write_p99  sync_p99  stall_p99  stall_max  missed  KB/s");
+    for (int j = i; j < count; j++) {
+      const WorkloadBenchRow& w = rows[j];
+      if (!workloadSameSetup(key, w)) {
+        continue;
+      }
+      printed[j] = true;
+      Serial.printf("  %s %-7s %-9s %9lu %9lu %10lu %10lu %7lu %5lu%s\n", j == best ? "*" : " ", w.backend,
+                    w.prealloc ? (w.contiguous ? "on/contig" : "on") : "off", w.writeP99, w.syncP99, w.stallP99,
+                    w.stallMax, w.missed, w.kbPerS, w.errors != 0 ? " (エラーあり)" : "");
+    }
+    if (best >= 0) {
+      Serial.printf("  最速: %s%s\n", rows[best].backend, rows[best].prealloc ? " (prealloc=on)" : "");
+    }
+  }
+  if (count == 32) {
+    Serial.println("(先頭の 32 件だけを比べました)");
+  }
+}
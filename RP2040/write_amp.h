@@ -0,0 +1,169 @@
+/**
+ * @file write_amp.h
+ * @brief 論理的な書き込み量と、カードへの物理的なセクタ書き込みを分類して数えますわ
+ * @details
+ * SD.h はカードへのセクタ書き込みを外から覗けませんので、保存層が行った操作
+ * (追記・sync・close) から、SdFat がそのとき書くセクタを見積もって数えますの。
+ * SdFat の動きは次のとおりですわ。
+ * - データ: 512 バイトのセクタが埋まるたびに1回。sync/close の時点で埋まりかけのセクタが
+ *   あればそれも1回書き、後で埋まったときにもう一度書きますの (ここが増幅の元ですわ)
+ * - FAT: 新しいクラスタを割り当てるとFATのセクタが汚れ、別のFATセクタへ移るときか
+ *   sync/close のときに、FATの数 (通常2) だけ書きますの
+ * - ディレクトリエントリ: 前回の確定からサイズが変わっていれば、sync/close で1回ですわ
+ * - 索引・ジャーナル: 健全性記録などの管理用ファイルのデータセクタですの
+ *
+ * 増幅率 = 物理バイト (セクタ数 × 512) ÷ 論理バイト (アプリが書いたバイト) ですわ。
+ * 確定の方針ごとに、メタデータの分だけ増幅率がどれだけ上がるかを比べられますの。
+ * Arduinoに依存しませんので、ホストでも同じ見積もりを使えますわ。
+ */
+#pragma once
+#include <stdint.h>
+
+#define WA_SECTOR_BYTES 512
+
+enum WriteAmpCategory : uint8_t {
+  WA_DATA = 0, ///< ログ本体のデータセクタ
+  WA_FAT,      ///< FATのセクタ (ミラー分も含みますの)
+  WA_DIR,      ///< ディレクトリエントリのセクタ
+  WA_INDEX,    ///< 索引・ジャーナル (健全性記録など) のデータセクタ
+  WA_CATEGORY_COUNT
+};
+
+inline const char* writeAmpCategoryName(uint8_t c) {
+  switch (c) {
+    case WA_DATA:  return "data";
+    case WA_FAT:   return "fat";
+    case WA_DIR:   return "dir";
+    case WA_INDEX: return "index";
+    default:       return "?";
+  }
+}
+
+/** @brief ファイルシステムの形ですわ。storageBegin() の後に設定してくださいませ */
+struct WriteAmpGeometry {
+  uint32_t sectorsPerCluster = 64; ///< 32 KB クラスタ (SDXC/SDHC の標準的な書式) を既定にしますの
+  uint32_t fatEntriesPerSector = 128; ///< FAT32 なら 128、FAT16 なら 256 ですわ
+  uint8_t fatCount = 2;               ///< FATの数。SDカードの標準書式では2ですの
+};
+
+/** @brief カード全体の集計ですわ */
+struct WriteAmpCounters {
+  uint64_t logicalBytes;                 ///< アプリが書いたバイト数
+  uint32_t sectors[WA_CATEGORY_COUNT];   ///< 分類ごとの物理セクタ書き込み数
+  uint32_t syncs;                        ///< sync/close の回数
+
+  uint32_t totalSectors() const {
+    uint32_t n = 0;
+    for (int c = 0; c < WA_CATEGORY_COUNT; c++) {
+      n += sectors[c];
+    }
+    return n;
+  }
+  /** @brief 増幅率の100倍ですわ (整数で扱えるように) */
+  uint32_t ratioX100() const {
+    if (logicalBytes == 0) {
+      return 0;
+    }
+    return static_cast<uint32_t>(static_cast<uint64_t>(totalSectors()) * WA_SECTOR_BYTES * 100 / logicalBytes);
+  }
+};
+
+inline WriteAmpGeometry g_writeAmpGeometry;
+inline WriteAmpCounters g_writeAmp = {};
+
+/** @brief storage_backend.h が返す形から設定しますの (fatType は 16・32、exFAT なら 64) */
+inline void writeAmpSetGeometry(uint32_t blocksPerCluster, uint8_t fatType) {
+  if (blocksPerCluster > 0) {
+    g_writeAmpGeometry.sectorsPerCluster = blocksPerCluster;
+  }
+  g_writeAmpGeometry.fatEntriesPerSector = fatType == 16 ? 256 : 128;
+}
+
+/**
+ * @brief 1つのファイルについて、操作からセクタ書き込みを見積もりますわ
+ * @details 追記だけのファイルを前提にしますの。新しいクラスタは連続して割り当てられるとみなしますわ。
+ */
+class WriteAmpFile {
+public:
+  /** @brief 既存のファイルを追記で開いたときは、その大きさから始めますの */
+  void begin(uint32_t sizeBytes, WriteAmpCategory dataCategory) {
+    _pos = sizeBytes;
+    _category = dataCategory;
+    _partialDirty = false;
+    _entryDirty = false;
+    _fatDirty = false;
+    _fatSector = UINT32_MAX;
+    _allocatedEnd = 0;
+  }
+
+  /**
+   * @brief 空のファイルに連続したクラスタを先に確保したときの分ですわ
+   * @details チェーンのFATセクタをまとめて1回ずつ書きますの。確保した範囲への追記では、もうFATを汚しませんわ。
+   */
+  void onPreAllocate(uint32_t bytes) {
+    const WriteAmpGeometry& g = g_writeAmpGeometry;
+    const uint32_t clusterBytes = g.sectorsPerCluster * WA_SECTOR_BYTES;
+    const uint32_t clusters = (bytes + clusterBytes - 1) / clusterBytes;
+    g_writeAmp.sectors[WA_FAT] += (clusters + g.fatEntriesPerSector - 1) / g.fatEntriesPerSector * g.fatCount;
+    _allocatedEnd = clusters * clusterBytes;
+  }
+
+  void onWrite(uint32_t len) {
+    if (len == 0) {
+      return;
+    }
+    const WriteAmpGeometry& g = g_writeAmpGeometry;
+    const uint32_t clusterBytes = g.sectorsPerCluster * WA_SECTOR_BYTES;
+    const uint32_t before = _pos;
+    _pos += len;
+    g_writeAmp.logicalBytes += len;
+
+    // 埋まったセクタはその場で書かれますの
+    g_writeAmp.sectors[_category] += _pos / WA_SECTOR_BYTES - before / WA_SECTOR_BYTES;
+    _partialDirty = (_pos % WA_SECTOR_BYTES) != 0;
+
+    // 新しく割り当てたクラスタごとにFATのエントリが汚れますわ
+    // (先に確保した範囲は除きますの)
+    uint32_t firstCluster = (before + clusterBytes - 1) / clusterBytes;
+    if (firstCluster < _allocatedEnd / clusterBytes) {
+      firstCluster = _allocatedEnd / clusterBytes;
+    }
+    uint32_t lastCluster = (_pos + clusterBytes - 1) / clusterBytes;
+    for (uint32_t c = firstCluster; c < lastCluster; c++) {
+      uint32_t fatSector = c / g.fatEntriesPerSector;
+      if (_fatDirty && fatSector != _fatSector) {
+        // 別のFATセクタへ移るので、汚れていた方を書き出しますの
+        g_writeAmp.sectors[WA_FAT] += g.fatCount;
+      }
+      _fatSector = fatSector;
+      _fatDirty = true;
+    }
+    _entryDirty = true;
+  }
+
+  /** @brief sync() や close() で確定したときの分ですわ */
+  void onSync() {
+    g_writeAmp.syncs++;
+    if (_partialDirty) {
+      g_writeAmp.sectors[_category]++;
+      _partialDirty = false;
+    }
+    if (_fatDirty) {
+      g_writeAmp.sectors[WA_FAT] += g_writeAmpGeometry.fatCount;
+      _fatDirty = false;
+    }
+    if (_entryDirty) {
+      g_writeAmp.sectors[WA_DIR]++;
+      _entryDirty = false;
+    }
+  }
+
+private:
+  uint32_t _pos = 0;
+  uint32_t _allocatedEnd = 0; ///< 先に確保したクラスタの終わり
+  uint32_t _fatSector = UINT32_MAX;
+  WriteAmpCategory _category = WA_DATA;
+  bool _partialDirty = false;
+  bool _entryDirty = false;
+  bool _fatDirty = false;
+};